@@ -12,3 +12,16 @@ void Gui::mainloop() {
 #endif
     return;
 }
+
+void Gui::requestRedraw() {
+#ifdef USE_DESKTOP_MODE
+    desktopGuiSys.requestRedraw();
+#endif
+    // the XR compositor drives frames continuously
+}
+
+void Gui::setRoomChannel(RoomChannel &channel) {
+#ifdef USE_DESKTOP_MODE
+    desktopGuiSys.setRoomChannel(channel);
+#endif
+}
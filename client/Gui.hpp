@@ -3,6 +3,8 @@
 #include "desktop/DesktopGui.hpp"
 #endif
 
+class RoomChannel;
+
 class Gui {
   private:
 #ifdef USE_DESKTOP_MODE
@@ -16,4 +18,8 @@ class Gui {
     ~Gui();
 
     void mainloop();
+    // thread-safe
+    void requestRedraw();
+    // before mainloop(): remote avatars come in through the channel (not shown in XR mode yet)
+    void setRoomChannel(RoomChannel &channel);
 };
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// The cheapest way to show someone: their head and hands as rigid boxes, with no skeleton, skinning or joint palette.
+// Positions are those of the head and hand bones (as tracked, or as a VRM pose puts them) in the avatar's model space.
+struct ThreePartsAvatar {
+    enum Part { Head, LeftHand, RightHand, PartCount };
+
+    // standing, with the hands hanging at the sides
+    glm::vec3 positions[PartCount]{glm::vec3{0.0f, 1.45f, 0.0f}, glm::vec3{0.25f, 0.85f, 0.0f}, glm::vec3{-0.25f, 0.85f, 0.0f}};
+    glm::quat rotations[PartCount]{glm::quat{1.0f, 0.0f, 0.0f, 0.0f}, glm::quat{1.0f, 0.0f, 0.0f, 0.0f}, glm::quat{1.0f, 0.0f, 0.0f, 0.0f}};
+
+    // extent of a part's box; the head's sits on top of its bone, the hands' are centered on theirs
+    static glm::vec3 partSize(Part part) { return part == Head ? glm::vec3{0.18f, 0.24f, 0.2f} : glm::vec3{0.09f, 0.04f, 0.18f}; }
+
+    // from a unit cube centered at the origin to the part in model space
+    glm::mat4 partMatrix(Part part) const {
+        const auto size = partSize(part);
+        const glm::vec3 center{0.0f, part == Head ? size.y * 0.5f : 0.0f, 0.0f};
+        return glm::scale(glm::translate(glm::translate(glm::mat4{1.0f}, positions[part]) * glm::mat4_cast(rotations[part]), center), size);
+    }
+};
@@ -0,0 +1,245 @@
+#include "VRMAvator.hpp"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <simdjson.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {
+
+using simdjson::dom::element;
+
+uint32_t toIndex(element value) {
+    uint64_t index;
+    if (value.get_uint64().get(index) != simdjson::SUCCESS)
+        throw std::runtime_error("VRM: bad index");
+    return static_cast<uint32_t>(index);
+}
+
+uint32_t getIndex(element object, const char *key) {
+    element value;
+    if (object[key].get(value) != simdjson::SUCCESS)
+        throw std::runtime_error(std::string("VRM: missing ") + key);
+    return toIndex(value);
+}
+
+float getFloat(element object, const char *key, float fallback) {
+    double value;
+    return object[key].get_double().get(value) == simdjson::SUCCESS ? float(value) : fallback;
+}
+
+// 1.0 writes vectors as [x, y, z]
+glm::vec3 getVec3(element object, const char *key, glm::vec3 fallback) {
+    simdjson::dom::array array;
+    if (object[key].get(array) != simdjson::SUCCESS || array.size() != 3)
+        return fallback;
+    glm::vec3 vec;
+    int i = 0;
+    for (auto component : array) {
+        double value;
+        if (component.get_double().get(value) != simdjson::SUCCESS)
+            return fallback;
+        vec[i++] = float(value);
+    }
+    return vec;
+}
+
+// 0.x writes them as {x, y, z}, in Unity's axes: z is mirrored
+glm::vec3 getXyz(element object, const char *key, glm::vec3 fallback) {
+    element vec;
+    if (object[key].get(vec) != simdjson::SUCCESS)
+        return fallback;
+    return glm::vec3{getFloat(vec, "x", fallback.x), getFloat(vec, "y", fallback.y), -getFloat(vec, "z", -fallback.z)};
+}
+
+// calls fn for each element of the array at key, if there is one
+void forEach(element object, const char *key, const std::function<void(element)> &fn) {
+    simdjson::dom::array array;
+    if (object[key].get(array) != simdjson::SUCCESS)
+        return;
+    for (auto item : array)
+        fn(item);
+}
+
+constexpr const char *humanBoneNames[] = {
+    "hips", "spine", "chest", "upperChest", "neck", "head",
+    "leftShoulder", "leftUpperArm", "leftLowerArm", "leftHand",
+    "rightShoulder", "rightUpperArm", "rightLowerArm", "rightHand",
+    "leftUpperLeg", "leftLowerLeg", "leftFoot",
+    "rightUpperLeg", "rightLowerLeg", "rightFoot",
+};
+static_assert(std::size(humanBoneNames) == size_t(HumanBone::Count));
+
+void setHumanBone(VrmHumanoid &humanoid, std::string_view name, uint32_t node) {
+    for (size_t i = 0; i < std::size(humanBoneNames); i++)
+        if (name == humanBoneNames[i])
+            humanoid.nodes[i] = node;
+}
+
+// 1.0 keys the bones by name
+void loadVrm1Humanoid(element humanBones, VrmHumanoid &humanoid) {
+    simdjson::dom::object bones;
+    if (humanBones.get(bones) != simdjson::SUCCESS)
+        return;
+    for (auto [name, bone] : bones)
+        setHumanBone(humanoid, name, getIndex(bone, "node"));
+}
+
+// 0.x lists them with the name inside
+void loadVrm0Humanoid(element humanoidExtension, VrmHumanoid &humanoid) {
+    forEach(humanoidExtension, "humanBones", [&](element bone) {
+        std::string_view name;
+        if (bone["bone"].get(name) == simdjson::SUCCESS)
+            setHumanBone(humanoid, name, getIndex(bone, "node"));
+    });
+}
+
+void loadVrm1(element springBone, VrmSpringBones &bones) {
+    forEach(springBone, "colliders", [&](element collider) {
+        VrmCollider parsed{getIndex(collider, "node")};
+        element shape;
+        if (collider["shape"]["sphere"].get(shape) == simdjson::SUCCESS) {
+            parsed.offset = getVec3(shape, "offset", glm::vec3{0.0f});
+            parsed.radius = getFloat(shape, "radius", 0.0f);
+            parsed.tail = parsed.offset;
+        } else if (collider["shape"]["capsule"].get(shape) == simdjson::SUCCESS) {
+            parsed.offset = getVec3(shape, "offset", glm::vec3{0.0f});
+            parsed.radius = getFloat(shape, "radius", 0.0f);
+            parsed.tail = getVec3(shape, "tail", parsed.offset);
+        }
+        bones.colliders.push_back(parsed);
+    });
+
+    std::vector<std::vector<uint32_t>> groups;
+    forEach(springBone, "colliderGroups", [&](element group) {
+        groups.emplace_back();
+        forEach(group, "colliders", [&](element collider) { groups.back().push_back(toIndex(collider)); });
+    });
+
+    forEach(springBone, "springs", [&](element spring) {
+        VrmSpring parsed;
+        forEach(spring, "joints", [&](element joint) {
+            VrmSpringJoint settings{getIndex(joint, "node")};
+            settings.hitRadius = getFloat(joint, "hitRadius", 0.0f);
+            settings.stiffness = getFloat(joint, "stiffness", 1.0f);
+            settings.dragForce = getFloat(joint, "dragForce", 0.5f);
+            settings.gravityPower = getFloat(joint, "gravityPower", 0.0f);
+            settings.gravityDir = getVec3(joint, "gravityDir", glm::vec3{0.0f, -1.0f, 0.0f});
+            parsed.joints.push_back(settings);
+        });
+        // the last joint only marks where the one before points
+        if (parsed.joints.size() < 2)
+            return;
+        parsed.tailNode = parsed.joints.back().node;
+        parsed.joints.pop_back();
+        forEach(spring, "colliderGroups", [&](element group) {
+            const auto &colliders = groups.at(toIndex(group));
+            parsed.colliders.insert(parsed.colliders.end(), colliders.begin(), colliders.end());
+        });
+        bones.springs.push_back(std::move(parsed));
+    });
+}
+
+void loadVrm0(element secondary, const std::vector<std::vector<uint32_t>> &children, VrmSpringBones &bones) {
+    std::vector<std::vector<uint32_t>> groups;
+    forEach(secondary, "colliderGroups", [&](element group) {
+        const auto node = getIndex(group, "node");
+        groups.emplace_back();
+        forEach(group, "colliders", [&](element collider) {
+            VrmCollider parsed{node};
+            parsed.offset = getXyz(collider, "offset", glm::vec3{0.0f});
+            parsed.radius = getFloat(collider, "radius", 0.0f);
+            parsed.tail = parsed.offset;
+            groups.back().push_back(static_cast<uint32_t>(bones.colliders.size()));
+            bones.colliders.push_back(parsed);
+        });
+    });
+
+    forEach(secondary, "boneGroups", [&](element group) {
+        // one setting for the whole group ("stiffiness" is spelled so in 0.x)
+        VrmSpringJoint settings{0};
+        settings.hitRadius = getFloat(group, "hitRadius", 0.02f);
+        settings.stiffness = getFloat(group, "stiffiness", 1.0f);
+        settings.dragForce = getFloat(group, "dragForce", 0.4f);
+        settings.gravityPower = getFloat(group, "gravityPower", 0.0f);
+        settings.gravityDir = getXyz(group, "gravityDir", glm::vec3{0.0f, -1.0f, 0.0f});
+        std::vector<uint32_t> colliders;
+        forEach(group, "colliderGroups", [&](element index) {
+            const auto &groupColliders = groups.at(toIndex(index));
+            colliders.insert(colliders.end(), groupColliders.begin(), groupColliders.end());
+        });
+
+        // every descendant of a root swings: first children continue a spring, the others start one of their own
+        forEach(group, "bones", [&](element root) {
+            std::vector<uint32_t> starts{toIndex(root)};
+            while (!starts.empty()) {
+                VrmSpring spring;
+                spring.colliders = colliders;
+                auto node = starts.back();
+                starts.pop_back();
+                while (true) {
+                    settings.node = node;
+                    spring.joints.push_back(settings);
+                    const auto &nodeChildren = children.at(node);
+                    if (nodeChildren.empty())
+                        break;
+                    starts.insert(starts.end(), nodeChildren.begin() + 1, nodeChildren.end());
+                    node = nodeChildren.front();
+                }
+                bones.springs.push_back(std::move(spring));
+            }
+        });
+    });
+}
+
+} // namespace
+
+VrmExtensions loadVrmExtensions(const std::filesystem::path &path) {
+    // magic, version, length, then the length and type of the first chunk, which is the JSON
+    uint32_t header[5];
+    std::ifstream file{path, std::ios::binary};
+    if (!file.read(reinterpret_cast<char *>(header), sizeof(header)) || header[0] != 0x46546C67 || header[4] != 0x4E4F534A)
+        throw std::runtime_error("not a glb file");
+    simdjson::padded_string json(header[3]);
+    if (!file.read(json.data(), header[3]))
+        throw std::runtime_error("truncated glb file");
+
+    simdjson::dom::parser parser;
+    element doc;
+    if (parser.parse(json).get(doc) != simdjson::SUCCESS)
+        throw std::runtime_error("bad glTF JSON");
+
+    std::vector<std::vector<uint32_t>> children;
+    forEach(doc, "nodes", [&](element node) {
+        children.emplace_back();
+        forEach(node, "children", [&](element child) { children.back().push_back(toIndex(child)); });
+    });
+
+    VrmExtensions extensions;
+    auto &bones = extensions.springBones;
+    element extension;
+    if (doc["extensions"]["VRMC_vrm"]["humanoid"]["humanBones"].get(extension) == simdjson::SUCCESS)
+        loadVrm1Humanoid(extension, extensions.humanoid);
+    else if (doc["extensions"]["VRM"]["humanoid"].get(extension) == simdjson::SUCCESS)
+        loadVrm0Humanoid(extension, extensions.humanoid);
+    if (doc["extensions"]["VRMC_springBone"].get(extension) == simdjson::SUCCESS)
+        loadVrm1(extension, bones);
+    else if (doc["extensions"]["VRM"]["secondaryAnimation"].get(extension) == simdjson::SUCCESS)
+        loadVrm0(extension, children, bones);
+
+    // springs hanging off a joint of another spring go after it
+    std::vector<int32_t> parents(children.size(), -1);
+    for (uint32_t i = 0; i < children.size(); i++)
+        for (const auto child : children[i])
+            parents.at(child) = i;
+    auto depth = [&](const VrmSpring &spring) {
+        uint32_t d = 0;
+        for (int32_t p = spring.joints.front().node; p != -1; p = parents.at(p))
+            d++;
+        return d;
+    };
+    std::stable_sort(bones.springs.begin(), bones.springs.end(), [&](const VrmSpring &a, const VrmSpring &b) { return depth(a) < depth(b); });
+    return extensions;
+}
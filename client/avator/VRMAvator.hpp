@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Humanoid bones and spring bone settings of a VRM model, from the VRMC_vrm and VRMC_springBone (1.0)
+// or VRM (0.x) extensions. Node indices are those of the glTF file; vectors are in glTF axes.
+
+// the bones IK drives or passes through; both versions name them alike
+enum class HumanBone {
+    Hips,
+    Spine,
+    Chest,
+    UpperChest,
+    Neck,
+    Head,
+    LeftShoulder,
+    LeftUpperArm,
+    LeftLowerArm,
+    LeftHand,
+    RightShoulder,
+    RightUpperArm,
+    RightLowerArm,
+    RightHand,
+    LeftUpperLeg,
+    LeftLowerLeg,
+    LeftFoot,
+    RightUpperLeg,
+    RightLowerLeg,
+    RightFoot,
+    Count,
+};
+
+struct VrmHumanoid {
+    // -1 where the model lacks the bone
+    std::array<int32_t, size_t(HumanBone::Count)> nodes;
+
+    VrmHumanoid() { nodes.fill(-1); }
+    int32_t operator[](HumanBone bone) const { return nodes[size_t(bone)]; }
+    bool empty() const { return nodes[size_t(HumanBone::Hips)] == -1; }
+};
+
+struct VrmSpringJoint {
+    uint32_t node;
+    float hitRadius = 0.0f;
+    float stiffness = 1.0f;
+    float dragForce = 0.5f;
+    float gravityPower = 0.0f;
+    glm::vec3 gravityDir{0.0f, -1.0f, 0.0f};
+};
+
+struct VrmCollider {
+    uint32_t node;
+    glm::vec3 offset{0.0f};
+    float radius = 0.0f;
+    // spheres have tail == offset
+    glm::vec3 tail{0.0f};
+};
+
+// a chain of joints, each the child of the one before; every joint swings toward the next one.
+// The last joint swings toward tailNode, or toward a point extending it by 7 cm if there is none (a leaf, in 0.x).
+struct VrmSpring {
+    std::vector<VrmSpringJoint> joints;
+    int32_t tailNode = -1;
+    // indices into VrmSpringBones::colliders
+    std::vector<uint32_t> colliders;
+};
+
+struct VrmSpringBones {
+    // parents come before their children, also across springs
+    std::vector<VrmSpring> springs;
+    std::vector<VrmCollider> colliders;
+};
+
+struct VrmExtensions {
+    VrmHumanoid humanoid;
+    VrmSpringBones springBones;
+};
+
+// reads the JSON chunk of a glb file; both are empty if it isn't a VRM model. Throws on a malformed file.
+VrmExtensions loadVrmExtensions(const std::filesystem::path &path);
@@ -0,0 +1,284 @@
+#include "AnimationClip.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+static_assert(sizeof(AnimationClip::Key) == 10, "keys are packed");
+
+// smallest-three: the other components of a unit quaternion lie within +-1/sqrt(2)
+constexpr float smallestRange = 0.70710678f;
+constexpr uint32_t smallestMax = (1u << 15) - 1;
+
+glm::quat toQuat(const glm::vec4 &v) { return glm::quat(v.w, v.x, v.y, v.z); }
+glm::vec4 toVec4(const glm::quat &q) { return glm::vec4(q.x, q.y, q.z, q.w); }
+
+// a + (b - a) * t along the shorter arc, normalized; what playback does between keys
+glm::vec4 nlerp(const glm::vec4 &a, glm::vec4 b, float t) {
+    if (glm::dot(a, b) < 0.0f)
+        b = -b;
+    return glm::normalize(glm::mix(a, b, t));
+}
+
+float rotationError(const glm::vec4 &a, const glm::vec4 &b) {
+    return 2.0f * std::acos(std::min(1.0, std::abs(double(glm::dot(a, b)))));
+}
+
+void encodeRotation(glm::vec4 q, uint16_t *value) {
+    q = glm::normalize(q);
+    int largest = 0;
+    for (int c = 1; c < 4; c++) {
+        if (std::abs(q[c]) > std::abs(q[largest]))
+            largest = c;
+    }
+    // q and -q are the same rotation; the dropped component is always the positive one
+    if (q[largest] < 0.0f)
+        q = -q;
+    uint64_t bits = uint64_t(largest) << 45;
+    int shift = 30;
+    for (int c = 0; c < 4; c++) {
+        if (c == largest)
+            continue;
+        const float normalized = (glm::clamp(q[c], -smallestRange, smallestRange) + smallestRange) / (2.0f * smallestRange);
+        bits |= uint64_t(std::lround(normalized * smallestMax)) << shift;
+        shift -= 15;
+    }
+    value[0] = uint16_t(bits);
+    value[1] = uint16_t(bits >> 16);
+    value[2] = uint16_t(bits >> 32);
+}
+
+glm::vec4 decodeRotation(const uint16_t *value) {
+    const uint64_t bits = uint64_t(value[0]) | uint64_t(value[1]) << 16 | uint64_t(value[2]) << 32;
+    const int largest = int(bits >> 45) & 3;
+    glm::vec4 q;
+    float sumSq = 0.0f;
+    int shift = 30;
+    for (int c = 0; c < 4; c++) {
+        if (c == largest)
+            continue;
+        q[c] = float((bits >> shift) & smallestMax) / smallestMax * (2.0f * smallestRange) - smallestRange;
+        sumSq += q[c] * q[c];
+        shift -= 15;
+    }
+    q[largest] = std::sqrt(std::max(1.0f - sumSq, 0.0f));
+    return q;
+}
+
+} // namespace
+
+glm::vec4 RawAnimationTrack::sample(float time) const {
+    const bool cubic = interpolation == Interpolation::CubicSpline;
+    auto value = [&](size_t i) { return values[cubic ? i * 3 + 1 : i]; };
+    if (times.empty())
+        return path == Path::Rotation ? glm::vec4{0.0f, 0.0f, 0.0f, 1.0f} : glm::vec4{0.0f};
+
+    const auto next = std::upper_bound(times.begin(), times.end(), time);
+    if (next == times.begin())
+        return value(0);
+    if (next == times.end())
+        return value(times.size() - 1);
+    const size_t i = next - times.begin() - 1;
+    const float span = times[i + 1] - times[i];
+    const float t = span > 0.0f ? (time - times[i]) / span : 0.0f;
+
+    switch (interpolation) {
+    case Interpolation::Step:
+        return value(i);
+    case Interpolation::Linear:
+        if (path == Path::Rotation)
+            return toVec4(glm::slerp(toQuat(value(i)), toQuat(value(i + 1)), t));
+        return glm::mix(value(i), value(i + 1), t);
+    case Interpolation::CubicSpline: {
+        // Hermite, with the tangents scaled by the key interval
+        const float t2 = t * t, t3 = t2 * t;
+        const auto result = (2.0f * t3 - 3.0f * t2 + 1.0f) * value(i) + (t3 - 2.0f * t2 + t) * span * values[i * 3 + 2] +
+                            (-2.0f * t3 + 3.0f * t2) * value(i + 1) + (t3 - t2) * span * values[(i + 1) * 3];
+        return path == Path::Rotation ? glm::normalize(result) : result;
+    }
+    }
+    return value(i);
+}
+
+AnimationClip::AnimationClip(const RawAnimation &raw) : name{raw.name} {
+    float start = std::numeric_limits<float>::max(), end = std::numeric_limits<float>::lowest();
+    for (const auto &track : raw.tracks) {
+        if (track.times.empty())
+            continue;
+        start = std::min(start, track.times.front());
+        end = std::max(end, track.times.back());
+    }
+    if (start > end)
+        return;
+    startTime = start;
+    duration = end - start;
+    const uint32_t frameNum = static_cast<uint32_t>(std::ceil(duration * sampleRate)) + 1;
+    if (frameNum > 65536 || raw.tracks.size() > 65536)
+        throw std::runtime_error("animation too long for a clip");
+    auto timeOf = [&](uint32_t frame) { return std::min(frame / sampleRate, duration); };
+
+    struct PendingKey {
+        int64_t need;
+        Key key;
+    };
+    std::vector<PendingKey> pending;
+    std::vector<glm::vec4> samples(frameNum), decoded(frameNum);
+    std::vector<uint32_t> kept;
+    for (const auto &source : raw.tracks) {
+        const bool rotation = source.path == RawAnimationTrack::Path::Rotation;
+        stats.rawKeyNum += source.times.size();
+        stats.rawBytes += sizeof(float) * source.times.size() + (rotation ? 16 : 12) * source.values.size();
+        if (source.times.empty())
+            continue;
+
+        const auto trackIndex = static_cast<uint16_t>(tracks.size());
+        Track track{source.joint, rotation, glm::vec3{0.0f}, glm::vec3{0.0f}};
+        jointNum = std::max(jointNum, source.joint + 1);
+        for (uint32_t f = 0; f < frameNum; f++)
+            samples[f] = source.sample(start + timeOf(f));
+
+        std::vector<Key> quantized(frameNum);
+        if (rotation) {
+            for (uint32_t f = 0; f < frameNum; f++) {
+                encodeRotation(samples[f], quantized[f].value);
+                decoded[f] = decodeRotation(quantized[f].value);
+            }
+        } else {
+            glm::vec3 low{std::numeric_limits<float>::max()}, high{std::numeric_limits<float>::lowest()};
+            for (const auto &sample : samples) {
+                low = glm::min(low, glm::vec3(sample));
+                high = glm::max(high, glm::vec3(sample));
+            }
+            track.rangeMin = low;
+            track.rangeScale = (high - low) / 65535.0f;
+            for (uint32_t f = 0; f < frameNum; f++) {
+                for (int c = 0; c < 3; c++) {
+                    const float normalized = track.rangeScale[c] > 0.0f ? (samples[f][c] - low[c]) / track.rangeScale[c] : 0.0f;
+                    quantized[f].value[c] = static_cast<uint16_t>(glm::clamp(std::lround(normalized), 0l, 65535l));
+                    decoded[f][c] = low[c] + quantized[f].value[c] * track.rangeScale[c];
+                }
+                decoded[f].w = 0.0f;
+            }
+        }
+
+        // greedily the longest spans whose interpolation stays within the tolerance of every sample under them,
+        // measured on the quantized keys so quantization counts against the bound too
+        auto spans = [&](uint32_t from, uint32_t to) {
+            for (uint32_t i = from + 1; i < to; i++) {
+                const float t = float(i - from) / float(to - from);
+                if (rotation ? rotationError(nlerp(decoded[from], decoded[to], t), samples[i]) > rotationTolerance
+                             : glm::distance(glm::vec3(glm::mix(decoded[from], decoded[to], t)), glm::vec3(samples[i])) > translationTolerance)
+                    return false;
+            }
+            return true;
+        };
+        kept.assign(1, 0);
+        for (uint32_t to = 2; to < frameNum; to++) {
+            if (!spans(kept.back(), to))
+                kept.push_back(to - 1);
+        }
+        // every track has two keys at least, so playback always has a pair to interpolate
+        kept.push_back(frameNum - 1);
+
+        // a key is needed once playback passes the key before it; the first two are needed from the start
+        for (size_t k = 0; k < kept.size(); k++) {
+            Key key = quantized[kept[k]];
+            key.track = trackIndex;
+            key.frame = static_cast<uint16_t>(kept[k]);
+            pending.push_back(PendingKey{k == 0 ? -1 : int64_t(kept[k - 1]), key});
+        }
+        tracks.push_back(track);
+    }
+
+    std::stable_sort(pending.begin(), pending.end(), [](const PendingKey &a, const PendingKey &b) {
+        return a.need != b.need ? a.need < b.need : a.key.track < b.key.track;
+    });
+    for (const auto &key : pending)
+        keys.push_back(key.key);
+    stats.keyNum = keys.size();
+    stats.bytes = sizeof(Key) * keys.size() + sizeof(Track) * tracks.size();
+}
+
+void AnimationClip::measure(const RawAnimation &raw) {
+    const uint32_t frameNum = static_cast<uint32_t>(std::ceil(duration * sampleRate)) + 1;
+    auto timeOf = [&](uint32_t frame) { return std::min(frame / sampleRate, duration); };
+
+    PoseBuffer pose{jointNum};
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t f = 0; f < frameNum; f++) {
+        for (const auto &source : raw.tracks) {
+            if (source.times.empty())
+                continue;
+            const auto value = source.sample(startTime + timeOf(f));
+            if (source.path == RawAnimationTrack::Path::Rotation)
+                pose.setRotation(source.joint, toQuat(value));
+            else
+                pose.setTranslation(source.joint, glm::vec3(value));
+        }
+    }
+    stats.rawSampleMicroseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - begin).count();
+    begin = std::chrono::steady_clock::now();
+    ClipCursor cursor{*this};
+    for (uint32_t f = 0; f < frameNum; f++)
+        cursor.sample(timeOf(f), pose);
+    stats.sampleMicroseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - begin).count();
+}
+
+glm::vec4 AnimationClip::decode(const Key &key) const {
+    const auto &track = tracks[key.track];
+    if (track.rotation)
+        return decodeRotation(key.value);
+    return glm::vec4(track.rangeMin + glm::vec3(key.value[0], key.value[1], key.value[2]) * track.rangeScale, 0.0f);
+}
+
+ClipCursor::ClipCursor(const AnimationClip &clip) : clip{&clip} {
+    const auto trackNum = clip.getTracks().size();
+    for (auto *v : {&time0, &time1, &x0, &y0, &z0, &w0, &x1, &y1, &z1, &w1})
+        v->assign(trackNum, 0.0f);
+    restart();
+}
+
+void ClipCursor::consume(const AnimationClip::Key &key) {
+    const auto k = key.track;
+    const auto value = clip->decode(key);
+    time0[k] = time1[k];
+    x0[k] = x1[k], y0[k] = y1[k], z0[k] = z1[k], w0[k] = w1[k];
+    time1[k] = key.frame / AnimationClip::sampleRate;
+    x1[k] = value.x, y1[k] = value.y, z1[k] = value.z, w1[k] = value.w;
+}
+
+void ClipCursor::restart() {
+    const auto &keys = clip->getKeys();
+    time = 0.0f;
+    nextKey = 0;
+    for (const auto initial = std::min(keys.size(), 2 * clip->getTracks().size()); nextKey < initial; nextKey++)
+        consume(keys[nextKey]);
+}
+
+void ClipCursor::sample(float t, PoseBuffer &pose) {
+    t = glm::clamp(t, 0.0f, clip->getDuration());
+    if (t < time)
+        restart();
+    time = t;
+    const auto &keys = clip->getKeys();
+    while (nextKey < keys.size() && time1[keys[nextKey].track] <= t)
+        consume(keys[nextKey++]);
+
+    const auto &tracks = clip->getTracks();
+    for (size_t k = 0; k < tracks.size(); k++) {
+        const float span = time1[k] - time0[k];
+        const float u = span > 0.0f ? glm::clamp((t - time0[k]) / span, 0.0f, 1.0f) : 1.0f;
+        if (tracks[k].rotation) {
+            // the shorter arc; smallest-three keys may flip sign from one to the next
+            const float sign = x0[k] * x1[k] + y0[k] * y1[k] + z0[k] * z1[k] + w0[k] * w1[k] < 0.0f ? -1.0f : 1.0f;
+            const glm::quat q(w0[k] + (sign * w1[k] - w0[k]) * u, x0[k] + (sign * x1[k] - x0[k]) * u,
+                              y0[k] + (sign * y1[k] - y0[k]) * u, z0[k] + (sign * z1[k] - z0[k]) * u);
+            pose.setRotation(tracks[k].joint, glm::normalize(q));
+        } else {
+            pose.setTranslation(tracks[k].joint, glm::vec3(x0[k] + (x1[k] - x0[k]) * u, y0[k] + (y1[k] - y0[k]) * u, z0[k] + (z1[k] - z0[k]) * u));
+        }
+    }
+}
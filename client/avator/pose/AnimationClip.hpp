@@ -0,0 +1,104 @@
+#pragma once
+
+#include "pose.hpp"
+#include <string>
+#include <vector>
+
+// a glTF animation channel as stored in the file
+struct RawAnimationTrack {
+    enum class Path { Translation, Rotation };
+    enum class Interpolation { Step, Linear, CubicSpline };
+
+    uint32_t joint;
+    Path path;
+    Interpolation interpolation;
+    std::vector<float> times;
+    // xyz(0) or xyzw per key; cubic splines have an in-tangent, the value and an out-tangent per key
+    std::vector<glm::vec4> values;
+
+    // as glTF defines it, clamped to the first and last key
+    glm::vec4 sample(float time) const;
+};
+
+struct RawAnimation {
+    std::string name;
+    std::vector<RawAnimationTrack> tracks;
+};
+
+struct AnimationClipStats {
+    uint64_t rawBytes = 0, bytes = 0;
+    uint32_t rawKeyNum = 0, keyNum = 0;
+    // sampling every track of the clip once per frame over its whole length, raw and compressed; only once measured
+    float rawSampleMicroseconds = 0.0f, sampleMicroseconds = 0.0f;
+};
+
+// A compressed animation clip. Tracks are resampled at sampleRate, then reduced to the keys linear interpolation
+// needs to stay within the tolerances. Rotations are quantized with smallest-three (2 + 3 * 15 bits), translations
+// to 16 bits per axis over the track's range. Keys of all tracks are interleaved in the order playback reaches them,
+// so a ClipCursor reads them front to back.
+class AnimationClip {
+  public:
+    static constexpr float sampleRate = 60.0f;
+    // radians, and model units
+    static constexpr float rotationTolerance = 1e-3f;
+    static constexpr float translationTolerance = 1e-4f;
+
+    struct Track {
+        uint32_t joint;
+        bool rotation;
+        // translations decode as rangeMin + value * rangeScale
+        glm::vec3 rangeMin, rangeScale;
+    };
+    struct Key {
+        uint16_t track;
+        uint16_t frame;
+        uint16_t value[3];
+    };
+
+  private:
+    std::string name;
+    // where the clip starts in the raw animation's time
+    float startTime = 0.0f;
+    float duration = 0.0f;
+    uint32_t jointNum = 0;
+    std::vector<Track> tracks;
+    std::vector<Key> keys;
+    AnimationClipStats stats;
+
+  public:
+    // throws if the clip is too long or has too many tracks for the format
+    explicit AnimationClip(const RawAnimation &raw);
+    // times sampling the clip against sampling raw, the animation it was built from, into the stats; for diagnostics
+    void measure(const RawAnimation &raw);
+
+    const std::string &getName() const { return name; }
+    float getDuration() const { return duration; }
+    // one past the highest joint the clip animates
+    uint32_t getJointCount() const { return jointNum; }
+    const std::vector<Track> &getTracks() const { return tracks; }
+    const std::vector<Key> &getKeys() const { return keys; }
+    const AnimationClipStats &getStats() const { return stats; }
+
+    // xyzw, or xyz and 0 for translations
+    glm::vec4 decode(const Key &key) const;
+};
+
+// Playback position in a clip. Moving forward streams in the keys passed since the last sample;
+// moving back (on a loop, say) starts over from the beginning.
+class ClipCursor {
+    const AnimationClip *clip;
+    size_t nextKey = 0;
+    float time = 0.0f;
+    // per track: the keys around the cursor, their times and values
+    std::vector<float> time0, time1;
+    std::vector<float> x0, y0, z0, w0, x1, y1, z1, w1;
+
+    void consume(const AnimationClip::Key &key);
+    void restart();
+
+  public:
+    explicit ClipCursor(const AnimationClip &clip);
+
+    // writes every track of the clip at time into pose; joints the clip doesn't animate are left as they are
+    void sample(float time, PoseBuffer &pose);
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "pose.hpp"
+
+// Animation layers over a base pose, evaluated into one PoseBuffer that Skeleton reads as is.
+// Layers apply in the order pushed: override layers blend the result toward their pose,
+// additive ones (from makeAdditive) add onto it. Both take a weight and an optional per-joint mask.
+class FKPose {
+  public:
+    struct Layer {
+        const PoseBuffer *pose;
+        float weight = 1.0f;
+        const PoseMask *mask = nullptr;
+        bool additive = false;
+        PoseBlend blend = PoseBlend::Nlerp;
+    };
+
+  private:
+    std::vector<Layer> layers;
+    // kept between evaluations so its arrays are reused
+    PoseBuffer result;
+
+  public:
+    void clearLayers() { layers.clear(); }
+    void pushLayer(const Layer &layer) { layers.push_back(layer); }
+
+    const PoseBuffer &evaluate(const PoseBuffer &base) {
+        result = base;
+        for (const auto &layer : layers) {
+            if (layer.weight <= 0.0f)
+                continue;
+            if (layer.additive)
+                addPose(result, *layer.pose, layer.weight, layer.mask);
+            else
+                blendPoses(result, *layer.pose, layer.weight, layer.mask, result, layer.blend);
+        }
+        return result;
+    }
+    const PoseBuffer &getResult() const { return result; }
+};
@@ -0,0 +1,331 @@
+#include "IKPose.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glm/gtx/quaternion.hpp>
+#include <stdexcept>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define IK_POSE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr glm::vec3 up{0.0f, 1.0f, 0.0f};
+const glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+// reach is kept this far inside the limits, so the elbow angle never degenerates
+constexpr float reachMargin = 1e-4f;
+
+// two-bone chains of a batch, a field per array, padded to a multiple of four
+struct TwoBoneBatch {
+    // root, target, the direction the middle joint bends toward, and bone lengths
+    std::vector<float> rootX, rootY, rootZ, targetX, targetY, targetZ, poleX, poleY, poleZ, upperLength, lowerLength;
+    // middle joint, and the end as close to the target as the limb reaches
+    std::vector<float> middleX, middleY, middleZ, endX, endY, endZ;
+
+    void resize(size_t n) {
+        n = (n + 3) & ~size_t(3);
+        for (auto *v : {&rootX, &rootY, &rootZ, &targetX, &targetY, &targetZ, &poleX, &poleY, &poleZ, &middleX, &middleY, &middleZ, &endX, &endY, &endZ})
+            v->assign(n, 0.0f);
+        // padding lanes are solved too; these keep them finite
+        targetX.assign(n, 1.0f);
+        poleY.assign(n, 1.0f);
+        upperLength.assign(n, 1.0f);
+        lowerLength.assign(n, 1.0f);
+    }
+    size_t size() const { return rootX.size(); }
+
+    void set(size_t i, const glm::vec3 &root, const glm::vec3 &target, const glm::vec3 &pole, float upper, float lower) {
+        rootX[i] = root.x, rootY[i] = root.y, rootZ[i] = root.z;
+        targetX[i] = target.x, targetY[i] = target.y, targetZ[i] = target.z;
+        poleX[i] = pole.x, poleY[i] = pole.y, poleZ[i] = pole.z;
+        upperLength[i] = upper;
+        lowerLength[i] = lower;
+    }
+    glm::vec3 root(size_t i) const { return {rootX[i], rootY[i], rootZ[i]}; }
+    glm::vec3 middle(size_t i) const { return {middleX[i], middleY[i], middleZ[i]}; }
+    glm::vec3 end(size_t i) const { return {endX[i], endY[i], endZ[i]}; }
+};
+
+// law of cosines: the middle joint sits on the circle the two bones allow, on the side of the pole
+void solveTwoBone(TwoBoneBatch &batch) {
+#ifdef IK_POSE_SSE
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), margin = _mm_set1_ps(reachMargin), tiny = _mm_set1_ps(1e-12f);
+    auto dot = [](__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+    };
+    for (size_t i = 0; i < batch.size(); i += 4) {
+        const __m128 rx = _mm_loadu_ps(&batch.rootX[i]), ry = _mm_loadu_ps(&batch.rootY[i]), rz = _mm_loadu_ps(&batch.rootZ[i]);
+        const __m128 a = _mm_loadu_ps(&batch.upperLength[i]), b = _mm_loadu_ps(&batch.lowerLength[i]);
+        const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&batch.targetX[i]), rx);
+        const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&batch.targetY[i]), ry);
+        const __m128 dz = _mm_sub_ps(_mm_loadu_ps(&batch.targetZ[i]), rz);
+        const __m128 distance = _mm_sqrt_ps(_mm_max_ps(dot(dx, dy, dz, dx, dy, dz), tiny));
+        const __m128 invDistance = _mm_div_ps(one, distance);
+        const __m128 dirX = _mm_mul_ps(dx, invDistance), dirY = _mm_mul_ps(dy, invDistance), dirZ = _mm_mul_ps(dz, invDistance);
+        const __m128 shortest = _mm_add_ps(_mm_max_ps(_mm_sub_ps(a, b), _mm_sub_ps(b, a)), margin);
+        const __m128 reach = _mm_min_ps(_mm_max_ps(distance, shortest), _mm_sub_ps(_mm_add_ps(a, b), margin));
+
+        __m128 px = _mm_loadu_ps(&batch.poleX[i]), py = _mm_loadu_ps(&batch.poleY[i]), pz = _mm_loadu_ps(&batch.poleZ[i]);
+        const __m128 along = dot(px, py, pz, dirX, dirY, dirZ);
+        px = _mm_sub_ps(px, _mm_mul_ps(dirX, along));
+        py = _mm_sub_ps(py, _mm_mul_ps(dirY, along));
+        pz = _mm_sub_ps(pz, _mm_mul_ps(dirZ, along));
+        const __m128 invPole = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(dot(px, py, pz, px, py, pz), tiny)));
+
+        __m128 cosine = _mm_div_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(reach, reach)), _mm_mul_ps(b, b)), _mm_mul_ps(_mm_add_ps(a, a), reach));
+        cosine = _mm_min_ps(_mm_max_ps(cosine, _mm_sub_ps(zero, one)), one);
+        const __m128 sine = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(cosine, cosine)), zero));
+        const __m128 alongBone = _mm_mul_ps(a, cosine), acrossBone = _mm_mul_ps(_mm_mul_ps(a, sine), invPole);
+
+        _mm_storeu_ps(&batch.middleX[i], _mm_add_ps(rx, _mm_add_ps(_mm_mul_ps(dirX, alongBone), _mm_mul_ps(px, acrossBone))));
+        _mm_storeu_ps(&batch.middleY[i], _mm_add_ps(ry, _mm_add_ps(_mm_mul_ps(dirY, alongBone), _mm_mul_ps(py, acrossBone))));
+        _mm_storeu_ps(&batch.middleZ[i], _mm_add_ps(rz, _mm_add_ps(_mm_mul_ps(dirZ, alongBone), _mm_mul_ps(pz, acrossBone))));
+        _mm_storeu_ps(&batch.endX[i], _mm_add_ps(rx, _mm_mul_ps(dirX, reach)));
+        _mm_storeu_ps(&batch.endY[i], _mm_add_ps(ry, _mm_mul_ps(dirY, reach)));
+        _mm_storeu_ps(&batch.endZ[i], _mm_add_ps(rz, _mm_mul_ps(dirZ, reach)));
+    }
+#else
+    for (size_t i = 0; i < batch.size(); i++) {
+        const auto root = batch.root(i);
+        const float a = batch.upperLength[i], b = batch.lowerLength[i];
+        const auto toTarget = glm::vec3{batch.targetX[i], batch.targetY[i], batch.targetZ[i]} - root;
+        const float distance = std::sqrt(std::max(glm::dot(toTarget, toTarget), 1e-12f));
+        const auto direction = toTarget / distance;
+        const float reach = std::min(std::max(distance, std::abs(a - b) + reachMargin), a + b - reachMargin);
+
+        auto pole = glm::vec3{batch.poleX[i], batch.poleY[i], batch.poleZ[i]};
+        pole -= direction * glm::dot(pole, direction);
+        pole /= std::sqrt(std::max(glm::dot(pole, pole), 1e-12f));
+
+        const float cosine = glm::clamp((a * a + reach * reach - b * b) / (2.0f * a * reach), -1.0f, 1.0f);
+        const float sine = std::sqrt(std::max(1.0f - cosine * cosine, 0.0f));
+        const auto middle = root + direction * (a * cosine) + pole * (a * sine);
+        const auto end = root + direction * reach;
+        batch.middleX[i] = middle.x, batch.middleY[i] = middle.y, batch.middleZ[i] = middle.z;
+        batch.endX[i] = end.x, batch.endY[i] = end.y, batch.endZ[i] = end.z;
+    }
+#endif
+}
+
+// model-space transforms of the rig's chain joints under pose
+void forwardKinematics(const IKRig &rig, const PoseBuffer &pose, std::vector<glm::quat> &rotations, std::vector<glm::vec3> &positions) {
+    for (const auto node : rig.chainOrder) {
+        const auto parent = rig.parents[node];
+        const auto config = pose[node];
+        if (parent == -1) {
+            rotations[node] = config.rotation;
+            positions[node] = config.translation;
+        } else {
+            rotations[node] = rotations[parent] * config.rotation;
+            positions[node] = positions[parent] + rotations[parent] * config.translation;
+        }
+    }
+}
+
+// what a batch keeps of each avatar between placing the body and finishing the limbs
+struct BodyState {
+    glm::quat yaw;
+    // model-space rotation of each limb's upper joint's parent
+    glm::quat limbParents[IKRig::LimbCount];
+};
+
+// sets hips, spine and head of out, and returns the body's turn about the vertical
+glm::quat placeBody(const IKRig &rig, const IKTargets &targets, PoseBuffer &out, std::vector<glm::quat> &rotations, std::vector<glm::vec3> &positions) {
+    // facing follows the head; subtracting its up by its pitch keeps it steady when looking straight up or down
+    const auto headForward = targets.headRotation * rig.forward;
+    auto facing = headForward - (targets.headRotation * up) * headForward.y;
+    facing.y = 0.0f;
+    const float yawAngle = glm::dot(facing, facing) > 1e-12f ? std::atan2(glm::dot(glm::cross(rig.forward, facing), up), glm::dot(rig.forward, facing)) : 0.0f;
+    const auto yaw = glm::angleAxis(yawAngle, up);
+    const auto tilt = glm::inverse(yaw) * targets.headRotation;
+
+    // model-space rotations from hips to head, turned into local ones down the chain
+    auto setRotation = [&](uint32_t node, const glm::quat &parentRotation, const glm::quat &rotation) {
+        out.setRotation(node, glm::normalize(glm::inverse(parentRotation) * rotation));
+    };
+    const auto hipsParent = rig.parents[rig.hips];
+    const auto hipsParentRotation = hipsParent == -1 ? identity : rig.restRotations[hipsParent];
+    auto parentRotation = yaw * rig.restRotations[rig.hips];
+    setRotation(rig.hips, hipsParentRotation, parentRotation);
+    for (size_t k = 0; k < rig.spine.size(); k++) {
+        const float share = IKSolver::spineShare * float(k + 1) / float(rig.spine.size());
+        const auto rotation = yaw * glm::slerp(identity, tilt, share) * rig.restRotations[rig.spine[k]];
+        setRotation(rig.spine[k], parentRotation, rotation);
+        parentRotation = rotation;
+    }
+    setRotation(rig.head, parentRotation, targets.headRotation * rig.restRotations[rig.head]);
+
+    // then the hips move wherever puts the head on its target
+    forwardKinematics(rig, out, rotations, positions);
+    out.setTranslation(rig.hips, out.translation(rig.hips) + glm::inverse(hipsParentRotation) * (targets.headPosition - positions[rig.head]));
+    forwardKinematics(rig, out, rotations, positions);
+    return yaw;
+}
+
+// turns the solved middle and end positions of a limb into rotations of its three joints
+void finishLimb(const IKRig &rig, const IKRig::Limb &limb, const glm::quat &parentRotation, const glm::vec3 &root, const glm::vec3 &middle,
+                const glm::vec3 &end, const glm::quat &endRotation, PoseBuffer &out) {
+    const auto &rest = rig.restRotations;
+    // joints between the three, twist bones say, stay at rest relative to the joint above them
+    auto swing = [&](const glm::quat &rotation, uint32_t from, uint32_t to, const glm::vec3 &toward) {
+        const auto bone = rotation * glm::inverse(rest[from]) * (rig.restPositions[to] - rig.restPositions[from]);
+        return glm::rotation(glm::normalize(bone), glm::normalize(toward)) * rotation;
+    };
+
+    const auto upper = swing(parentRotation * out.rotation(limb.upper), limb.upper, limb.lower, middle - root);
+    out.setRotation(limb.upper, glm::normalize(glm::inverse(parentRotation) * upper));
+    const auto upperDelta = upper * glm::inverse(rest[limb.upper]);
+
+    const auto lower = swing(upperDelta * rest[limb.lower], limb.lower, limb.end, end - middle);
+    out.setRotation(limb.lower, glm::normalize(glm::inverse(upperDelta * rest[rig.parents[limb.lower]]) * lower));
+    const auto lowerDelta = lower * glm::inverse(rest[limb.lower]);
+
+    out.setRotation(limb.end, glm::normalize(glm::inverse(lowerDelta * rest[rig.parents[limb.end]]) * endRotation));
+}
+
+} // namespace
+
+IKRig::IKRig(const std::vector<int32_t> &parents, const PoseBuffer &restPose, const VrmHumanoid &humanoid)
+    : parents{parents}, restPose{restPose} {
+    const auto n = static_cast<uint32_t>(parents.size());
+    if (restPose.jointCount() != n)
+        throw std::runtime_error("IK: rest pose doesn't match the skeleton");
+    auto require = [&](HumanBone bone) {
+        const auto node = humanoid[bone];
+        if (node < 0 || uint32_t(node) >= n)
+            throw std::runtime_error("IK: humanoid lacks a bone");
+        return uint32_t(node);
+    };
+
+    // model-space rest transforms; a parent may come after its children in the file
+    restRotations.resize(n);
+    restPositions.resize(n);
+    std::vector<bool> resolved(n, false);
+    std::vector<uint32_t> path;
+    for (uint32_t i = 0; i < n; i++) {
+        for (int32_t p = i; p != -1 && !resolved[p]; p = parents[p])
+            path.push_back(p);
+        for (; !path.empty(); path.pop_back()) {
+            const auto node = path.back();
+            const auto parent = parents[node];
+            restRotations[node] = parent == -1 ? restPose.rotation(node) : restRotations[parent] * restPose.rotation(node);
+            restPositions[node] = parent == -1 ? restPose.translation(node) : restPositions[parent] + restRotations[parent] * restPose.translation(node);
+            resolved[node] = true;
+        }
+    }
+
+    hips = require(HumanBone::Hips);
+    head = require(HumanBone::Head);
+    for (int32_t p = parents[head]; p != int32_t(hips); p = parents[p]) {
+        if (p == -1)
+            throw std::runtime_error("IK: head isn't below hips");
+        spine.push_back(p);
+    }
+    std::reverse(spine.begin(), spine.end());
+
+    auto makeLimb = [&](HumanBone upper, HumanBone lower, HumanBone end) {
+        Limb limb{require(upper), require(lower), require(end)};
+        limb.upperLength = glm::distance(restPositions[limb.upper], restPositions[limb.lower]);
+        limb.lowerLength = glm::distance(restPositions[limb.lower], restPositions[limb.end]);
+        if (limb.upperLength < reachMargin * 2.0f || limb.lowerLength < reachMargin * 2.0f || parents[limb.upper] == -1)
+            throw std::runtime_error("IK: degenerate limb");
+        return limb;
+    };
+    limbs[LeftArm] = makeLimb(HumanBone::LeftUpperArm, HumanBone::LeftLowerArm, HumanBone::LeftHand);
+    limbs[RightArm] = makeLimb(HumanBone::RightUpperArm, HumanBone::RightLowerArm, HumanBone::RightHand);
+    limbs[LeftLeg] = makeLimb(HumanBone::LeftUpperLeg, HumanBone::LeftLowerLeg, HumanBone::LeftFoot);
+    limbs[RightLeg] = makeLimb(HumanBone::RightUpperLeg, HumanBone::RightLowerLeg, HumanBone::RightFoot);
+
+    left = restPositions[limbs[LeftLeg].upper] - restPositions[limbs[RightLeg].upper];
+    left.y = 0.0f;
+    if (glm::dot(left, left) < 1e-12f)
+        throw std::runtime_error("IK: legs don't set the model's left");
+    left = glm::normalize(left);
+    forward = glm::cross(left, up);
+
+    std::vector<uint32_t> depth(n, 0);
+    std::vector<bool> inChain(n, false);
+    for (const auto end : {head, limbs[LeftArm].upper, limbs[RightArm].upper, limbs[LeftLeg].upper, limbs[RightLeg].upper}) {
+        for (int32_t p = end; p != -1; p = parents[p])
+            inChain[p] = true;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        for (int32_t p = parents[i]; p != -1; p = parents[p])
+            depth[i]++;
+        if (inChain[i])
+            chainOrder.push_back(i);
+    }
+    std::stable_sort(chainOrder.begin(), chainOrder.end(), [&](uint32_t a, uint32_t b) { return depth[a] < depth[b]; });
+}
+
+void IKSolver::solve(std::vector<Job> &jobs) {
+    const auto start = std::chrono::steady_clock::now();
+    busyNanoseconds = 0;
+    const size_t batchNum = (jobs.size() + batchSize - 1) / batchSize;
+    pool.run(batchNum, [&](size_t batch) {
+        const auto first = batch * batchSize;
+        solveBatch(jobs.data() + first, std::min<size_t>(batchSize, jobs.size() - first));
+    });
+
+    stats.avatarNum = jobs.size();
+    stats.wallMicroseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+    stats.microsecondsPerAvatar = jobs.empty() ? 0.0f : busyNanoseconds.load() * 1e-3f / jobs.size();
+}
+
+void IKSolver::solveBatch(Job *jobs, size_t n) {
+    const auto start = std::chrono::steady_clock::now();
+    thread_local std::vector<glm::quat> rotations;
+    thread_local std::vector<glm::vec3> positions;
+    thread_local std::vector<BodyState> bodies;
+    thread_local TwoBoneBatch chains;
+    bodies.resize(n);
+    chains.resize(n * IKRig::LimbCount);
+
+    // hips, spine and head of every avatar, which gives the roots and targets of its limbs
+    for (size_t i = 0; i < n; i++) {
+        const auto &rig = *jobs[i].rig;
+        const auto &targets = jobs[i].targets;
+        auto &out = *jobs[i].out;
+        rotations.resize(rig.parents.size());
+        positions.resize(rig.parents.size());
+        out = rig.restPose;
+        auto &body = bodies[i];
+        body.yaw = placeBody(rig, targets, out, rotations, positions);
+
+        for (uint32_t l = 0; l < IKRig::LimbCount; l++) {
+            const auto &limb = rig.limbs[l];
+            const bool arm = l == IKRig::LeftArm || l == IKRig::RightArm;
+            const float side = l == IKRig::LeftArm || l == IKRig::LeftLeg ? 1.0f : -1.0f;
+            glm::vec3 target, pole;
+            if (arm) {
+                target = targets.handPositions[l];
+                pole = targets.elbowHints[l];
+                if (pole == glm::vec3{0.0f})
+                    pole = body.yaw * (-up - rig.forward * 0.5f + rig.left * (side * 0.3f));
+            } else {
+                // feet stay under the hips, on the floor of the rest pose
+                target = positions[rig.hips] + body.yaw * (rig.restPositions[limb.end] - rig.restPositions[rig.hips]);
+                target.y = rig.restPositions[limb.end].y;
+                pole = body.yaw * (rig.forward + rig.left * (side * 0.1f));
+            }
+            body.limbParents[l] = rotations[rig.parents[limb.upper]];
+            chains.set(i * IKRig::LimbCount + l, positions[limb.upper], target, pole, limb.upperLength, limb.lowerLength);
+        }
+    }
+
+    solveTwoBone(chains);
+
+    for (size_t i = 0; i < n; i++) {
+        const auto &rig = *jobs[i].rig;
+        const auto &body = bodies[i];
+        for (uint32_t l = 0; l < IKRig::LimbCount; l++) {
+            const auto &limb = rig.limbs[l];
+            const auto c = i * IKRig::LimbCount + l;
+            const auto endRotation = (l == IKRig::LeftArm || l == IKRig::RightArm ? jobs[i].targets.handRotations[l] : body.yaw) * rig.restRotations[limb.end];
+            finishLimb(rig, limb, body.limbParents[l], chains.root(c), chains.middle(c), chains.end(c), endRotation, *jobs[i].out);
+        }
+    }
+
+    busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "../../concurrent/WorkerPool.hpp"
+#include "../VRMAvator.hpp"
+#include "pose.hpp"
+#include <atomic>
+#include <vector>
+
+// Tracked head and hands of an avatar, in its model space.
+// Rotations are relative to the rest pose: identity holds the bone as the model's rest pose does.
+struct IKTargets {
+    glm::vec3 headPosition{0.0f};
+    glm::quat headRotation{1.0f, 0.0f, 0.0f, 0.0f};
+    // left, then right
+    glm::vec3 handPositions[2]{glm::vec3{0.0f}, glm::vec3{0.0f}};
+    glm::quat handRotations[2]{glm::quat{1.0f, 0.0f, 0.0f, 0.0f}, glm::quat{1.0f, 0.0f, 0.0f, 0.0f}};
+    // directions the elbows bend toward; zero for down, back and a little outward from the body
+    glm::vec3 elbowHints[2]{glm::vec3{0.0f}, glm::vec3{0.0f}};
+};
+
+// The humanoid bones of a model that IK drives, and their rest pose in model space.
+struct IKRig {
+    struct Limb {
+        uint32_t upper, lower, end;
+        float upperLength, lowerLength;
+    };
+    enum { LeftArm, RightArm, LeftLeg, RightLeg, LimbCount };
+
+    std::vector<int32_t> parents;
+    PoseBuffer restPose;
+    std::vector<glm::quat> restRotations;
+    std::vector<glm::vec3> restPositions;
+
+    uint32_t hips, head;
+    // joints from hips to head, both excluded
+    std::vector<uint32_t> spine;
+    Limb limbs[LimbCount];
+    // ancestors of the head and of every limb, parents first; forward kinematics only visits these
+    std::vector<uint32_t> chainOrder;
+    // the way the model faces and its left, horizontal
+    glm::vec3 forward, left;
+
+    // throws if the humanoid lacks a bone IK needs, or a limb has a zero-length bone
+    IKRig(const std::vector<int32_t> &parents, const PoseBuffer &restPose, const VrmHumanoid &humanoid);
+};
+
+struct IKSolveStats {
+    uint32_t avatarNum = 0;
+    // the whole solve() call, and thread time per avatar summed over all threads
+    float wallMicroseconds = 0.0f;
+    float microsecondsPerAvatar = 0.0f;
+};
+
+// Reconstructs full-body poses from head and hand targets: hips under the head, the spine taking part of the head's tilt,
+// analytic two-bone arms reaching the hands with elbows toward the hints, and legs keeping the feet on the rest floor.
+// Avatars are solved in batches spread over worker threads; the two-bone solves of a batch run four limbs at a time with SSE.
+class IKSolver {
+  public:
+    struct Job {
+        const IKRig *rig;
+        IKTargets targets;
+        // resized to the rig's joint count; joints IK doesn't drive keep their rest configuration
+        PoseBuffer *out;
+    };
+    static constexpr uint32_t batchSize = 32;
+    // the share of the head's pitch and roll the spine bends with
+    static constexpr float spineShare = 0.4f;
+
+  private:
+    WorkerPool pool;
+    std::atomic<uint64_t> busyNanoseconds{0};
+    IKSolveStats stats;
+
+    void solveBatch(Job *jobs, size_t n);
+
+  public:
+    explicit IKSolver(uint32_t workerNum) : pool{workerNum} {}
+
+    void solve(std::vector<Job> &jobs);
+    // of the last solve()
+    const IKSolveStats &getStats() const { return stats; }
+};
@@ -0,0 +1,170 @@
+#include "pose.hpp"
+#include <cmath>
+#include <stdexcept>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define POSE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+void checkSkeleton(const PoseBuffer &a, const PoseBuffer &b) {
+    if (a.jointCount() != b.jointCount())
+        throw std::runtime_error("poses of different skeletons");
+}
+
+// zeux's fit of the slerp parameter for nlerp, by the cosine d of the angle between the rotations
+inline float correctedWeight(float t, float d) {
+    const float a = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+    const float b = 0.848013f + d * (-1.06021f + d * 0.215638f);
+    const float k = a * (t - 0.5f) * (t - 0.5f) + b;
+    return t + t * (t - 0.5f) * (t - 1.0f) * k;
+}
+
+#ifdef POSE_SSE
+struct Quat4 {
+    __m128 x, y, z, w;
+};
+
+inline Quat4 loadRotations(const PoseBuffer &pose, uint32_t i) {
+    return {_mm_loadu_ps(pose.data(PoseBuffer::RotationX) + i), _mm_loadu_ps(pose.data(PoseBuffer::RotationY) + i),
+            _mm_loadu_ps(pose.data(PoseBuffer::RotationZ) + i), _mm_loadu_ps(pose.data(PoseBuffer::RotationW) + i)};
+}
+
+inline void storeRotations(PoseBuffer &pose, uint32_t i, const Quat4 &q) {
+    _mm_storeu_ps(pose.data(PoseBuffer::RotationX) + i, q.x);
+    _mm_storeu_ps(pose.data(PoseBuffer::RotationY) + i, q.y);
+    _mm_storeu_ps(pose.data(PoseBuffer::RotationZ) + i, q.z);
+    _mm_storeu_ps(pose.data(PoseBuffer::RotationW) + i, q.w);
+}
+
+inline __m128 dot(const Quat4 &a, const Quat4 &b) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_add_ps(_mm_mul_ps(a.z, b.z), _mm_mul_ps(a.w, b.w)));
+}
+
+// a + (b - a) * t, normalized
+inline Quat4 nlerp(const Quat4 &a, const Quat4 &b, __m128 t) {
+    Quat4 r{_mm_add_ps(a.x, _mm_mul_ps(_mm_sub_ps(b.x, a.x), t)), _mm_add_ps(a.y, _mm_mul_ps(_mm_sub_ps(b.y, a.y), t)),
+            _mm_add_ps(a.z, _mm_mul_ps(_mm_sub_ps(b.z, a.z), t)), _mm_add_ps(a.w, _mm_mul_ps(_mm_sub_ps(b.w, a.w), t))};
+    const __m128 invLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(dot(r, r), _mm_set1_ps(1e-12f))));
+    return {_mm_mul_ps(r.x, invLength), _mm_mul_ps(r.y, invLength), _mm_mul_ps(r.z, invLength), _mm_mul_ps(r.w, invLength)};
+}
+
+inline Quat4 multiply(const Quat4 &a, const Quat4 &b) {
+    return {
+        _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a.w, b.x), _mm_mul_ps(a.x, b.w)), _mm_mul_ps(a.y, b.z)), _mm_mul_ps(a.z, b.y)),
+        _mm_add_ps(_mm_sub_ps(_mm_mul_ps(a.w, b.y), _mm_mul_ps(a.x, b.z)), _mm_add_ps(_mm_mul_ps(a.y, b.w), _mm_mul_ps(a.z, b.x))),
+        _mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(a.w, b.z), _mm_mul_ps(a.x, b.y)), _mm_mul_ps(a.y, b.x)), _mm_mul_ps(a.z, b.w)),
+        _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(a.w, b.w), _mm_mul_ps(a.x, b.x)), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z)),
+    };
+}
+
+inline __m128 loadWeights(float weight, const PoseMask *mask, uint32_t i) {
+    const __m128 w = _mm_set1_ps(weight);
+    return mask ? _mm_mul_ps(w, _mm_loadu_ps(mask->data() + i)) : w;
+}
+
+// x + (y - x) * t for the translation components
+inline void lerpTranslations(const PoseBuffer &from, const PoseBuffer &to, PoseBuffer &out, uint32_t i, __m128 t) {
+    for (const auto c : {PoseBuffer::TranslationX, PoseBuffer::TranslationY, PoseBuffer::TranslationZ}) {
+        const __m128 x = _mm_loadu_ps(from.data(c) + i), y = _mm_loadu_ps(to.data(c) + i);
+        _mm_storeu_ps(out.data(c) + i, _mm_add_ps(x, _mm_mul_ps(_mm_sub_ps(y, x), t)));
+    }
+}
+#endif
+
+} // namespace
+
+PoseBuffer::PoseBuffer(uint32_t jointNum) : jointNum{jointNum} {
+    for (auto &component : components)
+        component.assign((jointNum + 3) & ~3u, 0.0f);
+    std::fill(components[RotationW].begin(), components[RotationW].end(), 1.0f);
+}
+
+PoseBuffer::PoseBuffer(const std::vector<JointConfiguration> &joints) : PoseBuffer(static_cast<uint32_t>(joints.size())) {
+    for (uint32_t i = 0; i < jointNum; i++)
+        set(i, joints[i]);
+}
+
+void blendPoses(const PoseBuffer &from, const PoseBuffer &to, float weight, const PoseMask *mask, PoseBuffer &out, PoseBlend mode) {
+    checkSkeleton(from, to);
+    if (out.jointCount() != from.jointCount())
+        out = PoseBuffer{from.jointCount()};
+#ifdef POSE_SSE
+    const __m128 half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f), signBit = _mm_set1_ps(-0.0f);
+    for (uint32_t i = 0; i < from.paddedCount(); i += 4) {
+        const __m128 t = loadWeights(weight, mask, i);
+        const auto a = loadRotations(from, i);
+        auto b = loadRotations(to, i);
+        // the shortest arc: flip b where it is on the other hemisphere
+        const __m128 cosine = dot(a, b);
+        const __m128 flip = _mm_and_ps(cosine, signBit);
+        b = {_mm_xor_ps(b.x, flip), _mm_xor_ps(b.y, flip), _mm_xor_ps(b.z, flip), _mm_xor_ps(b.w, flip)};
+
+        __m128 rotationT = t;
+        if (mode == PoseBlend::Slerp) {
+            const __m128 d = _mm_andnot_ps(signBit, cosine);
+            const __m128 fitA = _mm_add_ps(_mm_set1_ps(1.0904f), _mm_mul_ps(d, _mm_add_ps(_mm_set1_ps(-3.2452f), _mm_mul_ps(d, _mm_sub_ps(_mm_set1_ps(3.55645f), _mm_mul_ps(d, _mm_set1_ps(1.43519f)))))));
+            const __m128 fitB = _mm_add_ps(_mm_set1_ps(0.848013f), _mm_mul_ps(d, _mm_add_ps(_mm_set1_ps(-1.06021f), _mm_mul_ps(d, _mm_set1_ps(0.215638f)))));
+            const __m128 centered = _mm_sub_ps(t, half);
+            const __m128 k = _mm_add_ps(_mm_mul_ps(fitA, _mm_mul_ps(centered, centered)), fitB);
+            rotationT = _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(t, centered), _mm_mul_ps(_mm_sub_ps(t, one), k)));
+        }
+        storeRotations(out, i, nlerp(a, b, rotationT));
+        lerpTranslations(from, to, out, i, t);
+    }
+#else
+    for (uint32_t i = 0; i < from.jointCount(); i++) {
+        const float t = mask ? weight * (*mask)[i] : weight;
+        const auto a = from.rotation(i);
+        auto b = to.rotation(i);
+        float cosine = glm::dot(a, b);
+        if (cosine < 0.0f) {
+            b = -b;
+            cosine = -cosine;
+        }
+        const float rotationT = mode == PoseBlend::Slerp ? correctedWeight(t, cosine) : t;
+        out.setRotation(i, glm::normalize(a + (b - a) * rotationT));
+        out.setTranslation(i, glm::mix(from.translation(i), to.translation(i), t));
+    }
+#endif
+}
+
+void makeAdditive(const PoseBuffer &pose, const PoseBuffer &reference, PoseBuffer &out) {
+    checkSkeleton(pose, reference);
+    if (out.jointCount() != pose.jointCount())
+        out = PoseBuffer{pose.jointCount()};
+    // once per clip, not per frame
+    for (uint32_t i = 0; i < pose.jointCount(); i++) {
+        auto delta = glm::normalize(glm::inverse(reference.rotation(i)) * pose.rotation(i));
+        // the short way round, so weights between 0 and 1 scale it from identity
+        if (delta.w < 0.0f)
+            delta = -delta;
+        out.setRotation(i, delta);
+        out.setTranslation(i, pose.translation(i) - reference.translation(i));
+    }
+}
+
+void addPose(PoseBuffer &base, const PoseBuffer &additive, float weight, const PoseMask *mask) {
+    checkSkeleton(base, additive);
+#ifdef POSE_SSE
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const Quat4 identity{zero, zero, zero, one};
+    for (uint32_t i = 0; i < base.paddedCount(); i += 4) {
+        const __m128 t = loadWeights(weight, mask, i);
+        storeRotations(base, i, multiply(loadRotations(base, i), nlerp(identity, loadRotations(additive, i), t)));
+        for (const auto c : {PoseBuffer::TranslationX, PoseBuffer::TranslationY, PoseBuffer::TranslationZ}) {
+            const __m128 x = _mm_loadu_ps(base.data(c) + i), delta = _mm_loadu_ps(additive.data(c) + i);
+            _mm_storeu_ps(base.data(c) + i, _mm_add_ps(x, _mm_mul_ps(delta, t)));
+        }
+    }
+#else
+    const glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+    for (uint32_t i = 0; i < base.jointCount(); i++) {
+        const float t = mask ? weight * (*mask)[i] : weight;
+        const auto delta = glm::normalize(identity + (additive.rotation(i) - identity) * t);
+        base.setRotation(i, base.rotation(i) * delta);
+        base.setTranslation(i, base.translation(i) + additive.translation(i) * t);
+    }
+#endif
+}
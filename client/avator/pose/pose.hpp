@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+// transform of a joint relative to its parent, as ModelManager::NodeInfo holds the rest pose
+struct JointConfiguration {
+    glm::quat rotation;
+    glm::vec3 translation;
+};
+
+// Local rotations and translations of every joint of a skeleton, a component per array,
+// padded to a multiple of four with identity joints so blends run four joints at a time.
+class PoseBuffer {
+  public:
+    enum Component { RotationX, RotationY, RotationZ, RotationW, TranslationX, TranslationY, TranslationZ, ComponentCount };
+
+  private:
+    uint32_t jointNum = 0;
+    std::array<std::vector<float>, ComponentCount> components;
+
+  public:
+    PoseBuffer() = default;
+    // every joint at identity
+    explicit PoseBuffer(uint32_t jointNum);
+    explicit PoseBuffer(const std::vector<JointConfiguration> &joints);
+
+    uint32_t jointCount() const { return jointNum; }
+    // the length of every component array
+    uint32_t paddedCount() const { return components[0].size(); }
+    bool empty() const { return jointNum == 0; }
+    void clear() { *this = PoseBuffer{}; }
+
+    float *data(Component c) { return components[c].data(); }
+    const float *data(Component c) const { return components[c].data(); }
+
+    glm::quat rotation(uint32_t joint) const {
+        return glm::quat(components[RotationW][joint], components[RotationX][joint], components[RotationY][joint], components[RotationZ][joint]);
+    }
+    glm::vec3 translation(uint32_t joint) const {
+        return glm::vec3(components[TranslationX][joint], components[TranslationY][joint], components[TranslationZ][joint]);
+    }
+    JointConfiguration operator[](uint32_t joint) const { return JointConfiguration{rotation(joint), translation(joint)}; }
+
+    void setRotation(uint32_t joint, const glm::quat &q) {
+        components[RotationX][joint] = q.x;
+        components[RotationY][joint] = q.y;
+        components[RotationZ][joint] = q.z;
+        components[RotationW][joint] = q.w;
+    }
+    void setTranslation(uint32_t joint, const glm::vec3 &t) {
+        components[TranslationX][joint] = t.x;
+        components[TranslationY][joint] = t.y;
+        components[TranslationZ][joint] = t.z;
+    }
+    void set(uint32_t joint, const JointConfiguration &config) {
+        setRotation(joint, config.rotation);
+        setTranslation(joint, config.translation);
+    }
+};
+
+// per-joint weights of a layer, padded like a PoseBuffer; a joint at 0 keeps the pose under the layer
+class PoseMask {
+    std::vector<float> weights;
+
+  public:
+    PoseMask() = default;
+    PoseMask(uint32_t jointNum, float weight) : weights((jointNum + 3) & ~3u, 0.0f) { std::fill_n(weights.begin(), jointNum, weight); }
+
+    void set(uint32_t joint, float weight) { weights[joint] = weight; }
+    float operator[](uint32_t joint) const { return weights[joint]; }
+    const float *data() const { return weights.data(); }
+};
+
+enum class PoseBlend {
+    // normalized lerp: the cheapest, and fine for the small angles between neighbouring samples
+    Nlerp,
+    // nlerp with its parameter corrected by a polynomial fit, which stays within about 1e-3 of slerp without any trigonometry
+    Slerp,
+};
+
+// out = from blended toward to by weight (times mask, if given), rotations along the shortest arc.
+// The poses share a skeleton; out may be either of them.
+void blendPoses(const PoseBuffer &from, const PoseBuffer &to, float weight, const PoseMask *mask, PoseBuffer &out, PoseBlend mode = PoseBlend::Nlerp);
+// out = the difference of pose from reference, for addPose; rotations are applied after the base's own
+void makeAdditive(const PoseBuffer &pose, const PoseBuffer &reference, PoseBuffer &out);
+// adds an additive pose onto base by weight (times mask, if given)
+void addPose(PoseBuffer &base, const PoseBuffer &additive, float weight, const PoseMask *mask);
@@ -1,7 +1,36 @@
 #include "Communicate.hpp"
+#include <iostream>
 
-Communicate::Communicate() : defaultLoop(uvw::loop::get_default())
+Communicate::Communicate(std::string serverIp, unsigned int serverPort)
+    : defaultLoop(uvw::loop::get_default()),
+      socket(defaultLoop->raw(), [this](const uint8_t *data, size_t size, const sockaddr *from) {
+          // anyone can send to our port; only the server is listened to
+          if (sameAddress(from, reinterpret_cast<const sockaddr *>(&serverAddress)))
+              receive(data, size);
+      }),
+      stopSignal(defaultLoop->resource<uvw::async_handle>()), outboundSignal(defaultLoop->resource<uvw::async_handle>()),
+      uplinkTimer(defaultLoop->resource<uvw::timer_handle>()),
+      serverAddress(parseAddress(serverIp, serverPort))
 {
+    stopSignal->on<uvw::async_event>([this](const uvw::async_event &, uvw::async_handle &) {
+        socket.close();
+        outboundSignal->close();
+        uplinkTimer->close();
+        stopSignal->close();
+    });
+    // wakeups coalesce, so drain everything posted by then; the pose goes out on the next tick
+    outboundSignal->on<uvw::async_event>([this](const uvw::async_event &, uvw::async_handle &) {
+        takeOutbound();
+    });
+    uplinkTimer->on<uvw::timer_event>([this](const uvw::timer_event &, uvw::timer_handle &) {
+        takeOutbound();
+        sendOutbound();
+    });
+    const uvw::timer_handle::time interval{uint64_t(1000.0f / poseSyncRate)};
+    uplinkTimer->start(interval, interval);
+    channel.wakeNetwork = [this]() { outboundSignal->send(); };
+    socket.bind(serverAddress.ss_family == AF_INET6 ? "::" : "0.0.0.0", 0);
+    socket.start();
 }
 
 Communicate::~Communicate()
@@ -11,3 +40,64 @@ Communicate::~Communicate()
 void Communicate::run() {
     defaultLoop->run();
 }
+
+void Communicate::stop() {
+    stopSignal->send();
+}
+
+void Communicate::receive(const uint8_t *data, size_t length) {
+    if (length == 0)
+        return;
+    const auto arrival = std::chrono::steady_clock::now();
+    switch (MessageType(data[0])) {
+    case MessageType::PoseSync:
+        if (auto snapshot = downlink.decode(data, length)) {
+            const auto ack = encodePoseAck(snapshot->tick);
+            send(ack.data(), ack.size());
+            // late ticks are acknowledged all the same, as baselines to come, but don't replace a newer snapshot.
+            // The render side gets them all, in arrival order, to interpolate between
+            if (!roomPoses || int16_t(snapshot->tick - roomPoses->tick) > 0)
+                roomPoses = *snapshot;
+            if (!channel.snapshots.tryPush(ReceivedSnapshot{std::move(*snapshot), arrival}))
+                droppedSnapshots++;
+            else if (channel.wakeRender)
+                channel.wakeRender();
+        }
+        break;
+    case MessageType::PoseAck:
+        if (auto tick = decodePoseAck(data, length))
+            uplink.acknowledge(*tick);
+        break;
+    }
+    publishState();
+}
+
+void Communicate::publishState() {
+    // assigning into the slots reuses their storage once they have been through a few snapshots
+    auto &state = channel.state.writeSlot();
+    if (roomPoses)
+        state.newest = *roomPoses;
+    state.uplink = uplink.getStats();
+    state.downlink = downlink.getStats();
+    state.droppedSnapshots = droppedSnapshots;
+    channel.state.publish();
+}
+
+void Communicate::send(const uint8_t *data, size_t size) {
+    socket.send(data, size, reinterpret_cast<const sockaddr *>(&serverAddress));
+}
+
+void Communicate::takeOutbound() {
+    AvatarPose pose;
+    while (channel.outboundPoses.tryPop(pose))
+        outbound.assign(1, pose);
+}
+
+void Communicate::sendOutbound() {
+    // nothing to say until the first pose is posted
+    if (outbound.empty())
+        return;
+    uplink.encode(outbound, packet);
+    send(packet.data(), packet.size());
+    publishState();
+}
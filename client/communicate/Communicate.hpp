@@ -1,12 +1,52 @@
+#include "../../common/PoseCodec.hpp"
+#include "../../common/Protocol.hpp"
+#include "../../common/UdpEndpoint.hpp"
+#include "RoomChannel.hpp"
+#include <optional>
+#include <string>
 #include <uvw.hpp>
 
 class Communicate
 {
 private:
     std::shared_ptr<uvw::loop> defaultLoop;
+    // receives into pooled buffers, parsed in place
+    UdpEndpoint socket;
+    // closes the handles from another thread, letting run() return
+    std::shared_ptr<uvw::async_handle> stopSignal;
+    // RoomChannel::wakeNetwork: outbound messages were posted
+    std::shared_ptr<uvw::async_handle> outboundSignal;
+    // sends our newest pose at poseSyncRate, posted since or not, so the server keeps us while nothing moves
+    std::shared_ptr<uvw::timer_handle> uplinkTimer;
+    sockaddr_storage serverAddress;
+
+    // our avatar, up to the server
+    PoseEncoder uplink;
+    // everyone in the room, down from it
+    PoseDecoder downlink;
+    std::optional<PoseSnapshot> roomPoses;
+    RoomChannel channel;
+    uint64_t droppedSnapshots = 0;
+    // the newest pose posted, as the only avatar of an uplink message
+    std::vector<AvatarPose> outbound;
+    std::vector<uint8_t> packet;
+
+    void receive(const uint8_t *data, size_t length);
+    void send(const uint8_t *data, size_t size);
+    void takeOutbound();
+    void sendOutbound();
+    void publishState();
 public:
-    Communicate();
+    Communicate(std::string serverIp = "127.0.0.1", unsigned int serverPort = defaultServerPort);
     ~Communicate();
 
     void run();
+    // from any thread
+    void stop();
+
+    // to and from the other threads; set its wakeRender before run()
+    RoomChannel &getChannel() { return channel; }
+    // on the loop's thread, or once it has stopped
+    const UdpStats &getSocketStats() const { return socket.getStats(); }
+    const PacketPoolStats &getPacketPoolStats() const { return socket.getPoolStats(); }
 };
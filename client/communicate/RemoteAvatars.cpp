@@ -0,0 +1,57 @@
+#include "RemoteAvatars.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+
+glm::mat4 roomTransform(const AvatarPose &pose) {
+    return glm::translate(glm::mat4{1.0f}, pose.position) * glm::mat4_cast(pose.rotation);
+}
+
+ThreePartsAvatar threeParts(const AvatarPose &pose) {
+    ThreePartsAvatar parts;
+    for (uint32_t part = 0; part < AvatarPose::PartCount; part++) {
+        parts.positions[part] = pose.partPositions[part];
+        parts.rotations[part] = pose.partRotations[part];
+    }
+    return parts;
+}
+
+IKTargets ikTargets(const AvatarPose &pose) {
+    IKTargets targets;
+    targets.headPosition = pose.partPositions[AvatarPose::Head];
+    targets.headRotation = pose.partRotations[AvatarPose::Head];
+    for (uint32_t hand = 0; hand < 2; hand++) {
+        targets.handPositions[hand] = pose.partPositions[AvatarPose::LeftHand + hand];
+        targets.handRotations[hand] = pose.partRotations[AvatarPose::LeftHand + hand];
+    }
+    return targets;
+}
+
+} // namespace
+
+void RemoteAvatars::update(VulkanManagerCore &graphics, SnapshotBuffer::Clock::time_point now) {
+    while (channel.snapshots.tryPop(received))
+        buffer.push(std::move(received.snapshot), received.arrival);
+    // nothing to go by yet; from the first snapshot on, an empty sample means nobody is in range
+    if (buffer.getStats().received == 0)
+        return;
+
+    buffer.sample(now, poses);
+    roster.update(poses, changes);
+    for (const auto id : changes.left) {
+        graphics.removeAvatar(avatarIds.at(id));
+        avatarIds.erase(id);
+    }
+    for (const auto &pose : changes.joined) {
+        const auto avatarId = graphics.requestAvatar(avatarModel, roomTransform(pose));
+        graphics.setAvatarParts(avatarId, threeParts(pose));
+        graphics.setAvatarTracking(avatarId, ikTargets(pose));
+        avatarIds.emplace(pose.avatarId, avatarId);
+    }
+    for (const auto &pose : changes.moved) {
+        const auto avatarId = avatarIds.at(pose.avatarId);
+        graphics.setAvatarTransform(avatarId, roomTransform(pose));
+        graphics.setAvatarParts(avatarId, threeParts(pose));
+        graphics.setAvatarTracking(avatarId, ikTargets(pose));
+    }
+}
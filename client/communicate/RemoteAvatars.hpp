@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../graphics/vulkan/VulkanManagerCore.hpp"
+#include "RemoteRoster.hpp"
+#include "RoomChannel.hpp"
+#include "SnapshotBuffer.hpp"
+#include <map>
+
+// The render loop's end of a RoomChannel: takes the received snapshots, plays them back through a SnapshotBuffer
+// and keeps an avatar in the renderer for everyone in the room. Their tracked head and hands drive the full body by IK,
+// or are shown as they are once the crowd is past the renderer's full avatar budget.
+class RemoteAvatars {
+    // until the protocol says which model each avatar wears
+    static constexpr const char *avatarModel = "AliciaSolid.vrm";
+
+    RoomChannel &channel;
+    SnapshotBuffer buffer;
+    ReceivedSnapshot received;
+    // sampled every frame; kept so its storage is reused
+    std::vector<AvatarPose> poses;
+    // only changed avatars are handed to the renderer, so an unchanged one doesn't mark the scene dirty
+    RemoteRoster roster;
+    RemoteRoster::Changes changes;
+    // renderer avatar ids, by room avatar id
+    std::map<uint16_t, uint32_t> avatarIds;
+
+  public:
+    explicit RemoteAvatars(RoomChannel &channel) : channel{channel} {}
+
+    // on the render thread, before each frame
+    void update(VulkanManagerCore &graphics, SnapshotBuffer::Clock::time_point now);
+
+    const SnapshotBufferStats &getStats() const { return buffer.getStats(); }
+};
@@ -0,0 +1,44 @@
+#include "RemoteRoster.hpp"
+#include <iterator>
+
+namespace {
+
+bool samePose(const AvatarPose &a, const AvatarPose &b) {
+    if (a.position != b.position || a.rotation != b.rotation)
+        return false;
+    for (uint32_t part = 0; part < AvatarPose::PartCount; part++)
+        if (a.partPositions[part] != b.partPositions[part] || a.partRotations[part] != b.partRotations[part])
+            return false;
+    return true;
+}
+
+} // namespace
+
+void RemoteRoster::update(const std::vector<AvatarPose> &poses, Changes &changes) {
+    changes.joined.clear();
+    changes.moved.clear();
+    changes.left.clear();
+
+    // both are in ascending id order
+    auto it = shown.begin();
+    for (const auto &pose : poses) {
+        while (it != shown.end() && it->first < pose.avatarId) {
+            changes.left.push_back(it->first);
+            it = shown.erase(it);
+        }
+        if (it == shown.end() || it->first != pose.avatarId) {
+            changes.joined.push_back(pose);
+            it = std::next(shown.emplace_hint(it, pose.avatarId, pose));
+            continue;
+        }
+        if (!samePose(it->second, pose)) {
+            changes.moved.push_back(pose);
+            it->second = pose;
+        }
+        ++it;
+    }
+    while (it != shown.end()) {
+        changes.left.push_back(it->first);
+        it = shown.erase(it);
+    }
+}
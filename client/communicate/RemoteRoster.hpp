@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../../common/PoseCodec.hpp"
+#include <map>
+#include <vector>
+
+// Which room avatars are shown, kept in step with the poses a SnapshotBuffer plays back: whoever is in the
+// sample is shown, everyone else goes. Bookkeeping only; RemoteAvatars carries the changes out in the renderer.
+class RemoteRoster {
+  public:
+    struct Changes {
+        std::vector<AvatarPose> joined;
+        // shown already, at a different pose than last time
+        std::vector<AvatarPose> moved;
+        // room avatar ids
+        std::vector<uint16_t> left;
+    };
+
+  private:
+    // by room avatar id, at the pose last reported
+    std::map<uint16_t, AvatarPose> shown;
+
+  public:
+    // poses in ascending id order, as SnapshotBuffer::sample() writes them; an empty sample clears the roster.
+    // changes is cleared first, so one kept across frames is filled without allocating
+    void update(const std::vector<AvatarPose> &poses, Changes &changes);
+
+    size_t size() const { return shown.size(); }
+    bool contains(uint16_t avatarId) const { return shown.count(avatarId) != 0; }
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../../common/PoseCodec.hpp"
+#include "../concurrent/MpscQueue.hpp"
+#include "../concurrent/SpscQueue.hpp"
+#include "../concurrent/TripleBuffer.hpp"
+#include <chrono>
+#include <functional>
+
+struct ReceivedSnapshot {
+    PoseSnapshot snapshot;
+    std::chrono::steady_clock::time_point arrival;
+};
+
+// what the network thread last knew of the room
+struct RoomState {
+    PoseSnapshot newest;
+    PoseCodecStats uplink, downlink;
+    // snapshots dropped because the render side fell behind taking them
+    uint64_t droppedSnapshots = 0;
+};
+
+// Everything the network thread and the rest of the client exchange, without locks on either side.
+// Received snapshots go to the render loop in arrival order, for a SnapshotBuffer to play back; the newest room
+// state is there for anyone who only needs that; outbound messages come from any thread.
+class RoomChannel {
+  public:
+    // network thread -> render loop: about three seconds at poseSyncRate
+    SpscQueue<ReceivedSnapshot, 64> snapshots;
+    TripleBuffer<RoomState> state;
+    // any thread -> network thread; a newer pose supersedes the ones still queued
+    MpscQueue<AvatarPose, 16> outboundPoses;
+
+    // set once before the threads start; both are thread-safe
+    std::function<void()> wakeNetwork, wakeRender;
+
+    // the local avatar's pose, for the next uplink tick; false if the network thread is that far behind
+    bool postPose(const AvatarPose &pose) {
+        if (!outboundPoses.tryPush(pose))
+            return false;
+        wakeNetwork();
+        return true;
+    }
+};
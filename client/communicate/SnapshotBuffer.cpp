@@ -0,0 +1,121 @@
+#include "SnapshotBuffer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace {
+
+// how fast the transit floor follows arrivals back up, per snapshot, so clock drift doesn't build up into delay
+constexpr double floorDrift = 0.001;
+
+AvatarPose blendPose(const AvatarPose &a, const AvatarPose &b, float t) {
+    AvatarPose pose;
+    pose.avatarId = a.avatarId;
+    pose.position = glm::mix(a.position, b.position, t);
+    // the shortest arc, renormalized since t past 1 extrapolates
+    pose.rotation = glm::normalize(glm::slerp(a.rotation, b.rotation, t));
+    for (uint32_t part = 0; part < AvatarPose::PartCount; part++) {
+        pose.partPositions[part] = glm::mix(a.partPositions[part], b.partPositions[part], t);
+        pose.partRotations[part] = glm::normalize(glm::slerp(a.partRotations[part], b.partRotations[part], t));
+    }
+    return pose;
+}
+
+// into out: avatars in both are blended; one only in a is kept while t < 1, one only in b from t = 1 on
+void blendAvatars(const std::vector<AvatarPose> &a, const std::vector<AvatarPose> &b, float t, std::vector<AvatarPose> &out) {
+    out.clear();
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        if (j == b.size() || (i < a.size() && a[i].avatarId < b[j].avatarId)) {
+            if (t < 1.0f)
+                out.push_back(a[i]);
+            i++;
+        } else if (i == a.size() || b[j].avatarId < a[i].avatarId) {
+            if (t >= 1.0f)
+                out.push_back(b[j]);
+            j++;
+        } else {
+            out.push_back(blendPose(a[i++], b[j++], t));
+        }
+    }
+}
+
+} // namespace
+
+SnapshotBuffer::SnapshotBuffer(float tickRate) : interval{1.0 / tickRate}, delay{interval} {}
+
+void SnapshotBuffer::push(PoseSnapshot snapshot, Clock::time_point arrival) {
+    stats.received++;
+    const int64_t tick = newestTick ? *newestTick + int16_t(snapshot.tick - uint16_t(*newestTick)) : snapshot.tick;
+
+    // jitter as RTP measures it: the smoothed difference in transit time from one arrival to the next
+    const double transit = seconds(arrival) - sendTime(tick);
+    if (lastTransit)
+        jitter += (std::abs(transit - *lastTransit) - jitter) / 16.0;
+    lastTransit = transit;
+    if (!transitFloor || transit < *transitFloor)
+        transitFloor = transit;
+    else
+        *transitFloor += (transit - *transitFloor) * floorDrift;
+
+    const auto position = std::lower_bound(entries.begin(), entries.end(), tick, [](const Entry &entry, int64_t tick) { return entry.tick < tick; });
+    if (!entries.empty() && (tick < entries.front().tick || (position != entries.end() && position->tick == tick))) {
+        stats.late++;
+        return;
+    }
+    entries.insert(position, Entry{tick, std::move(snapshot.avatars)});
+    if (!newestTick || tick > *newestTick)
+        newestTick = tick;
+    while (entries.size() > capacity)
+        entries.pop_front();
+}
+
+void SnapshotBuffer::sample(Clock::time_point now, std::vector<AvatarPose> &out) {
+    out.clear();
+    if (entries.empty())
+        return;
+
+    const double target = std::min(interval + jitterMargin * jitter, double(maxDelay));
+    if (lastSample) {
+        const double step = delaySlew * std::chrono::duration<double>(now - *lastSample).count();
+        delay += std::clamp(target - delay, -step, step);
+    } else {
+        delay = target;
+    }
+    lastSample = now;
+    stats.delay = float(delay);
+    stats.jitter = float(jitter);
+
+    const double time = seconds(now) - *transitFloor - delay;
+    auto next = std::upper_bound(entries.begin(), entries.end(), time, [this](double time, const Entry &entry) { return time < sendTime(entry.tick); });
+    // before the oldest: hold it
+    if (next == entries.begin()) {
+        out.assign(entries.front().avatars.begin(), entries.front().avatars.end());
+        return;
+    }
+    // older entries aren't needed any more, but for one before the current to extrapolate from
+    if (const auto passed = std::distance(entries.begin(), next); passed > 2) {
+        entries.erase(entries.begin(), entries.begin() + (passed - 2));
+        next = entries.begin() + 2;
+    }
+
+    const auto &from = *std::prev(next);
+    if (next != entries.end()) {
+        blendAvatars(from.avatars, next->avatars, float((time - sendTime(from.tick)) / (sendTime(next->tick) - sendTime(from.tick))), out);
+        return;
+    }
+
+    // past the newest: carry on from the last two for a while, then stop
+    const double ahead = time - sendTime(from.tick);
+    if (std::prev(next) == entries.begin() || ahead > maxExtrapolation) {
+        stats.held++;
+        if (std::prev(next) == entries.begin()) {
+            out.assign(from.avatars.begin(), from.avatars.end());
+            return;
+        }
+    } else {
+        stats.extrapolated++;
+    }
+    const auto &before = *std::prev(next, 2);
+    blendAvatars(before.avatars, from.avatars, 1.0f + float(std::min(ahead, double(maxExtrapolation)) / (sendTime(from.tick) - sendTime(before.tick))), out);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../../common/PoseCodec.hpp"
+#include "../../common/Protocol.hpp"
+#include <chrono>
+#include <deque>
+#include <optional>
+
+struct SnapshotBufferStats {
+    // seconds: how far playback is behind the sender, and the smoothed variation of arrival times
+    float delay = 0.0f, jitter = 0.0f;
+    uint64_t received = 0;
+    // snapshots that came after playback had passed them, or twice
+    uint64_t late = 0;
+    // samples past the newest snapshot: extrapolated, and held once extrapolation ran out
+    uint64_t extrapolated = 0, held = 0;
+};
+
+// Plays a stream of remote snapshots back a little behind their sender, interpolating between the two around the
+// playback time so motion stays smooth under jitter, loss and reordering at a low send rate.
+// The delay follows the measured jitter: a send interval plus enough for late snapshots to nearly always make it,
+// changed gradually by running playback slightly fast or slow. Past the newest snapshot, motion is extrapolated
+// for up to maxExtrapolation, then held.
+class SnapshotBuffer {
+  public:
+    using Clock = std::chrono::steady_clock;
+    // seconds
+    static constexpr float maxDelay = 0.5f;
+    static constexpr float maxExtrapolation = 0.25f;
+    // jitters of delay on top of the send interval
+    static constexpr float jitterMargin = 3.0f;
+    // how much faster or slower than real time playback may run while the delay changes
+    static constexpr float delaySlew = 0.1f;
+    static constexpr size_t capacity = 64;
+
+  private:
+    struct Entry {
+        // unwrapped, so it keeps counting past 65535
+        int64_t tick;
+        std::vector<AvatarPose> avatars;
+    };
+
+    double interval;
+    Clock::time_point epoch = Clock::now();
+    // ascending ticks
+    std::deque<Entry> entries;
+    std::optional<int64_t> newestTick;
+    // arrival minus send time: its floor (the quickest arrival, drifting up slowly with the clocks), the previous one
+    std::optional<double> transitFloor, lastTransit;
+    double jitter = 0.0;
+    double delay;
+    std::optional<Clock::time_point> lastSample;
+    SnapshotBufferStats stats;
+
+    double seconds(Clock::time_point time) const { return std::chrono::duration<double>(time - epoch).count(); }
+    double sendTime(int64_t tick) const { return double(tick) * interval; }
+
+  public:
+    explicit SnapshotBuffer(float tickRate = poseSyncRate);
+
+    void push(PoseSnapshot snapshot, Clock::time_point arrival);
+    // every avatar at the playback time for now into out, in ascending id order; empty until the first snapshot.
+    // out is cleared first, so a vector kept across frames is filled without allocating
+    void sample(Clock::time_point now, std::vector<AvatarPose> &out);
+
+    const SnapshotBufferStats &getStats() const { return stats; }
+};
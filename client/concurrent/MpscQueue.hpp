@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Lock-free bounded multi-producer/single-consumer queue.
+// Producers claim a slot with a compare-exchange on the tail; every slot carries a sequence number telling whose
+// turn it is, so a producer never waits for another to finish writing. A full queue refuses the push.
+template <typename T, size_t Capacity>
+class MpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+    static constexpr size_t mask = Capacity - 1;
+    static constexpr size_t cacheLine = 64;
+
+    struct Cell {
+        // position: free for the producer of position; position + 1: holds its value
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::array<Cell, Capacity> cells;
+    alignas(cacheLine) std::atomic<size_t> tail{0};
+    // owned by the consumer
+    alignas(cacheLine) size_t head = 0;
+
+  public:
+    MpscQueue() {
+        for (size_t i = 0; i < Capacity; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // any thread; returns false if full
+    bool tryPush(T value) {
+        auto position = tail.load(std::memory_order_relaxed);
+        while (true) {
+            auto &cell = cells[position & mask];
+            const auto lag = intptr_t(cell.sequence.load(std::memory_order_acquire)) - intptr_t(position);
+            if (lag == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                // the consumer hasn't freed this slot from the previous lap
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // consumer side; returns false if empty, or if the next value is still being written
+    bool tryPop(T &value) {
+        auto &cell = cells[head & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+            return false;
+        value = std::move(cell.value);
+        cell.sequence.store(head + Capacity, std::memory_order_release);
+        head++;
+        return true;
+    }
+};
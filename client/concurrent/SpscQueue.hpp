@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Lock-free bounded single-producer/single-consumer queue.
+// Slots are allocated up front and values are moved through them, so neither side allocates or waits; a full
+// queue refuses the push. Each side caches the other's index and only reloads it when it looks full or empty.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+    static constexpr size_t mask = Capacity - 1;
+    static constexpr size_t cacheLine = 64;
+
+    std::array<T, Capacity> slots{};
+    // written by the producer
+    alignas(cacheLine) std::atomic<size_t> tail{0};
+    size_t cachedHead = 0;
+    // written by the consumer
+    alignas(cacheLine) std::atomic<size_t> head{0};
+    size_t cachedTail = 0;
+
+  public:
+    // producer side; returns false if full
+    bool tryPush(T &&value) {
+        const auto position = tail.load(std::memory_order_relaxed);
+        if (position - cachedHead == Capacity) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (position - cachedHead == Capacity)
+                return false;
+        }
+        slots[position & mask] = std::move(value);
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side; returns false if empty
+    bool tryPop(T &value) {
+        const auto position = head.load(std::memory_order_relaxed);
+        if (position == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (position == cachedTail)
+                return false;
+        }
+        value = std::move(slots[position & mask]);
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+};
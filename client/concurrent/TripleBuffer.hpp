@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer "latest value" slot.
+// The writer never blocks the reader and vice versa; the reader always sees the most recently published value.
+template <typename T>
+class TripleBuffer {
+    static constexpr uint8_t indexMask = 0x3;
+    static constexpr uint8_t freshBit = 0x4;
+
+    std::array<T, 3> slots{};
+    std::atomic<uint8_t> middle{1};
+    uint8_t writeIndex = 0;
+    uint8_t readIndex = 2;
+
+  public:
+    // writer side
+    T &writeSlot() { return slots[writeIndex]; }
+    void publish() {
+        auto prev = middle.exchange(writeIndex | freshBit, std::memory_order_acq_rel);
+        writeIndex = prev & indexMask;
+    }
+    void write(const T &value) {
+        writeSlot() = value;
+        publish();
+    }
+
+    // reader side; returns true if a newer value has been taken
+    bool fetch() {
+        if (!(middle.load(std::memory_order_relaxed) & freshBit))
+            return false;
+        auto prev = middle.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = prev & indexMask;
+        return true;
+    }
+    const T &readSlot() const { return slots[readIndex]; }
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// Wakes a sleeping thread from any other thread.
+// The mutex is only taken to sleep or to wake a sleeper; checking for a pending signal is a single atomic exchange.
+class WakeSignal {
+    std::atomic<bool> signaled{false};
+    std::mutex mutex;
+    std::condition_variable cv;
+
+  public:
+    void notify() {
+        signaled.store(true, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+        }
+        cv.notify_one();
+    }
+
+    // returns true if a signal was pending, and clears it
+    bool consume() {
+        return signaled.exchange(false, std::memory_order_acq_rel);
+    }
+
+    // both waits return true if woken by a signal (which is consumed), false on timeout
+    template <typename TimePoint>
+    bool waitUntil(const TimePoint &deadline) {
+        std::unique_lock<std::mutex> lock{mutex};
+        cv.wait_until(lock, deadline, [this]() { return signaled.load(std::memory_order_acquire); });
+        return consume();
+    }
+
+    bool wait() {
+        std::unique_lock<std::mutex> lock{mutex};
+        cv.wait(lock, [this]() { return signaled.load(std::memory_order_acquire); });
+        return consume();
+    }
+};
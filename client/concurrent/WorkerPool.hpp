@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent threads that run one batch of work at a time, together with the calling thread.
+// Items are handed out through an atomic counter, so uneven items balance out; fn must not throw.
+class WorkerPool {
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    uint64_t generation = 0;
+    uint32_t busyWorkers = 0;
+    bool stopping = false;
+
+    const std::function<void(size_t)> *current = nullptr;
+    size_t currentNum = 0;
+    std::atomic<size_t> next{0};
+
+    void take() {
+        for (size_t i; (i = next.fetch_add(1)) < currentNum;)
+            (*current)(i);
+    }
+
+    void work() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock{mutex};
+        while (true) {
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            lock.unlock();
+            take();
+            lock.lock();
+            if (--busyWorkers == 0)
+                finished.notify_one();
+        }
+    }
+
+  public:
+    explicit WorkerPool(uint32_t workerNum) {
+        for (uint32_t i = 0; i < workerNum; i++)
+            workers.emplace_back([this]() { work(); });
+    }
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    // the workers and the calling thread
+    uint32_t threadCount() const { return workers.size() + 1; }
+
+    // calls fn(i) once for every i in [0, n) and returns when all are done
+    void run(size_t n, const std::function<void(size_t)> &fn) {
+        if (n == 0)
+            return;
+        current = &fn;
+        currentNum = n;
+        next = 0;
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            generation++;
+            busyWorkers = workers.size();
+        }
+        wake.notify_all();
+        take();
+
+        std::unique_lock<std::mutex> lock{mutex};
+        finished.wait(lock, [this]() { return busyWorkers == 0; });
+    }
+};
@@ -0,0 +1,40 @@
+#include "DesktopConfig.hpp"
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+bool envFlag(const char *name) {
+    const char *value = std::getenv(name);
+    return value && std::string(value) != "0";
+}
+
+uint32_t envUint(const char *name, uint32_t defaultValue) {
+    const char *value = std::getenv(name);
+    if (!value)
+        return defaultValue;
+    try {
+        return std::stoul(value);
+    } catch (const std::exception &) {
+        return defaultValue;
+    }
+}
+
+} // namespace
+
+DesktopGuiConfig loadDesktopGuiConfigFromEnv() {
+    DesktopGuiConfig config;
+    config.lowLatencyPresent = envFlag("COMMONCHAT_LOW_LATENCY");
+    config.frameRateLimit = envUint("COMMONCHAT_FPS_LIMIT", config.frameRateLimit);
+    config.reportLatency = envFlag("COMMONCHAT_REPORT_LATENCY");
+    config.onDemandRendering = envFlag("COMMONCHAT_ON_DEMAND");
+    config.minRefreshRate = envUint("COMMONCHAT_MIN_REFRESH_RATE", config.minRefreshRate);
+    config.reportAnimation = envFlag("COMMONCHAT_REPORT_ANIMATION");
+    config.fastTextureCompression = envFlag("COMMONCHAT_FAST_TEXTURES");
+    config.textureBudgetMiB = envUint("COMMONCHAT_TEXTURE_BUDGET_MB", config.textureBudgetMiB);
+    config.reportTextures = envFlag("COMMONCHAT_REPORT_TEXTURES");
+    config.modelBudgetMiB = envUint("COMMONCHAT_MODEL_BUDGET_MB", config.modelBudgetMiB);
+    config.reportModels = envFlag("COMMONCHAT_REPORT_MODELS");
+    config.reportNetwork = envFlag("COMMONCHAT_REPORT_NETWORK");
+    return config;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+struct DesktopGuiConfig {
+    // prefer mailbox (or immediate) presentation over fifo when the surface supports it
+    bool lowLatencyPresent = false;
+    // 0: unlimited
+    uint32_t frameRateLimit = 0;
+    // print input-to-present latency percentiles periodically
+    bool reportLatency = false;
+    // render only when the scene, camera or window changed, or a redraw was requested
+    bool onDemandRendering = false;
+    // lower bound of the refresh rate in on-demand mode (0: none)
+    uint32_t minRefreshRate = 1;
+    // print skeleton evaluations per frame on exit
+    bool reportAnimation = false;
+    // BC1/BC3 instead of BC7 for textures encoded at load (faster, lower quality)
+    bool fastTextureCompression = false;
+    // device memory for streamed textures in MiB (0: a quarter of video memory)
+    uint32_t textureBudgetMiB = 0;
+    // print texture memory saved by block compression and the encoding rate after loading, and residency on exit
+    bool reportTextures = false;
+    // device memory for whole avatar models in MiB (0: as much as the model vertex/index buffers hold)
+    uint32_t modelBudgetMiB = 0;
+    // print model residency on exit
+    bool reportModels = false;
+    // print remote snapshot playback (arrivals, late ones, extrapolation, delay and jitter) on exit
+    bool reportNetwork = false;
+};
+
+DesktopGuiConfig loadDesktopGuiConfigFromEnv();
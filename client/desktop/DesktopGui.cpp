@@ -2,8 +2,35 @@
 
 #include "DesktopGui.hpp"
 #include "GLFWHelper.hpp"
+#include <fmt/format.h>
+#include <glm/gtc/quaternion.hpp>
+#include <iostream>
+#include <thread>
 
-DesktopGuiSystem::DesktopGuiSystem() {
+namespace {
+
+// the local avatar as the desktop camera stands in for it: under the eye, turned the way it looks, hands at rest
+AvatarPose cameraPose(const glm::mat4 &view) {
+    const auto eye = glm::inverse(view);
+    const glm::vec3 position{eye[3]};
+    const glm::vec3 forward = -glm::vec3(eye[2]);
+
+    AvatarPose pose;
+    pose.position = glm::vec3{position.x, 0.0f, position.z};
+    pose.rotation = glm::angleAxis(std::atan2(forward.x, forward.z), glm::vec3{0.0f, 1.0f, 0.0f});
+    const ThreePartsAvatar rest;
+    for (uint32_t part = 0; part < AvatarPose::PartCount; part++)
+        pose.partPositions[part] = rest.positions[part];
+    pose.partPositions[AvatarPose::Head].y = position.y;
+    pose.partRotations[AvatarPose::Head] = glm::angleAxis(std::asin(glm::clamp(-forward.y, -1.0f, 1.0f)), glm::vec3{1.0f, 0.0f, 0.0f});
+    return pose;
+}
+
+} // namespace
+
+DesktopGuiSystem::DesktopGuiSystem(const DesktopGuiConfig &config)
+    : config{config}, frameLimiter{config.frameRateLimit}, latencyRecorder{config.reportLatency},
+      camera{glm::vec3(0.0f, 1.3f, -0.9f), glm::vec3(-0.5f, 0.5f, 0.0f)} {
     if (!glfwInit())
         __GLFW_ERROR_THROW
 
@@ -13,20 +40,218 @@ DesktopGuiSystem::DesktopGuiSystem() {
     if (!window)
         __GLFW_ERROR_THROW
 
-    graphicManager = std::make_unique<VulkanManagerGlfw>(window);
+    glfwSetWindowUserPointer(window, this);
+    glfwSetFramebufferSizeCallback(window, onFramebufferSize);
+    glfwSetWindowIconifyCallback(window, onWindowIconify);
+    glfwSetCursorPosCallback(window, onCursorPos);
+    glfwSetMouseButtonCallback(window, onMouseButton);
+    glfwSetScrollCallback(window, onScroll);
+
+    {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        input.framebufferWidth = width;
+        input.framebufferHeight = height;
+    }
+    {
+        // used to express idle time as skipped frames
+        const auto mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        const int refreshRate = mode && mode->refreshRate > 0 ? mode->refreshRate : 60;
+        nominalFramePeriod = std::chrono::duration_cast<FrameClock::duration>(std::chrono::duration<double>(1.0 / refreshRate));
+    }
+
+    AssetSettings assetSettings;
+    assetSettings.compression = config.fastTextureCompression ? TextureCompression::Fast : TextureCompression::Quality;
+    assetSettings.textureBudget = uint64_t(config.textureBudgetMiB) << 20;
+    assetSettings.modelBudget = uint64_t(config.modelBudgetMiB) << 20;
+    graphicManager = std::make_unique<VulkanManagerGlfw>(window, config.lowLatencyPresent, assetSettings);
     graphicManager->buildRenderTarget();
 }
 
 DesktopGuiSystem::~DesktopGuiSystem() {
+    graphicManager.reset();
     glfwTerminate();
 }
 
+void DesktopGuiSystem::onFramebufferSize(GLFWwindow *window, int width, int height) {
+    auto self = static_cast<DesktopGuiSystem *>(glfwGetWindowUserPointer(window));
+    self->input.framebufferWidth = width;
+    self->input.framebufferHeight = height;
+    self->input.resizeSerial++;
+    self->input.changeSerial++;
+}
+
+void DesktopGuiSystem::onWindowIconify(GLFWwindow *window, int iconified) {
+    auto self = static_cast<DesktopGuiSystem *>(glfwGetWindowUserPointer(window));
+    self->input.iconified = iconified == GLFW_TRUE;
+    self->input.changeSerial++;
+}
+
+void DesktopGuiSystem::onCursorPos(GLFWwindow *window, double x, double y) {
+    constexpr float rotateSpeed = 0.005f;
+    auto self = static_cast<DesktopGuiSystem *>(glfwGetWindowUserPointer(window));
+    if (self->dragging)
+        self->camera.rotate(float(x - self->lastCursorX) * rotateSpeed, float(y - self->lastCursorY) * rotateSpeed);
+    self->lastCursorX = x;
+    self->lastCursorY = y;
+}
+
+void DesktopGuiSystem::onMouseButton(GLFWwindow *window, int button, int action, int mods) {
+    auto self = static_cast<DesktopGuiSystem *>(glfwGetWindowUserPointer(window));
+    if (button == GLFW_MOUSE_BUTTON_LEFT)
+        self->dragging = action == GLFW_PRESS;
+}
+
+void DesktopGuiSystem::onScroll(GLFWwindow *window, double dx, double dy) {
+    auto self = static_cast<DesktopGuiSystem *>(glfwGetWindowUserPointer(window));
+    self->camera.zoom(std::pow(0.9f, float(dy)));
+}
+
+void DesktopGuiSystem::publishInput() {
+    input.pollTime = FrameClock::now();
+    const auto view = camera.view();
+    if (view != input.view)
+        input.changeSerial++;
+    input.view = view;
+    frameInput.write(input);
+
+    if (input.changeSerial != notifiedChangeSerial) {
+        notifiedChangeSerial = input.changeSerial;
+        renderWake.notify();
+    }
+}
+
+bool DesktopGuiSystem::waitForRedraw(FrameClock::time_point lastRender, bool idleForever) {
+    if (idleForever || config.minRefreshRate == 0)
+        return renderWake.wait();
+
+    const auto minRefreshInterval = std::chrono::duration_cast<FrameClock::duration>(std::chrono::duration<double>(1.0 / config.minRefreshRate));
+    return renderWake.waitUntil(lastRender + minRefreshInterval);
+}
+
+void DesktopGuiSystem::renderLoop() {
+    try {
+        uint32_t builtResizeSerial = 0, renderedChangeSerial = ~0u;
+        bool freshInput = false, redrawRequested = false;
+        auto lastRender = FrameClock::now();
+        auto lastPosePost = FrameClock::time_point{};
+        const auto posePostInterval = std::chrono::duration_cast<FrameClock::duration>(std::chrono::duration<double>(1.0 / poseSyncRate));
+        while (running) {
+            freshInput |= frameInput.fetch();
+            if (frameInput.readSlot().iconified || frameInput.readSlot().framebufferWidth == 0 || frameInput.readSlot().framebufferHeight == 0) {
+                // nothing can be presented; sleep until the window comes back
+                redrawRequested |= waitForRedraw(lastRender, true);
+                continue;
+            }
+
+            // remote avatars move on by themselves between snapshots, marking the scene dirty while they do
+            if (remoteAvatars)
+                remoteAvatars->update(graphicManager->getCore(), FrameClock::now());
+            // the network thread resends the newest pose every tick, so while nothing is drawn it stays put
+            if (roomChannel && FrameClock::now() - lastPosePost >= posePostInterval) {
+                lastPosePost = FrameClock::now();
+                roomChannel->postPose(cameraPose(frameInput.readSlot().view));
+            }
+
+            if (config.onDemandRendering) {
+                redrawRequested |= renderWake.consume();
+                bool dirty = redrawRequested ||
+                             frameInput.readSlot().changeSerial != renderedChangeSerial ||
+                             graphicManager->isSceneDirty() ||
+                             graphicManager->needsRebuildRenderTarget();
+                bool refreshDue = config.minRefreshRate != 0 &&
+                                  FrameClock::now() - lastRender >= std::chrono::duration<double>(1.0 / config.minRefreshRate);
+                if (!dirty && !refreshDue) {
+                    redrawRequested |= waitForRedraw(lastRender, false);
+                    continue;
+                }
+            }
+
+            frameLimiter.wait();
+
+            if (frameInput.readSlot().resizeSerial != builtResizeSerial || graphicManager->needsRebuildRenderTarget()) {
+                builtResizeSerial = frameInput.readSlot().resizeSerial;
+                graphicManager->buildRenderTarget();
+            }
+
+            if (!graphicManager->beginFrame())
+                continue;
+
+            // sample the latest input after the (possibly blocking) acquire
+            freshInput |= frameInput.fetch();
+            const auto &in = frameInput.readSlot();
+            graphicManager->setViewMatrix(in.view);
+            renderedChangeSerial = in.changeSerial;
+
+            const auto timing = graphicManager->render();
+            if (freshInput)
+                latencyRecorder.record(in.pollTime, timing);
+            freshInput = redrawRequested = false;
+
+            const auto idle = timing.present - lastRender;
+            if (idle > nominalFramePeriod)
+                framesSkipped += idle / nominalFramePeriod - 1;
+            framesRendered++;
+            lastRender = timing.present;
+        }
+    } catch (...) {
+        renderError = std::current_exception();
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+        glfwPostEmptyEvent();
+    }
+}
+
 void DesktopGuiSystem::mainLoop() {
+    running = true;
+    publishInput();
+    std::thread renderThread{[this]() { renderLoop(); }};
+
+    // window events are processed here without ever waiting for a frame to finish
     while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
+        glfwWaitEvents();
+        publishInput();
+    }
+
+    running = false;
+    renderWake.notify();
+    renderThread.join();
+    if (renderError)
+        std::rethrow_exception(renderError);
 
-        graphicManager->render();
+    if (config.reportNetwork && remoteAvatars && remoteAvatars->getStats().received > 0) {
+        const auto &stats = remoteAvatars->getStats();
+        std::clog << fmt::format("remote snapshots: {} received, {} late, {} samples extrapolated, {} held; playback delay {:.0f} ms (jitter {:.1f} ms)",
+                                 stats.received, stats.late, stats.extrapolated, stats.held, stats.delay * 1000.0f, stats.jitter * 1000.0f)
+                  << std::endl;
+    }
+    if (config.onDemandRendering)
+        std::clog << fmt::format("frames rendered: {}, frames skipped: {}", framesRendered, framesSkipped) << std::endl;
+    if (config.reportAnimation) {
+        const auto &scheduler = graphicManager->getAnimationScheduler();
+        std::clog << fmt::format("skeleton evaluations per frame: avg {:.1f}, peak {}", scheduler.averageEvaluated(), scheduler.peakEvaluated()) << std::endl;
+    }
+    if (config.reportTextures) {
+        // models load in the background, so only now has every texture been through the transcoder
+        const auto transcoded = graphicManager->getTextureStats();
+        std::clog << fmt::format("textures: {} ({} from cache), {:.1f} MiB saved by block compression ({:.1f} -> {:.1f} MiB), encoded at {:.1f} Mpixel/s",
+                                 transcoded.textures, transcoded.cacheHits, transcoded.savedBytes() / 1048576.0, transcoded.uncompressedBytes / 1048576.0,
+                                 transcoded.compressedBytes / 1048576.0, transcoded.megapixelsPerSecond())
+                  << std::endl;
+        const auto &residency = graphicManager->getTextureResidency();
+        const auto &stats = residency.getStats();
+        std::clog << fmt::format("texture residency: {:.1f} MiB (peak {:.1f}) of {:.1f} MiB budget, {} streamed in, {} evicted",
+                                 stats.residentBytes / 1048576.0, stats.peakBytes / 1048576.0, residency.getBudget() / 1048576.0,
+                                 stats.streamedIn, stats.evicted)
+                  << std::endl;
+    }
+    if (config.reportModels) {
+        const auto &residency = graphicManager->getModelResidency();
+        const auto &stats = residency.getStats();
+        std::clog << fmt::format("model residency: {:.1f} MiB (peak {:.1f}) of {:.1f} MiB budget, {} reloaded, {} evicted",
+                                 stats.residentBytes / 1048576.0, stats.peakBytes / 1048576.0, residency.getBudget() / 1048576.0,
+                                 stats.loaded, stats.evicted)
+                  << std::endl;
     }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,17 +1,66 @@
 #include <GLFW/glfw3.h>
+#include <atomic>
+#include <exception>
 #include <stdexcept>
 #include <memory>
+#include <optional>
+#include "../concurrent/TripleBuffer.hpp"
+#include "../communicate/RemoteAvatars.hpp"
+#include "../concurrent/WakeSignal.hpp"
 #include "../graphics/IGraphics.hpp"
 #include "../graphics/vulkan/VulkanGlfwAdapter.hpp"
+#include "DesktopConfig.hpp"
+#include "DesktopInput.hpp"
+#include "FrameTiming.hpp"
 
 class DesktopGuiSystem {
   private:
     GLFWwindow *window;
     pIGraphics g;
     std::unique_ptr<VulkanManagerGlfw> graphicManager;
+    DesktopGuiConfig config;
+    FrameLimiter frameLimiter;
+    LatencyRecorder latencyRecorder;
+
+    // owned by the event thread
+    DesktopCamera camera;
+    DesktopFrameInput input;
+    double lastCursorX = 0.0, lastCursorY = 0.0;
+    bool dragging = false;
+    uint32_t notifiedChangeSerial = ~0u;
+
+    // event thread -> render thread
+    TripleBuffer<DesktopFrameInput> frameInput;
+    WakeSignal renderWake;
+    std::atomic<bool> running{false};
+    std::exception_ptr renderError;
+
+    // on-demand rendering statistics, owned by the render thread
+    FrameClock::duration nominalFramePeriod;
+    std::optional<RemoteAvatars> remoteAvatars;
+    // where our avatar, as the camera shows it, is posted up to the room at poseSyncRate
+    RoomChannel *roomChannel = nullptr;
+    uint64_t framesRendered = 0, framesSkipped = 0;
+
+    static void onFramebufferSize(GLFWwindow *window, int width, int height);
+    static void onWindowIconify(GLFWwindow *window, int iconified);
+    static void onCursorPos(GLFWwindow *window, double x, double y);
+    static void onMouseButton(GLFWwindow *window, int button, int action, int mods);
+    static void onScroll(GLFWwindow *window, double dx, double dy);
+
+    void publishInput();
+    void renderLoop();
+    bool waitForRedraw(FrameClock::time_point lastRender, bool idleForever);
   public:
-    DesktopGuiSystem();
+    DesktopGuiSystem(const DesktopGuiConfig &config = loadDesktopGuiConfigFromEnv());
     ~DesktopGuiSystem();
 
     void mainLoop();
+    // thread-safe; makes the next frame render even if nothing local has changed (e.g. on network updates)
+    void requestRedraw() { renderWake.notify(); }
+    // before mainLoop(): shows the avatars of the room the channel's network thread receives
+    void setRoomChannel(RoomChannel &channel) {
+        remoteAvatars.emplace(channel);
+        roomChannel = &channel;
+    }
 };
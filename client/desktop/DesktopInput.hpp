@@ -0,0 +1,44 @@
+#pragma once
+
+#include "FrameTiming.hpp"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+class DesktopCamera {
+    glm::vec3 target;
+    float yaw, pitch, distance;
+
+  public:
+    DesktopCamera(glm::vec3 eye, glm::vec3 target) : target{target} {
+        auto d = eye - target;
+        distance = glm::length(d);
+        yaw = std::atan2(d.x, d.z);
+        pitch = std::asin(d.y / distance);
+    }
+
+    void rotate(float dYaw, float dPitch) {
+        constexpr float pitchLimit = glm::radians(89.0f);
+        yaw += dYaw;
+        pitch = glm::clamp(pitch + dPitch, -pitchLimit, pitchLimit);
+    }
+    void zoom(float factor) {
+        distance = glm::clamp(distance * factor, 0.2f, 20.0f);
+    }
+
+    glm::mat4 view() const {
+        glm::vec3 eye = target + distance * glm::vec3(std::cos(pitch) * std::sin(yaw), std::sin(pitch), std::cos(pitch) * std::cos(yaw));
+        return glm::lookAt(eye, target, glm::vec3(0.0f, -1.0f, 0.0f));
+    }
+};
+
+// Snapshot handed from the event thread to the render thread
+struct DesktopFrameInput {
+    FrameClock::time_point pollTime;
+    glm::mat4 view;
+    uint32_t framebufferWidth = 0, framebufferHeight = 0;
+    // incremented on every framebuffer resize
+    uint32_t resizeSerial = 0;
+    // incremented whenever anything affecting the rendered image changed
+    uint32_t changeSerial = 0;
+    bool iconified = false;
+};
@@ -0,0 +1,72 @@
+#include "FrameTiming.hpp"
+#include <algorithm>
+#include <fmt/format.h>
+#include <iostream>
+#include <thread>
+
+FrameLimiter::FrameLimiter(uint32_t frameRateLimit)
+    : interval{frameRateLimit == 0 ? FrameClock::duration::zero()
+                                   : std::chrono::duration_cast<FrameClock::duration>(std::chrono::duration<double>(1.0 / frameRateLimit))},
+      next{FrameClock::now()} {}
+
+void FrameLimiter::wait() {
+    if (interval == FrameClock::duration::zero())
+        return;
+
+    auto now = FrameClock::now();
+    if (now < next) {
+        std::this_thread::sleep_until(next);
+        next += interval;
+    } else {
+        // fell behind; don't try to catch up with a burst of frames
+        next = now + interval;
+    }
+}
+
+LatencyRecorder::LatencyRecorder(bool enabled, FrameClock::duration reportInterval)
+    : lastReport{FrameClock::now()}, reportInterval{reportInterval}, enabled{enabled} {}
+
+void LatencyRecorder::record(FrameClock::time_point inputPoll, const PresentTiming &timing) {
+    if (!enabled)
+        return;
+
+    using ms = std::chrono::duration<float, std::milli>;
+    inputToSubmitMs.push_back(ms(timing.submit - inputPoll).count());
+    inputToPresentMs.push_back(ms(timing.present - inputPoll).count());
+
+    if (timing.present - lastReport >= reportInterval) {
+        report();
+        lastReport = timing.present;
+    }
+}
+
+namespace {
+
+float percentile(std::vector<float> &samples, float p) {
+    auto nth = samples.begin() + std::min(samples.size() - 1, size_t(p * samples.size()));
+    std::nth_element(samples.begin(), nth, samples.end());
+    return *nth;
+}
+
+} // namespace
+
+void LatencyRecorder::report() {
+    if (inputToPresentMs.empty())
+        return;
+
+    const auto frames = inputToPresentMs.size();
+    const auto submitP50 = percentile(inputToSubmitMs, 0.5f);
+    const auto [minIt, maxIt] = std::minmax_element(inputToPresentMs.begin(), inputToPresentMs.end());
+    const auto minMs = *minIt, maxMs = *maxIt;
+
+    std::clog << fmt::format("input->present latency ({} frames): min {:.2f}ms, p50 {:.2f}ms, p90 {:.2f}ms, p99 {:.2f}ms, max {:.2f}ms (input->submit p50 {:.2f}ms)",
+                             frames, minMs,
+                             percentile(inputToPresentMs, 0.5f),
+                             percentile(inputToPresentMs, 0.9f),
+                             percentile(inputToPresentMs, 0.99f),
+                             maxMs, submitP50)
+              << std::endl;
+
+    inputToSubmitMs.clear();
+    inputToPresentMs.clear();
+}
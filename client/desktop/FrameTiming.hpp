@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+using FrameClock = std::chrono::steady_clock;
+
+struct PresentTiming {
+    FrameClock::time_point submit;
+    FrameClock::time_point present;
+};
+
+// Sleeps until the next frame slot. Called right before input is sampled,
+// so that the waiting does not happen between input sampling and present.
+class FrameLimiter {
+    FrameClock::duration interval;
+    FrameClock::time_point next;
+
+  public:
+    explicit FrameLimiter(uint32_t frameRateLimit);
+
+    void wait();
+};
+
+class LatencyRecorder {
+    std::vector<float> inputToSubmitMs;
+    std::vector<float> inputToPresentMs;
+    FrameClock::time_point lastReport;
+    FrameClock::duration reportInterval;
+    bool enabled;
+
+    void report();
+
+  public:
+    explicit LatencyRecorder(bool enabled, FrameClock::duration reportInterval = std::chrono::seconds(5));
+
+    void record(FrameClock::time_point inputPoll, const PresentTiming &timing);
+};
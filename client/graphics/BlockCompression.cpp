@@ -0,0 +1,369 @@
+#include "BlockCompression.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+using Texels = float[16][4];
+
+// BC7 4-bit index interpolation weights, in 64ths
+constexpr uint32_t bc7Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+float clampChannel(float v) {
+    return std::min(std::max(v, 0.0f), 255.0f);
+}
+
+// endpoints of the line through the texels' first n channels that best fits them (principal axis by power iteration)
+void fitLine(const Texels texels, int n, float lo[4], float hi[4]) {
+    float mean[4] = {};
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < n; c++)
+            mean[c] += texels[i][c] / 16.0f;
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; i++)
+        for (int a = 0; a < n; a++)
+            for (int b = 0; b < n; b++)
+                cov[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+
+    // start from the covariance column of the widest channel so anti-correlated channels keep their sign
+    int widest = 0;
+    for (int c = 1; c < n; c++)
+        if (cov[c][c] > cov[widest][widest])
+            widest = c;
+    float axis[4] = {};
+    for (int c = 0; c < n; c++)
+        axis[c] = cov[c][widest];
+    for (int iter = 0; iter < 8; iter++) {
+        float next[4] = {}, len = 0.0f;
+        for (int a = 0; a < n; a++) {
+            for (int b = 0; b < n; b++)
+                next[a] += cov[a][b] * axis[b];
+            len += next[a] * next[a];
+        }
+        if (len < 1e-12f)
+            break;
+        len = std::sqrt(len);
+        for (int c = 0; c < n; c++)
+            axis[c] = next[c] / len;
+    }
+    float axisLen = 0.0f;
+    for (int c = 0; c < n; c++)
+        axisLen += axis[c] * axis[c];
+    if (axisLen < 1e-12f) {
+        // flat block
+        for (int c = 0; c < n; c++)
+            lo[c] = hi[c] = mean[c];
+        return;
+    }
+    axisLen = std::sqrt(axisLen);
+    for (int c = 0; c < n; c++)
+        axis[c] /= axisLen;
+
+    float tMin = 0.0f, tMax = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < n; c++)
+            t += (texels[i][c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for (int c = 0; c < n; c++) {
+        lo[c] = clampChannel(mean[c] + axis[c] * tMin);
+        hi[c] = clampChannel(mean[c] + axis[c] * tMax);
+    }
+}
+
+float distanceSq(const float *a, const float *b, int n) {
+    float d = 0.0f;
+    for (int c = 0; c < n; c++)
+        d += (a[c] - b[c]) * (a[c] - b[c]);
+    return d;
+}
+
+uint16_t packRgb565(const float c[3]) {
+    const auto r = static_cast<uint16_t>(std::lround(c[0] * 31.0f / 255.0f));
+    const auto g = static_cast<uint16_t>(std::lround(c[1] * 63.0f / 255.0f));
+    const auto b = static_cast<uint16_t>(std::lround(c[2] * 31.0f / 255.0f));
+    return (r << 11) | (g << 5) | b;
+}
+
+void unpackRgb565(uint16_t packed, float c[3]) {
+    const uint32_t r = packed >> 11, g = (packed >> 5) & 0x3f, b = packed & 0x1f;
+    c[0] = static_cast<float>((r << 3) | (r >> 2));
+    c[1] = static_cast<float>((g << 2) | (g >> 4));
+    c[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+void writeLE(uint8_t *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+// BC1 colour block, always in 4-colour mode (also the colour half of BC3)
+void encodeColorBlock(const Texels texels, uint8_t *out) {
+    float lo[4], hi[4];
+    fitLine(texels, 3, lo, hi);
+    uint16_t c0 = packRgb565(hi), c1 = packRgb565(lo);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        float palette[4][3];
+        unpackRgb565(c0, palette[0]);
+        unpackRgb565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+        for (int i = 0; i < 16; i++) {
+            uint32_t best = 0;
+            float bestErr = distanceSq(texels[i], palette[0], 3);
+            for (uint32_t p = 1; p < 4; p++) {
+                const float err = distanceSq(texels[i], palette[p], 3);
+                if (err < bestErr) {
+                    bestErr = err;
+                    best = p;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+    writeLE(out, c0, 2);
+    writeLE(out + 2, c1, 2);
+    writeLE(out + 4, indices, 4);
+}
+
+// BC3 alpha block in 8-value mode: a0 > a1, indices 2..7 step from a0 towards a1
+void encodeAlphaBlock(const Texels texels, uint8_t *out) {
+    float aMin = 255.0f, aMax = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        aMin = std::min(aMin, texels[i][3]);
+        aMax = std::max(aMax, texels[i][3]);
+    }
+    const auto a0 = static_cast<uint8_t>(std::lround(aMax)), a1 = static_cast<uint8_t>(std::lround(aMin));
+
+    uint64_t indices = 0;
+    if (a0 > a1) {
+        for (int i = 0; i < 16; i++) {
+            const auto step = std::lround((a0 - texels[i][3]) / (a0 - a1) * 7.0f);
+            const uint64_t index = step <= 0 ? 0 : step >= 7 ? 1 : step + 1;
+            indices |= index << (3 * i);
+        }
+    }
+    out[0] = a0;
+    out[1] = a1;
+    writeLE(out + 2, indices, 6);
+}
+
+struct Bc7Endpoint {
+    uint8_t q[4]; // 7 bits per channel
+    uint8_t p;    // shared lowest bit
+    uint32_t decoded(int c) const { return (q[c] << 1) | p; }
+};
+
+Bc7Endpoint quantizeBc7(const float e[4]) {
+    Bc7Endpoint best{};
+    float bestErr = -1.0f;
+    for (uint8_t p = 0; p < 2; p++) {
+        Bc7Endpoint candidate{};
+        candidate.p = p;
+        float err = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            candidate.q[c] = static_cast<uint8_t>(std::clamp<long>(std::lround((e[c] - p) / 2.0f), 0, 127));
+            const float d = static_cast<float>(candidate.decoded(c)) - e[c];
+            err += d * d;
+        }
+        if (bestErr < 0.0f || err < bestErr) {
+            bestErr = err;
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+float assignBc7Indices(const Texels texels, const Bc7Endpoint &e0, const Bc7Endpoint &e1, uint8_t indices[16]) {
+    float palette[16][4];
+    for (int w = 0; w < 16; w++)
+        for (int c = 0; c < 4; c++)
+            palette[w][c] = static_cast<float>(((64 - bc7Weights[w]) * e0.decoded(c) + bc7Weights[w] * e1.decoded(c) + 32) >> 6);
+
+    float total = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        uint8_t best = 0;
+        float bestErr = distanceSq(texels[i], palette[0], 4);
+        for (uint8_t w = 1; w < 16; w++) {
+            const float err = distanceSq(texels[i], palette[w], 4);
+            if (err < bestErr) {
+                bestErr = err;
+                best = w;
+            }
+        }
+        indices[i] = best;
+        total += bestErr;
+    }
+    return total;
+}
+
+// least-squares endpoints for fixed indices; false if the indices don't span a line
+bool refineBc7Endpoints(const Texels texels, const uint8_t indices[16], float e0[4], float e1[4]) {
+    float a = 0.0f, b = 0.0f, cc = 0.0f, x[4] = {}, y[4] = {};
+    for (int i = 0; i < 16; i++) {
+        const float t = bc7Weights[indices[i]] / 64.0f, s = 1.0f - t;
+        a += s * s;
+        b += s * t;
+        cc += t * t;
+        for (int c = 0; c < 4; c++) {
+            x[c] += s * texels[i][c];
+            y[c] += t * texels[i][c];
+        }
+    }
+    const float det = a * cc - b * b;
+    if (std::abs(det) < 1e-6f)
+        return false;
+    for (int c = 0; c < 4; c++) {
+        e0[c] = clampChannel((cc * x[c] - b * y[c]) / det);
+        e1[c] = clampChannel((a * y[c] - b * x[c]) / det);
+    }
+    return true;
+}
+
+struct BitWriter {
+    uint8_t *out;
+    uint32_t pos = 0;
+    void put(uint32_t value, uint32_t bits) {
+        for (uint32_t b = 0; b < bits; b++, pos++)
+            if ((value >> b) & 1)
+                out[pos >> 3] |= 1 << (pos & 7);
+    }
+};
+
+void encodeBc7Block(const Texels texels, uint8_t *out) {
+    float lo[4], hi[4];
+    fitLine(texels, 4, lo, hi);
+    Bc7Endpoint e0 = quantizeBc7(lo), e1 = quantizeBc7(hi);
+    uint8_t indices[16];
+    float err = assignBc7Indices(texels, e0, e1, indices);
+
+    for (int iter = 0; iter < 2; iter++) {
+        float r0[4], r1[4];
+        if (!refineBc7Endpoints(texels, indices, r0, r1))
+            break;
+        const Bc7Endpoint n0 = quantizeBc7(r0), n1 = quantizeBc7(r1);
+        uint8_t nextIndices[16];
+        const float nextErr = assignBc7Indices(texels, n0, n1, nextIndices);
+        if (nextErr >= err)
+            break;
+        e0 = n0;
+        e1 = n1;
+        err = nextErr;
+        std::memcpy(indices, nextIndices, sizeof(indices));
+    }
+
+    // the first texel's index is stored without its top bit
+    if (indices[0] & 8) {
+        std::swap(e0, e1);
+        for (auto &index : indices)
+            index = 15 - index;
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter writer{out};
+    writer.put(1 << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        writer.put(e0.q[c], 7);
+        writer.put(e1.q[c], 7);
+    }
+    writer.put(e0.p, 1);
+    writer.put(e1.p, 1);
+    writer.put(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        writer.put(indices[i], 4);
+}
+
+const std::array<float, 256> &srgbToLinearTable() {
+    static const auto table = []() {
+        std::array<float, 256> t;
+        for (int i = 0; i < 256; i++) {
+            const float v = i / 255.0f;
+            t[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+        }
+        return t;
+    }();
+    return table;
+}
+
+uint8_t linearToSrgb(float v) {
+    v = std::min(std::max(v, 0.0f), 1.0f);
+    const float s = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(std::lround(s * 255.0f));
+}
+
+} // namespace
+
+void encodeBlock(BlockFormat format, const uint8_t *texels, uint8_t *out) {
+    float block[16][4];
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 4; c++)
+            block[i][c] = texels[i * 4 + c];
+
+    switch (format) {
+    case BlockFormat::BC1:
+        encodeColorBlock(block, out);
+        break;
+    case BlockFormat::BC3:
+        encodeAlphaBlock(block, out);
+        encodeColorBlock(block, out + 8);
+        break;
+    case BlockFormat::BC7:
+        encodeBc7Block(block, out);
+        break;
+    }
+}
+
+void encodeBlockRows(BlockFormat format, const uint8_t *rgba, uint32_t width, uint32_t height, uint32_t firstRow, uint32_t lastRow, uint8_t *out) {
+    const uint32_t blocksX = blockCount(width);
+    uint8_t texels[64];
+    for (uint32_t by = firstRow; by < lastRow; by++) {
+        for (uint32_t bx = 0; bx < blocksX; bx++) {
+            for (uint32_t y = 0; y < 4; y++) {
+                const uint32_t sy = std::min(by * 4 + y, height - 1);
+                for (uint32_t x = 0; x < 4; x++) {
+                    const uint32_t sx = std::min(bx * 4 + x, width - 1);
+                    std::memcpy(texels + (y * 4 + x) * 4, rgba + (size_t(sy) * width + sx) * 4, 4);
+                }
+            }
+            encodeBlock(format, texels, out + (size_t(by) * blocksX + bx) * blockBytes(format));
+        }
+    }
+}
+
+std::vector<uint8_t> downsampleSrgb(const uint8_t *rgba, uint32_t width, uint32_t height) {
+    const auto &toLinear = srgbToLinearTable();
+    const uint32_t w = std::max(width / 2, 1u), h = std::max(height / 2, 1u);
+    std::vector<uint8_t> dst(size_t(w) * h * 4);
+    for (uint32_t y = 0; y < h; y++) {
+        const uint32_t y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+        for (uint32_t x = 0; x < w; x++) {
+            const uint32_t x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+            const uint8_t *src[4] = {rgba + (size_t(y0) * width + x0) * 4, rgba + (size_t(y0) * width + x1) * 4,
+                                     rgba + (size_t(y1) * width + x0) * 4, rgba + (size_t(y1) * width + x1) * 4};
+            uint8_t *texel = dst.data() + (size_t(y) * w + x) * 4;
+            for (int c = 0; c < 3; c++)
+                texel[c] = linearToSrgb((toLinear[src[0][c]] + toLinear[src[1][c]] + toLinear[src[2][c]] + toLinear[src[3][c]]) * 0.25f);
+            texel[3] = static_cast<uint8_t>((src[0][3] + src[1][3] + src[2][3] + src[3][3] + 2) / 4);
+        }
+    }
+    return dst;
+}
+
+bool hasTranslucentTexels(const uint8_t *rgba, size_t texelCount) {
+    for (size_t i = 0; i < texelCount; i++)
+        if (rgba[i * 4 + 3] != 255)
+            return true;
+    return false;
+}
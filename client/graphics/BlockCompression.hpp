@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU encoders for the BCn block formats. Every block covers 4x4 texels of RGBA8 data.
+enum class BlockFormat {
+    BC1, // 8 bytes per block, opaque colour
+    BC3, // 16 bytes per block, BC1 colour plus interpolated alpha
+    BC7, // 16 bytes per block, mode 6 only: one RGBA line with 4-bit indices
+};
+
+constexpr size_t blockBytes(BlockFormat format) {
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+// texels: 16 RGBA8 texels in row order; out: blockBytes(format) bytes
+void encodeBlock(BlockFormat format, const uint8_t *texels, uint8_t *out);
+
+// encodes block rows [firstRow, lastRow) of a width x height RGBA8 image into out, which holds the whole level.
+// Edge blocks repeat the last texel row and column.
+void encodeBlockRows(BlockFormat format, const uint8_t *rgba, uint32_t width, uint32_t height, uint32_t firstRow, uint32_t lastRow, uint8_t *out);
+
+constexpr uint32_t blockCount(uint32_t texels) {
+    return (texels + 3) / 4;
+}
+
+// halves an sRGB RGBA8 image with a box filter, averaging colour in linear space
+std::vector<uint8_t> downsampleSrgb(const uint8_t *rgba, uint32_t width, uint32_t height);
+
+bool hasTranslucentTexels(const uint8_t *rgba, size_t texelCount);
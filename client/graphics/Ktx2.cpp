@@ -0,0 +1,194 @@
+#include "Ktx2.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+constexpr size_t headerSize = 80; // identifier, header and index up to the level index
+constexpr size_t levelIndexEntrySize = 24;
+
+// VkFormat values
+constexpr uint32_t formatBc1RgbSrgb = 132;
+constexpr uint32_t formatBc3Srgb = 138;
+constexpr uint32_t formatBc7Srgb = 146;
+
+// Khronos data format descriptor values
+constexpr uint8_t modelBc1a = 128, modelBc3 = 130, modelBc7 = 134;
+constexpr uint8_t primariesBt709 = 1;
+constexpr uint8_t transferSrgb = 2;
+constexpr uint8_t channelColor = 0, channelBc3Alpha = 15;
+constexpr uint8_t sampleLinear = 0x10;
+
+struct FormatInfo {
+    uint8_t model;
+    uint32_t blockBytes;
+};
+
+std::optional<FormatInfo> formatInfo(uint32_t vkFormat) {
+    switch (vkFormat) {
+    case formatBc1RgbSrgb:
+        return FormatInfo{modelBc1a, 8};
+    case formatBc3Srgb:
+        return FormatInfo{modelBc3, 16};
+    case formatBc7Srgb:
+        return FormatInfo{modelBc7, 16};
+    default:
+        return std::nullopt;
+    }
+}
+
+uint64_t levelBytes(const FormatInfo &info, uint32_t width, uint32_t height, uint32_t level) {
+    const uint64_t w = std::max(width >> level, 1u), h = std::max(height >> level, 1u);
+    return ((w + 3) / 4) * ((h + 3) / 4) * info.blockBytes;
+}
+
+void put32(std::vector<uint8_t> &out, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void put64(std::vector<uint8_t> &out, uint64_t value) {
+    put32(out, static_cast<uint32_t>(value));
+    put32(out, static_cast<uint32_t>(value >> 32));
+}
+
+uint32_t get32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+uint64_t get64(const uint8_t *p) {
+    return get32(p) | (uint64_t(get32(p + 4)) << 32);
+}
+
+std::vector<uint8_t> buildDfd(const FormatInfo &info) {
+    struct Sample {
+        uint16_t bitOffset;
+        uint8_t bitLength;
+        uint8_t channel;
+    };
+    std::vector<Sample> samples;
+    if (info.model == modelBc3) {
+        samples.push_back({0, 64, uint8_t(channelBc3Alpha | sampleLinear)});
+        samples.push_back({64, 64, channelColor});
+    } else {
+        samples.push_back({0, uint8_t(info.blockBytes * 8), channelColor});
+    }
+
+    const uint32_t blockSize = 24 + 16 * uint32_t(samples.size());
+    std::vector<uint8_t> dfd;
+    put32(dfd, 4 + blockSize);
+    put32(dfd, 0);                       // vendor: Khronos, type: basic
+    put32(dfd, 2 | (blockSize << 16));   // version 1.3
+    dfd.insert(dfd.end(), {info.model, primariesBt709, transferSrgb, 0});
+    dfd.insert(dfd.end(), {3, 3, 0, 0}); // 4x4x1x1 texel block
+    dfd.insert(dfd.end(), {uint8_t(info.blockBytes), 0, 0, 0, 0, 0, 0, 0});
+    for (const auto &sample : samples) {
+        put32(dfd, sample.bitOffset | (uint32_t(sample.bitLength - 1) << 16) | (uint32_t(sample.channel) << 24));
+        put32(dfd, 0);
+        put32(dfd, 0);
+        put32(dfd, 0xFFFFFFFF);
+    }
+    return dfd;
+}
+
+} // namespace
+
+void writeKtx2(const std::filesystem::path &path, const Ktx2Texture &texture) {
+    const auto info = formatInfo(texture.vkFormat);
+    if (!info)
+        throw std::runtime_error("unsupported KTX2 format");
+    const auto levelCount = static_cast<uint32_t>(texture.levels.size());
+
+    const auto dfd = buildDfd(*info);
+    const size_t dfdOffset = headerSize + levelIndexEntrySize * levelCount;
+    auto align = [&](size_t offset) { return (offset + info->blockBytes - 1) / info->blockBytes * info->blockBytes; };
+
+    // level data is stored smallest mip first
+    std::vector<uint64_t> levelOffsets(levelCount);
+    size_t end = dfdOffset + dfd.size();
+    for (uint32_t level = levelCount; level-- > 0;) {
+        levelOffsets[level] = align(end);
+        end = levelOffsets[level] + texture.levels[level].size();
+    }
+
+    std::vector<uint8_t> out(identifier, identifier + sizeof(identifier));
+    put32(out, texture.vkFormat);
+    put32(out, 1); // typeSize
+    put32(out, texture.width);
+    put32(out, texture.height);
+    put32(out, 0); // pixelDepth
+    put32(out, 0); // layerCount
+    put32(out, 1); // faceCount
+    put32(out, levelCount);
+    put32(out, 0); // no supercompression
+    put32(out, static_cast<uint32_t>(dfdOffset));
+    put32(out, static_cast<uint32_t>(dfd.size()));
+    put32(out, 0); // no key/value data
+    put32(out, 0);
+    put64(out, 0); // no supercompression global data
+    put64(out, 0);
+    for (uint32_t level = 0; level < levelCount; level++) {
+        put64(out, levelOffsets[level]);
+        put64(out, texture.levels[level].size());
+        put64(out, texture.levels[level].size());
+    }
+    out.insert(out.end(), dfd.begin(), dfd.end());
+    for (uint32_t level = levelCount; level-- > 0;) {
+        out.resize(levelOffsets[level], 0);
+        out.insert(out.end(), texture.levels[level].begin(), texture.levels[level].end());
+    }
+
+    // written aside and renamed so a reader never sees a partial file; the name is unique per call
+    // since two loads may cache the same texture at once
+    static std::atomic<uint32_t> tmpCounter{0};
+    auto tmpPath = path;
+    tmpPath += "." + std::to_string(tmpCounter++) + ".tmp";
+    {
+        std::ofstream file{tmpPath, std::ios::binary | std::ios::trunc};
+        if (!file)
+            throw std::runtime_error("failed to open " + tmpPath.string());
+        file.write(reinterpret_cast<const char *>(out.data()), out.size());
+        if (!file)
+            throw std::runtime_error("failed to write " + tmpPath.string());
+    }
+    std::filesystem::rename(tmpPath, path);
+}
+
+std::optional<Ktx2Texture> readKtx2(const std::filesystem::path &path) {
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    if (!file)
+        return std::nullopt;
+    std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(data.data()), data.size());
+    if (!file || data.size() < headerSize || std::memcmp(data.data(), identifier, sizeof(identifier)) != 0)
+        return std::nullopt;
+
+    Ktx2Texture texture;
+    texture.vkFormat = get32(&data[12]);
+    texture.width = get32(&data[20]);
+    texture.height = get32(&data[24]);
+    const uint32_t depth = get32(&data[28]), layers = get32(&data[32]), faces = get32(&data[36]);
+    const uint32_t levelCount = get32(&data[40]), supercompression = get32(&data[44]);
+
+    const auto info = formatInfo(texture.vkFormat);
+    if (!info || depth != 0 || layers != 0 || faces != 1 || supercompression != 0 || texture.width == 0 || texture.height == 0)
+        return std::nullopt;
+    if (levelCount == 0 || levelCount > 32 || data.size() < headerSize + levelIndexEntrySize * levelCount)
+        return std::nullopt;
+
+    texture.levels.resize(levelCount);
+    for (uint32_t level = 0; level < levelCount; level++) {
+        const uint8_t *entry = &data[headerSize + levelIndexEntrySize * level];
+        const uint64_t offset = get64(entry), length = get64(entry + 8);
+        if (length != levelBytes(*info, texture.width, texture.height, level) || offset > data.size() || length > data.size() - offset)
+            return std::nullopt;
+        texture.levels[level].assign(data.begin() + offset, data.begin() + offset + length);
+    }
+    return texture;
+}
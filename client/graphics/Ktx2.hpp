@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+// Minimal KTX2 container for a single 2D block-compressed texture with its mip chain, no supercompression.
+struct Ktx2Texture {
+    uint32_t vkFormat; // VkFormat value; only BC1 RGB, BC3 and BC7 (sRGB) are written
+    uint32_t width, height;
+    std::vector<std::vector<uint8_t>> levels; // level 0 first
+};
+
+void writeKtx2(const std::filesystem::path &path, const Ktx2Texture &texture);
+// nullopt if the file is missing, truncated or not a texture writeKtx2 could have produced
+std::optional<Ktx2Texture> readKtx2(const std::filesystem::path &path);
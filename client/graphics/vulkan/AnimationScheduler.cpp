@@ -0,0 +1,80 @@
+#include "AnimationScheduler.hpp"
+#include <algorithm>
+
+uint32_t AnimationScheduler::chooseInterval(float pixels, bool visible) {
+    if (!visible)
+        return maxInterval;
+    if (pixels >= 200.0f)
+        return 1;
+    if (pixels >= 100.0f)
+        return 2;
+    if (pixels >= 40.0f)
+        return 4;
+    return 8;
+}
+
+void AnimationScheduler::assignInterval(Entry &entry, uint32_t interval) {
+    if (entry.interval == interval)
+        return;
+    if (entry.interval != 0)
+        phaseLoad[entry.interval][entry.phase]--;
+
+    auto &load = phaseLoad[interval];
+    load.resize(interval, 0);
+    entry.interval = interval;
+    entry.phase = std::min_element(load.begin(), load.end()) - load.begin();
+    load[entry.phase]++;
+}
+
+void AnimationScheduler::remove(uint32_t avatarId) {
+    auto it = entries.find(avatarId);
+    if (it == entries.end())
+        return;
+    if (it->second.interval != 0)
+        phaseLoad[it->second.interval][it->second.phase]--;
+    entries.erase(it);
+}
+
+void AnimationScheduler::beginFrame() {
+    frameStats = FrameStats{};
+}
+
+AnimationScheduler::Action AnimationScheduler::schedule(uint32_t avatarId, float pixels, bool visible, uint64_t frame) {
+    auto [it, inserted] = entries.try_emplace(avatarId);
+    auto &entry = it->second;
+    assignInterval(entry, chooseInterval(pixels, visible));
+    // small but visible avatars still move smoothly; far or hidden ones just hold their pose
+    entry.smooth = visible && entry.interval > 1 && entry.interval <= 4;
+
+    Action action;
+    if (inserted || (frame + entry.phase) % entry.interval == 0 || frame - entry.lastEvaluated >= entry.interval) {
+        entry.lastEvaluated = frame;
+        action = Action::Evaluate;
+    } else {
+        action = entry.smooth ? Action::Interpolate : Action::Reuse;
+    }
+
+    switch (action) {
+    case Action::Evaluate:
+        frameStats.evaluated++;
+        break;
+    case Action::Interpolate:
+        frameStats.interpolated++;
+        break;
+    case Action::Reuse:
+        frameStats.reused++;
+        break;
+    }
+    return action;
+}
+
+void AnimationScheduler::endFrame() {
+    totalEvaluated += frameStats.evaluated;
+    maxEvaluated = std::max<uint64_t>(maxEvaluated, frameStats.evaluated);
+    frames++;
+}
+
+float AnimationScheduler::interpolationFactor(uint32_t avatarId, uint64_t frame) const {
+    const auto &entry = entries.at(avatarId);
+    return std::min(1.0f, float(frame - entry.lastEvaluated) / float(entry.interval));
+}
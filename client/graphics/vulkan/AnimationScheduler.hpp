@@ -0,0 +1,64 @@
+#ifndef VULKAN_ANIMATION_SCHEDULER_HPP
+#define VULKAN_ANIMATION_SCHEDULER_HPP
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+// Decides how often each avatar's skeleton is evaluated.
+// The interval follows on-screen size and visibility; avatars sharing an interval are spread over its phases
+// so the number of evaluations per frame stays flat instead of spiking every N frames.
+class AnimationScheduler {
+  public:
+    enum class Action {
+        Evaluate,    // evaluate the skeleton from the latest pose
+        Interpolate, // blend between the last two evaluated palettes
+        Reuse,       // keep the last palette
+    };
+
+    struct FrameStats {
+        uint32_t evaluated = 0;
+        uint32_t interpolated = 0;
+        uint32_t reused = 0;
+    };
+
+    static constexpr uint32_t maxInterval = 16;
+
+  private:
+    struct Entry {
+        uint32_t interval = 0;
+        uint32_t phase = 0;
+        uint64_t lastEvaluated = 0;
+        bool smooth = false;
+    };
+
+    std::unordered_map<uint32_t, Entry> entries;
+    // number of avatars per phase, for each interval in use
+    std::map<uint32_t, std::vector<uint32_t>> phaseLoad;
+
+    FrameStats frameStats;
+    uint64_t totalEvaluated = 0, maxEvaluated = 0, frames = 0;
+
+    void assignInterval(Entry &entry, uint32_t interval);
+
+  public:
+    static uint32_t chooseInterval(float pixels, bool visible);
+
+    void remove(uint32_t avatarId);
+
+    void beginFrame();
+    Action schedule(uint32_t avatarId, float pixels, bool visible, uint64_t frame);
+    void endFrame();
+
+    // Smoothed avatars are shown blending from the previous evaluated palette to the latest one over the interval,
+    // including on evaluation frames, so they trail by one interval but never jump.
+    bool isSmoothed(uint32_t avatarId) const { return entries.at(avatarId).smooth; }
+    float interpolationFactor(uint32_t avatarId, uint64_t frame) const;
+
+    const FrameStats &getFrameStats() const { return frameStats; }
+    double averageEvaluated() const { return frames ? double(totalEvaluated) / frames : 0.0; }
+    uint64_t peakEvaluated() const { return maxEvaluated; }
+};
+
+#endif // VULKAN_ANIMATION_SCHEDULER_HPP
@@ -12,27 +12,40 @@ Buffer::Buffer(vk::PhysicalDevice physDevice, vk::Device device, vk::DeviceSize
     vk::MemoryAllocateInfo allocInfo;
     allocInfo.allocationSize = memReq.size;
     allocInfo.memoryTypeIndex = findMemoryTypeIndex(physDevice, memFlagReq, memReq).value();
+    vk::MemoryAllocateFlagsInfo allocFlagsInfo{vk::MemoryAllocateFlagBits::eDeviceAddress};
+    if (usage & vk::BufferUsageFlagBits::eShaderDeviceAddress)
+        allocInfo.pNext = &allocFlagsInfo;
     memory = device.allocateMemoryUnique(allocInfo);
 
     device.bindBufferMemory(buffer.get(), memory.get(), 0);
 }
 
-ReadonlyBuffer::ReadonlyBuffer(vk::PhysicalDevice physDevice, vk::Device device, vk::Queue queue, vk::CommandBuffer cmdBuf, const void *datSrc, vk::DeviceSize sz, vk::BufferUsageFlags usage, vk::Fence fence)
+ReadonlyBuffer::ReadonlyBuffer(vk::PhysicalDevice physDevice, vk::Device device, vk::BufferUsageFlags usage, vk::DeviceSize sz)
     : Buffer{physDevice, device, sz, usage | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal} {
-    write(physDevice, device, queue, cmdBuf, datSrc, sz, 0, fence);
 }
 
-ReadonlyBuffer::ReadonlyBuffer(vk::PhysicalDevice physDevice, vk::Device device, vk::BufferUsageFlags usage, vk::DeviceSize sz)
-    : Buffer{physDevice, device, sz, usage | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal} {
+void ReadonlyBuffer::recordWrite(vk::CommandBuffer cmdBuf, vk::Buffer srcBuf, vk::DeviceSize srcOffset, vk::DeviceSize sz, vk::DeviceSize dstOffset) {
+    vk::BufferCopy bufCopy;
+    bufCopy.size = sz;
+    bufCopy.srcOffset = srcOffset;
+    bufCopy.dstOffset = dstOffset;
+    cmdBuf.copyBuffer(srcBuf, buffer.get(), {bufCopy});
+}
+
+StagingBuffer::StagingBuffer(vk::PhysicalDevice physDevice, vk::Device device, vk::DeviceSize sz)
+    : Buffer{physDevice, device, sz, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent},
+      device{device} {
+    pMem = device.mapMemory(memory.get(), 0, sz);
 }
 
-void ReadonlyBuffer::write(vk::PhysicalDevice physDevice, vk::Device device, vk::Queue queue, vk::CommandBuffer cmdBuf, const void *datSrc, vk::DeviceSize sz, vk::DeviceSize offset, vk::Fence fence) {
-    Buffer stagingBuf{physDevice, device, sz, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible};
-    device.waitForFences({fence}, true, UINT64_MAX);
-    device.resetFences({fence});
-    writeByMemoryMapping(device, stagingBuf.getMemory(), datSrc, sz, 0);
-    writeByBufferCopy(device, cmdBuf, queue, stagingBuf.getBuffer(), buffer.get(), sz, 0, offset, fence);
-    device.waitForFences({fence}, true, UINT64_MAX);
+StagingBuffer::StagingBuffer(StagingBuffer &&buf)
+    : Buffer(std::move(buf)), device(buf.device), pMem(buf.pMem) {
+    buf.pMem = nullptr;
+}
+
+StagingBuffer::~StagingBuffer() {
+    if (pMem)
+        device.unmapMemory(memory.get());
 }
 
 CommunicationBuffer::CommunicationBuffer(vk::PhysicalDevice physDevice, vk::Device device, vk::DeviceSize sz, vk::BufferUsageFlags usage)
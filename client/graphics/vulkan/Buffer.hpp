@@ -16,14 +16,28 @@ class Buffer {
 
     vk::Buffer getBuffer() { return buffer.get(); };
     vk::DeviceMemory getMemory() { return memory.get(); };
+    // requires vk::BufferUsageFlagBits::eShaderDeviceAddress
+    vk::DeviceAddress getDeviceAddress(vk::Device device) { return device.getBufferAddress(vk::BufferDeviceAddressInfo{buffer.get()}); };
 };
 
 class ReadonlyBuffer : public Buffer {
   public:
-    ReadonlyBuffer(vk::PhysicalDevice physDevice, vk::Device device, vk::Queue queue, vk::CommandBuffer cmdBuf, const void *datSrc, vk::DeviceSize sz, vk::BufferUsageFlags usage, vk::Fence fence);
     ReadonlyBuffer(vk::PhysicalDevice physDevice, vk::Device device, vk::BufferUsageFlags usage, vk::DeviceSize sz);
     ReadonlyBuffer(ReadonlyBuffer&&) = default;
-    void write(vk::PhysicalDevice physDevice, vk::Device device, vk::Queue queue, vk::CommandBuffer cmdBuf, const void *datSrc, vk::DeviceSize sz, vk::DeviceSize dstOffset, vk::Fence fence);
+    // records a copy of staged data into the buffer; see TransferQueue
+    void recordWrite(vk::CommandBuffer cmdBuf, vk::Buffer srcBuf, vk::DeviceSize srcOffset, vk::DeviceSize sz, vk::DeviceSize dstOffset);
+};
+
+// host-visible and coherent, mapped for as long as it lives; uploads are copied from here
+class StagingBuffer : public Buffer {
+    vk::Device device;
+    void *pMem;
+
+  public:
+    StagingBuffer(vk::PhysicalDevice physDevice, vk::Device device, vk::DeviceSize sz);
+    StagingBuffer(StagingBuffer&&);
+    ~StagingBuffer();
+    void *get() const { return pMem; };
 };
 
 class CommunicationBuffer : public Buffer {
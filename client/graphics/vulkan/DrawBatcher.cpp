@@ -0,0 +1,59 @@
+#include "DrawBatcher.hpp"
+
+void DrawBatcher::add(const MeshRange &range, const ShaderVariant &variant, uint32_t meshIndex) {
+    auto [it, inserted] = batchIndices.try_emplace(BatchKey{variant, range}, uint32_t(batches.size()));
+    if (inserted)
+        batches.push_back(Batch{range, {}});
+
+    auto &batch = batches[it->second];
+    locations[meshIndex] = {it->second, uint32_t(batch.meshIndices.size())};
+    batch.meshIndices.push_back(meshIndex);
+    dirty = true;
+}
+
+void DrawBatcher::remove(uint32_t meshIndex) {
+    auto it = locations.find(meshIndex);
+    if (it == locations.end())
+        return;
+
+    auto [batchIndex, position] = it->second;
+    auto &indices = batches[batchIndex].meshIndices;
+    // swap with the last instance; the order of instances within a batch doesn't matter
+    indices[position] = indices.back();
+    locations[indices[position]].second = position;
+    indices.pop_back();
+    locations.erase(it);
+    dirty = true;
+}
+
+bool DrawBatcher::rebuild() {
+    if (!dirty)
+        return false;
+
+    draws.clear();
+    instanceTable.clear();
+    groups.clear();
+    // the map is ordered by variant first, so draws of one variant come out contiguous
+    for (const auto &[key, batchIndex] : batchIndices) {
+        const auto &batch = batches[batchIndex];
+        if (batch.meshIndices.empty())
+            continue;
+
+        const auto &variant = key.first;
+        if (groups.empty() || variant < groups.back().variant || groups.back().variant < variant)
+            groups.push_back(DrawGroup{variant, uint32_t(draws.size()), 0});
+        groups.back().drawCount++;
+
+        vk::DrawIndexedIndirectCommand drawCmd;
+        drawCmd.vertexOffset = batch.range.vertexOffset;
+        drawCmd.firstIndex = batch.range.firstIndex;
+        drawCmd.indexCount = batch.range.indexCount;
+        drawCmd.firstInstance = instanceTable.size();
+        drawCmd.instanceCount = batch.meshIndices.size();
+        draws.push_back(drawCmd);
+
+        instanceTable.insert(instanceTable.end(), batch.meshIndices.begin(), batch.meshIndices.end());
+    }
+    dirty = false;
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef VULKAN_DRAW_BATCHER_HPP
+#define VULKAN_DRAW_BATCHER_HPP
+
+#include "ShaderVariant.hpp"
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+// Collapses draws of the same index range into one instanced indirect command.
+// Each instance is identified by a mesh record index; the instance table maps gl_InstanceIndex to that record.
+// Draws are ordered by shader variant so a renderer binds each pipeline once.
+class DrawBatcher {
+  public:
+    struct MeshRange {
+        int32_t vertexOffset;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+
+        bool operator<(const MeshRange &rhs) const {
+            return std::tie(vertexOffset, firstIndex, indexCount) < std::tie(rhs.vertexOffset, rhs.firstIndex, rhs.indexCount);
+        }
+    };
+
+  private:
+    using BatchKey = std::pair<ShaderVariant, MeshRange>;
+
+    struct Batch {
+        MeshRange range;
+        std::vector<uint32_t> meshIndices;
+    };
+
+    std::map<BatchKey, uint32_t> batchIndices;
+    std::vector<Batch> batches;
+    // mesh record index -> (batch, position in batch), for O(1) removal
+    std::unordered_map<uint32_t, std::pair<uint32_t, uint32_t>> locations;
+
+    std::vector<vk::DrawIndexedIndirectCommand> draws;
+    std::vector<uint32_t> instanceTable;
+    std::vector<DrawGroup> groups;
+    bool dirty = false;
+
+  public:
+    void add(const MeshRange &range, const ShaderVariant &variant, uint32_t meshIndex);
+    void remove(uint32_t meshIndex);
+
+    // regenerates draws and the instance table if instances were added or removed since the last call
+    bool rebuild();
+
+    const std::vector<vk::DrawIndexedIndirectCommand> &getDraws() const { return draws; }
+    const std::vector<uint32_t> &getInstanceTable() const { return instanceTable; }
+    const std::vector<DrawGroup> &getGroups() const { return groups; }
+};
+
+#endif // VULKAN_DRAW_BATCHER_HPP
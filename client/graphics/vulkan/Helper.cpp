@@ -1,4 +1,5 @@
 #include "Helper.hpp"
+#include <algorithm>
 #include <fstream>
 
 std::optional<UsingQueueSet> chooseSuitableQueueSet(const std::vector<vk::QueueFamilyProperties> queueProps) {
@@ -18,7 +19,7 @@ std::optional<UsingQueueSet> chooseSuitableQueueSet(const std::vector<vk::QueueF
     return props;
 }
 
-vk::UniqueImageView createImageViewFromImage(vk::Device device, const vk::Image &image, vk::Format format, uint32_t arrayNum, vk::ImageAspectFlags aspect) {
+vk::UniqueImageView createImageViewFromImage(vk::Device device, const vk::Image &image, vk::Format format, uint32_t arrayNum, vk::ImageAspectFlags aspect, uint32_t mipLevels) {
     vk::ImageViewCreateInfo imgViewCreateInfo;
     imgViewCreateInfo.image = image;
     imgViewCreateInfo.viewType = vk::ImageViewType::e2D;
@@ -29,13 +30,20 @@ vk::UniqueImageView createImageViewFromImage(vk::Device device, const vk::Image
     imgViewCreateInfo.components.a = vk::ComponentSwizzle::eIdentity;
     imgViewCreateInfo.subresourceRange.aspectMask = aspect;
     imgViewCreateInfo.subresourceRange.baseMipLevel = 0;
-    imgViewCreateInfo.subresourceRange.levelCount = 1;
+    imgViewCreateInfo.subresourceRange.levelCount = mipLevels;
     imgViewCreateInfo.subresourceRange.baseArrayLayer = 0;
     imgViewCreateInfo.subresourceRange.layerCount = arrayNum;
 
     return device.createImageViewUnique(imgViewCreateInfo);
 }
 
+uint32_t calcMipLevels(vk::Extent3D extent) {
+    uint32_t levels = 1;
+    for (auto size = std::max(extent.width, extent.height); size > 1; size /= 2)
+        levels++;
+    return levels;
+}
+
 std::vector<vk::UniqueImageView> createImageViewsFromImages(vk::Device device, const std::vector<vk::Image> &images, vk::Format format, vk::ImageAspectFlags aspect) {
     std::vector<vk::UniqueImageView> imageViews(images.size());
 
@@ -171,29 +179,41 @@ void writeByBufferCopy(vk::Device device, vk::CommandBuffer cmdBuf, vk::Queue qu
     cmdBuf.copyBuffer(srcBuf, dstBuf, {bufCopy});
 }
 
-void writeByBufferToImageCopy(vk::Device device, vk::CommandBuffer cmdBuf, vk::Queue queue, vk::Buffer srcBuf, vk::Image dstImg, vk::Extent3D extent, uint32_t arrayNum, vk::DeviceSize srcOffset, vk::Fence fence) {
+namespace {
+
+void transitionLevels(vk::CommandBuffer cmdBuf, vk::Image image, uint32_t arrayNum, uint32_t baseLevel, uint32_t levelCount, vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+                      vk::AccessFlags srcAccess, vk::AccessFlags dstAccess, vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage) {
+    vk::ImageMemoryBarrier barrior;
+    barrior.oldLayout = oldLayout;
+    barrior.newLayout = newLayout;
+    barrior.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrior.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrior.image = image;
+    barrior.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+    barrior.subresourceRange.baseMipLevel = baseLevel;
+    barrior.subresourceRange.levelCount = levelCount;
+    barrior.subresourceRange.baseArrayLayer = 0;
+    barrior.subresourceRange.layerCount = arrayNum;
+    barrior.srcAccessMask = srcAccess;
+    barrior.dstAccessMask = dstAccess;
+    cmdBuf.pipelineBarrier(srcStage, dstStage, vk::DependencyFlags{}, {}, {}, {barrior});
+}
+
+} // namespace
+
+void writeByBufferToImageCopy(vk::Device device, vk::CommandBuffer cmdBuf, vk::Queue queue, vk::Buffer srcBuf, vk::Image dstImg, vk::Extent3D extent, uint32_t arrayNum, vk::DeviceSize srcOffset, vk::Fence fence, uint32_t mipLevels) {
     CommandExec cmd{cmdBuf, queue, fence};
 
-    {
-        vk::ImageMemoryBarrier barrior;
-        barrior.oldLayout = vk::ImageLayout::eUndefined;
-        barrior.newLayout = vk::ImageLayout::eTransferDstOptimal;
-        barrior.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrior.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrior.image = dstImg;
-        barrior.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-        barrior.subresourceRange.baseMipLevel = 0;
-        barrior.subresourceRange.levelCount = 1;
-        barrior.subresourceRange.baseArrayLayer = 0;
-        barrior.subresourceRange.layerCount = arrayNum;
-        barrior.srcAccessMask = {};
-        barrior.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
-                               vk::DependencyFlags{}, {}, {}, {barrior});
-    }
+    auto levelBarrier = [&](uint32_t baseLevel, uint32_t levelCount, vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+                            vk::AccessFlags srcAccess, vk::AccessFlags dstAccess, vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage) {
+        transitionLevels(cmdBuf, dstImg, arrayNum, baseLevel, levelCount, oldLayout, newLayout, srcAccess, dstAccess, srcStage, dstStage);
+    };
+
+    levelBarrier(0, mipLevels, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+                 {}, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer);
 
     vk::BufferImageCopy bufimgCopy;
-    bufimgCopy.bufferOffset = 0;
+    bufimgCopy.bufferOffset = srcOffset;
     bufimgCopy.bufferRowLength = 0;
     bufimgCopy.bufferImageHeight = 0;
 
@@ -207,21 +227,64 @@ void writeByBufferToImageCopy(vk::Device device, vk::CommandBuffer cmdBuf, vk::Q
 
     cmdBuf.copyBufferToImage(srcBuf, dstImg, vk::ImageLayout::eTransferDstOptimal, {bufimgCopy});
 
-    {
-        vk::ImageMemoryBarrier barrior;
-        barrior.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-        barrior.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-        barrior.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrior.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrior.image = dstImg;
-        barrior.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-        barrior.subresourceRange.baseMipLevel = 0;
-        barrior.subresourceRange.levelCount = 1;
-        barrior.subresourceRange.baseArrayLayer = 0;
-        barrior.subresourceRange.layerCount = arrayNum;
-        barrior.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-        barrior.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
-                               vk::DependencyFlags{}, {}, {}, {barrior});
+    // each level is read back as the source of the next one, then handed to the shaders
+    int32_t width = extent.width, height = extent.height;
+    for (uint32_t level = 1; level < mipLevels; level++) {
+        levelBarrier(level - 1, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal,
+                     vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer);
+
+        const int32_t nextWidth = std::max(width / 2, 1), nextHeight = std::max(height / 2, 1);
+        vk::ImageBlit blit;
+        blit.srcSubresource = vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, level - 1, 0, arrayNum};
+        blit.srcOffsets[1] = vk::Offset3D{width, height, 1};
+        blit.dstSubresource = vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, level, 0, arrayNum};
+        blit.dstOffsets[1] = vk::Offset3D{nextWidth, nextHeight, 1};
+        cmdBuf.blitImage(dstImg, vk::ImageLayout::eTransferSrcOptimal, dstImg, vk::ImageLayout::eTransferDstOptimal, {blit}, vk::Filter::eLinear);
+
+        levelBarrier(level - 1, 1, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+                     vk::AccessFlagBits::eTransferRead, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader);
+        width = nextWidth;
+        height = nextHeight;
+    }
+
+    levelBarrier(mipLevels - 1, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+                 vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader);
+}
+
+void recordLevelsUpload(vk::CommandBuffer cmdBuf, vk::Buffer srcBuf, const std::vector<vk::DeviceSize> &levelOffsets, vk::Image copySrc, uint32_t copySrcLevel,
+                        vk::Image dstImg, vk::Extent3D extent, uint32_t levelCount) {
+    const auto hostLevels = static_cast<uint32_t>(levelOffsets.size());
+    const auto copiedLevels = levelCount - hostLevels;
+    auto levelExtent = [&](uint32_t level) { return vk::Extent3D{std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u), 1}; };
+
+    transitionLevels(cmdBuf, dstImg, 1, 0, levelCount, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+                     {}, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer);
+
+    if (hostLevels) {
+        std::vector<vk::BufferImageCopy> copies(hostLevels);
+        for (uint32_t level = 0; level < hostLevels; level++) {
+            copies[level].bufferOffset = levelOffsets[level];
+            copies[level].imageSubresource = vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, level, 0, 1};
+            copies[level].imageExtent = levelExtent(level);
+        }
+        cmdBuf.copyBufferToImage(srcBuf, dstImg, vk::ImageLayout::eTransferDstOptimal, copies);
+    }
+
+    if (copiedLevels) {
+        // frames submitted earlier may still be sampling it; the ones after find it back as it was
+        transitionLevels(cmdBuf, copySrc, 1, copySrcLevel, copiedLevels, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eTransferSrcOptimal,
+                         {}, vk::AccessFlagBits::eTransferRead, vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eTransfer);
+        std::vector<vk::ImageCopy> copies(copiedLevels);
+        for (uint32_t i = 0; i < copiedLevels; i++) {
+            copies[i].srcSubresource = vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, copySrcLevel + i, 0, 1};
+            copies[i].dstSubresource = vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, hostLevels + i, 0, 1};
+            copies[i].extent = levelExtent(hostLevels + i);
+        }
+        cmdBuf.copyImage(copySrc, vk::ImageLayout::eTransferSrcOptimal, dstImg, vk::ImageLayout::eTransferDstOptimal, copies);
+        transitionLevels(cmdBuf, copySrc, 1, copySrcLevel, copiedLevels, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+                         {}, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader);
     }
+
+    transitionLevels(cmdBuf, dstImg, 1, 0, levelCount, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+                     vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader);
 }
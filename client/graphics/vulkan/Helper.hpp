@@ -16,7 +16,9 @@ struct SwapchainDetails {
 };
 
 std::optional<UsingQueueSet> chooseSuitableQueueSet(const std::vector<vk::QueueFamilyProperties> queueProps);
-vk::UniqueImageView createImageViewFromImage(vk::Device device, const vk::Image &image, vk::Format format, uint32_t arrayNum, vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor);
+vk::UniqueImageView createImageViewFromImage(vk::Device device, const vk::Image &image, vk::Format format, uint32_t arrayNum, vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor, uint32_t mipLevels = 1);
+// levels of a full mip chain down to 1x1
+uint32_t calcMipLevels(vk::Extent3D extent);
 std::vector<vk::UniqueImageView> createImageViewsFromImages(vk::Device device, const std::vector<vk::Image> &images, vk::Format format, vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor);
 std::vector<vk::UniqueFramebuffer> createFrameBufsFromImageView(vk::Device device, vk::RenderPass renderpass, vk::Extent2D extent, const std::vector<std::reference_wrapper<const std::vector<vk::UniqueImageView>>> imageViews);
 
@@ -58,4 +60,10 @@ struct CommandExec {
 std::optional<uint32_t> findMemoryTypeIndex(vk::PhysicalDevice physDevice, std::optional<vk::MemoryPropertyFlags> memFlagReq, std::optional<vk::MemoryRequirements> memReq);
 void writeByMemoryMapping(vk::Device device, vk::DeviceMemory memory, const void *src, size_t sz, vk::DeviceSize dstOffset);
 void writeByBufferCopy(vk::Device device, vk::CommandBuffer cmdBuf, vk::Queue queue, vk::Buffer srcBuf, vk::Buffer dstBuf, vk::DeviceSize sz, vk::DeviceSize srcOffset, vk::DeviceSize dstOffset, vk::Fence fence);
-void writeByBufferToImageCopy(vk::Device device, vk::CommandBuffer cmdBuf, vk::Queue queue, vk::Buffer srcBuf, vk::Image dstImg, vk::Extent3D extent, uint32_t arrayNum, vk::DeviceSize srcOffset, vk::Fence fence);
+// copies into mip 0 and, with mipLevels > 1, fills the rest of the chain by blitting each level from the previous one
+void writeByBufferToImageCopy(vk::Device device, vk::CommandBuffer cmdBuf, vk::Queue queue, vk::Buffer srcBuf, vk::Image dstImg, vk::Extent3D extent, uint32_t arrayNum, vk::DeviceSize srcOffset, vk::Fence fence, uint32_t mipLevels = 1);
+// records filling the levelCount levels of a precomputed mip chain (e.g. block-compressed) into dstImg, whose level 0 is extent:
+// the first levelOffsets.size() from srcBuf, level i at levelOffsets[i], the rest copied from copySrc starting at its level copySrcLevel.
+// copySrc is left in shader read layout for the frames sampling it, before and after.
+void recordLevelsUpload(vk::CommandBuffer cmdBuf, vk::Buffer srcBuf, const std::vector<vk::DeviceSize> &levelOffsets, vk::Image copySrc, uint32_t copySrcLevel,
+                        vk::Image dstImg, vk::Extent3D extent, uint32_t levelCount);
@@ -2,11 +2,25 @@
 #include "Buffer.hpp"
 #include "Helper.hpp"
 
-Image::Image(vk::PhysicalDevice physDevice, vk::Device device, vk::Extent3D extent, uint32_t arrayNum, vk::Format format, vk::ImageUsageFlags usage, std::optional<vk::MemoryPropertyFlags> memFlagReq) {
+namespace {
+
+uint32_t chooseMipLevels(vk::PhysicalDevice physDevice, vk::Format format, vk::Extent3D extent, bool withMips) {
+    if (!withMips)
+        return 1;
+    const auto features = physDevice.getFormatProperties(format).optimalTilingFeatures;
+    if (!(features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear) || !(features & vk::FormatFeatureFlagBits::eBlitSrc) || !(features & vk::FormatFeatureFlagBits::eBlitDst))
+        return 1;
+    return calcMipLevels(extent);
+}
+
+} // namespace
+
+Image::Image(vk::PhysicalDevice physDevice, vk::Device device, vk::Extent3D extent, uint32_t arrayNum, vk::Format format, vk::ImageUsageFlags usage, std::optional<vk::MemoryPropertyFlags> memFlagReq, uint32_t mipLevels)
+    : format{format}, mipLevels{mipLevels} {
     vk::ImageCreateInfo imgCreateInfo;
     imgCreateInfo.imageType = vk::ImageType::e2D;
     imgCreateInfo.extent = extent;
-    imgCreateInfo.mipLevels = 1;
+    imgCreateInfo.mipLevels = mipLevels;
     imgCreateInfo.arrayLayers = arrayNum;
     imgCreateInfo.format = format;
     imgCreateInfo.tiling = vk::ImageTiling::eOptimal;
@@ -25,11 +39,16 @@ Image::Image(vk::PhysicalDevice physDevice, vk::Device device, vk::Extent3D exte
     device.bindImageMemory(image.get(), memory.get(), 0);
 }
 
-ReadonlyImage::ReadonlyImage(vk::PhysicalDevice physDevice, vk::Device device, vk::Queue queue, vk::CommandBuffer cmdBuf, void *datSrc, vk::Extent3D extent, uint32_t arrayNum, vk::ImageUsageFlags usage, vk::Fence fence)
-    : Image{physDevice, device, extent, arrayNum, vk::Format::eR8G8B8A8Srgb, usage | vk::ImageUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal} {
+ReadonlyImage::ReadonlyImage(vk::PhysicalDevice physDevice, vk::Device device, vk::Queue queue, vk::CommandBuffer cmdBuf, void *datSrc, vk::Extent3D extent, uint32_t arrayNum, vk::ImageUsageFlags usage, vk::Fence fence, bool withMips)
+    : Image{physDevice, device, extent, arrayNum, vk::Format::eR8G8B8A8Srgb, usage | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eDeviceLocal,
+            chooseMipLevels(physDevice, vk::Format::eR8G8B8A8Srgb, extent, withMips)} {
     write(physDevice, device, queue, cmdBuf, datSrc, extent, arrayNum, 0, fence);
 }
 
+ReadonlyImage::ReadonlyImage(vk::PhysicalDevice physDevice, vk::Device device, vk::Format format, vk::Extent3D extent, uint32_t mipLevels, vk::ImageUsageFlags usage)
+    : Image{physDevice, device, extent, 1, format, usage | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eDeviceLocal, mipLevels} {
+}
+
 ReadonlyImage::ReadonlyImage(vk::PhysicalDevice physDevice, vk::Device device, vk::Extent3D extent, uint32_t arrayNum, vk::ImageUsageFlags usage)
     : Image{physDevice, device, extent, arrayNum, vk::Format::eR8G8B8A8Srgb, usage | vk::ImageUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal} {
 }
@@ -40,6 +59,6 @@ void ReadonlyImage::write(vk::PhysicalDevice physDevice, vk::Device device, vk::
     device.waitForFences({fence}, true, UINT64_MAX);
     device.resetFences({fence});
     writeByMemoryMapping(device, stagingBuf.getMemory(), datSrc, sz, 0);
-    writeByBufferToImageCopy(device, cmdBuf, queue, stagingBuf.getBuffer(), image.get(), extent, arrayNum, offset, fence);
+    writeByBufferToImageCopy(device, cmdBuf, queue, stagingBuf.getBuffer(), image.get(), extent, arrayNum, offset, fence, mipLevels);
     device.waitForFences({fence}, true, UINT64_MAX);
 }
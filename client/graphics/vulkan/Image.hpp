@@ -3,6 +3,7 @@
 
 #include <array>
 #include <optional>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 
 class Image {
@@ -10,18 +11,25 @@ class Image {
     vk::UniqueImage image;
     vk::UniqueDeviceMemory memory;
     vk::Format format;
+    uint32_t mipLevels;
 
   public:
-    Image(vk::PhysicalDevice physDevice, vk::Device device, vk::Extent3D extent, uint32_t arrayNum, vk::Format format, vk::ImageUsageFlags usage, std::optional<vk::MemoryPropertyFlags> memFlagReq);
+    Image(vk::PhysicalDevice physDevice, vk::Device device, vk::Extent3D extent, uint32_t arrayNum, vk::Format format, vk::ImageUsageFlags usage, std::optional<vk::MemoryPropertyFlags> memFlagReq, uint32_t mipLevels = 1);
     Image(Image&&) = default;
 
     vk::Image getImage() const { return image.get(); };
     vk::DeviceMemory getMemory() const { return memory.get(); };
+    uint32_t getMipLevels() const { return mipLevels; };
+    vk::Format getFormat() const { return format; };
 };
 
 class ReadonlyImage : public Image {
   public:
-    ReadonlyImage(vk::PhysicalDevice physDevice, vk::Device device, vk::Queue queue, vk::CommandBuffer cmdBuf, void *datSrc, vk::Extent3D extent, uint32_t arrayNum, vk::ImageUsageFlags usage, vk::Fence fence);
+    // withMips: allocate a full chain and generate it from the data on upload (if the format can be blitted linearly)
+    ReadonlyImage(vk::PhysicalDevice physDevice, vk::Device device, vk::Queue queue, vk::CommandBuffer cmdBuf, void *datSrc, vk::Extent3D extent, uint32_t arrayNum, vk::ImageUsageFlags usage, vk::Fence fence, bool withMips = false);
+    // mipLevels levels of a precomputed mip chain in any format, e.g. block-compressed, left for recordLevelsUpload() to fill.
+    // Usable as a copy source, so that later uploads can take levels from it on the device.
+    ReadonlyImage(vk::PhysicalDevice physDevice, vk::Device device, vk::Format format, vk::Extent3D extent, uint32_t mipLevels, vk::ImageUsageFlags usage);
     ReadonlyImage(vk::PhysicalDevice physDevice, vk::Device device, vk::Extent3D extent, uint32_t arrayNum, vk::ImageUsageFlags usage);
     ReadonlyImage(ReadonlyImage&&) = default;
     void write(vk::PhysicalDevice physDevice, vk::Device device, vk::Queue queue, vk::CommandBuffer cmdBuf, void *datSrc, vk::Extent3D extent, uint32_t arrayNum, vk::DeviceSize offset, vk::Fence fence);
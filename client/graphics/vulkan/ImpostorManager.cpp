@@ -0,0 +1,215 @@
+#include "ImpostorManager.hpp"
+#include "Helper.hpp"
+#include "renderer/SimpleRenderProc.hpp"
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
+
+// mesh records per flight frame to start with; grown to the largest model baked
+constexpr uint32_t initialBakePrimitiveNum = 256;
+constexpr vk::Format atlasFormat = vk::Format::eR8G8B8A8Srgb;
+
+namespace {
+
+// must match octahedralEncode() in impostor.vert
+glm::vec3 octahedralDecode(glm::vec2 uv) {
+    glm::vec2 p = uv * 2.0f - 1.0f;
+    glm::vec3 dir{p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y)};
+    if (dir.z < 0.0f) {
+        glm::vec2 folded = (1.0f - glm::abs(glm::vec2{dir.y, dir.x})) * glm::vec2{dir.x >= 0.0f ? 1.0f : -1.0f, dir.y >= 0.0f ? 1.0f : -1.0f};
+        dir.x = folded.x;
+        dir.y = folded.y;
+    }
+    return glm::normalize(dir);
+}
+
+vk::UniqueRenderPass createBakeRenderPass(vk::Device device) {
+    vk::AttachmentDescription attachments[2];
+    attachments[0].format = atlasFormat;
+    attachments[0].samples = vk::SampleCountFlagBits::e1;
+    attachments[0].loadOp = vk::AttachmentLoadOp::eClear;
+    attachments[0].storeOp = vk::AttachmentStoreOp::eStore;
+    attachments[0].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+    attachments[0].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+    attachments[0].initialLayout = vk::ImageLayout::eUndefined;
+    attachments[0].finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    attachments[1].format = vk::Format::eD32Sfloat;
+    attachments[1].samples = vk::SampleCountFlagBits::e1;
+    attachments[1].loadOp = vk::AttachmentLoadOp::eClear;
+    attachments[1].storeOp = vk::AttachmentStoreOp::eDontCare;
+    attachments[1].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+    attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+    attachments[1].initialLayout = vk::ImageLayout::eUndefined;
+    attachments[1].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+
+    vk::AttachmentReference colorRef{0, vk::ImageLayout::eColorAttachmentOptimal};
+    vk::AttachmentReference depthRef{1, vk::ImageLayout::eDepthStencilAttachmentOptimal};
+
+    vk::SubpassDescription subpasses[1];
+    subpasses[0].pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+    subpasses[0].colorAttachmentCount = 1;
+    subpasses[0].pColorAttachments = &colorRef;
+    subpasses[0].pDepthStencilAttachment = &depthRef;
+
+    // the atlas may still be sampled by the previous frame, and the shared depth buffer written by the previous bake
+    vk::SubpassDependency dependency[2];
+    dependency[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency[0].dstSubpass = 0;
+    dependency[0].srcStageMask = vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eLateFragmentTests;
+    dependency[0].dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
+    dependency[0].srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+    dependency[0].dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+    dependency[1].srcSubpass = 0;
+    dependency[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependency[1].srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+    dependency[1].dstStageMask = vk::PipelineStageFlagBits::eFragmentShader;
+    dependency[1].srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+    dependency[1].dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+    vk::RenderPassCreateInfo renderpassCreateInfo;
+    renderpassCreateInfo.attachmentCount = std::size(attachments);
+    renderpassCreateInfo.pAttachments = attachments;
+    renderpassCreateInfo.subpassCount = std::size(subpasses);
+    renderpassCreateInfo.pSubpasses = subpasses;
+    renderpassCreateInfo.dependencyCount = std::size(dependency);
+    renderpassCreateInfo.pDependencies = dependency;
+
+    return device.createRenderPassUnique(renderpassCreateInfo);
+}
+
+} // namespace
+
+ImpostorManager::ImpostorManager(vk::PhysicalDevice physDevice, vk::Device device, vk::DescriptorPool pool,
+                                 vk::DescriptorSetLayout descLayout, vk::DescriptorSetLayout assetDescLayout, uint32_t flightFramesNum)
+    : physDevice{physDevice}, device{device}, flightFramesNum{flightFramesNum}, instanceCapacity{initialBakePrimitiveNum} {
+    pipelineLayout = createPipelineLayout(device, {descLayout, assetDescLayout});
+    renderpass = createBakeRenderPass(device);
+    pipelines.emplace(device, pipelineLayout.get(), renderpass.get(), std::nullopt);
+
+    const vk::Extent3D atlasExtent{gridSize * cellSize, gridSize * cellSize, 1};
+    depthImage.emplace(physDevice, device, atlasExtent, 1, vk::Format::eD32Sfloat, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    depthImageView = createImageViewFromImage(device, depthImage->getImage(), vk::Format::eD32Sfloat, 1, vk::ImageAspectFlagBits::eDepth);
+
+    cameraBuffer.emplace(physDevice, device, sizeof(SceneData) * gridSize * gridSize * flightFramesNum, vk::BufferUsageFlagBits::eUniformBuffer);
+    instanceBuffer.emplace(physDevice, device, sizeof(uint32_t) * instanceCapacity * flightFramesNum,
+                           vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+
+    vk::DescriptorSetAllocateInfo allocInfo;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descLayout;
+    descSet = std::move(device.allocateDescriptorSetsUnique(allocInfo)[0]);
+
+    vk::DescriptorBufferInfo cameraBufInfo{cameraBuffer->getBuffer(), 0, sizeof(SceneData)};
+    vk::WriteDescriptorSet writeDescSet;
+    writeDescSet.dstSet = descSet.get();
+    writeDescSet.dstBinding = 0;
+    writeDescSet.dstArrayElement = 0;
+    writeDescSet.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+    writeDescSet.descriptorCount = 1;
+    writeDescSet.pBufferInfo = &cameraBufInfo;
+    device.updateDescriptorSets({writeDescSet}, {});
+}
+
+uint32_t ImpostorManager::addAtlas(ModelManager &modelManager) {
+    const vk::Extent3D atlasExtent{gridSize * cellSize, gridSize * cellSize, 1};
+    Image color{physDevice, device, atlasExtent, 1, atlasFormat,
+                vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal};
+    auto view = createImageViewFromImage(device, color.getImage(), atlasFormat, 1);
+
+    vk::ImageView attachments[] = {view.get(), depthImageView.get()};
+    vk::FramebufferCreateInfo frameBufCreateInfo;
+    frameBufCreateInfo.width = atlasExtent.width;
+    frameBufCreateInfo.height = atlasExtent.height;
+    frameBufCreateInfo.layers = 1;
+    frameBufCreateInfo.renderPass = renderpass.get();
+    frameBufCreateInfo.attachmentCount = std::size(attachments);
+    frameBufCreateInfo.pAttachments = attachments;
+    auto framebuffer = device.createFramebufferUnique(frameBufCreateInfo);
+
+    auto textureIndex = modelManager.registerTexture(view.get());
+    atlases.push_back(Atlas{std::move(color), std::move(view), std::move(framebuffer), textureIndex});
+    return atlases.size() - 1;
+}
+
+bool ImpostorManager::needsBake(uint32_t atlas, uint64_t frame) const {
+    return !atlases[atlas].baked || frame - atlases[atlas].lastBakeFrame >= refreshInterval;
+}
+
+void ImpostorManager::bake(const RenderDetails &rd, uint32_t atlasIndex, const ModelManager::ModelInfo &model, const std::vector<uint32_t> &meshIndices,
+                           const std::vector<ShaderVariant> &variants, const glm::mat4 &modelMat, uint64_t frame) {
+    auto &atlas = atlases[atlasIndex];
+    const auto cmdBuf = rd.cmdBuf;
+    const auto primitiveNum = static_cast<uint32_t>(meshIndices.size());
+
+    while (!retiredInstanceBuffers.empty() && retiredInstanceBuffers.front().frame + flightFramesNum <= frame)
+        retiredInstanceBuffers.pop_front();
+    // frames in flight keep reading the old one
+    if (primitiveNum > instanceCapacity) {
+        retiredInstanceBuffers.push_back(RetiredInstanceBuffer{std::move(*instanceBuffer), frame});
+        instanceCapacity = primitiveNum;
+        instanceBuffer.emplace(physDevice, device, sizeof(uint32_t) * instanceCapacity * flightFramesNum,
+                               vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+    }
+
+    {
+        const glm::vec3 center = glm::vec3(modelMat * glm::vec4(model.boundsCenter, 1.0f));
+        const float r = model.boundsRadius;
+        SceneData *cameras = static_cast<SceneData *>(cameraBuffer->get()) + gridSize * gridSize * rd.flightIndex;
+        for (uint32_t y = 0; y < gridSize; y++) {
+            for (uint32_t x = 0; x < gridSize; x++) {
+                auto dir = glm::normalize(glm::mat3(modelMat) * octahedralDecode((glm::vec2(float(x), float(y)) + 0.5f) / float(gridSize)));
+                // same up vector as the desktop camera, so impostors aren't rolled relative to the billboard
+                glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, -1.0f, 0.0f);
+                cameras[y * gridSize + x].view = glm::lookAt(center + dir * 2.0f * r, center, up);
+                cameras[y * gridSize + x].proj = glm::ortho(-r, r, -r, r, -r, 3.0f * r);
+            }
+        }
+        std::copy_n(meshIndices.begin(), primitiveNum, static_cast<uint32_t *>(instanceBuffer->get()) + instanceCapacity * rd.flightIndex);
+        cameraBuffer.value().flush<1>(device, {{{0, VK_WHOLE_SIZE}}});
+        instanceBuffer.value().flush<1>(device, {{{0, VK_WHOLE_SIZE}}});
+    }
+
+    vk::ClearValue clearVal[2];
+    clearVal[0].color = vk::ClearColorValue{std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f}};
+    clearVal[1].depthStencil.depth = 1.0f;
+    clearVal[1].depthStencil.stencil = 0;
+
+    vk::RenderPassBeginInfo rpBeginInfo;
+    rpBeginInfo.renderPass = renderpass.get();
+    rpBeginInfo.framebuffer = atlas.framebuffer.get();
+    rpBeginInfo.renderArea = vk::Rect2D{{0, 0}, {gridSize * cellSize, gridSize * cellSize}};
+    rpBeginInfo.clearValueCount = std::size(clearVal);
+    rpBeginInfo.pClearValues = clearVal;
+
+    cmdBuf.beginRenderPass(rpBeginInfo, vk::SubpassContents::eInline);
+    cmdBuf.bindVertexBuffers(0,
+                             {rd.positionVertBuf, rd.normalVertBuf, rd.texcoordVertBuf[0], rd.jointsVertBuf[0], rd.weightsVertBuf[0]},
+                             {0, 0, 0, 0, 0});
+    cmdBuf.bindIndexBuffer(rd.indexBuf, 0, vk::IndexType::eUint32);
+
+    // the scene's buffers, except that instances index this bake's own mesh list
+    SceneBufferAddresses sceneBuffers = rd.sceneBuffers;
+    sceneBuffers.instances = instanceBuffer->getDeviceAddress(device) + sizeof(uint32_t) * instanceCapacity * rd.flightIndex;
+    cmdBuf.pushConstants(pipelineLayout.get(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(SceneBufferAddresses), &sceneBuffers);
+
+    for (uint32_t cell = 0; cell < gridSize * gridSize; cell++) {
+        vk::Viewport viewport{float(cell % gridSize * cellSize), float(cell / gridSize * cellSize), float(cellSize), float(cellSize), 0.0f, 1.0f};
+        vk::Rect2D scissor{{int32_t(cell % gridSize * cellSize), int32_t(cell / gridSize * cellSize)}, {cellSize, cellSize}};
+        cmdBuf.setViewport(0, {viewport});
+        cmdBuf.setScissor(0, {scissor});
+
+        const uint32_t cameraOffset = sizeof(SceneData) * (gridSize * gridSize * rd.flightIndex + cell);
+        cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout.get(), 0, {descSet.get(), rd.assetDescSet}, {cameraOffset});
+
+        // firstInstance selects the primitive's mesh record through the instance table
+        for (uint32_t i = 0; i < primitiveNum; i++) {
+            const auto &primitive = model.primitives[i];
+            cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines->get(variants[i]));
+            cmdBuf.drawIndexed(primitive.indexNum, 1, primitive.IndexBase, primitive.vertexBase, i);
+        }
+    }
+    cmdBuf.endRenderPass();
+
+    atlas.baked = true;
+    atlas.lastBakeFrame = frame;
+}
@@ -0,0 +1,77 @@
+#ifndef VULKAN_IMPOSTOR_MANAGER_HPP
+#define VULKAN_IMPOSTOR_MANAGER_HPP
+
+#include "Buffer.hpp"
+#include "Image.hpp"
+#include "ModelManager.hpp"
+#include "Render.hpp"
+#include "ScenePipelineCache.hpp"
+#include <deque>
+#include <vulkan/vulkan.hpp>
+
+// Bakes each model into an octahedral atlas: gridSize x gridSize views of the model, one per direction.
+// Distant avatars are drawn as a single quad textured with the cell nearest to the view direction.
+class ImpostorManager {
+  public:
+    static constexpr uint32_t gridSize = 8;
+    static constexpr uint32_t cellSize = 128;
+    // on-screen diameter in pixels below which an avatar switches to its impostor, and above which it switches back
+    static constexpr float enterPixels = 48.0f;
+    static constexpr float exitPixels = 64.0f;
+    // frames between re-bakes of an atlas while impostors using it are visible
+    static constexpr uint64_t refreshInterval = 30;
+
+  private:
+    struct Atlas {
+        Image color;
+        vk::UniqueImageView view;
+        vk::UniqueFramebuffer framebuffer;
+        uint32_t textureIndex;
+        uint64_t lastBakeFrame = 0;
+        bool baked = false;
+    };
+    // outgrown by a model with more primitives, released once no frame in flight reads it
+    struct RetiredInstanceBuffer {
+        CommunicationBuffer buffer;
+        uint64_t frame;
+    };
+
+    vk::PhysicalDevice physDevice;
+    vk::Device device;
+    uint32_t flightFramesNum;
+
+    vk::UniquePipelineLayout pipelineLayout;
+    vk::UniqueRenderPass renderpass;
+    std::optional<ScenePipelineCache> pipelines;
+
+    // shared by every atlas, bakes are recorded one after another
+    std::optional<Image> depthImage;
+    vk::UniqueImageView depthImageView;
+
+    // per flight frame: one SceneData per cell, and the mesh records of the avatar being baked, room for instanceCapacity
+    std::optional<CommunicationBuffer> cameraBuffer;
+    std::optional<CommunicationBuffer> instanceBuffer;
+    uint32_t instanceCapacity;
+    std::deque<RetiredInstanceBuffer> retiredInstanceBuffers;
+    vk::UniqueDescriptorSet descSet;
+
+    std::vector<Atlas> atlases;
+
+  public:
+    ImpostorManager(vk::PhysicalDevice physDevice, vk::Device device, vk::DescriptorPool pool,
+                    vk::DescriptorSetLayout descLayout, vk::DescriptorSetLayout assetDescLayout, uint32_t flightFramesNum);
+
+    // creates an atlas and registers it in the model texture array
+    uint32_t addAtlas(ModelManager &modelManager);
+    uint32_t getTextureIndex(uint32_t atlas) const { return atlases[atlas].textureIndex; }
+    bool needsBake(uint32_t atlas, uint64_t frame) const;
+    bool isBaked(uint32_t atlas) const { return atlases[atlas].baked; }
+
+    // renders the avatar owning meshIndices (with its current pose, morphs and transform) into the atlas; variants are
+    // what the main pass draws each primitive with. At most one bake per frame: the per-flight camera and instance regions
+    // are reused by every bake.
+    void bake(const RenderDetails &rd, uint32_t atlas, const ModelManager::ModelInfo &model, const std::vector<uint32_t> &meshIndices,
+              const std::vector<ShaderVariant> &variants, const glm::mat4 &modelMat, uint64_t frame);
+};
+
+#endif // VULKAN_IMPOSTOR_MANAGER_HPP
@@ -0,0 +1,92 @@
+#include "ModelLoadQueue.hpp"
+#include <algorithm>
+
+ModelLoadQueue::ModelLoadQueue(Parse parse, uint32_t workerNum) : parse{std::move(parse)} {
+    for (uint32_t i = 0; i < workerNum; i++)
+        workers.emplace_back([this]() { work(); });
+}
+
+ModelLoadQueue::~ModelLoadQueue() {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void ModelLoadQueue::work() {
+    std::unique_lock<std::mutex> lock{mutex};
+    while (true) {
+        auto next = jobs.end();
+        wake.wait(lock, [&]() {
+            // highest priority among those not started; the earliest request on a tie
+            next = jobs.end();
+            for (auto it = jobs.begin(); it != jobs.end(); ++it)
+                if (!it->second.running && (next == jobs.end() || it->second.priority > next->second.priority))
+                    next = it;
+            return stopping || next != jobs.end();
+        });
+        if (stopping)
+            return;
+
+        const auto ticket = next->first;
+        const auto path = next->second.path;
+        next->second.running = true;
+        lock.unlock();
+
+        Result result{ticket};
+        try {
+            result.host = parse(path);
+        } catch (const std::exception &e) {
+            result.error = e.what();
+        }
+
+        lock.lock();
+        auto it = jobs.find(ticket);
+        if (!it->second.cancelled)
+            finished.push_back(std::move(result));
+        jobs.erase(it);
+    }
+}
+
+ModelLoadQueue::Ticket ModelLoadQueue::push(std::filesystem::path path, float priority) {
+    Ticket ticket;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        ticket = nextTicket++;
+        jobs.emplace(ticket, Job{std::move(path), priority});
+    }
+    wake.notify_one();
+    return ticket;
+}
+
+void ModelLoadQueue::setPriority(Ticket ticket, float priority) {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (auto it = jobs.find(ticket); it != jobs.end())
+        it->second.priority = priority;
+}
+
+void ModelLoadQueue::cancel(Ticket ticket) {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (auto it = jobs.find(ticket); it != jobs.end()) {
+        if (it->second.running)
+            it->second.cancelled = true;
+        else
+            jobs.erase(it);
+    }
+    finished.erase(std::remove_if(finished.begin(), finished.end(), [ticket](const Result &result) { return result.ticket == ticket; }), finished.end());
+}
+
+std::vector<ModelLoadQueue::Result> ModelLoadQueue::takeFinished() {
+    std::vector<Result> taken;
+    std::lock_guard<std::mutex> lock{mutex};
+    taken.swap(finished);
+    return taken;
+}
+
+bool ModelLoadQueue::isBusy() const {
+    std::lock_guard<std::mutex> lock{mutex};
+    return !jobs.empty() || !finished.empty();
+}
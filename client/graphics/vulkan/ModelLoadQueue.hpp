@@ -0,0 +1,65 @@
+#ifndef VULKAN_MODEL_LOAD_QUEUE_HPP
+#define VULKAN_MODEL_LOAD_QUEUE_HPP
+
+#include "ModelManager.hpp"
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Parses and decodes model files on worker threads, highest priority first.
+// Finished loads are collected by the render thread, which uploads them; a cancelled load is dropped
+// before it starts, or its result discarded if it is already running.
+class ModelLoadQueue {
+  public:
+    using Ticket = uint64_t;
+    using Parse = std::function<ModelManager::ModelHostData(const std::filesystem::path &)>;
+
+    struct Result {
+        Ticket ticket;
+        // absent if parsing threw; error holds what it said
+        std::optional<ModelManager::ModelHostData> host;
+        std::string error;
+    };
+
+  private:
+    struct Job {
+        std::filesystem::path path;
+        float priority;
+        bool running = false;
+        bool cancelled = false;
+    };
+
+    Parse parse;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::map<Ticket, Job> jobs;
+    std::vector<Result> finished;
+    Ticket nextTicket = 0;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    void work();
+
+  public:
+    // parse runs on the workers, several calls at once
+    ModelLoadQueue(Parse parse, uint32_t workerNum);
+    // drops whatever hasn't started and waits for the running parses
+    ~ModelLoadQueue();
+
+    Ticket push(std::filesystem::path path, float priority);
+    // takes effect if the load hasn't started yet
+    void setPriority(Ticket ticket, float priority);
+    void cancel(Ticket ticket);
+    // loads finished since the last call, in completion order; cancelled ones are left out
+    std::vector<Result> takeFinished();
+    // true while anything is queued, running or waiting to be taken
+    bool isBusy() const;
+};
+
+#endif // VULKAN_MODEL_LOAD_QUEUE_HPP
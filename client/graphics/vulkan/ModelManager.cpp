@@ -1,18 +1,39 @@
 #include "Modelmanager.hpp"
+#include "../BlockCompression.hpp"
 #include "Buffer.hpp"
 #include "Helper.hpp"
 #include "Image.hpp"
 #include "Render.hpp"
+#include <algorithm>
+#include <cstring>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <limits>
 #include <stb_image.h>
+#ifdef _DEBUG
+#include <iostream>
+#endif
 
 constexpr uint32_t maxVertNum = 1048576;
 constexpr uint32_t maxIndNum = 4194304;
-constexpr uint32_t maxTexNum = 32;
+constexpr uint32_t maxMorphEntryNum = 1048576;
+// upper bound of the bindless texture array; the device limit usually decides
+constexpr uint32_t maxTexNum = 65536;
 constexpr uint32_t maxModelNum = 1024;
 constexpr uint32_t maxPrimitiveNum = 32768;
 constexpr uint32_t maxMaterialNum = 32768;
 constexpr uint32_t maxJointNum = 65536;
+const std::filesystem::path textureCacheDir = "texture_cache";
+// textures gaining levels per frame; their uploads run in the background
+constexpr uint32_t maxTextureStreamInPerFrame = 2;
+// models whose uploads start per frame; the copies run in the background
+constexpr uint32_t maxModelLoadsPerFrame = 1;
+// staging for uploads in flight; a model beyond this is staged in a buffer of its own
+constexpr vk::DeviceSize stagingRingBytes = 64ull << 20;
+// position, normal, texcoord, joints and weights
+constexpr uint64_t vertexBytes = sizeof(glm::vec3) * 2 + sizeof(glm::vec2) + sizeof(glm::u16vec4) + sizeof(glm::vec4);
+// morph deltas shorter than this (in model units) are left out of the sparse targets
+constexpr float morphEpsilon = 1e-6f;
 
 struct JointInfo {
     glm::mat4 inverseBindMatrix;
@@ -46,7 +67,7 @@ vk::DescriptorSetLayoutBinding buildDescSetLayoutBinding(uint32_t bindingNum, vk
     return binding;
 }
 
-vk::UniqueDescriptorSetLayout createDescLayout(vk::Device device) {
+vk::UniqueDescriptorSetLayout createDescLayout(vk::Device device, uint32_t textureCapacity) {
     std::vector<vk::DescriptorSetLayoutBinding> binding;
     // Model
     binding.push_back(buildDescSetLayoutBinding(
@@ -70,7 +91,7 @@ vk::UniqueDescriptorSetLayout createDescLayout(vk::Device device) {
     binding.push_back(buildDescSetLayoutBinding(
         3,
         vk::DescriptorType::eCombinedImageSampler,
-        maxTexNum,
+        textureCapacity,
         vk::ShaderStageFlagBits::eFragment));
     // Joints Info
     binding.push_back(buildDescSetLayoutBinding(
@@ -91,7 +112,16 @@ vk::UniqueDescriptorSetLayout createDescLayout(vk::Device device) {
     //     1,
     //     vk::ShaderStageFlagBits::eVertex));
 
+    // textures are appended while the set is in use, and slots not yet written are never read
+    std::vector<vk::DescriptorBindingFlags> bindingFlags(binding.size());
+    bindingFlags[3] = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+    vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo;
+    bindingFlagsInfo.bindingCount = bindingFlags.size();
+    bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
     vk::DescriptorSetLayoutCreateInfo createInfo;
+    createInfo.pNext = &bindingFlagsInfo;
+    createInfo.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
     createInfo.bindingCount = std::size(binding);
     createInfo.pBindings = binding.data();
 
@@ -107,15 +137,18 @@ std::vector<vk::UniqueDescriptorSet> createDescSets(vk::Device device, vk::Descr
     return device.allocateDescriptorSetsUnique(allocInfo);
 }
 
-vk::UniqueSampler createSampler(vk::Device device) {
+vk::UniqueSampler createSampler(vk::PhysicalDevice physDevice, vk::Device device) {
+    // the device is created with every supported feature, so anisotropy is on wherever the hardware has it
+    const bool anisotropy = physDevice.getFeatures().samplerAnisotropy;
+
     vk::SamplerCreateInfo createInfo;
     createInfo.magFilter = vk::Filter::eLinear;
     createInfo.minFilter = vk::Filter::eLinear;
     createInfo.addressModeU = vk::SamplerAddressMode::eRepeat;
     createInfo.addressModeV = vk::SamplerAddressMode::eRepeat;
     createInfo.addressModeW = vk::SamplerAddressMode::eRepeat;
-    createInfo.anisotropyEnable = false;
-    createInfo.maxAnisotropy = 1.0f;
+    createInfo.anisotropyEnable = anisotropy;
+    createInfo.maxAnisotropy = anisotropy ? std::min(16.0f, physDevice.getProperties().limits.maxSamplerAnisotropy) : 1.0f;
     createInfo.borderColor = vk::BorderColor::eIntOpaqueBlack;
     createInfo.unnormalizedCoordinates = false;
     createInfo.compareEnable = false;
@@ -123,20 +156,113 @@ vk::UniqueSampler createSampler(vk::Device device) {
     createInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
     createInfo.mipLodBias = 0.0f;
     createInfo.minLod = 0.0f;
-    createInfo.maxLod = 0.0f;
+    createInfo.maxLod = VK_LOD_CLAMP_NONE;
 
     return device.createSamplerUnique(createInfo);
 }
 
+uint64_t chooseTextureBudget(vk::PhysicalDevice physDevice, const AssetSettings &settings) {
+    if (settings.textureBudget)
+        return settings.textureBudget;
+    vk::DeviceSize largestHeap = 0;
+    for (const auto &heap : physDevice.getMemoryProperties().memoryHeaps)
+        if (heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+            largestHeap = std::max(largestHeap, heap.size);
+    return largestHeap / 4;
+}
+
+uint64_t chooseModelBudget(const AssetSettings &settings) {
+    return settings.modelBudget ? settings.modelBudget : vertexBytes * maxVertNum + sizeof(uint32_t) * maxIndNum + sizeof(glm::uvec2) * maxMorphEntryNum;
+}
+
+// copies count elements of an accessor, which must be tightly packed
+template <typename T>
+void copyAccessor(const fastgltf::Asset &asset, size_t index, T *dst) {
+    const auto &accessor = asset.accessors[index];
+    const auto &bufferView = asset.bufferViews[accessor.bufferViewIndex.value()];
+    const auto &bufferBytes = std::get<fastgltf::sources::ByteView>(asset.buffers[bufferView.bufferIndex].data).bytes;
+    if (accessor.byteOffset + accessor.count * sizeof(T) > bufferView.byteLength)
+        throw std::runtime_error("accessor out of its buffer view");
+    std::memcpy(dst, bufferBytes.data() + bufferView.byteOffset + accessor.byteOffset, accessor.count * sizeof(T));
+}
+
+// the translation and rotation channels of an animation; other channels, and outputs that aren't floats, are skipped
+RawAnimation readAnimation(const fastgltf::Asset &asset, const fastgltf::Animation &animation) {
+    RawAnimation raw{std::string(animation.name)};
+    for (const auto &channel : animation.channels) {
+        const auto &sampler = animation.samplers[channel.samplerIndex];
+        const auto &input = asset.accessors[sampler.inputAccessor];
+        const auto &output = asset.accessors[sampler.outputAccessor];
+        if (input.componentType != fastgltf::ComponentType::Float || output.componentType != fastgltf::ComponentType::Float)
+            continue;
+
+        RawAnimationTrack track;
+        track.joint = static_cast<uint32_t>(channel.nodeIndex);
+        if (channel.path == fastgltf::AnimationPath::Translation && output.type == fastgltf::AccessorType::Vec3) {
+            track.path = RawAnimationTrack::Path::Translation;
+            std::vector<glm::vec3> values(output.count);
+            copyAccessor(asset, sampler.outputAccessor, values.data());
+            for (const auto &value : values)
+                track.values.emplace_back(value, 0.0f);
+        } else if (channel.path == fastgltf::AnimationPath::Rotation && output.type == fastgltf::AccessorType::Vec4) {
+            track.path = RawAnimationTrack::Path::Rotation;
+            track.values.resize(output.count);
+            copyAccessor(asset, sampler.outputAccessor, track.values.data());
+        } else {
+            continue;
+        }
+        switch (sampler.interpolation) {
+        case fastgltf::AnimationInterpolation::Step:
+            track.interpolation = RawAnimationTrack::Interpolation::Step;
+            break;
+        case fastgltf::AnimationInterpolation::CubicSpline:
+            track.interpolation = RawAnimationTrack::Interpolation::CubicSpline;
+            break;
+        default:
+            track.interpolation = RawAnimationTrack::Interpolation::Linear;
+            break;
+        }
+        track.times.resize(input.count);
+        copyAccessor(asset, sampler.inputAccessor, track.times.data());
+        if (track.values.size() != track.times.size() * (track.interpolation == RawAnimationTrack::Interpolation::CubicSpline ? 3 : 1))
+            throw std::runtime_error("animation sampler with mismatched input and output");
+        raw.tracks.push_back(std::move(track));
+    }
+    return raw;
+}
+
+// the transfer queue stages at this alignment, which is what copies into images need
+vk::DeviceSize stagingAligned(vk::DeviceSize size) {
+    return (size + 15) & ~vk::DeviceSize{15};
+}
+
 } // namespace
 
-ModelManager::ModelManager(vk::PhysicalDevice physDevice, vk::Device device, vk::DescriptorPool pool, vk::Queue queue, vk::CommandBuffer cmdBuf, vk::Fence fence) : physDevice{physDevice}, device{device} {
+uint32_t ModelManager::getTextureCapacity(vk::PhysicalDevice physDevice) {
+    auto props = physDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingProperties>();
+    const auto &limits = props.get<vk::PhysicalDeviceDescriptorIndexingProperties>();
+    return std::min({maxTexNum,
+                     limits.maxPerStageDescriptorUpdateAfterBindSamplers,
+                     limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                     limits.maxDescriptorSetUpdateAfterBindSamplers,
+                     limits.maxDescriptorSetUpdateAfterBindSampledImages});
+}
+
+ModelManager::ModelManager(vk::PhysicalDevice physDevice, vk::Device device, vk::DescriptorPool pool, vk::Queue queue, uint32_t queueFamilyIndex, vk::CommandBuffer cmdBuf, vk::Fence fence,
+                           const AssetSettings &settings)
+    : physDevice{physDevice}, device{device}, transfer{physDevice, device, queue, queueFamilyIndex, stagingRingBytes}, residency{chooseTextureBudget(physDevice, settings)}, textureCapacity{getTextureCapacity(physDevice)},
+      vertexRanges{maxVertNum}, indexRanges{maxIndNum}, morphEntryRanges{maxMorphEntryNum}, modelResidency{chooseModelBudget(settings)} {
+    if (TextureTranscoder::isSupported(physDevice, settings.compression))
+        transcoder.emplace(settings.compression, textureCacheDir);
+
     modelPosVertBuffer.emplace(physDevice, device, vk::BufferUsageFlagBits::eVertexBuffer, sizeof(glm::vec3) * maxVertNum);
     modelNormVertBuffer.emplace(physDevice, device, vk::BufferUsageFlagBits::eVertexBuffer, sizeof(glm::vec3) * maxVertNum);
     modelTexcoordVertBuffer.emplace(physDevice, device, vk::BufferUsageFlagBits::eVertexBuffer, sizeof(glm::vec2) * maxVertNum);
     modelJointsVertBuffer.emplace(physDevice, device, vk::BufferUsageFlagBits::eVertexBuffer, sizeof(glm::u16vec4) * maxVertNum);
     modelWeightsVertBuffer.emplace(physDevice, device, vk::BufferUsageFlagBits::eVertexBuffer, sizeof(glm::vec4) * maxVertNum);
     modelIndexBuffer.emplace(physDevice, device, vk::BufferUsageFlagBits::eIndexBuffer, sizeof(uint32_t) * maxIndNum);
+    morphEntryBuffer.emplace(physDevice, device, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                             sizeof(glm::uvec2) * maxMorphEntryNum);
 
     modelInfoBuffer.emplace(physDevice, device, vk::BufferUsageFlagBits::eStorageBuffer, sizeof(ModelInfoForShader) * maxModelNum);
     primitiveInfoBuffer.emplace(physDevice, device, vk::BufferUsageFlagBits::eStorageBuffer, sizeof(PrimitiveInfo) * maxPrimitiveNum);
@@ -149,14 +275,14 @@ ModelManager::ModelManager(vk::PhysicalDevice physDevice, vk::Device device, vk:
 
         defaultTexture.emplace(physDevice, device, queue, cmdBuf, pixels,
                                vk::Extent3D{static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1}, 1,
-                               vk::ImageUsageFlagBits::eSampled, fence);
+                               vk::ImageUsageFlagBits::eSampled, fence, true);
 
         stbi_image_free(pixels);
     }
-    defaultTextureImgView = createImageViewFromImage(device, defaultTexture->getImage(), vk::Format::eR8G8B8A8Srgb, 1);
-    defaultSampler = createSampler(device);
+    defaultTextureImgView = createImageViewFromImage(device, defaultTexture->getImage(), vk::Format::eR8G8B8A8Srgb, 1, vk::ImageAspectFlagBits::eColor, defaultTexture->getMipLevels());
+    defaultSampler = createSampler(physDevice, device);
 
-    modelDescSetLayout = createDescLayout(device);
+    modelDescSetLayout = createDescLayout(device, textureCapacity);
     modelDescSet = std::move(createDescSets(device, pool, modelDescSetLayout.get(), 1)[0]);
 
     {
@@ -172,18 +298,12 @@ ModelManager::ModelManager(vk::PhysicalDevice physDevice, vk::Device device, vk:
         materialBufDesc.buffer = materialInfoBuffer->getBuffer();
         materialBufDesc.offset = 0;
         materialBufDesc.range = sizeof(MaterialInfo) * maxMaterialNum;
-        vk::DescriptorImageInfo textureDesc[maxTexNum];
-        for (uint32_t i = 0; i < maxTexNum; i++) {
-            textureDesc[i].imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-            textureDesc[i].imageView = defaultTextureImgView.get();
-            textureDesc[i].sampler = defaultSampler.get();
-        }
         vk::DescriptorBufferInfo jointsBufDesc;
         jointsBufDesc.buffer = jointsInfoBuffer->getBuffer();
         jointsBufDesc.offset = 0;
         jointsBufDesc.range = sizeof(JointInfo) * maxJointNum;
 
-        vk::WriteDescriptorSet writeDescSet[5];
+        vk::WriteDescriptorSet writeDescSet[4];
         writeDescSet[0].dstSet = modelDescSet.get();
         writeDescSet[0].dstBinding = 0;
         writeDescSet[0].dstArrayElement = 0;
@@ -203,23 +323,160 @@ ModelManager::ModelManager(vk::PhysicalDevice physDevice, vk::Device device, vk:
         writeDescSet[2].descriptorType = vk::DescriptorType::eStorageBuffer;
         writeDescSet[2].pBufferInfo = &materialBufDesc;
         writeDescSet[3].dstSet = modelDescSet.get();
-        writeDescSet[3].dstBinding = 3;
+        writeDescSet[3].dstBinding = 4;
         writeDescSet[3].dstArrayElement = 0;
-        writeDescSet[3].descriptorCount = maxTexNum;
-        writeDescSet[3].descriptorType = vk::DescriptorType::eCombinedImageSampler;
-        writeDescSet[3].pImageInfo = textureDesc;
-        writeDescSet[4].dstSet = modelDescSet.get();
-        writeDescSet[4].dstBinding = 4;
-        writeDescSet[4].dstArrayElement = 0;
-        writeDescSet[4].descriptorCount = 1;
-        writeDescSet[4].descriptorType = vk::DescriptorType::eStorageBuffer;
-        writeDescSet[4].pBufferInfo = &jointsBufDesc;
+        writeDescSet[3].descriptorCount = 1;
+        writeDescSet[3].descriptorType = vk::DescriptorType::eStorageBuffer;
+        writeDescSet[3].pBufferInfo = &jointsBufDesc;
         device.updateDescriptorSets(writeDescSet, {});
     }
+    // slot 0: fallback for anything without a texture of its own
+    registerTexture(defaultTextureImgView.get());
+}
+
+uint32_t ModelManager::registerTexture(vk::ImageView view) {
+    uint32_t slot;
+    if (!freeTextureSlots.empty()) {
+        slot = freeTextureSlots.back();
+        freeTextureSlots.pop_back();
+    } else if (textureCount < textureCapacity) {
+        slot = textureCount++;
+    } else {
+        throw std::runtime_error("texture array is full");
+    }
+
+    vk::DescriptorImageInfo textureDesc;
+    textureDesc.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    textureDesc.imageView = view;
+    textureDesc.sampler = defaultSampler.get();
+
+    vk::WriteDescriptorSet writeDescSet;
+    writeDescSet.dstSet = modelDescSet.get();
+    writeDescSet.dstBinding = 3;
+    writeDescSet.dstArrayElement = slot;
+    writeDescSet.descriptorCount = 1;
+    writeDescSet.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+    writeDescSet.pImageInfo = &textureDesc;
+    device.updateDescriptorSets({writeDescSet}, {});
+    return slot;
 }
 
-ModelManager::MeshPointer ModelManager::allocate(uint32_t vertNum, uint32_t indNum) {
-    return MeshPointer{0, 0, 0, 0, 0};
+uint32_t ModelManager::getHostLevelEnd(uint32_t texture, uint32_t level) const {
+    const auto &streamed = streamedTextures[texture];
+    if (streamed.pending)
+        return std::max(level, streamed.pending->level);
+    if (streamed.image)
+        return std::max(level, streamed.imageLevel);
+    return static_cast<uint32_t>(streamed.source.levels.size());
+}
+
+vk::DeviceSize ModelManager::getStagingBytes(uint32_t texture, uint32_t level) const {
+    const auto &levels = streamedTextures[texture].source.levels;
+    vk::DeviceSize bytes = 0;
+    for (uint32_t i = level; i < getHostLevelEnd(texture, level); i++)
+        bytes += stagingAligned(levels[i].size());
+    return bytes;
+}
+
+void ModelManager::setResidentLevel(uint32_t texture, uint32_t level, uint64_t frame, const TransferQueue::Staging &staging) {
+    auto &streamed = streamedTextures[texture];
+    const auto &source = streamed.source;
+    const auto levelCount = static_cast<uint32_t>(source.levels.size());
+    const auto hostEnd = getHostLevelEnd(texture, level);
+
+    std::vector<vk::DeviceSize> offsets;
+    vk::DeviceSize offset = 0;
+    for (uint32_t i = level; i < hostEnd; i++) {
+        std::memcpy(staging.data + offset, source.levels[i].data(), source.levels[i].size());
+        offsets.push_back(staging.offset + offset);
+        offset += stagingAligned(source.levels[i].size());
+    }
+    // a pending image is filled by the time this batch runs, so it is as good a source as the shown one
+    vk::Image copySrc;
+    uint32_t copySrcLevel = 0;
+    if (hostEnd < levelCount) {
+        copySrc = streamed.pending ? streamed.pending->image.getImage() : streamed.image->getImage();
+        copySrcLevel = hostEnd - (streamed.pending ? streamed.pending->level : streamed.imageLevel);
+    }
+
+    const vk::Extent3D extent{std::max(source.extent.width >> level, 1u), std::max(source.extent.height >> level, 1u), 1};
+    ReadonlyImage image{physDevice, device, source.format, extent, levelCount - level, vk::ImageUsageFlagBits::eSampled};
+    recordLevelsUpload(transfer.cmd(), staging.buffer, offsets, copySrc, copySrcLevel, image.getImage(), extent, levelCount - level);
+
+    if (streamed.pending)
+        retiredTextures.push_back(RetiredTexture{std::move(streamed.pending->image), {}, std::nullopt, frame, transfer.getTicket()});
+    else
+        pendingTextures.push_back(texture);
+    streamed.pending.emplace(PendingTexture{std::move(image), level, transfer.getTicket()});
+}
+
+bool ModelManager::showTexture(uint32_t texture, uint64_t frame) {
+    auto &streamed = streamedTextures[texture];
+    if (!streamed.pending || !transfer.isDone(streamed.pending->upload))
+        return false;
+    auto &image = streamed.pending->image;
+    auto view = createImageViewFromImage(device, image.getImage(), streamed.source.format, 1, vk::ImageAspectFlagBits::eColor, image.getMipLevels());
+    const auto slot = registerTexture(view.get());
+    if (streamed.image)
+        retiredTextures.push_back(RetiredTexture{std::move(*streamed.image), std::move(streamed.view), streamed.slot, frame, std::nullopt});
+    streamed.image.emplace(std::move(image));
+    streamed.view = std::move(view);
+    streamed.slot = slot;
+    streamed.imageLevel = streamed.pending->level;
+    streamed.pending.reset();
+    return true;
+}
+
+void ModelManager::evictTexture(uint32_t texture, uint64_t frame) {
+    auto &streamed = streamedTextures[texture];
+    // the pending upload may still be reading the shown image
+    std::optional<TransferQueue::Ticket> upload;
+    if (streamed.pending) {
+        upload = streamed.pending->upload;
+        retiredTextures.push_back(RetiredTexture{std::move(streamed.pending->image), {}, std::nullopt, frame, upload});
+        streamed.pending.reset();
+        pendingTextures.erase(std::find(pendingTextures.begin(), pendingTextures.end(), texture));
+    }
+    if (streamed.image) {
+        retiredTextures.push_back(RetiredTexture{std::move(*streamed.image), std::move(streamed.view), streamed.slot, frame, upload});
+        streamed.image.reset();
+    }
+    residency.evict(texture);
+}
+
+bool ModelManager::updateTextureResidency(uint64_t frame, uint32_t flightFramesNum) {
+    // frames recorded before the one that retired a texture are the last to use it
+    while (!retiredTextures.empty() && retiredTextures.front().frame + flightFramesNum <= frame &&
+           (!retiredTextures.front().upload || transfer.isDone(*retiredTextures.front().upload))) {
+        if (retiredTextures.front().slot)
+            freeTextureSlots.push_back(*retiredTextures.front().slot);
+        retiredTextures.pop_front();
+    }
+
+    bool changed = false;
+    for (auto it = pendingTextures.begin(); it != pendingTextures.end();) {
+        if (!showTexture(*it, frame)) {
+            ++it;
+            continue;
+        }
+        changed = true;
+        it = pendingTextures.erase(it);
+    }
+
+    // without a batch to record into, every change waits; with one, levels dropped need no staging,
+    // so only a texture gaining levels may have to wait for room in the ring
+    const bool recording = transfer.begin();
+    for (const auto &change : residency.plan(frame, maxTextureStreamInPerFrame)) {
+        const auto staging = recording ? transfer.stage(getStagingBytes(change.texture, change.level)) : std::nullopt;
+        if (!staging) {
+            const auto &streamed = streamedTextures[change.texture];
+            residency.cancel(change.texture, streamed.pending ? streamed.pending->level : streamed.imageLevel);
+            continue;
+        }
+        setResidentLevel(change.texture, change.level, frame, *staging);
+    }
+    transfer.submit();
+    return changed;
 }
 
 void ModelManager::prepareRender(RenderDetails &rd) {
@@ -232,7 +489,9 @@ void ModelManager::prepareRender(RenderDetails &rd) {
     rd.assetDescSet = modelDescSet.get();
 }
 
-ModelManager::ModelInfo ModelManager::loadModelFromGlbFile(const std::filesystem::path path, vk::Queue queue, vk::CommandBuffer cmdBuf, vk::Fence fence) {
+ModelManager::ModelHostData ModelManager::parseGlbFile(const std::filesystem::path &path) {
+    // a parser per call, so loads can run side by side
+    fastgltf::Parser gltfParser;
     fastgltf::GltfDataBuffer buffer;
     buffer.loadFromFile(path);
     auto gltf = gltfParser.loadBinaryGLTF(&buffer, path.parent_path());
@@ -247,31 +506,27 @@ ModelManager::ModelInfo ModelManager::loadModelFromGlbFile(const std::filesystem
         const auto &bufferBytes = std::get<fastgltf::sources::ByteView>(asset->buffers[bufferView.bufferIndex].data).bytes;
         return fastgltf::span<const std::byte>(bufferBytes.data() + bufferView.byteOffset, bufferView.byteLength);
     };
-    auto accessorToSpan = [&](size_t index) {
-        const auto &accessor = asset->accessors[index];
-        const auto &bufferView = asset->bufferViews[accessor.bufferViewIndex.value()];
-        const auto &bufferBytes = std::get<fastgltf::sources::ByteView>(asset->buffers[bufferView.bufferIndex].data).bytes;
-        return fastgltf::span<const std::byte>(bufferBytes.data() + bufferView.byteOffset, bufferView.byteLength);
-    };
 
     uint32_t vertNumSum = 0, indNumSum = 0;
     for (const auto &mesh : asset->meshes) {
         for (const auto &primitive : mesh.primitives) {
             if (primitive.type != fastgltf::PrimitiveType::Triangles)
                 throw std::runtime_error("Primitive type not supported");
-            for (const auto &[attrName, attrIndex] : primitive.attributes) {
-                vertNumSum += asset->accessors[primitive.attributes.begin()->second].count;
-                indNumSum += asset->accessors[primitive.indicesAccessor.value()].count;
-            }
+            vertNumSum += asset->accessors[primitive.attributes.begin()->second].count;
+            indNumSum += asset->accessors[primitive.indicesAccessor.value()].count;
         }
     }
     std::vector<uint32_t> meshToSkin(asset->meshes.size());
+    std::vector<bool> meshSkinned(asset->meshes.size(), false);
     for (const auto &node : asset->nodes) {
-        if (node.meshIndex.has_value() & node.skinIndex.has_value())
+        if (node.meshIndex.has_value() & node.skinIndex.has_value()) {
             meshToSkin[*node.meshIndex] = *node.skinIndex;
+            meshSkinned[*node.meshIndex] = true;
+        }
     }
 
-    ModelInfo info;
+    ModelHostData host;
+    auto &info = host.info;
     info.nodes.resize(asset->nodes.size());
     for(uint32_t i = 0; i < asset->nodes.size(); i++) {
         const auto& trs = std::get<fastgltf::Node::TRS>(asset->nodes[i].transform);
@@ -283,88 +538,129 @@ ModelManager::ModelInfo ModelManager::loadModelFromGlbFile(const std::filesystem
             info.nodes[child].parent = i;
     }
     for(const auto &skin : asset->skins) {
-        auto inverseBindMatrices = reinterpret_cast<const glm::mat4*>(accessorToSpan(skin.inverseBindMatrices.value()).data());
+        std::vector<glm::mat4> inverseBindMatrices(asset->accessors[skin.inverseBindMatrices.value()].count);
+        copyAccessor(*asset, skin.inverseBindMatrices.value(), inverseBindMatrices.data());
         for(uint32_t i = 0; i < skin.joints.size(); i++){
             info.nodes[skin.joints[i]].inverseBindMatrix = inverseBindMatrices[i];
         }
     }
 
-    MeshPointer pPrimitiveBase = allocate(vertNumSum, indNumSum);
-
-    for (const auto &image : asset->images) {
-        const auto imageData = datToSpan(image.data);
-
-        int w, h, ch;
-        auto pImage = stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(imageData.data()), imageData.size_bytes(), &w, &h, &ch, STBI_rgb_alpha);
-        if (!pImage)
-            throw std::runtime_error("failed to load texture image");
-
-        textureAtlas.emplace_back(physDevice, device, queue, cmdBuf, pImage, vk::Extent3D{uint32_t(w), uint32_t(h), 1}, 1,
-                                  vk::ImageUsageFlagBits::eSampled, fence);
-        stbi_image_free(pImage);
-    }
-    std::vector<vk::DescriptorImageInfo> textureDesc(textureAtlas.size());
-    for (uint32_t i = 0; i < textureAtlas.size(); i++) {
-        textureImageViews.emplace_back(createImageViewFromImage(device, textureAtlas[i].getImage(), vk::Format::eR8G8B8A8Srgb, 1));
-        textureDesc[i].imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-        textureDesc[i].imageView = textureImageViews.back().get();
-        textureDesc[i].sampler = defaultSampler.get();
+    if (transcoder) {
+        std::vector<TextureTranscoder::Source> sources;
+        for (const auto &image : asset->images) {
+            const auto imageData = datToSpan(image.data);
+            sources.push_back(TextureTranscoder::Source{imageData.data(), imageData.size_bytes()});
+        }
+        host.textures = transcoder->transcode(sources);
+    } else {
+        // uncompressed, but with the levels built up front so they can be streamed all the same
+        for (const auto &image : asset->images) {
+            const auto imageData = datToSpan(image.data);
+
+            int w, h, ch;
+            auto pImage = stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(imageData.data()), imageData.size_bytes(), &w, &h, &ch, STBI_rgb_alpha);
+            if (!pImage)
+                throw std::runtime_error("failed to load texture image");
+
+            TextureTranscoder::Texture texture{vk::Format::eR8G8B8A8Srgb, vk::Extent3D{uint32_t(w), uint32_t(h), 1}};
+            texture.levels.emplace_back(pImage, pImage + size_t(w) * h * 4);
+            stbi_image_free(pImage);
+            for (uint32_t width = w, height = h; width > 1 || height > 1;) {
+                texture.levels.push_back(downsampleSrgb(texture.levels.back().data(), width, height));
+                width = std::max(width / 2, 1u);
+                height = std::max(height / 2, 1u);
+            }
+            host.textures.push_back(std::move(texture));
+        }
     }
-    vk::WriteDescriptorSet writeDescSet;
-    writeDescSet.dstSet = modelDescSet.get();
-    writeDescSet.dstBinding = 3;
-    writeDescSet.dstArrayElement = 0;
-    writeDescSet.descriptorCount = textureDesc.size();
-    writeDescSet.descriptorType = vk::DescriptorType::eCombinedImageSampler;
-    writeDescSet.pImageInfo = textureDesc.data();
-    device.updateDescriptorSets({writeDescSet}, {});
 
-    MeshPointer pCurrentPrimitive = pPrimitiveBase;
+    host.positions.resize(vertNumSum);
+    host.normals.resize(vertNumSum);
+    host.texcoords.resize(vertNumSum);
+    host.joints.resize(vertNumSum);
+    host.weights.resize(vertNumSum);
+    host.indices.resize(indNumSum);
+
+    MeshPointer pCurrentPrimitive{0, 0, 0, 0, 0};
     uint32_t meshIndex = 0; 
     for (const auto &mesh : asset->meshes) {
         for (const auto &primitive : mesh.primitives) {
+            const auto vertexBase = pCurrentPrimitive.vertexBase;
             for (const auto &[attrName, attrAccessorIndex] : primitive.attributes) {
-                const auto attrData = accessorToSpan(attrAccessorIndex);
                 if (attrName == "POSITION") {
-                    modelPosVertBuffer->write(physDevice, device, queue, cmdBuf,
-                                              static_cast<const void *>(attrData.data()), attrData.size_bytes(),
-                                              pCurrentPrimitive.vertexBase * sizeof(glm::vec3), fence);
+                    copyAccessor(*asset, attrAccessorIndex, host.positions.data() + vertexBase);
                 } else if (attrName == "NORMAL") {
-                    modelNormVertBuffer->write(physDevice, device, queue, cmdBuf,
-                                               static_cast<const void *>(attrData.data()), attrData.size_bytes(),
-                                               pCurrentPrimitive.vertexBase * sizeof(glm::vec3), fence);
+                    copyAccessor(*asset, attrAccessorIndex, host.normals.data() + vertexBase);
                 } else if (attrName == "TEXCOORD_0") {
-                    modelTexcoordVertBuffer->write(physDevice, device, queue, cmdBuf,
-                                                   static_cast<const void *>(attrData.data()), attrData.size_bytes(),
-                                                   pCurrentPrimitive.vertexBase * sizeof(glm::vec2), fence);
+                    copyAccessor(*asset, attrAccessorIndex, host.texcoords.data() + vertexBase);
                 } else if (attrName == "JOINTS_0") {
-                    std::vector<uint16_t> convertedJointData(attrData.size_bytes() / 2);
-                    auto jointBuffer = reinterpret_cast<const uint16_t *>(attrData.data());
-
-                    for (uint32_t i = 0; i < attrData.size_bytes() / 2; i++) {
-                        convertedJointData[i] = asset->skins[meshToSkin[meshIndex]].joints[jointBuffer[i]];
-                    }
-
-                    modelJointsVertBuffer->write(physDevice, device, queue, cmdBuf,
-                                                 static_cast<const void *>(convertedJointData.data()), convertedJointData.size() * sizeof(uint16_t),
-                                                 pCurrentPrimitive.vertexBase * sizeof(glm::u16vec4), fence);
+                    const auto joints = host.joints.data() + vertexBase;
+                    copyAccessor(*asset, attrAccessorIndex, joints);
+                    for (uint32_t i = 0; i < asset->accessors[attrAccessorIndex].count; i++)
+                        for (int c = 0; c < 4; c++)
+                            joints[i][c] = asset->skins[meshToSkin[meshIndex]].joints[joints[i][c]];
                 } else if (attrName == "WEIGHTS_0") {
-                    modelWeightsVertBuffer->write(physDevice, device, queue, cmdBuf,
-                                                  static_cast<const void *>(attrData.data()), attrData.size_bytes(),
-                                                  pCurrentPrimitive.vertexBase * sizeof(glm::vec4), fence);
+                    copyAccessor(*asset, attrAccessorIndex, host.weights.data() + vertexBase);
                 }
             }
-            {
-                const auto indexData = accessorToSpan(primitive.indicesAccessor.value());
-                modelIndexBuffer->write(physDevice, device, queue, cmdBuf,
-                                        static_cast<const void *>(indexData.data()), indexData.size_bytes(),
-                                        pCurrentPrimitive.IndexBase * sizeof(uint32_t), fence);
+            copyAccessor(*asset, primitive.indicesAccessor.value(), host.indices.data() + pCurrentPrimitive.IndexBase);
+
+            pCurrentPrimitive.mesh = meshIndex;
+            pCurrentPrimitive.vertexNum = asset->accessors[primitive.attributes.begin()->second].count;
+            pCurrentPrimitive.firstMorphTarget = info.morphTargets.size();
+            pCurrentPrimitive.morphTargetNum = 0;
+            pCurrentPrimitive.firstTouched = pCurrentPrimitive.touchedNum = 0;
+            // entries hold a 16-bit vertex index, so larger primitives go without their targets
+            if (!primitive.targets.empty() && pCurrentPrimitive.vertexNum <= 65536) {
+                std::vector<glm::vec3> deltas(pCurrentPrimitive.vertexNum);
+                std::vector<bool> touched(pCurrentPrimitive.vertexNum, false);
+                for (const auto &target : primitive.targets) {
+                    MorphTarget sparse{static_cast<uint32_t>(host.morphEntries.size()), 0};
+                    const auto position = target.find("POSITION");
+                    // an accessor without a buffer view is all zero
+                    if (position != target.end() && asset->accessors[position->second].bufferViewIndex.has_value()) {
+                        if (asset->accessors[position->second].count != deltas.size())
+                            throw std::runtime_error("morph target size mismatch");
+                        copyAccessor(*asset, position->second, deltas.data());
+                        for (uint32_t v = 0; v < deltas.size(); v++) {
+                            if (glm::all(glm::lessThan(glm::abs(deltas[v]), glm::vec3(morphEpsilon))))
+                                continue;
+                            host.morphEntries.emplace_back(glm::packHalf2x16(glm::vec2(deltas[v])), v << 16 | glm::packHalf1x16(deltas[v].z));
+                            touched[v] = true;
+                        }
+                    }
+                    sparse.entryNum = host.morphEntries.size() - sparse.firstEntry;
+                    info.morphTargets.push_back(sparse);
+                }
+                pCurrentPrimitive.morphTargetNum = primitive.targets.size();
+                pCurrentPrimitive.firstTouched = host.morphEntries.size();
+                for (uint32_t v = 0; v < touched.size(); v++)
+                    if (touched[v])
+                        host.morphEntries.emplace_back(0, v << 16);
+                pCurrentPrimitive.touchedNum = host.morphEntries.size() - pCurrentPrimitive.firstTouched;
             }
+#ifdef _DEBUG
+            if (pCurrentPrimitive.vertexNum > 65536 && !primitive.targets.empty())
+                std::clog << "morph targets of a primitive with " << pCurrentPrimitive.vertexNum << " vertices are ignored" << std::endl;
+#endif
 
             pCurrentPrimitive.indexNum = asset->accessors[primitive.indicesAccessor.value()].count;
-            pCurrentPrimitive.materialIndex = pPrimitiveBase.materialIndex + primitive.materialIndex.value();
-            pCurrentPrimitive.textureIndex = pPrimitiveBase.textureIndex +
-                                             asset->textures[asset->materials[primitive.materialIndex.value()].pbrData->baseColorTexture->textureIndex].imageIndex.value();
+            pCurrentPrimitive.materialIndex = primitive.materialIndex.value();
+            pCurrentPrimitive.textureIndex = asset->textures[asset->materials[primitive.materialIndex.value()].pbrData->baseColorTexture->textureIndex].imageIndex.value();
+            {
+                // static props skip skinning entirely; Morph is chosen per avatar, by its weights
+                const auto hasAttribute = [&](const char *name) { return primitive.attributes.find(name) != primitive.attributes.end(); };
+                const auto &material = asset->materials[primitive.materialIndex.value()];
+                pCurrentPrimitive.variant = ShaderVariant{};
+                if (meshSkinned[meshIndex] && hasAttribute("JOINTS_0") && hasAttribute("WEIGHTS_0"))
+                    pCurrentPrimitive.variant.features |= ShaderFeature::Skinned;
+                if (!hasAttribute("NORMAL"))
+                    pCurrentPrimitive.variant.features |= ShaderFeature::Compact;
+                if (material.alphaMode == fastgltf::AlphaMode::Mask) {
+                    pCurrentPrimitive.variant.features |= ShaderFeature::AlphaTest;
+                    pCurrentPrimitive.variant.alphaCutoff = material.alphaCutoff;
+                }
+            }
             info.primitives.push_back(pCurrentPrimitive);
 
             pCurrentPrimitive.vertexBase += asset->accessors[primitive.attributes.begin()->second].count;
@@ -373,5 +669,207 @@ ModelManager::ModelInfo ModelManager::loadModelFromGlbFile(const std::filesystem
         meshIndex++;
     }
 
-    return info;
+    glm::vec3 boundsMin{std::numeric_limits<float>::max()}, boundsMax{std::numeric_limits<float>::lowest()};
+    for (const auto &position : host.positions) {
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
+    info.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    info.boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+    for (const auto &animation : asset->animations) {
+        const auto raw = readAnimation(*asset, animation);
+        auto &clip = info.animations.emplace_back(raw);
+#ifdef _DEBUG
+        clip.measure(raw);
+        const auto &stats = clip.getStats();
+        std::clog << "animation " << clip.getName() << ": " << stats.rawKeyNum << " keys in " << stats.rawBytes << " bytes compressed to "
+                  << stats.keyNum << " keys in " << stats.bytes << " bytes, sampled in " << stats.sampleMicroseconds << " us instead of "
+                  << stats.rawSampleMicroseconds << " us" << std::endl;
+#endif
+    }
+    auto vrm = loadVrmExtensions(path);
+    info.humanoid = vrm.humanoid;
+    info.springBones = std::move(vrm.springBones);
+    return host;
+}
+
+uint32_t ModelManager::addModel(ModelHostData host) {
+    Model model;
+    model.firstTexture = static_cast<uint32_t>(streamedTextures.size());
+    model.textureNum = static_cast<uint32_t>(host.textures.size());
+    uint64_t bytes = vertexBytes * host.positions.size() + sizeof(uint32_t) * host.indices.size() + sizeof(glm::uvec2) * host.morphEntries.size();
+    for (auto &texture : host.textures) {
+        std::vector<uint64_t> levelBytes;
+        for (const auto &level : texture.levels)
+            levelBytes.push_back(level.size());
+        const auto id = residency.add(texture.extent.width, texture.extent.height, std::move(levelBytes));
+        // nothing is on the device until the model is uploaded
+        residency.evict(id);
+        bytes += residency.getTailBytes(id);
+        streamedTextures.push_back(StreamedTexture{std::move(texture)});
+    }
+    host.textures.clear();
+
+    model.info = host.info;
+    for (auto &primitive : model.info.primitives) {
+        primitive.textureIndex += model.firstTexture;
+    }
+    model.host = std::move(host);
+    models.push_back(std::move(model));
+    return modelResidency.add(bytes, false);
+}
+
+bool ModelManager::uploadModel(uint32_t id) {
+    auto &model = models[id];
+    const auto &host = model.host;
+    const auto vertexNum = static_cast<uint32_t>(host.positions.size());
+    const auto indexNum = static_cast<uint32_t>(host.indices.size());
+    const auto morphEntryNum = static_cast<uint32_t>(host.morphEntries.size());
+    const auto vertexBase = vertexRanges.allocate(vertexNum);
+    const auto indexBase = indexRanges.allocate(indexNum);
+    const auto morphEntryBase = morphEntryRanges.allocate(morphEntryNum);
+    if (!vertexBase || !indexBase || !morphEntryBase) {
+        if (vertexBase)
+            vertexRanges.free(*vertexBase, vertexNum);
+        if (indexBase)
+            indexRanges.free(*indexBase, indexNum);
+        if (morphEntryBase)
+            morphEntryRanges.free(*morphEntryBase, morphEntryNum);
+        return false;
+    }
+
+    // staged at once, so a model goes out whole or waits for room; one copy per attribute, since the host copy is contiguous.
+    // Only the tail levels of its textures follow; finer ones are streamed in once something needs them.
+    struct Part {
+        ReadonlyBuffer &buffer;
+        const void *data;
+        vk::DeviceSize size, dstOffset;
+    };
+    const Part parts[] = {
+        {*modelPosVertBuffer, host.positions.data(), sizeof(glm::vec3) * vertexNum, sizeof(glm::vec3) * *vertexBase},
+        {*modelNormVertBuffer, host.normals.data(), sizeof(glm::vec3) * vertexNum, sizeof(glm::vec3) * *vertexBase},
+        {*modelTexcoordVertBuffer, host.texcoords.data(), sizeof(glm::vec2) * vertexNum, sizeof(glm::vec2) * *vertexBase},
+        {*modelJointsVertBuffer, host.joints.data(), sizeof(glm::u16vec4) * vertexNum, sizeof(glm::u16vec4) * *vertexBase},
+        {*modelWeightsVertBuffer, host.weights.data(), sizeof(glm::vec4) * vertexNum, sizeof(glm::vec4) * *vertexBase},
+        {*modelIndexBuffer, host.indices.data(), sizeof(uint32_t) * indexNum, sizeof(uint32_t) * *indexBase},
+        {*morphEntryBuffer, host.morphEntries.data(), sizeof(glm::uvec2) * morphEntryNum, sizeof(glm::uvec2) * *morphEntryBase},
+    };
+    vk::DeviceSize stagingSize = 0;
+    for (const auto &part : parts)
+        stagingSize += stagingAligned(part.size);
+    for (uint32_t texture = model.firstTexture; texture < model.firstTexture + model.textureNum; texture++)
+        stagingSize += getStagingBytes(texture, residency.getTailLevel(texture));
+    const auto staging = transfer.begin() ? transfer.stage(stagingSize) : std::nullopt;
+    if (!staging) {
+        vertexRanges.free(*vertexBase, vertexNum);
+        indexRanges.free(*indexBase, indexNum);
+        morphEntryRanges.free(*morphEntryBase, morphEntryNum);
+        return false;
+    }
+    vk::DeviceSize offset = 0;
+    for (const auto &part : parts) {
+        if (part.size == 0)
+            continue;
+        std::memcpy(staging->data + offset, part.data, part.size);
+        part.buffer.recordWrite(transfer.cmd(), staging->buffer, staging->offset + offset, part.size, part.dstOffset);
+        offset += stagingAligned(part.size);
+    }
+    for (uint32_t texture = model.firstTexture; texture < model.firstTexture + model.textureNum; texture++) {
+        const auto bytes = getStagingBytes(texture, residency.getTailLevel(texture));
+        residency.restore(texture);
+        setResidentLevel(texture, residency.getResidentLevel(texture), 0, TransferQueue::Staging{staging->data + offset, staging->buffer, staging->offset + offset});
+        offset += bytes;
+    }
+    model.upload = transfer.getTicket();
+    uploadingModels.push_back(id);
+
+    for (uint32_t i = 0; i < model.info.primitives.size(); i++) {
+        model.info.primitives[i].vertexBase = *vertexBase + host.info.primitives[i].vertexBase;
+        model.info.primitives[i].IndexBase = *indexBase + host.info.primitives[i].IndexBase;
+    }
+    model.info.morphEntryBase = *morphEntryBase;
+    model.vertexBase = *vertexBase;
+    model.indexBase = *indexBase;
+    model.morphEntryBase = *morphEntryBase;
+    return true;
+}
+
+void ModelManager::evictModel(uint32_t id, uint64_t frame) {
+    auto &model = models[id];
+    retiredGeometry.push_back(RetiredGeometry{model.vertexBase, static_cast<uint32_t>(model.host.positions.size()),
+                                              model.indexBase, static_cast<uint32_t>(model.host.indices.size()),
+                                              model.morphEntryBase, static_cast<uint32_t>(model.host.morphEntries.size()), frame, model.upload});
+    if (model.upload) {
+        uploadingModels.erase(std::find(uploadingModels.begin(), uploadingModels.end(), id));
+        model.upload.reset();
+    }
+    for (uint32_t texture = model.firstTexture; texture < model.firstTexture + model.textureNum; texture++)
+        evictTexture(texture, frame);
+    model.resident = false;
+}
+
+void ModelManager::finishModelUpload(uint32_t id, uint64_t frame) {
+    auto &model = models[id];
+    model.upload.reset();
+    model.resident = true;
+    // the tails went out in the same batch as the geometry
+    for (uint32_t texture = model.firstTexture; texture < model.firstTexture + model.textureNum; texture++) {
+        if (showTexture(texture, frame))
+            pendingTextures.erase(std::find(pendingTextures.begin(), pendingTextures.end(), texture));
+    }
+}
+
+uint32_t ModelManager::loadModelFromGlbFile(const std::filesystem::path path) {
+    const auto id = addModel(parseGlbFile(path));
+    if (!uploadModel(id))
+        throw std::runtime_error("model vertex/index buffers are full");
+    transfer.wait(*models[id].upload);
+    uploadingModels.erase(std::find(uploadingModels.begin(), uploadingModels.end(), id));
+    finishModelUpload(id, 0);
+    modelResidency.setResident(id, true);
+    return id;
+}
+
+ModelResidency::Plan ModelManager::updateModelResidency(uint64_t frame, uint32_t flightFramesNum) {
+    while (!retiredGeometry.empty() && retiredGeometry.front().frame + flightFramesNum <= frame &&
+           (!retiredGeometry.front().upload || transfer.isDone(*retiredGeometry.front().upload))) {
+        const auto &retired = retiredGeometry.front();
+        vertexRanges.free(retired.vertexBase, retired.vertexNum);
+        indexRanges.free(retired.indexBase, retired.indexNum);
+        morphEntryRanges.free(retired.morphEntryBase, retired.morphEntryNum);
+        retiredGeometry.pop_front();
+    }
+
+    auto plan = modelResidency.plan(frame, maxModelLoadsPerFrame);
+    // a model still uploading had nothing on the device to take away from its avatars
+    auto evicted = plan.evict.begin();
+    for (const auto model : plan.evict) {
+        if (models[model].resident)
+            *evicted++ = model;
+        evictModel(model, frame);
+    }
+    plan.evict.erase(evicted, plan.evict.end());
+
+    // the geometry evicted just now is only released frames later, so a load may have to wait for it
+    modelUploadDeferred = false;
+    for (const auto model : plan.load) {
+        if (!uploadModel(model)) {
+            modelResidency.setResident(model, false);
+            modelUploadDeferred = true;
+        }
+    }
+    transfer.submit();
+
+    // what is reported loaded is what finished uploading
+    plan.load.clear();
+    for (auto it = uploadingModels.begin(); it != uploadingModels.end();) {
+        if (!transfer.isDone(*models[*it].upload)) {
+            ++it;
+            continue;
+        }
+        finishModelUpload(*it, frame);
+        plan.load.push_back(*it);
+        it = uploadingModels.erase(it);
+    }
+    return plan;
 }
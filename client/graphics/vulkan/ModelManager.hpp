@@ -1,18 +1,60 @@
 #ifndef VULKAN_MODEL_MANAGER_HPP
 #define VULKAN_MODEL_MANAGER_HPP
 
+#include "../../avator/VRMAvator.hpp"
+#include "../../avator/pose/AnimationClip.hpp"
 #include "Buffer.hpp"
 #include "Image.hpp"
+#include "ModelResidency.hpp"
+#include "RangeAllocator.hpp"
 #include "Render.hpp"
+#include "TextureResidency.hpp"
+#include "TextureTranscoder.hpp"
+#include "TransferQueue.hpp"
 #include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_precision.hpp>
+#include <deque>
 #include <fastgltf/parser.hpp>
 #include <filesystem>
 
+struct AssetSettings {
+    TextureCompression compression = TextureCompression::Quality;
+    // device memory for streamed model textures; 0: a quarter of the largest device-local heap
+    uint64_t textureBudget = 0;
+    // device memory for whole models, geometry and texture tails; 0: whatever the vertex and index buffers hold
+    uint64_t modelBudget = 0;
+};
+
 class ModelManager {
-    fastgltf::Parser gltfParser;
+    // an image being filled for a new resident level, shown once its upload completes
+    struct PendingTexture {
+        ReadonlyImage image;
+        uint32_t level;
+        TransferQueue::Ticket upload;
+    };
+    // model textures: all levels stay on the host, the image holds the resident ones from imageLevel on
+    struct StreamedTexture {
+        TextureTranscoder::Texture source;
+        std::optional<ReadonlyImage> image;
+        vk::UniqueImageView view;
+        uint32_t slot;
+        uint32_t imageLevel = 0;
+        std::optional<PendingTexture> pending;
+    };
+    // replaced images and their slots, released once no frame in flight and no upload can use them
+    struct RetiredTexture {
+        ReadonlyImage image;
+        vk::UniqueImageView view;
+        // none for pending images replaced before they were shown
+        std::optional<uint32_t> slot;
+        uint64_t frame;
+        std::optional<TransferQueue::Ticket> upload;
+    };
 
     vk::PhysicalDevice physDevice;
     vk::Device device;
+    // model and texture uploads, polled every frame
+    TransferQueue transfer;
     vk::UniqueDescriptorSetLayout modelDescSetLayout;
     vk::UniqueDescriptorSet modelDescSet;
 
@@ -22,8 +64,15 @@ class ModelManager {
     std::optional<ReadonlyBuffer> modelJointsVertBuffer;
     std::optional<ReadonlyBuffer> modelWeightsVertBuffer;
     std::optional<ReadonlyBuffer> modelIndexBuffer;
-    std::vector<ReadonlyImage> textureAtlas;
-    std::vector<vk::UniqueImageView> textureImageViews;
+    // sparse morph target entries of the resident models, read by MorphEvaluator
+    std::optional<ReadonlyBuffer> morphEntryBuffer;
+    // absent if the device can't sample the block formats; textures then stay RGBA8
+    std::optional<TextureTranscoder> transcoder;
+    std::vector<StreamedTexture> streamedTextures;
+    // textures with a pending image
+    std::vector<uint32_t> pendingTextures;
+    std::deque<RetiredTexture> retiredTextures;
+    TextureResidency residency;
 
     std::optional<ReadonlyBuffer> modelInfoBuffer;
     std::optional<ReadonlyBuffer> primitiveInfoBuffer;
@@ -33,6 +82,23 @@ class ModelManager {
     std::optional<ReadonlyImage> defaultTexture;
     vk::UniqueImageView defaultTextureImgView;
     vk::UniqueSampler defaultSampler;
+    // size of the bindless texture array (binding 3), slots handed out so far, and released ones below that
+    uint32_t textureCapacity;
+    uint32_t textureCount = 0;
+    std::vector<uint32_t> freeTextureSlots;
+
+    // levels of texture from level up to this one come from the host when it changes to level; the rest are already on the device
+    uint32_t getHostLevelEnd(uint32_t texture, uint32_t level) const;
+    // staging setResidentLevel() takes for the change
+    vk::DeviceSize getStagingBytes(uint32_t texture, uint32_t level) const;
+    // makes level the finest resident one: records filling a new image into the transfer batch, levels the newest image
+    // (pending or shown) already holds copied from it on the device and only the rest from staging. It is shown by showTexture().
+    void setResidentLevel(uint32_t texture, uint32_t level, uint64_t frame, const TransferQueue::Staging &staging);
+    // puts the pending image of a texture into a new slot once its upload has completed, retiring the old pair;
+    // false if it has no pending image or its upload is still running
+    bool showTexture(uint32_t texture, uint64_t frame);
+    // drops the images of a texture, retiring them like replaced ones
+    void evictTexture(uint32_t texture, uint64_t frame);
 
   public:
     struct MeshPointer {
@@ -40,7 +106,21 @@ class ModelManager {
         uint32_t IndexBase;
         uint32_t indexNum;
         uint32_t materialIndex;
-        uint32_t textureIndex; // no longer used
+        // streamed texture; its current slot is getTextureSlot(textureIndex)
+        uint32_t textureIndex;
+        // cheapest shader permutation that can draw this primitive; Morph is added per avatar while its weights aren't zero
+        ShaderVariant variant;
+        // glTF mesh the primitive belongs to, whose weights drive its morph targets
+        uint32_t mesh = 0;
+        uint32_t vertexNum = 0;
+        // targets firstMorphTarget.. in ModelInfo::morphTargets, and the entries (with no delta) of every vertex they move
+        uint32_t firstMorphTarget = 0, morphTargetNum = 0;
+        uint32_t firstTouched = 0, touchedNum = 0;
+    };
+
+    // a run of sparse position deltas, see ModelHostData::morphEntries
+    struct MorphTarget {
+        uint32_t firstEntry, entryNum;
     };
 
     struct NodeInfo {
@@ -51,16 +131,119 @@ class ModelManager {
     };
 
     struct ModelInfo {
+        // vertexBase and IndexBase point into the shared buffers only while the model is resident
         std::vector<MeshPointer> primitives;
         std::vector<NodeInfo> nodes;
+        std::vector<MorphTarget> morphTargets;
+        // empty unless the file is a VRM model
+        VrmHumanoid humanoid;
+        VrmSpringBones springBones;
+        // the file's animations, compressed; scale and morph weight channels are left out
+        std::vector<AnimationClip> animations;
+        // where the model's morph entries start in the entry buffer, while it is resident
+        uint32_t morphEntryBase = 0;
+        // bounding sphere of the bind pose, in model space
+        glm::vec3 boundsCenter;
+        float boundsRadius;
     };
 
-    ModelManager(vk::PhysicalDevice physDevice, vk::Device device, vk::DescriptorPool pool, vk::Queue queue, vk::CommandBuffer cmdBuf, vk::Fence fence);
-    MeshPointer allocate(uint32_t vertNum, uint32_t indNum);
+    // a parsed model, everything needed to upload it. Attributes are contiguous over all primitives,
+    // zero where a primitive lacks one; primitive bases index these arrays and textureIndex the textures.
+    struct ModelHostData {
+        std::vector<glm::vec3> positions, normals;
+        std::vector<glm::vec2> texcoords;
+        std::vector<glm::u16vec4> joints;
+        std::vector<glm::vec4> weights;
+        std::vector<uint32_t> indices;
+        // morph targets, position only: x = packHalf2x16(delta.xy), y = vertex << 16 | packHalf2x16(delta.z).
+        // Only vertices a target moves have an entry; the vertex index is relative to the primitive.
+        std::vector<glm::uvec2> morphEntries;
+        std::vector<TextureTranscoder::Texture> textures;
+        ModelInfo info;
+    };
+
+  private:
+    // the host copy stays for as long as the model is registered, so an evicted model reloads without parsing
+    struct Model {
+        ModelHostData host;
+        ModelInfo info;
+        // streamed textures firstTexture.. of the model, moved out of host
+        uint32_t firstTexture, textureNum;
+        uint32_t vertexBase = 0, indexBase = 0, morphEntryBase = 0;
+        bool resident = false;
+        // copies in flight; the model becomes resident once they complete
+        std::optional<TransferQueue::Ticket> upload;
+    };
+    // geometry of evicted models, freed once no frame in flight can draw it and its upload, if cut short, is done
+    struct RetiredGeometry {
+        uint32_t vertexBase, vertexNum;
+        uint32_t indexBase, indexNum;
+        uint32_t morphEntryBase, morphEntryNum;
+        uint64_t frame;
+        std::optional<TransferQueue::Ticket> upload;
+    };
+
+    std::vector<Model> models;
+    // models whose upload is in flight
+    std::vector<uint32_t> uploadingModels;
+    std::deque<RetiredGeometry> retiredGeometry;
+    RangeAllocator vertexRanges, indexRanges, morphEntryRanges;
+    ModelResidency modelResidency;
+    // a planned load found the buffers too fragmented or not yet released, and waits for the next frame
+    bool modelUploadDeferred = false;
+
+    // records the copies of a model's geometry and texture tails, which is resident once they complete (see updateModelResidency()).
+    // False, leaving the model evicted, if the vertex, index or morph entry buffers or the staging ring have no room for it
+    bool uploadModel(uint32_t model);
+    // marks a model resident once its upload has completed, showing its textures
+    void finishModelUpload(uint32_t model, uint64_t frame);
+    void evictModel(uint32_t model, uint64_t frame);
+
+  public:
+    // texture array size: the device's update-after-bind limits, capped
+    static uint32_t getTextureCapacity(vk::PhysicalDevice physDevice);
+
+    ModelManager(vk::PhysicalDevice physDevice, vk::Device device, vk::DescriptorPool pool, vk::Queue queue, uint32_t queueFamilyIndex, vk::CommandBuffer cmdBuf, vk::Fence fence,
+                 const AssetSettings &settings = {});
     void prepareRender(RenderDetails &rd);
-    ModelInfo loadModelFromGlbFile(const std::filesystem::path path, vk::Queue queue, vk::CommandBuffer cmdBuf, vk::Fence fence);
-    const auto &getTextureImageViews() const { return textureImageViews; } // no longer used;
+
+    // reads a glb file and transcodes its textures; touches nothing on the device.
+    // Safe to call from other threads while the manager is in use.
+    ModelHostData parseGlbFile(const std::filesystem::path &path);
+    // registers a parsed model without uploading it; returns its id.
+    // It is uploaded once an avatar needs it, see observeModel().
+    uint32_t addModel(ModelHostData host);
+    // parses, registers and uploads at once; throws if the vertex or index buffers are full
+    uint32_t loadModelFromGlbFile(const std::filesystem::path path);
+    uint32_t getModelCount() const { return static_cast<uint32_t>(models.size()); }
+    const ModelInfo &getModelInfo(uint32_t model) const { return models[model].info; }
+    bool isModelResident(uint32_t model) const { return models[model].resident; }
+
+    // an avatar of the model is at distance from the camera this frame; needed if it is drawn as meshes
+    void observeModel(uint32_t model, float distance, bool needed, uint64_t frame) { modelResidency.observe(model, distance, needed, frame); }
+    // evicts models and starts uploads as observed this frame, and returns the models evicted and those whose uploads
+    // completed, which are resident from now on. Frames before frame - flightFramesNum must have completed.
+    ModelResidency::Plan updateModelResidency(uint64_t frame, uint32_t flightFramesNum);
+    bool isModelStreamingPending() const { return modelResidency.hasPending() || modelUploadDeferred || !uploadingModels.empty(); }
+    const ModelResidency &getModelResidency() const { return modelResidency; }
+    // add ModelInfo::morphEntryBase to the entry indices of a resident model
+    vk::DeviceAddress getMorphEntryAddress() { return morphEntryBuffer->getDeviceAddress(device); }
+
+    // puts an image view into a free slot of the texture array and returns its index.
+    // Safe while frames using the array are in flight: the slot is unused by them, and the binding is update-unused-while-pending.
+    uint32_t registerTexture(vk::ImageView view);
     const auto &getDescSetLayout() const { return modelDescSetLayout.get(); }
+    TextureTranscodeStats getTextureStats() const { return transcoder ? transcoder->getStats() : TextureTranscodeStats{}; }
+
+    // slot currently holding a streamed texture; set once its model is resident, and changes whenever updateTextureResidency() returns true
+    uint32_t getTextureSlot(uint32_t texture) const { return streamedTextures[texture].slot; }
+    // the texture is drawn this frame covering about screenPixels across
+    void requestTexture(uint32_t texture, float screenPixels, uint64_t frame) { residency.request(texture, screenPixels, frame); }
+    // starts streaming levels in and out as requested this frame, and shows the textures whose uploads have completed;
+    // true if any slot changed. Frames before frame - flightFramesNum must have completed.
+    bool updateTextureResidency(uint64_t frame, uint32_t flightFramesNum);
+    bool isTextureStreamingPending() const { return residency.hasPending() || !pendingTextures.empty(); }
+    const TextureResidency &getTextureResidency() const { return residency; }
 };
 
 #endif VULKAN_MODEL_MANAGER_HPP
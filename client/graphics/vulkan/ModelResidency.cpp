@@ -0,0 +1,122 @@
+#include "ModelResidency.hpp"
+#include <algorithm>
+
+float ModelResidency::predictedDistance(const Entry &entry) const {
+    return std::max(entry.distance - entry.approachSpeed * lookaheadFrames, 0.0f);
+}
+
+uint32_t ModelResidency::add(uint64_t bytes, bool resident) {
+    Entry entry;
+    entry.bytes = bytes;
+    entry.resident = resident;
+    if (resident) {
+        stats.residentBytes += bytes;
+        stats.peakBytes = std::max(stats.peakBytes, stats.residentBytes);
+    }
+    entries.push_back(entry);
+    return static_cast<uint32_t>(entries.size() - 1);
+}
+
+void ModelResidency::observe(uint32_t model, float distance, bool needed, uint64_t frame) {
+    auto &entry = entries[model];
+    if (entry.observedFrame != frame) {
+        entry.observedFrame = frame;
+        entry.distance = distance;
+        entry.needed = needed;
+    } else {
+        entry.distance = std::min(entry.distance, distance);
+        entry.needed |= needed;
+    }
+    if (needed)
+        entry.neededFrame = frame;
+}
+
+ModelResidency::Plan ModelResidency::plan(uint64_t frame, uint32_t maxLoads) {
+    Plan plan;
+    pending = false;
+
+    for (auto &entry : entries) {
+        if (entry.observedFrame != frame)
+            continue;
+        // smoothed, since avatars walk in steps and the nearest one changes
+        const float speed = entry.plannedFrame + 1 == frame ? entry.plannedDistance - entry.distance : 0.0f;
+        entry.approachSpeed += (speed - entry.approachSpeed) * 0.1f;
+        entry.plannedDistance = entry.distance;
+        entry.plannedFrame = frame;
+    }
+
+    auto observed = [frame](const Entry &entry) { return entry.observedFrame == frame; };
+    auto needed = [&](const Entry &entry) { return observed(entry) && entry.needed; };
+
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < entries.size(); i++)
+        if (!entries[i].resident && observed(entries[i]))
+            candidates.push_back(i);
+    std::stable_sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) {
+        if (needed(entries[a]) != needed(entries[b]))
+            return needed(entries[a]);
+        return predictedDistance(entries[a]) < predictedDistance(entries[b]);
+    });
+
+    // eviction order: models not seen this frame, least recently needed first, then impostor-only ones, furthest first
+    std::vector<uint32_t> victims;
+    for (uint32_t i = 0; i < entries.size(); i++)
+        if (entries[i].resident && !needed(entries[i]))
+            victims.push_back(i);
+    std::stable_sort(victims.begin(), victims.end(), [&](uint32_t a, uint32_t b) {
+        if (observed(entries[a]) != observed(entries[b]))
+            return !observed(entries[a]);
+        if (!observed(entries[a]))
+            return entries[a].neededFrame < entries[b].neededFrame;
+        return predictedDistance(entries[a]) > predictedDistance(entries[b]);
+    });
+
+    uint32_t loads = 0;
+    for (const auto model : candidates) {
+        if (loads == maxLoads) {
+            pending = true;
+            break;
+        }
+        const auto &entry = entries[model];
+        // only what is less useful than the candidate makes room for it
+        auto lessUseful = [&](const Entry &victim) {
+            return needed(entry) || !observed(victim) || predictedDistance(victim) > predictedDistance(entry);
+        };
+
+        uint64_t freed = 0;
+        size_t victimNum = 0;
+        while (stats.residentBytes - freed + entry.bytes > budget && victimNum < victims.size() && lessUseful(entries[victims[victimNum]]))
+            freed += entries[victims[victimNum++]].bytes;
+        if (stats.residentBytes - freed + entry.bytes > budget)
+            continue;
+
+        for (size_t v = 0; v < victimNum; v++) {
+            entries[victims[v]].resident = false;
+            plan.evict.push_back(victims[v]);
+            stats.evicted++;
+        }
+        victims.erase(victims.begin(), victims.begin() + victimNum);
+        stats.residentBytes -= freed;
+
+        entries[model].resident = true;
+        stats.residentBytes += entry.bytes;
+        stats.peakBytes = std::max(stats.peakBytes, stats.residentBytes);
+        stats.loaded++;
+        plan.load.push_back(model);
+        loads++;
+    }
+    return plan;
+}
+
+void ModelResidency::setResident(uint32_t model, bool resident) {
+    auto &entry = entries[model];
+    if (entry.resident == resident)
+        return;
+    entry.resident = resident;
+    if (resident) {
+        stats.residentBytes += entry.bytes;
+        stats.peakBytes = std::max(stats.peakBytes, stats.residentBytes);
+    } else {
+        stats.residentBytes -= entry.bytes;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef VULKAN_MODEL_RESIDENCY_HPP
+#define VULKAN_MODEL_RESIDENCY_HPP
+
+#include <cstdint>
+#include <vector>
+
+// Decides which models keep their geometry and textures on the device.
+// Models with an avatar drawn as meshes this frame always stay. When something needed doesn't fit in the
+// budget, models no avatar has needed for the longest time go first, then impostor-only ones furthest away.
+// Evicted models are brought back nearest first, where distance is extrapolated over lookaheadFrames so
+// avatars the camera approaches are loaded before they get close.
+class ModelResidency {
+  public:
+    static constexpr float lookaheadFrames = 60.0f;
+
+    struct Plan {
+        std::vector<uint32_t> evict, load;
+    };
+
+    struct Stats {
+        uint64_t residentBytes = 0, peakBytes = 0;
+        uint64_t loaded = 0, evicted = 0;
+    };
+
+  private:
+    struct Entry {
+        uint64_t bytes;
+        bool resident;
+        // nearest avatar in observedFrame, and whether any was drawn as meshes then
+        float distance = 0.0f;
+        bool needed = false;
+        uint64_t observedFrame = UINT64_MAX;
+        // last frame an avatar of the model was drawn as meshes
+        uint64_t neededFrame = 0;
+        // distance at the previous plan(), and how fast it shrinks per frame
+        float plannedDistance = 0.0f;
+        uint64_t plannedFrame = UINT64_MAX;
+        float approachSpeed = 0.0f;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t budget;
+    Stats stats;
+    bool pending = false;
+
+    float predictedDistance(const Entry &entry) const;
+
+  public:
+    explicit ModelResidency(uint64_t budget) : budget{budget} {}
+
+    // registers a model by its device size; ids are handed out in order
+    uint32_t add(uint64_t bytes, bool resident);
+    bool isResident(uint32_t model) const { return entries[model].resident; }
+
+    // an avatar of the model is at distance from the camera this frame; needed if it would be drawn as meshes
+    void observe(uint32_t model, float distance, bool needed, uint64_t frame);
+    // at most maxLoads models come back per call, evicting as needed. The returned changes are assumed done;
+    // a load that couldn't be carried out is reported back with setResident(model, false).
+    Plan plan(uint64_t frame, uint32_t maxLoads);
+    // for loads and evictions made outside plan()
+    void setResident(uint32_t model, bool resident);
+    // true if the last plan() left models it could have loaded for lack of time (not of budget)
+    bool hasPending() const { return pending; }
+
+    uint64_t getBudget() const { return budget; }
+    const Stats &getStats() const { return stats; }
+};
+
+#endif // VULKAN_MODEL_RESIDENCY_HPP
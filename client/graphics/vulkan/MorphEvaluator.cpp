@@ -0,0 +1,99 @@
+#include "MorphEvaluator.hpp"
+#include "Helper.hpp"
+#include <algorithm>
+#include <glm/glm.hpp>
+
+// vertices of all morphed primitive instances together
+constexpr uint32_t maxDeltaNum = 262144;
+// evaluations and targets applied per frame; the rest waits for the next one
+constexpr uint32_t maxInstanceNum = 1024;
+constexpr uint32_t maxJobNum = 16384;
+
+MorphEvaluator::MorphEvaluator(vk::PhysicalDevice physDevice, vk::Device device, uint32_t flightFramesNum)
+    : device{device}, flightFramesNum{flightFramesNum}, regions{maxDeltaNum} {
+    constexpr auto usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress;
+    deltaBuffer.emplace(physDevice, device, usage, sizeof(glm::vec3) * maxDeltaNum);
+    instanceBuffer.emplace(physDevice, device, sizeof(Instance) * maxInstanceNum * flightFramesNum, usage);
+    jobBuffer.emplace(physDevice, device, sizeof(Job) * maxJobNum * flightFramesNum, usage);
+
+    vk::PushConstantRange pushConstantRange{vk::ShaderStageFlagBits::eCompute, 0, sizeof(Addresses)};
+    vk::PipelineLayoutCreateInfo layoutCreateInfo;
+    layoutCreateInfo.pushConstantRangeCount = 1;
+    layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    pipelineLayout = device.createPipelineLayoutUnique(layoutCreateInfo);
+
+    auto shader = createShaderModuleFromFile(device, "morph.comp.spv");
+    vk::ComputePipelineCreateInfo pipelineCreateInfo;
+    pipelineCreateInfo.stage.stage = vk::ShaderStageFlagBits::eCompute;
+    pipelineCreateInfo.stage.module = shader.get();
+    pipelineCreateInfo.stage.pName = "main";
+    pipelineCreateInfo.layout = pipelineLayout.get();
+    pipeline = device.createComputePipelineUnique(nullptr, pipelineCreateInfo).value;
+}
+
+std::optional<uint32_t> MorphEvaluator::allocateRegion(uint32_t vertexNum, uint64_t frame) {
+    while (!retiredRegions.empty() && retiredRegions.front().frame + flightFramesNum <= frame) {
+        regions.free(retiredRegions.front().base, retiredRegions.front().vertexNum);
+        retiredRegions.pop_front();
+    }
+    const auto base = regions.allocate(vertexNum);
+    if (base)
+        newRegions.emplace_back(*base, vertexNum);
+    return base;
+}
+
+void MorphEvaluator::freeRegion(uint32_t base, uint32_t vertexNum, uint64_t frame) {
+    retiredRegions.push_back(RetiredRegion{base, vertexNum, frame});
+}
+
+bool MorphEvaluator::evaluate(uint32_t region, uint32_t firstTouched, uint32_t touchedNum, const std::vector<Target> &targets) {
+    if (instances.size() == maxInstanceNum || jobs.size() + targets.size() > maxJobNum)
+        return false;
+    instances.push_back(Instance{region, firstTouched, touchedNum, static_cast<uint32_t>(jobs.size()), static_cast<uint32_t>(targets.size())});
+    for (const auto &target : targets)
+        jobs.push_back(Job{target.firstEntry, target.entryNum, target.weight});
+    return true;
+}
+
+void MorphEvaluator::record(vk::CommandBuffer cmdBuf, uint32_t flightIndex, vk::DeviceAddress entries) {
+    if (instances.empty() && newRegions.empty())
+        return;
+
+    std::copy(instances.begin(), instances.end(), static_cast<Instance *>(instanceBuffer->get()) + maxInstanceNum * flightIndex);
+    std::copy(jobs.begin(), jobs.end(), static_cast<Job *>(jobBuffer->get()) + maxJobNum * flightIndex);
+    instanceBuffer.value().flush<1>(device, {{{sizeof(Instance) * maxInstanceNum * flightIndex, sizeof(Instance) * maxInstanceNum}}});
+    jobBuffer.value().flush<1>(device, {{{sizeof(Job) * maxJobNum * flightIndex, sizeof(Job) * maxJobNum}}});
+
+    // regions are shared by the flight frames, so the previous frame's draws must be done reading them
+    vk::MemoryBarrier readBarrier{vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+                                  vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eComputeShader,
+                           vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+                           vk::DependencyFlags{}, {readBarrier}, {}, {});
+
+    if (!newRegions.empty()) {
+        for (const auto &[base, vertexNum] : newRegions)
+            cmdBuf.fillBuffer(deltaBuffer->getBuffer(), sizeof(glm::vec3) * base, sizeof(glm::vec3) * vertexNum, 0);
+        vk::MemoryBarrier fillBarrier{vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eVertexShader,
+                               vk::DependencyFlags{}, {fillBarrier}, {}, {});
+        newRegions.clear();
+    }
+
+    if (!instances.empty()) {
+        Addresses addresses;
+        addresses.entries = entries;
+        addresses.instances = instanceBuffer->getDeviceAddress(device) + sizeof(Instance) * maxInstanceNum * flightIndex;
+        addresses.jobs = jobBuffer->getDeviceAddress(device) + sizeof(Job) * maxJobNum * flightIndex;
+        addresses.deltas = getDeltaAddress();
+        cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.get());
+        cmdBuf.pushConstants(pipelineLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(Addresses), &addresses);
+        cmdBuf.dispatch(static_cast<uint32_t>(instances.size()), 1, 1);
+
+        vk::MemoryBarrier writeBarrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead};
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eVertexShader,
+                               vk::DependencyFlags{}, {writeBarrier}, {}, {});
+        instances.clear();
+        jobs.clear();
+    }
+}
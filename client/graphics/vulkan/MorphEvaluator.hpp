@@ -0,0 +1,79 @@
+#ifndef VULKAN_MORPH_EVALUATOR_HPP
+#define VULKAN_MORPH_EVALUATOR_HPP
+
+#include "Buffer.hpp"
+#include "RangeAllocator.hpp"
+#include <deque>
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+// Applies sparse morph targets on the device.
+// Every morphed primitive instance owns a region of position deltas, one vec3 per vertex, that the MORPH
+// vertex shaders add to the bind pose. Only instances whose weights changed are re-evaluated: their
+// touched vertices are cleared, then each target with a non-zero weight adds weight * delta to the vertices it moves.
+class MorphEvaluator {
+  public:
+    // entries of a target in the model manager's morph entry buffer, and its weight
+    struct Target {
+        uint32_t firstEntry, entryNum;
+        float weight;
+    };
+
+  private:
+    struct Instance {
+        uint32_t region;
+        uint32_t firstTouched, touchedNum;
+        uint32_t firstJob, jobNum;
+        uint32_t dummy[3];
+    };
+    struct Job {
+        uint32_t firstEntry, entryNum;
+        float weight;
+        uint32_t dummy[1];
+    };
+    // morph.comp push constants
+    struct Addresses {
+        vk::DeviceAddress entries, instances, jobs, deltas;
+    };
+    struct RetiredRegion {
+        uint32_t base, vertexNum;
+        uint64_t frame;
+    };
+
+    vk::Device device;
+    uint32_t flightFramesNum;
+    vk::UniquePipelineLayout pipelineLayout;
+    vk::UniquePipeline pipeline;
+
+    std::optional<ReadonlyBuffer> deltaBuffer;
+    RangeAllocator regions;
+    std::deque<RetiredRegion> retiredRegions;
+    // per flight frame: the evaluations recorded in it
+    std::optional<CommunicationBuffer> instanceBuffer;
+    std::optional<CommunicationBuffer> jobBuffer;
+
+    std::vector<Instance> instances;
+    std::vector<Job> jobs;
+    // regions allocated since the last record(), cleared before anything is evaluated into them
+    std::vector<std::pair<uint32_t, uint32_t>> newRegions;
+
+  public:
+    MorphEvaluator(vk::PhysicalDevice physDevice, vk::Device device, uint32_t flightFramesNum);
+
+    // room for the deltas of vertexNum vertices, all zero until evaluated; nullopt if the delta buffer is full.
+    // Frames before frame - flightFramesNum must have completed.
+    std::optional<uint32_t> allocateRegion(uint32_t vertexNum, uint64_t frame);
+    // released once no frame in flight can draw with it
+    void freeRegion(uint32_t base, uint32_t vertexNum, uint64_t frame);
+
+    // queues the region to be rebuilt from targets this frame; touched lists the entries (of any delta)
+    // of every vertex any target of the primitive moves. False, queuing nothing, if this frame's tables are full.
+    bool evaluate(uint32_t region, uint32_t firstTouched, uint32_t touchedNum, const std::vector<Target> &targets);
+
+    // records the queued evaluations, ahead of any pass drawing the scene
+    void record(vk::CommandBuffer cmdBuf, uint32_t flightIndex, vk::DeviceAddress entries);
+    vk::DeviceAddress getDeltaAddress() { return deltaBuffer->getDeviceAddress(device); }
+};
+
+#endif // VULKAN_MORPH_EVALUATOR_HPP
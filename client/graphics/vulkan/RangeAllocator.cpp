@@ -0,0 +1,32 @@
+#include "RangeAllocator.hpp"
+#include <algorithm>
+
+std::optional<uint32_t> RangeAllocator::allocate(uint32_t n) {
+    if (n == 0)
+        return 0;
+    auto it = std::find_if(freeRanges.begin(), freeRanges.end(), [n](const auto &r) { return r.second - r.first >= n; });
+    if (it == freeRanges.end())
+        return std::nullopt;
+    const auto base = it->first;
+    it->first += n;
+    if (it->first == it->second)
+        freeRanges.erase(it);
+    highWater = std::max(highWater, base + n);
+    return base;
+}
+
+void RangeAllocator::free(uint32_t base, uint32_t n) {
+    if (n == 0)
+        return;
+    auto it = std::lower_bound(freeRanges.begin(), freeRanges.end(), std::make_pair(base, base + n));
+    it = freeRanges.insert(it, {base, base + n});
+    // merge with neighbours
+    if (std::next(it) != freeRanges.end() && it->second == std::next(it)->first) {
+        it->second = std::next(it)->second;
+        freeRanges.erase(std::next(it));
+    }
+    if (it != freeRanges.begin() && std::prev(it)->second == it->first) {
+        std::prev(it)->second = it->second;
+        freeRanges.erase(it);
+    }
+}
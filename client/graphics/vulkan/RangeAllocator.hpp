@@ -0,0 +1,24 @@
+#ifndef VULKAN_RANGE_ALLOCATOR_HPP
+#define VULKAN_RANGE_ALLOCATOR_HPP
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Hands out contiguous ranges of [0, capacity), first fit; freed ranges merge with their free neighbours.
+class RangeAllocator {
+    // free [begin, end) ranges, sorted
+    std::vector<std::pair<uint32_t, uint32_t>> freeRanges;
+    uint32_t highWater = 0;
+
+  public:
+    explicit RangeAllocator(uint32_t capacity) : freeRanges{{0, capacity}} {}
+
+    // base of n consecutive units, or nothing if no free range is that long
+    std::optional<uint32_t> allocate(uint32_t n);
+    void free(uint32_t base, uint32_t n);
+    // units past this have never been handed out
+    uint32_t getHighWater() const { return highWater; }
+};
+
+#endif // VULKAN_RANGE_ALLOCATOR_HPP
@@ -3,31 +3,49 @@
 
 #include <vulkan/vulkan.hpp>
 #include <glm/glm.hpp>
+#include <memory>
 #include "Image.hpp"
+#include "RenderGraph.hpp"
+#include "ScenePipelineCache.hpp"
+#include "ShaderVariant.hpp"
 
 struct RenderTargetHint {
     vk::Format format;
     vk::Extent2D extent;
     std::vector<vk::Image> images;
+    // layout the images must be in once rendering has finished
+    vk::ImageLayout finalLayout = vk::ImageLayout::ePresentSrcKHR;
 };
 
 struct RenderProcRenderTargetDependant {
-    std::vector<Image> depthImages;
-    std::vector<vk::UniqueImageView> depthImageViews;
-    std::vector<vk::UniqueFramebuffer> frameBufs;
-    vk::UniqueRenderPass renderpass;
-    vk::UniquePipeline pipeline;
+    std::unique_ptr<RenderGraph> graph;
+    std::unique_ptr<ScenePipelineCache> scenePipelines;
+    vk::UniquePipeline impostorPipeline;
 };
 
 struct RenderTarget {
     vk::Extent2D extent;
     vk::Format format;
+    vk::ImageLayout finalLayout;
+    std::vector<vk::Image> images;
     std::vector<vk::UniqueImageView> imageViews;
 };
 
+// device addresses of the current flight frame's scene buffers, pushed as constants instead of bound as descriptors
+struct SceneBufferAddresses {
+    vk::DeviceAddress objects;
+    vk::DeviceAddress joints;
+    vk::DeviceAddress meshes;
+    vk::DeviceAddress instances;
+    vk::DeviceAddress impostors;
+    // morph deltas of every instance, shared by the flight frames (MorphEvaluator)
+    vk::DeviceAddress morphDeltas;
+};
+
 struct RenderDetails {
     vk::CommandBuffer cmdBuf;
-    uint32_t imageIndex, modelsCount;
+    uint32_t imageIndex, flightIndex, impostorCount;
+    const std::vector<DrawGroup> *drawGroups;
 
     // vertex buffers
     vk::Buffer positionVertBuf, normalVertBuf, tangentVertBuf;
@@ -40,7 +58,9 @@ struct RenderDetails {
 
     vk::DescriptorSet descSet, assetDescSet;
 
-    std::array<uint32_t, 4> dynamicOfs;
+    // dynamic offset of the camera (set 0, binding 0)
+    uint32_t cameraOffset;
+    SceneBufferAddresses sceneBuffers;
 };
 
 struct SceneData {
@@ -0,0 +1,459 @@
+#include "RenderGraph.hpp"
+#include "Helper.hpp"
+#include <algorithm>
+#include <numeric>
+
+#ifdef _DEBUG
+#include <iostream>
+#endif
+
+namespace {
+
+constexpr vk::AccessFlags writeAccessMask =
+    vk::AccessFlagBits::eColorAttachmentWrite |
+    vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+    vk::AccessFlagBits::eShaderWrite |
+    vk::AccessFlagBits::eTransferWrite |
+    vk::AccessFlagBits::eHostWrite |
+    vk::AccessFlagBits::eMemoryWrite;
+
+bool hasWrite(vk::AccessFlags access) {
+    return bool(access & writeAccessMask);
+}
+
+vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+RenderGraph::RenderGraph(vk::PhysicalDevice physDevice, vk::Device device, uint32_t flightFramesNum)
+    : physDevice{physDevice}, device{device}, transientFrames(flightFramesNum) {}
+
+RenderGraph::ResourceId RenderGraph::createTransientImage(const std::string &name, vk::Format format, vk::Extent2D extent, vk::ImageAspectFlags aspect) {
+    Resource res;
+    res.name = name;
+    res.format = format;
+    res.extent = extent;
+    res.aspect = aspect;
+    res.transientIndex = transients.size();
+    transients.push_back(resources.size());
+    resources.push_back(std::move(res));
+    return resources.size() - 1;
+}
+
+RenderGraph::ResourceId RenderGraph::importImages(const std::string &name, std::vector<vk::Image> images, std::vector<vk::ImageView> views,
+                                                  vk::Format format, vk::Extent2D extent, vk::ImageLayout finalLayout) {
+    Resource res;
+    res.name = name;
+    res.imported = true;
+    res.format = format;
+    res.extent = extent;
+    res.aspect = vk::ImageAspectFlagBits::eColor;
+    res.finalLayout = finalLayout;
+    res.importedImages = std::move(images);
+    res.importedViews = std::move(views);
+    resources.push_back(std::move(res));
+    return resources.size() - 1;
+}
+
+RenderGraph::ResourceId RenderGraph::importBuffer(const std::string &name, vk::Buffer buffer) {
+    Resource res;
+    res.name = name;
+    res.isBuffer = true;
+    res.imported = true;
+    res.importedBuffer = buffer;
+    resources.push_back(std::move(res));
+    return resources.size() - 1;
+}
+
+RenderGraph::PassId RenderGraph::addGraphicsPass(const std::string &name, RecordFunc record) {
+    Pass pass;
+    pass.name = name;
+    pass.graphics = true;
+    pass.record = std::move(record);
+    passes.push_back(std::move(pass));
+    return passes.size() - 1;
+}
+
+RenderGraph::PassId RenderGraph::addComputePass(const std::string &name, RecordFunc record) {
+    Pass pass;
+    pass.name = name;
+    pass.graphics = false;
+    pass.record = std::move(record);
+    passes.push_back(std::move(pass));
+    return passes.size() - 1;
+}
+
+void RenderGraph::addAccess(PassId pass, Access access) {
+    auto &res = resources[access.resource];
+    res.firstPass = std::min(res.firstPass, pass);
+    res.lastPass = std::max(res.lastPass, pass);
+    passes[pass].accesses.push_back(access);
+    compiled = false;
+}
+
+void RenderGraph::writeColor(PassId pass, ResourceId image, std::optional<vk::ClearColorValue> clear) {
+    Access access{image, AccessType::ColorAttachment,
+                  vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                  vk::AccessFlagBits::eColorAttachmentWrite,
+                  vk::ImageLayout::eColorAttachmentOptimal};
+    if (clear)
+        access.clear = vk::ClearValue{*clear};
+    else
+        access.access |= vk::AccessFlagBits::eColorAttachmentRead;
+    resources[image].usage |= vk::ImageUsageFlagBits::eColorAttachment;
+    addAccess(pass, access);
+}
+
+void RenderGraph::writeDepth(PassId pass, ResourceId image, std::optional<float> clear) {
+    Access access{image, AccessType::DepthAttachment,
+                  vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+                  vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                  vk::ImageLayout::eDepthStencilAttachmentOptimal};
+    if (clear)
+        access.clear = vk::ClearValue{vk::ClearDepthStencilValue{*clear, 0}};
+    resources[image].usage |= vk::ImageUsageFlagBits::eDepthStencilAttachment;
+    addAccess(pass, access);
+}
+
+void RenderGraph::readSampled(PassId pass, ResourceId image, vk::PipelineStageFlags stage) {
+    resources[image].usage |= vk::ImageUsageFlagBits::eSampled;
+    addAccess(pass, Access{image, AccessType::Sampled, stage, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal});
+}
+
+void RenderGraph::readStorageImage(PassId pass, ResourceId image, vk::PipelineStageFlags stage) {
+    resources[image].usage |= vk::ImageUsageFlagBits::eStorage;
+    addAccess(pass, Access{image, AccessType::StorageRead, stage, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral});
+}
+
+void RenderGraph::writeStorageImage(PassId pass, ResourceId image, vk::PipelineStageFlags stage) {
+    resources[image].usage |= vk::ImageUsageFlagBits::eStorage;
+    addAccess(pass, Access{image, AccessType::StorageWrite, stage, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral});
+}
+
+void RenderGraph::readBuffer(PassId pass, ResourceId buffer, vk::PipelineStageFlags stage, vk::AccessFlags access) {
+    addAccess(pass, Access{buffer, AccessType::BufferRead, stage, access, vk::ImageLayout::eUndefined});
+}
+
+void RenderGraph::writeBuffer(PassId pass, ResourceId buffer, vk::PipelineStageFlags stage, vk::AccessFlags access) {
+    addAccess(pass, Access{buffer, AccessType::BufferWrite, stage, access, vk::ImageLayout::eUndefined});
+}
+
+vk::UniqueRenderPass RenderGraph::createRenderPass(const Pass &pass) const {
+    std::vector<vk::AttachmentDescription> attachments;
+    std::vector<vk::AttachmentReference> colorRefs;
+    std::optional<vk::AttachmentReference> depthRef;
+
+    for (const auto resId : pass.attachments) {
+        const auto &acc = *std::find_if(pass.accesses.begin(), pass.accesses.end(), [resId](const Access &a) { return a.resource == resId; });
+        const auto &res = resources[resId];
+        const bool usedLater = res.imported || res.lastPass > uint32_t(&pass - passes.data());
+
+        vk::AttachmentDescription desc;
+        desc.format = res.format;
+        desc.samples = vk::SampleCountFlagBits::e1;
+        desc.loadOp = acc.clear ? vk::AttachmentLoadOp::eClear
+                                : (res.firstPass == uint32_t(&pass - passes.data()) ? vk::AttachmentLoadOp::eDontCare : vk::AttachmentLoadOp::eLoad);
+        desc.storeOp = usedLater ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+        desc.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+        desc.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+        // layout transitions are done by the graph's barriers, not by the render pass
+        desc.initialLayout = acc.layout;
+        desc.finalLayout = acc.layout;
+
+        vk::AttachmentReference ref{uint32_t(attachments.size()), acc.layout};
+        if (acc.type == AccessType::DepthAttachment)
+            depthRef = ref;
+        else
+            colorRefs.push_back(ref);
+        attachments.push_back(desc);
+    }
+
+    vk::SubpassDescription subpasses[1];
+    subpasses[0].pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+    subpasses[0].colorAttachmentCount = colorRefs.size();
+    subpasses[0].pColorAttachments = colorRefs.data();
+    subpasses[0].pDepthStencilAttachment = depthRef ? &*depthRef : nullptr;
+
+    vk::RenderPassCreateInfo renderpassCreateInfo;
+    renderpassCreateInfo.attachmentCount = attachments.size();
+    renderpassCreateInfo.pAttachments = attachments.data();
+    renderpassCreateInfo.subpassCount = std::size(subpasses);
+    renderpassCreateInfo.pSubpasses = subpasses;
+
+    return device.createRenderPassUnique(renderpassCreateInfo);
+}
+
+void RenderGraph::compile() {
+    struct State {
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+        vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eTopOfPipe;
+        vk::AccessFlags access;
+        bool used = false;
+    };
+    std::vector<State> states(resources.size());
+
+    for (auto &res : resources) {
+        if (!res.imported && !res.isBuffer) {
+            // a transient may share memory with one whose lifetime already ended
+            res.aliased = std::any_of(transients.begin(), transients.end(), [&](ResourceId other) {
+                return resources[other].lastPass < res.firstPass;
+            });
+        }
+    }
+
+    for (uint32_t passIndex = 0; passIndex < passes.size(); passIndex++) {
+        auto &pass = passes[passIndex];
+        pass.barriers.clear();
+        pass.attachments.clear();
+        pass.clearValues.clear();
+
+        for (const auto &acc : pass.accesses) {
+            auto &st = states[acc.resource];
+            const auto &res = resources[acc.resource];
+
+            Barrier barrier{acc.resource, st.stage, acc.stage, st.access, acc.access, st.layout, acc.layout};
+            bool needed;
+            if (res.isBuffer) {
+                // read-after-write, write-after-write and write-after-read need a dependency
+                needed = st.used && (hasWrite(st.access) || hasWrite(acc.access));
+            } else {
+                needed = st.layout != acc.layout || hasWrite(st.access) || (st.used && hasWrite(acc.access));
+                if (!st.used && res.aliased) {
+                    barrier.srcStage = vk::PipelineStageFlagBits::eAllCommands;
+                    barrier.srcAccess = vk::AccessFlagBits::eMemoryWrite;
+                } else if (!st.used) {
+                    // chains with the semaphore wait on acquired swapchain images
+                    barrier.srcStage = acc.stage;
+                }
+            }
+            if (needed)
+                pass.barriers.push_back(barrier);
+
+            st.layout = acc.layout;
+            st.stage = acc.stage;
+            st.access = acc.access;
+            st.used = true;
+        }
+
+        if (pass.graphics) {
+            // color attachments first, depth last
+            for (const auto &acc : pass.accesses)
+                if (acc.type == AccessType::ColorAttachment)
+                    pass.attachments.push_back(acc.resource);
+            for (const auto &acc : pass.accesses)
+                if (acc.type == AccessType::DepthAttachment)
+                    pass.attachments.push_back(acc.resource);
+            for (const auto resId : pass.attachments) {
+                const auto &acc = *std::find_if(pass.accesses.begin(), pass.accesses.end(), [resId](const Access &a) { return a.resource == resId; });
+                pass.clearValues.push_back(acc.clear.value_or(vk::ClearValue{}));
+            }
+            pass.renderpass = createRenderPass(pass);
+            pass.framebuffers.clear();
+        }
+    }
+
+    finalBarriers.clear();
+    for (ResourceId id = 0; id < resources.size(); id++) {
+        const auto &res = resources[id];
+        const auto &st = states[id];
+        if (res.imported && !res.isBuffer && res.finalLayout != vk::ImageLayout::eUndefined && res.finalLayout != st.layout) {
+            finalBarriers.push_back(Barrier{id, st.stage, vk::PipelineStageFlagBits::eBottomOfPipe,
+                                            st.access, {}, st.layout, res.finalLayout});
+        }
+    }
+
+    placements.clear();
+    for (auto &frame : transientFrames)
+        frame.reset();
+    compiled = true;
+}
+
+vk::UniqueImage RenderGraph::createTransientImage(const Resource &res) const {
+    vk::ImageCreateInfo imgCreateInfo;
+    imgCreateInfo.imageType = vk::ImageType::e2D;
+    imgCreateInfo.extent = vk::Extent3D{res.extent.width, res.extent.height, 1};
+    imgCreateInfo.mipLevels = 1;
+    imgCreateInfo.arrayLayers = 1;
+    imgCreateInfo.format = res.format;
+    imgCreateInfo.tiling = vk::ImageTiling::eOptimal;
+    imgCreateInfo.initialLayout = vk::ImageLayout::eUndefined;
+    imgCreateInfo.usage = res.usage;
+    imgCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+    imgCreateInfo.samples = vk::SampleCountFlagBits::e1;
+    return device.createImageUnique(imgCreateInfo);
+}
+
+void RenderGraph::planTransientMemory(const std::vector<vk::UniqueImage> &images) {
+    std::vector<vk::MemoryRequirements> reqs;
+    uint32_t typeBits = ~0u;
+    for (const auto &image : images) {
+        reqs.push_back(device.getImageMemoryRequirements(image.get()));
+        typeBits &= reqs.back().memoryTypeBits;
+    }
+
+    // place the biggest first, each at the lowest offset not overlapping anything alive at the same time
+    std::vector<uint32_t> order(images.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return reqs[a].size > reqs[b].size; });
+
+    placements.assign(images.size(), TransientPlacement{0});
+    std::vector<uint32_t> placed;
+    transientMemorySize = 0;
+    for (const auto i : order) {
+        const auto &res = resources[transients[i]];
+        auto lifetimeOverlaps = [&](uint32_t j) {
+            const auto &other = resources[transients[j]];
+            return res.firstPass <= other.lastPass && other.firstPass <= res.lastPass;
+        };
+
+        std::vector<vk::DeviceSize> candidates = {0};
+        for (const auto j : placed)
+            if (lifetimeOverlaps(j))
+                candidates.push_back(alignUp(placements[j].offset + reqs[j].size, reqs[i].alignment));
+        std::sort(candidates.begin(), candidates.end());
+
+        for (const auto offset : candidates) {
+            bool fits = std::none_of(placed.begin(), placed.end(), [&](uint32_t j) {
+                return lifetimeOverlaps(j) && offset < placements[j].offset + reqs[j].size && placements[j].offset < offset + reqs[i].size;
+            });
+            if (fits) {
+                placements[i].offset = offset;
+                break;
+            }
+        }
+        placed.push_back(i);
+        transientMemorySize = std::max(transientMemorySize, placements[i].offset + reqs[i].size);
+    }
+
+    vk::MemoryRequirements combined;
+    combined.memoryTypeBits = typeBits;
+    auto typeIndex = findMemoryTypeIndex(physDevice, vk::MemoryPropertyFlags{vk::MemoryPropertyFlagBits::eDeviceLocal}, combined);
+    if (!typeIndex)
+        throw std::runtime_error("no memory type suitable for all transient images");
+    transientMemoryTypeIndex = *typeIndex;
+
+#ifdef _DEBUG
+    vk::DeviceSize unaliased = 0;
+    for (const auto &req : reqs)
+        unaliased += req.size;
+    std::clog << "render graph transient memory: " << transientMemorySize << " bytes (" << unaliased << " without aliasing)" << std::endl;
+#endif
+}
+
+RenderGraph::TransientFrame &RenderGraph::getTransientFrame(uint32_t flightIndex) {
+    auto &frame = transientFrames[flightIndex];
+    if (frame)
+        return *frame;
+
+    frame.emplace();
+    for (const auto resId : transients)
+        frame->images.push_back(createTransientImage(resources[resId]));
+    if (placements.empty())
+        planTransientMemory(frame->images);
+
+    vk::MemoryAllocateInfo allocInfo;
+    allocInfo.allocationSize = transientMemorySize;
+    allocInfo.memoryTypeIndex = transientMemoryTypeIndex;
+    frame->memory = device.allocateMemoryUnique(allocInfo);
+
+    for (uint32_t i = 0; i < transients.size(); i++) {
+        const auto &res = resources[transients[i]];
+        device.bindImageMemory(frame->images[i].get(), frame->memory.get(), placements[i].offset);
+        frame->views.push_back(createImageViewFromImage(device, frame->images[i].get(), res.format, 1, res.aspect));
+    }
+    return *frame;
+}
+
+vk::Image RenderGraph::getImage(ResourceId id, uint32_t imageIndex, const TransientFrame *transientFrame) const {
+    const auto &res = resources[id];
+    return res.imported ? res.importedImages[imageIndex] : transientFrame->images[res.transientIndex].get();
+}
+
+vk::ImageView RenderGraph::getImageView(ResourceId id, uint32_t imageIndex, const TransientFrame *transientFrame) const {
+    const auto &res = resources[id];
+    return res.imported ? res.importedViews[imageIndex] : transientFrame->views[res.transientIndex].get();
+}
+
+void RenderGraph::execute(vk::CommandBuffer cmdBuf, const RenderDetails &rd, uint32_t imageIndex, uint32_t flightIndex) {
+    if (!compiled)
+        compile();
+
+    const TransientFrame *transientFrame = transients.empty() ? nullptr : &getTransientFrame(flightIndex);
+
+    auto emitBarriers = [&](const std::vector<Barrier> &barriers) {
+        if (barriers.empty())
+            return;
+        vk::PipelineStageFlags srcStages, dstStages;
+        std::vector<vk::ImageMemoryBarrier> imageBarriers;
+        std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+        for (const auto &b : barriers) {
+            const auto &res = resources[b.resource];
+            srcStages |= b.srcStage;
+            dstStages |= b.dstStage;
+            if (res.isBuffer) {
+                vk::BufferMemoryBarrier barrier;
+                barrier.srcAccessMask = b.srcAccess;
+                barrier.dstAccessMask = b.dstAccess;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.buffer = res.importedBuffer;
+                barrier.offset = 0;
+                barrier.size = VK_WHOLE_SIZE;
+                bufferBarriers.push_back(barrier);
+            } else {
+                vk::ImageMemoryBarrier barrier;
+                barrier.srcAccessMask = b.srcAccess;
+                barrier.dstAccessMask = b.dstAccess;
+                barrier.oldLayout = b.oldLayout;
+                barrier.newLayout = b.newLayout;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = getImage(b.resource, imageIndex, transientFrame);
+                barrier.subresourceRange = vk::ImageSubresourceRange{res.aspect, 0, 1, 0, 1};
+                imageBarriers.push_back(barrier);
+            }
+        }
+        cmdBuf.pipelineBarrier(srcStages, dstStages, vk::DependencyFlags{}, {}, bufferBarriers, imageBarriers);
+    };
+
+    for (auto &pass : passes) {
+        emitBarriers(pass.barriers);
+
+        if (!pass.graphics) {
+            pass.record(RenderGraphPassContext{cmdBuf, rd, vk::Extent2D{}});
+            continue;
+        }
+
+        const auto extent = resources[pass.attachments[0]].extent;
+        std::vector<vk::ImageView> views;
+        for (const auto resId : pass.attachments)
+            views.push_back(getImageView(resId, imageIndex, transientFrame));
+
+        auto &framebuffer = pass.framebuffers[views];
+        if (!framebuffer) {
+            vk::FramebufferCreateInfo frameBufCreateInfo;
+            frameBufCreateInfo.width = extent.width;
+            frameBufCreateInfo.height = extent.height;
+            frameBufCreateInfo.layers = 1;
+            frameBufCreateInfo.renderPass = pass.renderpass.get();
+            frameBufCreateInfo.attachmentCount = views.size();
+            frameBufCreateInfo.pAttachments = views.data();
+            framebuffer = device.createFramebufferUnique(frameBufCreateInfo);
+        }
+
+        vk::RenderPassBeginInfo rpBeginInfo;
+        rpBeginInfo.renderPass = pass.renderpass.get();
+        rpBeginInfo.framebuffer = framebuffer.get();
+        rpBeginInfo.renderArea = vk::Rect2D{{0, 0}, extent};
+        rpBeginInfo.clearValueCount = pass.clearValues.size();
+        rpBeginInfo.pClearValues = pass.clearValues.data();
+
+        cmdBuf.beginRenderPass(rpBeginInfo, vk::SubpassContents::eInline);
+        pass.record(RenderGraphPassContext{cmdBuf, rd, extent});
+        cmdBuf.endRenderPass();
+    }
+
+    emitBarriers(finalBarriers);
+}
@@ -0,0 +1,145 @@
+#ifndef VULKAN_RENDER_GRAPH_HPP
+#define VULKAN_RENDER_GRAPH_HPP
+
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+struct RenderDetails;
+
+struct RenderGraphPassContext {
+    vk::CommandBuffer cmdBuf;
+    const RenderDetails &rd;
+    vk::Extent2D extent;
+};
+
+// A small frame graph.
+// Passes declare which resources they read and write; compile() derives the barriers, layout transitions and
+// render passes from those declarations. Transient images are allocated lazily, once per in-flight frame,
+// and transients whose lifetimes don't overlap share memory.
+class RenderGraph {
+  public:
+    using ResourceId = uint32_t;
+    using PassId = uint32_t;
+    using RecordFunc = std::function<void(const RenderGraphPassContext &)>;
+
+  private:
+    enum class AccessType {
+        ColorAttachment,
+        DepthAttachment,
+        Sampled,
+        StorageRead,
+        StorageWrite,
+        BufferRead,
+        BufferWrite,
+    };
+
+    struct Access {
+        ResourceId resource;
+        AccessType type;
+        vk::PipelineStageFlags stage;
+        vk::AccessFlags access;
+        vk::ImageLayout layout;
+        std::optional<vk::ClearValue> clear;
+    };
+
+    struct Resource {
+        std::string name;
+        bool isBuffer = false;
+        bool imported = false;
+        vk::Format format = vk::Format::eUndefined;
+        vk::Extent2D extent;
+        vk::ImageAspectFlags aspect;
+        vk::ImageUsageFlags usage;
+        vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined;
+
+        // imported images are indexed by image index, imported buffers have a single entry
+        std::vector<vk::Image> importedImages;
+        std::vector<vk::ImageView> importedViews;
+        vk::Buffer importedBuffer;
+
+        // transient: index into per-flight allocations, and lifetime in pass order
+        uint32_t transientIndex = 0;
+        uint32_t firstPass = ~0u, lastPass = 0;
+        bool aliased = false;
+    };
+
+    struct Barrier {
+        ResourceId resource;
+        vk::PipelineStageFlags srcStage, dstStage;
+        vk::AccessFlags srcAccess, dstAccess;
+        vk::ImageLayout oldLayout, newLayout;
+    };
+
+    struct Pass {
+        std::string name;
+        bool graphics;
+        RecordFunc record;
+        std::vector<Access> accesses;
+        std::vector<Barrier> barriers;
+        vk::UniqueRenderPass renderpass;
+        std::vector<vk::ClearValue> clearValues;
+        std::vector<ResourceId> attachments;
+        std::map<std::vector<vk::ImageView>, vk::UniqueFramebuffer> framebuffers;
+    };
+
+    struct TransientPlacement {
+        vk::DeviceSize offset;
+    };
+
+    struct TransientFrame {
+        vk::UniqueDeviceMemory memory;
+        std::vector<vk::UniqueImage> images;
+        std::vector<vk::UniqueImageView> views;
+    };
+
+    vk::PhysicalDevice physDevice;
+    vk::Device device;
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<Barrier> finalBarriers;
+    std::vector<ResourceId> transients;
+    std::vector<TransientPlacement> placements;
+    vk::DeviceSize transientMemorySize = 0;
+    uint32_t transientMemoryTypeIndex = 0;
+    std::vector<std::optional<TransientFrame>> transientFrames;
+    bool compiled = false;
+
+    void addAccess(PassId pass, Access access);
+    void planTransientMemory(const std::vector<vk::UniqueImage> &images);
+    TransientFrame &getTransientFrame(uint32_t flightIndex);
+    vk::Image getImage(ResourceId id, uint32_t imageIndex, const TransientFrame *transientFrame) const;
+    vk::ImageView getImageView(ResourceId id, uint32_t imageIndex, const TransientFrame *transientFrame) const;
+    vk::UniqueImage createTransientImage(const Resource &res) const;
+    vk::UniqueRenderPass createRenderPass(const Pass &pass) const;
+
+  public:
+    RenderGraph(vk::PhysicalDevice physDevice, vk::Device device, uint32_t flightFramesNum);
+
+    ResourceId createTransientImage(const std::string &name, vk::Format format, vk::Extent2D extent, vk::ImageAspectFlags aspect);
+    // images[i]/views[i] are selected by the image index passed to execute()
+    ResourceId importImages(const std::string &name, std::vector<vk::Image> images, std::vector<vk::ImageView> views,
+                            vk::Format format, vk::Extent2D extent, vk::ImageLayout finalLayout);
+    ResourceId importBuffer(const std::string &name, vk::Buffer buffer);
+
+    PassId addGraphicsPass(const std::string &name, RecordFunc record);
+    PassId addComputePass(const std::string &name, RecordFunc record);
+
+    void writeColor(PassId pass, ResourceId image, std::optional<vk::ClearColorValue> clear = std::nullopt);
+    void writeDepth(PassId pass, ResourceId image, std::optional<float> clear = std::nullopt);
+    void readSampled(PassId pass, ResourceId image, vk::PipelineStageFlags stage);
+    void readStorageImage(PassId pass, ResourceId image, vk::PipelineStageFlags stage);
+    void writeStorageImage(PassId pass, ResourceId image, vk::PipelineStageFlags stage);
+    void readBuffer(PassId pass, ResourceId buffer, vk::PipelineStageFlags stage, vk::AccessFlags access);
+    void writeBuffer(PassId pass, ResourceId buffer, vk::PipelineStageFlags stage, vk::AccessFlags access);
+
+    void compile();
+    vk::RenderPass getRenderPass(PassId pass) const { return passes[pass].renderpass.get(); }
+
+    void execute(vk::CommandBuffer cmdBuf, const RenderDetails &rd, uint32_t imageIndex, uint32_t flightIndex);
+};
+
+#endif // VULKAN_RENDER_GRAPH_HPP
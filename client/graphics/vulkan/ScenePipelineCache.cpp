@@ -0,0 +1,30 @@
+#include "ScenePipelineCache.hpp"
+#include "Helper.hpp"
+#include "renderer/SimpleRenderProc.hpp"
+#include <fmt/format.h>
+#ifdef _DEBUG
+#include <iostream>
+#endif
+
+ScenePipelineCache::ScenePipelineCache(vk::Device device, vk::PipelineLayout layout, vk::RenderPass renderpass, std::optional<vk::Extent2D> extent)
+    : device{device}, layout{layout}, renderpass{renderpass}, extent{extent} {}
+
+vk::Pipeline ScenePipelineCache::get(const ShaderVariant &variant) {
+    if (auto it = pipelines.find(variant); it != pipelines.end())
+        return it->second.get();
+
+    const auto vertMask = variant.features & ShaderFeature::vertexMask;
+    const auto fragMask = variant.features & ShaderFeature::fragmentMask;
+    auto &vert = vertShaders[vertMask];
+    if (!vert)
+        vert = createShaderModuleFromFile(device, fmt::format("shader.{}.vert.spv", vertMask));
+    auto &frag = fragShaders[fragMask];
+    if (!frag)
+        frag = createShaderModuleFromFile(device, fmt::format("shader.{}.frag.spv", fragMask));
+
+#ifdef _DEBUG
+    std::clog << fmt::format("creating scene pipeline: features {:#x}, alpha cutoff {}", variant.features, variant.alphaCutoff) << std::endl;
+#endif
+    auto pipeline = createScenePipeline(device, vert.get(), frag.get(), extent, renderpass, layout, variant);
+    return pipelines.emplace(variant, std::move(pipeline)).first->second.get();
+}
@@ -0,0 +1,27 @@
+#ifndef VULKAN_SCENE_PIPELINE_CACHE_HPP
+#define VULKAN_SCENE_PIPELINE_CACHE_HPP
+
+#include "ShaderVariant.hpp"
+#include <map>
+#include <optional>
+#include <vulkan/vulkan.hpp>
+
+// Scene pipelines for one render pass, created the first time a variant is drawn.
+// Shader modules are loaded on first use as well, so unused permutations cost nothing.
+class ScenePipelineCache {
+    vk::Device device;
+    vk::PipelineLayout layout;
+    vk::RenderPass renderpass;
+    std::optional<vk::Extent2D> extent;
+
+    std::map<uint32_t, vk::UniqueShaderModule> vertShaders, fragShaders;
+    std::map<ShaderVariant, vk::UniquePipeline> pipelines;
+
+  public:
+    // without an extent, viewport and scissor are dynamic
+    ScenePipelineCache(vk::Device device, vk::PipelineLayout layout, vk::RenderPass renderpass, std::optional<vk::Extent2D> extent);
+
+    vk::Pipeline get(const ShaderVariant &variant);
+};
+
+#endif // VULKAN_SCENE_PIPELINE_CACHE_HPP
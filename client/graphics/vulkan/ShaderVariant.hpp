@@ -0,0 +1,36 @@
+#ifndef VULKAN_SHADER_VARIANT_HPP
+#define VULKAN_SHADER_VARIANT_HPP
+
+#include <cstdint>
+#include <tuple>
+
+// Features of the scene shader permutations.
+// CMake compiles shader.vert and shader.frag once per combination; the mask is part of the SPIR-V file name.
+namespace ShaderFeature {
+enum : uint32_t {
+    Skinned = 1,   // joints/weights streams and the joint palette
+    Morph = 2,     // per-instance position deltas written by morph.comp
+    Compact = 4,   // no normal stream
+    AlphaTest = 8, // discard below the cutoff (a specialization constant)
+};
+constexpr uint32_t vertexMask = Skinned | Morph | Compact;
+constexpr uint32_t fragmentMask = AlphaTest;
+} // namespace ShaderFeature
+
+struct ShaderVariant {
+    uint32_t features = 0;
+    float alphaCutoff = 0.5f;
+
+    bool operator<(const ShaderVariant &rhs) const {
+        return std::tie(features, alphaCutoff) < std::tie(rhs.features, rhs.alphaCutoff);
+    }
+};
+
+// consecutive indirect draws that share a variant
+struct DrawGroup {
+    ShaderVariant variant;
+    uint32_t firstDraw;
+    uint32_t drawCount;
+};
+
+#endif // VULKAN_SHADER_VARIANT_HPP
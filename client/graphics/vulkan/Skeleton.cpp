@@ -0,0 +1,42 @@
+#include "Skeleton.hpp"
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include <numeric>
+
+Skeleton::Skeleton(const ModelManager::ModelInfo &model) : restPose(static_cast<uint32_t>(model.nodes.size())) {
+    for (const auto &node : model.nodes) {
+        restPose.set(parents.size(), JointConfiguration{node.rotation, node.translation});
+        parents.push_back(node.parent);
+        inverseBindMatrices.push_back(node.inverseBindMatrix);
+    }
+
+    // sorting by depth puts every parent before its children
+    std::vector<uint32_t> depth(parents.size(), 0);
+    for (uint32_t i = 0; i < parents.size(); i++) {
+        for (int32_t p = parents[i]; p != -1; p = parents[p])
+            depth[i]++;
+    }
+    order.resize(parents.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return depth[a] < depth[b]; });
+}
+
+void Skeleton::evaluateGlobals(const PoseBuffer &pose, glm::mat4 *globals) const {
+    constexpr auto idmat = glm::identity<glm::mat4>();
+    for (const auto i : order) {
+        globals[i] = (parents[i] == -1 ? idmat : globals[parents[i]]) * glm::translate(idmat, pose.translation(i)) * glm::toMat4(pose.rotation(i));
+    }
+}
+
+void Skeleton::evaluate(const PoseBuffer &pose, glm::mat4 *palette) const {
+    evaluateGlobals(pose, palette);
+    for (uint32_t i = 0; i < parents.size(); i++) {
+        palette[i] *= inverseBindMatrices[i];
+    }
+}
+
+void interpolatePalette(const glm::mat4 *from, const glm::mat4 *to, float t, uint32_t n, glm::mat4 *out) {
+    for (uint32_t i = 0; i < n; i++)
+        out[i] = from[i] + (to[i] - from[i]) * t;
+}
@@ -0,0 +1,33 @@
+#ifndef VULKAN_SKELETON_HPP
+#define VULKAN_SKELETON_HPP
+
+#include "../../avator/pose/pose.hpp"
+#include "ModelManager.hpp"
+#include <glm/glm.hpp>
+#include <vector>
+
+// Joint hierarchy of a model, with the parent-before-child evaluation order computed once.
+class Skeleton {
+    std::vector<int32_t> parents;
+    std::vector<glm::mat4> inverseBindMatrices;
+    PoseBuffer restPose;
+    std::vector<uint32_t> order;
+
+  public:
+    explicit Skeleton(const ModelManager::ModelInfo &model);
+
+    uint32_t jointCount() const { return parents.size(); }
+    int32_t getParent(uint32_t joint) const { return parents[joint]; }
+    const std::vector<int32_t> &getParents() const { return parents; }
+    const PoseBuffer &getRestPose() const { return restPose; }
+
+    // writes the model-space transform of every joint into globals[0, jointCount())
+    void evaluateGlobals(const PoseBuffer &pose, glm::mat4 *globals) const;
+    // writes the skinning matrices for pose into palette[0, jointCount())
+    void evaluate(const PoseBuffer &pose, glm::mat4 *palette) const;
+};
+
+// per-element linear blend of two palettes; fine for the small joint motion between two updates
+void interpolatePalette(const glm::mat4 *from, const glm::mat4 *to, float t, uint32_t n, glm::mat4 *out);
+
+#endif // VULKAN_SKELETON_HPP
@@ -0,0 +1,362 @@
+#include "SpringBones.hpp"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include <stdexcept>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define SPRING_BONES_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// tails moving less than this (in metres) over an update count as resting
+constexpr float settleDistance = 1e-4f;
+// 0.x leaves have no tail node; theirs extends the bone by this much
+constexpr float leafTailLength = 0.07f;
+
+template <typename T>
+void eraseRange(std::vector<T> &v, uint32_t first, uint32_t n) {
+    v.erase(v.begin() + first, v.begin() + first + n);
+}
+
+// the rotation of a transform that may be scaled
+glm::quat rotationOf(const glm::mat4 &m) {
+    return glm::quat_cast(glm::mat3(glm::normalize(glm::vec3(m[0])), glm::normalize(glm::vec3(m[1])), glm::normalize(glm::vec3(m[2]))));
+}
+
+// the colliders of one spring in world space, padded to a multiple of four with ones nothing reaches
+struct ColliderBatch {
+    std::vector<float> headX, headY, headZ;
+    // head to tail, and the inverse of its squared length (0 for spheres)
+    std::vector<float> axisX, axisY, axisZ, invAxisLengthSq;
+    std::vector<float> radius;
+
+    void clear() {
+        for (auto *v : {&headX, &headY, &headZ, &axisX, &axisY, &axisZ, &invAxisLengthSq, &radius})
+            v->clear();
+    }
+    void push(const glm::vec3 &head, const glm::vec3 &tail, float r) {
+        const auto axis = tail - head;
+        const float lengthSq = glm::dot(axis, axis);
+        headX.push_back(head.x);
+        headY.push_back(head.y);
+        headZ.push_back(head.z);
+        axisX.push_back(axis.x);
+        axisY.push_back(axis.y);
+        axisZ.push_back(axis.z);
+        invAxisLengthSq.push_back(lengthSq > 0.0f ? 1.0f / lengthSq : 0.0f);
+        radius.push_back(r);
+    }
+    void pad() {
+        while (headX.size() % 4)
+            push(glm::vec3{1e10f}, glm::vec3{1e10f}, 0.0f);
+    }
+};
+
+// moves tail onto the surface of collider i if it is within reach of it; true if it did
+bool pushOut(const ColliderBatch &batch, size_t i, float hitRadius, glm::vec3 &tail) {
+    const glm::vec3 head{batch.headX[i], batch.headY[i], batch.headZ[i]};
+    const glm::vec3 axis{batch.axisX[i], batch.axisY[i], batch.axisZ[i]};
+    const auto nearest = head + axis * glm::clamp(glm::dot(tail - head, axis) * batch.invAxisLengthSq[i], 0.0f, 1.0f);
+    const auto away = tail - nearest;
+    const float reach = batch.radius[i] + hitRadius;
+    const float distanceSq = glm::dot(away, away);
+    if (distanceSq >= reach * reach || distanceSq == 0.0f)
+        return false;
+    tail = nearest + away * (reach / std::sqrt(distanceSq));
+    return true;
+}
+
+// resolves every collision of the tail in collider order, keeping it at length from head
+void collide(const ColliderBatch &batch, float hitRadius, const glm::vec3 &head, float length, glm::vec3 &tail) {
+#ifdef SPRING_BONES_SSE
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), hit = _mm_set1_ps(hitRadius);
+    for (size_t i = 0; i < batch.headX.size(); i += 4) {
+        const __m128 dx = _mm_sub_ps(_mm_set1_ps(tail.x), _mm_loadu_ps(&batch.headX[i]));
+        const __m128 dy = _mm_sub_ps(_mm_set1_ps(tail.y), _mm_loadu_ps(&batch.headY[i]));
+        const __m128 dz = _mm_sub_ps(_mm_set1_ps(tail.z), _mm_loadu_ps(&batch.headZ[i]));
+        const __m128 ax = _mm_loadu_ps(&batch.axisX[i]);
+        const __m128 ay = _mm_loadu_ps(&batch.axisY[i]);
+        const __m128 az = _mm_loadu_ps(&batch.axisZ[i]);
+        __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, ax), _mm_mul_ps(dy, ay)), _mm_mul_ps(dz, az));
+        t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(t, _mm_loadu_ps(&batch.invAxisLengthSq[i])), zero), one);
+        const __m128 px = _mm_sub_ps(dx, _mm_mul_ps(ax, t));
+        const __m128 py = _mm_sub_ps(dy, _mm_mul_ps(ay, t));
+        const __m128 pz = _mm_sub_ps(dz, _mm_mul_ps(az, t));
+        const __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz));
+        const __m128 reach = _mm_add_ps(_mm_loadu_ps(&batch.radius[i]), hit);
+        // hits are rare; lanes before the first one didn't move the tail, so going one by one from there is exact
+        if (_mm_movemask_ps(_mm_cmplt_ps(distanceSq, _mm_mul_ps(reach, reach)))) {
+            for (size_t lane = i; lane < i + 4; lane++)
+                if (pushOut(batch, lane, hitRadius, tail))
+                    tail = head + glm::normalize(tail - head) * length;
+        }
+    }
+#else
+    for (size_t i = 0; i < batch.headX.size(); i++)
+        if (pushOut(batch, i, hitRadius, tail))
+            tail = head + glm::normalize(tail - head) * length;
+#endif
+}
+
+} // namespace
+
+uint32_t SpringBoneSystem::chooseSubsteps(float distance) {
+    if (distance < 3.0f)
+        return maxSubsteps;
+    if (distance < 8.0f)
+        return 2;
+    if (distance < 20.0f)
+        return 1;
+    return 0;
+}
+
+void SpringBoneSystem::addAvatar(uint32_t avatarId, const VrmSpringBones &bones, const Skeleton &skeleton) {
+    if (bones.springs.empty())
+        return;
+    const auto &rest = skeleton.getRestPose();
+    auto checkNode = [&](int64_t node) {
+        if (node < 0 || node >= skeleton.jointCount())
+            throw std::runtime_error("spring bone node out of range");
+    };
+
+    Avatar avatar{};
+    avatar.firstJoint = jointNodes.size();
+    avatar.firstSpring = springs.size();
+    avatar.firstCollider = colliderNodes.size();
+    avatar.firstColliderRef = colliderRefs.size();
+
+    for (const auto &collider : bones.colliders) {
+        checkNode(collider.node);
+        colliderNodes.push_back(collider.node);
+        colliderHeads.push_back(collider.offset);
+        colliderTails.push_back(collider.tail);
+        colliderRadii.push_back(collider.radius);
+    }
+
+    for (const auto &spring : bones.springs) {
+        Spring packed;
+        packed.firstJoint = jointNodes.size() - avatar.firstJoint;
+        packed.jointNum = spring.joints.size();
+        packed.firstColliderRef = colliderRefs.size() - avatar.firstColliderRef;
+        packed.colliderRefNum = spring.colliders.size();
+        for (const auto collider : spring.colliders) {
+            if (collider >= bones.colliders.size())
+                throw std::runtime_error("spring bone collider out of range");
+            colliderRefs.push_back(collider);
+        }
+
+        for (uint32_t i = 0; i < spring.joints.size(); i++) {
+            const auto &joint = spring.joints[i];
+            checkNode(joint.node);
+
+            // a spring starting below a joint of an earlier one swings along with it
+            int32_t parent = -1;
+            if (i > 0) {
+                parent = jointNodes.size() - 1 - avatar.firstJoint;
+            } else {
+                for (uint32_t j = avatar.firstJoint; j < jointNodes.size(); j++)
+                    if (int32_t(jointNodes[j]) == skeleton.getParent(joint.node))
+                        parent = j - avatar.firstJoint;
+            }
+
+            glm::vec3 restTail{0.0f};
+            if (i + 1 < spring.joints.size()) {
+                restTail = rest.translation(spring.joints[i + 1].node);
+            } else if (spring.tailNode != -1) {
+                checkNode(spring.tailNode);
+                restTail = rest.translation(spring.tailNode);
+            }
+            if (glm::length(restTail) < 1e-6f) {
+                // continues the direction from the parent, in the joint's own space
+                const auto along = rest.translation(joint.node);
+                const auto direction = glm::length(along) > 1e-6f ? glm::normalize(along) : glm::vec3{0.0f, -1.0f, 0.0f};
+                restTail = glm::inverse(rest.rotation(joint.node)) * direction * leafTailLength;
+            }
+
+            jointNodes.push_back(joint.node);
+            jointParents.push_back(parent);
+            for (auto *v : {&tailX, &tailY, &tailZ, &prevTailX, &prevTailY, &prevTailZ})
+                v->push_back(0.0f);
+            restTailX.push_back(restTail.x);
+            restTailY.push_back(restTail.y);
+            restTailZ.push_back(restTail.z);
+            stiffness.push_back(joint.stiffness);
+            drag.push_back(joint.dragForce);
+            hitRadius.push_back(joint.hitRadius);
+            gravityX.push_back(joint.gravityDir.x * joint.gravityPower);
+            gravityY.push_back(joint.gravityDir.y * joint.gravityPower);
+            gravityZ.push_back(joint.gravityDir.z * joint.gravityPower);
+            rotations.push_back(rest.rotation(joint.node));
+        }
+        springs.push_back(packed);
+    }
+
+    avatar.jointNum = jointNodes.size() - avatar.firstJoint;
+    avatar.springNum = springs.size() - avatar.firstSpring;
+    avatar.colliderNum = colliderNodes.size() - avatar.firstCollider;
+    avatar.colliderRefNum = colliderRefs.size() - avatar.firstColliderRef;
+    avatars[avatarId] = avatar;
+}
+
+void SpringBoneSystem::removeAvatar(uint32_t avatarId) {
+    auto it = avatars.find(avatarId);
+    if (it == avatars.end())
+        return;
+    const auto removed = it->second;
+    avatars.erase(it);
+
+    eraseRange(jointNodes, removed.firstJoint, removed.jointNum);
+    eraseRange(jointParents, removed.firstJoint, removed.jointNum);
+    for (auto *v : {&tailX, &tailY, &tailZ, &prevTailX, &prevTailY, &prevTailZ, &restTailX, &restTailY, &restTailZ,
+                    &stiffness, &drag, &hitRadius, &gravityX, &gravityY, &gravityZ})
+        eraseRange(*v, removed.firstJoint, removed.jointNum);
+    eraseRange(rotations, removed.firstJoint, removed.jointNum);
+    eraseRange(colliderNodes, removed.firstCollider, removed.colliderNum);
+    eraseRange(colliderHeads, removed.firstCollider, removed.colliderNum);
+    eraseRange(colliderTails, removed.firstCollider, removed.colliderNum);
+    eraseRange(colliderRadii, removed.firstCollider, removed.colliderNum);
+    eraseRange(springs, removed.firstSpring, removed.springNum);
+    eraseRange(colliderRefs, removed.firstColliderRef, removed.colliderRefNum);
+
+    // everything else is relative to these
+    for (auto &[id, avatar] : avatars) {
+        if (avatar.firstJoint > removed.firstJoint)
+            avatar.firstJoint -= removed.jointNum;
+        if (avatar.firstSpring > removed.firstSpring)
+            avatar.firstSpring -= removed.springNum;
+        if (avatar.firstCollider > removed.firstCollider)
+            avatar.firstCollider -= removed.colliderNum;
+        if (avatar.firstColliderRef > removed.firstColliderRef)
+            avatar.firstColliderRef -= removed.colliderRefNum;
+    }
+}
+
+void SpringBoneSystem::rest(uint32_t avatarId) {
+    if (auto it = avatars.find(avatarId); it != avatars.end())
+        it->second.simulating = false;
+}
+
+void SpringBoneSystem::update(float elapsed, std::vector<Input> &inputs) {
+    pendingSeconds += elapsed;
+    const auto steps = std::min(static_cast<uint32_t>(pendingSeconds / stepSeconds), maxStepsPerUpdate);
+    pendingSeconds = std::min(pendingSeconds - steps * stepSeconds, stepSeconds);
+
+    pool.run(inputs.size(), [&](size_t i) { simulate(inputs[i], steps); });
+}
+
+void SpringBoneSystem::simulate(Input &input, uint32_t steps) {
+    constexpr auto idmat = glm::identity<glm::mat4>();
+    const auto &pose = *input.pose;
+    auto &out = *input.out;
+    out = pose;
+    input.moved = false;
+
+    auto found = avatars.find(input.avatarId);
+    if (found == avatars.end())
+        return;
+    auto &avatar = found->second;
+    const auto substeps = chooseSubsteps(input.distance);
+    if (substeps == 0) {
+        // back to the animated pose, and started afresh from it when close again
+        input.moved = avatar.simulating;
+        avatar.simulating = false;
+        return;
+    }
+
+    thread_local std::vector<glm::mat4> globals, jointWorlds;
+    thread_local std::vector<glm::vec3> colliderWorldHeads, colliderWorldTails;
+    thread_local std::vector<float> colliderWorldRadii;
+    thread_local ColliderBatch batch;
+
+    const auto &skeleton = *input.skeleton;
+    globals.resize(skeleton.jointCount());
+    skeleton.evaluateGlobals(pose, globals.data());
+    auto world = [&](int32_t node) { return node == -1 ? input.modelMat : input.modelMat * globals[node]; };
+    const float scale = glm::length(glm::vec3(input.modelMat[0]));
+
+    // the world transform of the parent of joint j, as simulated so far
+    jointWorlds.resize(avatar.jointNum);
+    auto parentWorld = [&](uint32_t j) {
+        const auto parent = jointParents[j];
+        return parent != -1 ? jointWorlds[parent] : world(skeleton.getParent(jointNodes[j]));
+    };
+
+    if (!avatar.simulating) {
+        for (uint32_t j = avatar.firstJoint; j < avatar.firstJoint + avatar.jointNum; j++) {
+            const auto config = pose[jointNodes[j]];
+            const auto jointWorld = parentWorld(j) * glm::translate(idmat, config.translation) * glm::toMat4(config.rotation);
+            const glm::vec3 tail = jointWorld * glm::vec4(restTailX[j], restTailY[j], restTailZ[j], 1.0f);
+            tailX[j] = prevTailX[j] = tail.x;
+            tailY[j] = prevTailY[j] = tail.y;
+            tailZ[j] = prevTailZ[j] = tail.z;
+            rotations[j] = config.rotation;
+            jointWorlds[j - avatar.firstJoint] = jointWorld;
+        }
+        avatar.simulating = true;
+    }
+
+    // colliders follow the animated pose, which stays put over the substeps
+    colliderWorldHeads.clear();
+    colliderWorldTails.clear();
+    colliderWorldRadii.clear();
+    for (uint32_t c = avatar.firstCollider; c < avatar.firstCollider + avatar.colliderNum; c++) {
+        const auto m = world(colliderNodes[c]);
+        colliderWorldHeads.push_back(m * glm::vec4(colliderHeads[c], 1.0f));
+        colliderWorldTails.push_back(m * glm::vec4(colliderTails[c], 1.0f));
+        colliderWorldRadii.push_back(colliderRadii[c] * glm::length(glm::vec3(m[0])));
+    }
+
+    const float dt = stepSeconds / substeps;
+    float maxMoveSq = 0.0f;
+    for (uint32_t step = 0; step < steps * substeps; step++) {
+        for (uint32_t s = avatar.firstSpring; s < avatar.firstSpring + avatar.springNum; s++) {
+            const auto &spring = springs[s];
+            batch.clear();
+            for (uint32_t r = 0; r < spring.colliderRefNum; r++) {
+                const auto c = colliderRefs[avatar.firstColliderRef + spring.firstColliderRef + r];
+                batch.push(colliderWorldHeads[c], colliderWorldTails[c], colliderWorldRadii[c]);
+            }
+            batch.pad();
+
+            for (uint32_t j = avatar.firstJoint + spring.firstJoint; j < avatar.firstJoint + spring.firstJoint + spring.jointNum; j++) {
+                const auto config = pose[jointNodes[j]];
+                const auto parent = parentWorld(j);
+                const auto headWorld = parent * glm::translate(idmat, config.translation);
+                const glm::vec3 head = headWorld[3];
+                // where the tail points with the animated rotation, and the bone length in world units
+                const glm::vec3 restTail = glm::mat3(headWorld * glm::toMat4(config.rotation)) * glm::vec3(restTailX[j], restTailY[j], restTailZ[j]);
+                const float length = glm::length(restTail);
+                const auto restDirection = restTail / length;
+
+                const glm::vec3 tail{tailX[j], tailY[j], tailZ[j]};
+                const glm::vec3 prevTail{prevTailX[j], prevTailY[j], prevTailZ[j]};
+                const glm::vec3 gravity{gravityX[j], gravityY[j], gravityZ[j]};
+                glm::vec3 next = tail + (tail - prevTail) * (1.0f - drag[j]) + (restDirection * stiffness[j] + gravity) * dt;
+                next = head + glm::normalize(next - head) * length;
+                collide(batch, hitRadius[j] * scale, head, length, next);
+
+                const auto moved = next - tail;
+                maxMoveSq = std::max(maxMoveSq, glm::dot(moved, moved));
+                prevTailX[j] = tail.x;
+                prevTailY[j] = tail.y;
+                prevTailZ[j] = tail.z;
+                tailX[j] = next.x;
+                tailY[j] = next.y;
+                tailZ[j] = next.z;
+
+                // the swing from the rest direction onto the tail, brought into the parent's frame
+                const auto parentRotation = rotationOf(parent);
+                const auto swing = glm::rotation(restDirection, glm::normalize(next - head));
+                rotations[j] = glm::normalize(glm::inverse(parentRotation) * swing * parentRotation * config.rotation);
+                jointWorlds[j - avatar.firstJoint] = headWorld * glm::toMat4(rotations[j]);
+            }
+        }
+    }
+
+    for (uint32_t j = avatar.firstJoint; j < avatar.firstJoint + avatar.jointNum; j++)
+        out.setRotation(jointNodes[j], rotations[j]);
+    input.moved = maxMoveSq > settleDistance * settleDistance;
+}
@@ -0,0 +1,96 @@
+#ifndef VULKAN_SPRING_BONES_HPP
+#define VULKAN_SPRING_BONES_HPP
+
+#include "../../avator/VRMAvator.hpp"
+#include "../../concurrent/WorkerPool.hpp"
+#include "Skeleton.hpp"
+#include <unordered_map>
+#include <vector>
+
+// VRM spring bones (hair, skirts, accessories) of every avatar, simulated with Verlet integration at a fixed step.
+// The joints of all avatars live in one set of arrays, a field per array, and avatars are spread over worker threads.
+// Tails collide with the avatar's sphere and capsule colliders, four at a time where SSE is available.
+// Nearby avatars take several substeps per step, distant ones fewer, and the furthest rest in their animated pose.
+class SpringBoneSystem {
+  public:
+    static constexpr float stepSeconds = 1.0f / 60.0f;
+    // steps per update at most; after a longer hitch the springs fall behind instead of taking longer still
+    static constexpr uint32_t maxStepsPerUpdate = 4;
+    static constexpr uint32_t maxSubsteps = 3;
+
+    struct Input {
+        uint32_t avatarId;
+        const Skeleton *skeleton;
+        // animated pose; spring joints swing around the rotations it gives them
+        const PoseBuffer *pose;
+        glm::mat4 modelMat;
+        float distance;
+        // receives the pose with the rotations of the spring joints replaced
+        PoseBuffer *out;
+        // set if a tail moved noticeably, or the springs were put to rest
+        bool moved = false;
+    };
+
+  private:
+    // indices are relative to the avatar's first joint, spring and collider
+    struct Spring {
+        uint32_t firstJoint, jointNum;
+        uint32_t firstColliderRef, colliderRefNum;
+    };
+    struct Avatar {
+        uint32_t firstJoint, jointNum;
+        uint32_t firstSpring, springNum;
+        uint32_t firstCollider, colliderNum;
+        uint32_t firstColliderRef, colliderRefNum;
+        // tails hold a state to continue from
+        bool simulating = false;
+    };
+
+    // per joint
+    std::vector<uint32_t> jointNodes;
+    // the simulated joint this one hangs off, or -1 to take its parent from the animated pose
+    std::vector<int32_t> jointParents;
+    std::vector<float> tailX, tailY, tailZ;
+    std::vector<float> prevTailX, prevTailY, prevTailZ;
+    // joint to tail at rest, in the joint's space
+    std::vector<float> restTailX, restTailY, restTailZ;
+    std::vector<float> stiffness, drag, hitRadius;
+    std::vector<float> gravityX, gravityY, gravityZ;
+    std::vector<glm::quat> rotations;
+
+    // per collider, in the space of its node
+    std::vector<uint32_t> colliderNodes;
+    std::vector<glm::vec3> colliderHeads, colliderTails;
+    std::vector<float> colliderRadii;
+
+    std::vector<Spring> springs;
+    std::vector<uint32_t> colliderRefs;
+    std::unordered_map<uint32_t, Avatar> avatars;
+
+    // accumulated time not yet simulated
+    float pendingSeconds = 0.0f;
+
+    // spreads the avatars of an update over its threads
+    WorkerPool pool;
+
+    void simulate(Input &input, uint32_t steps);
+
+  public:
+    // distance from the camera to substeps per step; 0 leaves the avatar in its animated pose
+    static uint32_t chooseSubsteps(float distance);
+
+    explicit SpringBoneSystem(uint32_t workerNum) : pool{workerNum} {}
+
+    // registers the springs of an avatar; nothing if bones has none
+    void addAvatar(uint32_t avatarId, const VrmSpringBones &bones, const Skeleton &skeleton);
+    void removeAvatar(uint32_t avatarId);
+    // drops the tails of an avatar left out of updates; they start over from its animated pose once it is simulated again
+    void rest(uint32_t avatarId);
+    bool hasSprings(uint32_t avatarId) const { return avatars.count(avatarId) != 0; }
+
+    // advances every avatar of inputs by elapsed seconds, in fixed steps, and writes their poses.
+    // Inputs of avatars without springs get their pose copied.
+    void update(float elapsed, std::vector<Input> &inputs);
+};
+
+#endif // VULKAN_SPRING_BONES_HPP
@@ -0,0 +1,127 @@
+#include "TextureResidency.hpp"
+#include <algorithm>
+#include <cmath>
+
+uint64_t TextureResidency::bytesFrom(const Entry &entry, uint32_t level) const {
+    uint64_t bytes = 0;
+    for (uint32_t i = level; i < entry.levelBytes.size(); i++)
+        bytes += entry.levelBytes[i];
+    return bytes;
+}
+
+void TextureResidency::apply(std::vector<Change> &changes, uint32_t texture, uint32_t level) {
+    auto &entry = entries[texture];
+    stats.residentBytes = stats.residentBytes - bytesFrom(entry, entry.residentLevel) + bytesFrom(entry, level);
+    stats.peakBytes = std::max(stats.peakBytes, stats.residentBytes);
+    entry.residentLevel = level;
+    changes.push_back(Change{texture, level});
+}
+
+uint32_t TextureResidency::add(uint32_t width, uint32_t height, std::vector<uint64_t> levelBytes) {
+    Entry entry;
+    entry.size = std::max(width, height);
+    entry.tailLevel = 0;
+    while (entry.tailLevel + 1 < levelBytes.size() && (entry.size >> entry.tailLevel) > tailSize)
+        entry.tailLevel++;
+    entry.residentLevel = entry.wantedLevel = entry.tailLevel;
+    entry.levelBytes = std::move(levelBytes);
+
+    // the tail is loaded regardless of the budget
+    stats.residentBytes += bytesFrom(entry, entry.residentLevel);
+    stats.peakBytes = std::max(stats.peakBytes, stats.residentBytes);
+    entries.push_back(std::move(entry));
+    return static_cast<uint32_t>(entries.size() - 1);
+}
+
+void TextureResidency::evict(uint32_t texture) {
+    auto &entry = entries[texture];
+    stats.residentBytes -= bytesFrom(entry, entry.residentLevel);
+    entry.residentLevel = static_cast<uint32_t>(entry.levelBytes.size());
+}
+
+void TextureResidency::restore(uint32_t texture) {
+    auto &entry = entries[texture];
+    entry.residentLevel = entry.wantedLevel = entry.tailLevel;
+    stats.residentBytes += bytesFrom(entry, entry.residentLevel);
+    stats.peakBytes = std::max(stats.peakBytes, stats.residentBytes);
+}
+
+void TextureResidency::request(uint32_t texture, float screenPixels, uint64_t frame) {
+    auto &entry = entries[texture];
+    // about one texel per pixel, as if the texture were spread over the whole footprint
+    const float ratio = entry.size / std::max(screenPixels, 1.0f);
+    const uint32_t level = ratio <= 1.0f ? 0 : std::min(static_cast<uint32_t>(std::log2(ratio)), entry.tailLevel);
+    if (entry.requestFrame != frame) {
+        entry.requestFrame = frame;
+        entry.wantedLevel = level;
+    } else {
+        entry.wantedLevel = std::min(entry.wantedLevel, level);
+    }
+}
+
+std::vector<TextureResidency::Change> TextureResidency::plan(uint64_t frame, uint32_t maxStreamIn) {
+    std::vector<Change> changes;
+    pending = false;
+
+    // evicted textures sit past their tail and wait for restore()
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < entries.size(); i++)
+        if (entries[i].requestFrame == frame && entries[i].wantedLevel < entries[i].residentLevel && entries[i].residentLevel <= entries[i].tailLevel)
+            candidates.push_back(i);
+    // the ones furthest from what they need first
+    std::stable_sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+        return entries[a].residentLevel - entries[a].wantedLevel > entries[b].residentLevel - entries[b].wantedLevel;
+    });
+
+    // what a texture can be cut back to: its current need if needed this frame, the tail otherwise
+    auto floorLevel = [&](const Entry &entry) { return entry.requestFrame == frame ? entry.wantedLevel : entry.tailLevel; };
+
+    uint32_t streamed = 0;
+    for (const auto texture : candidates) {
+        if (streamed == maxStreamIn) {
+            pending = true;
+            break;
+        }
+        const auto &entry = entries[texture];
+        auto fits = [&](uint32_t level) {
+            return stats.residentBytes - bytesFrom(entry, entry.residentLevel) + bytesFrom(entry, level) <= budget;
+        };
+
+        while (!fits(entry.wantedLevel)) {
+            // least recently needed texture with levels beyond its floor
+            uint32_t victim = UINT32_MAX;
+            for (uint32_t i = 0; i < entries.size(); i++) {
+                if (i == texture || entries[i].residentLevel >= floorLevel(entries[i]))
+                    continue;
+                if (victim == UINT32_MAX || entries[i].requestFrame < entries[victim].requestFrame)
+                    victim = i;
+            }
+            if (victim == UINT32_MAX)
+                break;
+            apply(changes, victim, floorLevel(entries[victim]));
+            stats.evicted++;
+        }
+
+        // settle for the finest level that fits
+        auto level = entry.wantedLevel;
+        while (level < entry.residentLevel && !fits(level))
+            level++;
+        if (level < entry.residentLevel) {
+            apply(changes, texture, level);
+            stats.streamedIn++;
+            streamed++;
+        }
+    }
+    return changes;
+}
+
+void TextureResidency::cancel(uint32_t texture, uint32_t level) {
+    auto &entry = entries[texture];
+    if (level > entry.residentLevel)
+        stats.streamedIn--;
+    else
+        stats.evicted--;
+    stats.residentBytes = stats.residentBytes - bytesFrom(entry, entry.residentLevel) + bytesFrom(entry, level);
+    entry.residentLevel = level;
+    pending = true;
+}
@@ -0,0 +1,74 @@
+#ifndef VULKAN_TEXTURE_RESIDENCY_HPP
+#define VULKAN_TEXTURE_RESIDENCY_HPP
+
+#include <cstdint>
+#include <vector>
+
+// Decides which mip levels of each streamed texture are resident.
+// Levels of tailSize texels and below are always resident; finer ones are requested every frame from the
+// on-screen size of whatever uses the texture, and loaded while they fit in the budget. When they don't,
+// the finest levels of the least recently needed textures are dropped first.
+class TextureResidency {
+  public:
+    static constexpr uint32_t tailSize = 64;
+
+    // make level the finest resident one of texture
+    struct Change {
+        uint32_t texture;
+        uint32_t level;
+    };
+
+    struct Stats {
+        uint64_t residentBytes = 0, peakBytes = 0;
+        uint64_t streamedIn = 0, evicted = 0;
+    };
+
+  private:
+    struct Entry {
+        std::vector<uint64_t> levelBytes;
+        uint32_t size; // larger dimension of level 0
+        uint32_t tailLevel;
+        uint32_t residentLevel;
+        // finest level requested in requestFrame, the last frame the texture was needed
+        uint32_t wantedLevel;
+        uint64_t requestFrame = 0;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t budget;
+    Stats stats;
+    bool pending = false;
+
+    uint64_t bytesFrom(const Entry &entry, uint32_t level) const;
+    void apply(std::vector<Change> &changes, uint32_t texture, uint32_t level);
+
+  public:
+    explicit TextureResidency(uint64_t budget) : budget{budget} {}
+
+    // registers a texture by the byte size of each level, level 0 first; returns its id.
+    // Its initial resident level is getResidentLevel(id).
+    uint32_t add(uint32_t width, uint32_t height, std::vector<uint64_t> levelBytes);
+    uint32_t getResidentLevel(uint32_t texture) const { return entries[texture].residentLevel; }
+    uint32_t getTailLevel(uint32_t texture) const { return entries[texture].tailLevel; }
+    uint64_t getTailBytes(uint32_t texture) const { return bytesFrom(entries[texture], entries[texture].tailLevel); }
+    // drops every level, along with the model using the texture; requests are ignored until restore()
+    void evict(uint32_t texture);
+    // makes the tail resident again, regardless of the budget like add()
+    void restore(uint32_t texture);
+
+    // the texture is drawn this frame covering about screenPixels across
+    void request(uint32_t texture, float screenPixels, uint64_t frame);
+    // at most maxStreamIn textures gain levels per call; evictions making room for them come on top.
+    // The returned levels are assumed to be resident from now on.
+    std::vector<Change> plan(uint64_t frame, uint32_t maxStreamIn);
+    // undoes a change the last plan() returned but that couldn't be carried out, putting texture back at level;
+    // it is planned again on a later frame
+    void cancel(uint32_t texture, uint32_t level);
+    // true if the last plan() left requests it couldn't serve yet for lack of time (not of budget)
+    bool hasPending() const { return pending; }
+
+    uint64_t getBudget() const { return budget; }
+    const Stats &getStats() const { return stats; }
+};
+
+#endif // VULKAN_TEXTURE_RESIDENCY_HPP
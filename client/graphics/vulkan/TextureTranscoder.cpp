@@ -0,0 +1,206 @@
+#include "TextureTranscoder.hpp"
+#include "../BlockCompression.hpp"
+#include "../Ktx2.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fmt/format.h>
+#include <functional>
+#include <mutex>
+#include <stb_image.h>
+#include <thread>
+
+#ifdef _DEBUG
+#include <iostream>
+#endif
+
+namespace {
+
+// bump when the encoders change, so entries they produced are re-encoded
+constexpr uint32_t encoderVersion = 1;
+// block rows per encoding task; a large texture is spread over every worker
+constexpr uint32_t stripRows = 16;
+
+uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 14695981039346656037ull) {
+    const auto bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// runs fn(0) .. fn(count - 1) on the pool and the caller; rethrows the first exception.
+// Batches from concurrent transcodes take turns, so the cores are never shared by more than one of them
+template <typename F>
+void parallelFor(WorkerPool &pool, std::mutex &poolMutex, size_t count, F fn) {
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    std::atomic<bool> failed{false};
+    const std::function<void(size_t)> work = [&](size_t i) {
+        if (failed.load(std::memory_order_relaxed))
+            return;
+        try {
+            fn(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock{errorMutex};
+            if (!error)
+                error = std::current_exception();
+            failed = true;
+        }
+    };
+    {
+        std::lock_guard<std::mutex> lock{poolMutex};
+        pool.run(count, work);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+vk::Format toVkFormat(BlockFormat format) {
+    switch (format) {
+    case BlockFormat::BC1:
+        return vk::Format::eBc1RgbSrgbBlock;
+    case BlockFormat::BC3:
+        return vk::Format::eBc3SrgbBlock;
+    default:
+        return vk::Format::eBc7SrgbBlock;
+    }
+}
+
+} // namespace
+
+bool TextureTranscoder::isSupported(vk::PhysicalDevice physDevice, TextureCompression mode) {
+    if (!physDevice.getFeatures().textureCompressionBC)
+        return false;
+    std::vector<vk::Format> formats;
+    if (mode == TextureCompression::Quality)
+        formats = {vk::Format::eBc7SrgbBlock};
+    else
+        formats = {vk::Format::eBc1RgbSrgbBlock, vk::Format::eBc3SrgbBlock};
+
+    constexpr auto required = vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eSampledImageFilterLinear | vk::FormatFeatureFlagBits::eTransferDst;
+    return std::all_of(formats.begin(), formats.end(), [&](vk::Format format) {
+        return (physDevice.getFormatProperties(format).optimalTilingFeatures & required) == required;
+    });
+}
+
+TextureTranscoder::TextureTranscoder(TextureCompression mode, std::filesystem::path cacheDir)
+    : mode{mode}, cacheDir{std::move(cacheDir)}, pool{std::max(1u, std::thread::hardware_concurrency()) - 1} {}
+
+std::vector<TextureTranscoder::Texture> TextureTranscoder::transcode(const std::vector<Source> &sources) {
+    std::vector<Texture> textures(sources.size());
+    std::vector<std::filesystem::path> cachePaths(sources.size());
+    std::vector<size_t> misses;
+    // merged into stats at the end, so concurrent calls only meet there
+    TextureTranscodeStats added;
+    for (size_t i = 0; i < sources.size(); i++) {
+        const auto hash = fnv1a(&encoderVersion, sizeof(encoderVersion), fnv1a(sources[i].data, sources[i].size));
+        cachePaths[i] = cacheDir / fmt::format("{:016x}-{}.ktx2", hash, mode == TextureCompression::Fast ? "fast" : "bc7");
+        if (auto cached = readKtx2(cachePaths[i])) {
+            textures[i].format = static_cast<vk::Format>(cached->vkFormat);
+            textures[i].extent = vk::Extent3D{cached->width, cached->height, 1};
+            textures[i].levels = std::move(cached->levels);
+            added.cacheHits++;
+        } else {
+            misses.push_back(i);
+        }
+    }
+
+    if (!misses.empty()) {
+        const auto start = std::chrono::steady_clock::now();
+
+        // decode and build the RGBA8 mip chain, one image per task
+        struct Pending {
+            BlockFormat format;
+            std::vector<std::vector<uint8_t>> levels;
+            std::vector<vk::Extent2D> extents;
+        };
+        std::vector<Pending> pending(misses.size());
+        parallelFor(pool, poolMutex, misses.size(), [&](size_t m) {
+            const auto &source = sources[misses[m]];
+            int w, h, ch;
+            auto pixels = stbi_load_from_memory(static_cast<const stbi_uc *>(source.data), static_cast<int>(source.size), &w, &h, &ch, STBI_rgb_alpha);
+            if (!pixels)
+                throw std::runtime_error("failed to load texture image");
+            auto &p = pending[m];
+            uint32_t width = w, height = h;
+            p.levels.emplace_back(pixels, pixels + size_t(width) * height * 4);
+            p.extents.push_back(vk::Extent2D{width, height});
+            stbi_image_free(pixels);
+
+            while (width > 1 || height > 1) {
+                p.levels.push_back(downsampleSrgb(p.levels.back().data(), width, height));
+                width = std::max(width / 2, 1u);
+                height = std::max(height / 2, 1u);
+                p.extents.push_back(vk::Extent2D{width, height});
+            }
+            if (mode == TextureCompression::Quality)
+                p.format = BlockFormat::BC7;
+            else
+                p.format = hasTranslucentTexels(p.levels[0].data(), size_t(p.extents[0].width) * p.extents[0].height) ? BlockFormat::BC3 : BlockFormat::BC1;
+        });
+
+        // then encode every level in strips of block rows
+        struct Strip {
+            size_t pending;
+            uint32_t level, firstRow, lastRow;
+        };
+        std::vector<Strip> strips;
+        for (size_t m = 0; m < misses.size(); m++) {
+            auto &p = pending[m];
+            auto &texture = textures[misses[m]];
+            texture.format = toVkFormat(p.format);
+            texture.extent = vk::Extent3D{p.extents[0].width, p.extents[0].height, 1};
+            texture.levels.resize(p.levels.size());
+            for (uint32_t level = 0; level < p.levels.size(); level++) {
+                const auto &extent = p.extents[level];
+                const uint32_t rows = blockCount(extent.height);
+                texture.levels[level].resize(size_t(blockCount(extent.width)) * rows * blockBytes(p.format));
+                for (uint32_t row = 0; row < rows; row += stripRows)
+                    strips.push_back(Strip{m, level, row, std::min(row + stripRows, rows)});
+                added.encodedPixels += uint64_t(extent.width) * extent.height;
+            }
+        }
+        parallelFor(pool, poolMutex, strips.size(), [&](size_t s) {
+            const auto &strip = strips[s];
+            const auto &p = pending[strip.pending];
+            const auto &extent = p.extents[strip.level];
+            encodeBlockRows(p.format, p.levels[strip.level].data(), extent.width, extent.height, strip.firstRow, strip.lastRow,
+                            textures[misses[strip.pending]].levels[strip.level].data());
+        });
+
+        added.encodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // a cache that can't be written only costs the next load its time
+        for (const auto i : misses) {
+            try {
+                std::filesystem::create_directories(cacheDir);
+                writeKtx2(cachePaths[i], Ktx2Texture{static_cast<uint32_t>(textures[i].format), textures[i].extent.width, textures[i].extent.height, textures[i].levels});
+            } catch (const std::exception &e) {
+#ifdef _DEBUG
+                std::clog << "failed to cache texture: " << e.what() << std::endl;
+#endif
+            }
+        }
+    }
+
+    for (const auto &texture : textures) {
+        added.textures++;
+        for (uint32_t level = 0; level < texture.levels.size(); level++) {
+            const uint64_t w = std::max(texture.extent.width >> level, 1u), h = std::max(texture.extent.height >> level, 1u);
+            added.uncompressedBytes += w * h * 4;
+            added.compressedBytes += texture.levels[level].size();
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock{statsMutex};
+        stats.textures += added.textures;
+        stats.cacheHits += added.cacheHits;
+        stats.uncompressedBytes += added.uncompressedBytes;
+        stats.compressedBytes += added.compressedBytes;
+        stats.encodedPixels += added.encodedPixels;
+        stats.encodeSeconds += added.encodeSeconds;
+    }
+    return textures;
+}
@@ -0,0 +1,68 @@
+#ifndef VULKAN_TEXTURE_TRANSCODER_HPP
+#define VULKAN_TEXTURE_TRANSCODER_HPP
+
+#include "../../concurrent/WorkerPool.hpp"
+#include <filesystem>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+enum class TextureCompression {
+    // BC7 for everything
+    Quality,
+    // BC1 for opaque images, BC3 for the rest; several times faster to encode
+    Fast,
+};
+
+struct TextureTranscodeStats {
+    uint32_t textures = 0, cacheHits = 0;
+    // full mip chains, as RGBA8 and as uploaded
+    uint64_t uncompressedBytes = 0, compressedBytes = 0;
+    // decoding, mip generation and encoding of cache misses
+    uint64_t encodedPixels = 0;
+    double encodeSeconds = 0.0;
+
+    uint64_t savedBytes() const { return uncompressedBytes - compressedBytes; }
+    double megapixelsPerSecond() const { return encodeSeconds > 0.0 ? encodedPixels / encodeSeconds / 1e6 : 0.0; }
+};
+
+// Turns encoded source images (PNG, JPEG, ...) into block-compressed textures with full mip chains.
+// Encoding runs on a pool of one thread per core, shared by every transcode; results are cached on disk as KTX2,
+// keyed by a hash of the source bytes. transcode() may be called from several threads at once.
+class TextureTranscoder {
+  public:
+    struct Source {
+        const void *data;
+        size_t size;
+    };
+
+    struct Texture {
+        vk::Format format;
+        vk::Extent3D extent;
+        std::vector<std::vector<uint8_t>> levels;
+    };
+
+  private:
+    TextureCompression mode;
+    std::filesystem::path cacheDir;
+    mutable std::mutex statsMutex;
+    TextureTranscodeStats stats;
+    // the callers besides; taken by one batch at a time
+    WorkerPool pool;
+    std::mutex poolMutex;
+
+  public:
+    // false if the device can't sample the formats mode needs
+    static bool isSupported(vk::PhysicalDevice physDevice, TextureCompression mode);
+
+    TextureTranscoder(TextureCompression mode, std::filesystem::path cacheDir);
+
+    // throws if a source can't be decoded
+    std::vector<Texture> transcode(const std::vector<Source> &sources);
+    TextureTranscodeStats getStats() const {
+        std::lock_guard<std::mutex> lock{statsMutex};
+        return stats;
+    }
+};
+
+#endif // VULKAN_TEXTURE_TRANSCODER_HPP
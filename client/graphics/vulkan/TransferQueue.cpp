@@ -0,0 +1,117 @@
+#include "TransferQueue.hpp"
+#include "Helper.hpp"
+
+TransferQueue::TransferQueue(vk::PhysicalDevice physDevice, vk::Device device, vk::Queue queue, uint32_t queueFamilyIndex, vk::DeviceSize ringSize)
+    : physDevice{physDevice}, device{device}, queue{queue}, cmdPool{createCommandPool(device, queueFamilyIndex)},
+      ring{physDevice, device, ringSize}, ringSize{ringSize} {
+    // one being recorded besides those in flight
+    auto cmdBufs = createCommandBuffers(device, cmdPool.get(), maxBatchesInFlight + 1);
+    auto fences = createFences(device, maxBatchesInFlight + 1, false);
+    for (uint32_t i = 0; i < cmdBufs.size(); i++) {
+        idle.emplace_back();
+        idle.back().cmdBuf = std::move(cmdBufs[i]);
+        idle.back().fence = std::move(fences[i]);
+    }
+}
+
+void TransferQueue::retire() {
+    while (!inFlight.empty() && device.getFenceStatus(inFlight.front().fence.get()) == vk::Result::eSuccess) {
+        auto &batch = inFlight.front();
+        if (batch.ringBytes) {
+            tail = batch.ringEnd;
+            ringUsed -= batch.ringBytes;
+        }
+        completed = batch.ticket;
+        device.resetFences({batch.fence.get()});
+        batch.ownStaging.clear();
+        idle.push_back(std::move(batch));
+        inFlight.pop_front();
+    }
+}
+
+bool TransferQueue::begin() {
+    if (recording)
+        return true;
+    retire();
+    if (idle.empty())
+        return false;
+    recording = std::move(idle.back());
+    idle.pop_back();
+    recording->ticket = nextTicket++;
+    recording->recorded = false;
+    recording->ringBytes = 0;
+    recording->ringEnd = head;
+    recording->cmdBuf->begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    return true;
+}
+
+std::optional<TransferQueue::Staging> TransferQueue::stage(vk::DeviceSize sz) {
+    // copy offsets into images must be multiples of the texel block size; 16 covers every format
+    sz = (sz + 15) & ~vk::DeviceSize{15};
+    if (sz > ringSize) {
+        auto &own = recording->ownStaging.emplace_back(physDevice, device, sz);
+        return Staging{static_cast<uint8_t *>(own.get()), own.getBuffer(), 0};
+    }
+
+    retire();
+    if (ringUsed == 0)
+        head = tail = 0;
+    vk::DeviceSize offset;
+    if (head >= tail && ringUsed < ringSize) {
+        // free at the end and before the tail; the end is skipped if it is too short
+        if (head + sz <= ringSize) {
+            offset = head;
+        } else if (sz <= tail) {
+            recording->ringBytes += ringSize - head;
+            ringUsed += ringSize - head;
+            offset = 0;
+        } else {
+            return std::nullopt;
+        }
+    } else if (head + sz <= tail) {
+        offset = head;
+    } else {
+        return std::nullopt;
+    }
+    head = offset + sz;
+    ringUsed += sz;
+    recording->ringBytes += sz;
+    recording->ringEnd = head;
+    return Staging{static_cast<uint8_t *>(ring.get()) + offset, ring.getBuffer(), offset};
+}
+
+vk::CommandBuffer TransferQueue::cmd() {
+    recording->recorded = true;
+    return recording->cmdBuf.get();
+}
+
+void TransferQueue::submit() {
+    // an empty batch stays open for the next uploads
+    if (!recording || !recording->recorded)
+        return;
+    auto cmdBuf = recording->cmdBuf.get();
+    // for everything submitted after, whatever reads the uploads
+    vk::MemoryBarrier barrier{vk::AccessFlagBits::eTransferWrite,
+                              vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead};
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags{}, {barrier}, {}, {});
+    cmdBuf.end();
+    Submit({cmdBuf}, queue, recording->fence.get());
+    inFlight.push_back(std::move(*recording));
+    recording.reset();
+}
+
+bool TransferQueue::isDone(Ticket ticket) {
+    retire();
+    return ticket <= completed;
+}
+
+void TransferQueue::wait(Ticket ticket) {
+    if (recording && recording->ticket <= ticket)
+        submit();
+    for (const auto &batch : inFlight) {
+        if (batch.ticket > ticket)
+            break;
+        device.waitForFences({batch.fence.get()}, true, UINT64_MAX);
+    }
+    retire();
+}
@@ -0,0 +1,72 @@
+#ifndef VULKAN_TRANSFER_QUEUE_HPP
+#define VULKAN_TRANSFER_QUEUE_HPP
+
+#include "Buffer.hpp"
+#include <deque>
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+// Uploads recorded on the render thread and left to finish in the background.
+// Data is staged in a persistent, mapped ring, and copies are recorded into the batch being built; submit() sends it
+// off with a fence of its own, which isDone() polls on later frames without waiting. A batch's part of the ring is
+// reused once it has completed. Staging larger than the whole ring gets a buffer of its own, freed with its batch.
+class TransferQueue {
+  public:
+    // completes with the batch it was handed out for; tickets complete in the order they are handed out
+    using Ticket = uint64_t;
+    struct Staging {
+        uint8_t *data;
+        vk::Buffer buffer;
+        vk::DeviceSize offset;
+    };
+    static constexpr uint32_t maxBatchesInFlight = 4;
+
+  private:
+    struct Batch {
+        vk::UniqueCommandBuffer cmdBuf;
+        vk::UniqueFence fence;
+        Ticket ticket = 0;
+        bool recorded = false;
+        // where its part of the ring ends, and what it takes there, with any padding skipped at the ring's end
+        vk::DeviceSize ringEnd = 0, ringBytes = 0;
+        std::vector<StagingBuffer> ownStaging;
+    };
+
+    vk::PhysicalDevice physDevice;
+    vk::Device device;
+    vk::Queue queue;
+    vk::UniqueCommandPool cmdPool;
+    StagingBuffer ring;
+    vk::DeviceSize ringSize;
+    // next free byte, start of the oldest part in use, and bytes in use
+    vk::DeviceSize head = 0, tail = 0, ringUsed = 0;
+    std::vector<Batch> idle;
+    std::optional<Batch> recording;
+    // oldest first
+    std::deque<Batch> inFlight;
+    Ticket nextTicket = 1, completed = 0;
+
+    // frees the ring and the batches of everything that has completed
+    void retire();
+
+  public:
+    TransferQueue(vk::PhysicalDevice physDevice, vk::Device device, vk::Queue queue, uint32_t queueFamilyIndex, vk::DeviceSize ringSize);
+
+    // starts recording a batch unless one is already; false if too many are still in flight to start one now
+    bool begin();
+    // room for sz bytes in the batch being recorded, 16-byte aligned; nullopt if the ring is too full for now
+    std::optional<Staging> stage(vk::DeviceSize sz);
+    // of the batch being recorded; marks it as having something to submit
+    vk::CommandBuffer cmd();
+    Ticket getTicket() const { return recording->ticket; }
+    // sends off the batch being recorded, if anything was recorded into it
+    void submit();
+
+    bool isDone(Ticket ticket);
+    // blocks until ticket completes, submitting it first if it is still being recorded
+    void wait(Ticket ticket);
+    bool isBusy() const { return !inFlight.empty(); }
+};
+
+#endif // VULKAN_TRANSFER_QUEUE_HPP
@@ -61,7 +61,13 @@ vk::UniqueInstance createVulkanInstanceWithGlfw() {
             exts.push_back(glfwExts[i]);
         }
     }
+    // 1.2 for buffer device address
+    vk::ApplicationInfo appInfo;
+    appInfo.pApplicationName = "CommonChat";
+    appInfo.apiVersion = VK_API_VERSION_1_2;
+
     vk::InstanceCreateInfo instCreateInfo;
+    instCreateInfo.pApplicationInfo = &appInfo;
     instCreateInfo.enabledExtensionCount = exts.size();
     instCreateInfo.ppEnabledExtensionNames = exts.data();
     instCreateInfo.enabledLayerCount = layers.size();
@@ -91,11 +97,17 @@ vk::UniqueDevice createVulkanDeviceWithGlfw(vk::PhysicalDevice physicalDevice, c
     queueInfos.push_back(queueInfo);
 
     auto devFeats = physicalDevice.getFeatures2();
+    vk::PhysicalDeviceBufferDeviceAddressFeatures featbda;
+    featbda.bufferDeviceAddress = true;
+    featbda.pNext = &devFeats;
     vk::PhysicalDeviceDescriptorIndexingFeatures feati;
     feati.shaderSampledImageArrayNonUniformIndexing = true;
     feati.runtimeDescriptorArray = true;
     feati.descriptorBindingVariableDescriptorCount = true;
-    feati.pNext = &devFeats;
+    feati.descriptorBindingPartiallyBound = true;
+    feati.descriptorBindingSampledImageUpdateAfterBind = true;
+    feati.descriptorBindingUpdateUnusedWhilePending = true;
+    feati.pNext = &featbda;
 
     vk::DeviceCreateInfo deviceCreateInfo;
     deviceCreateInfo.pNext = &feati;
@@ -147,11 +159,17 @@ vk::SurfaceFormatKHR chooseSurfaceFormat(const std::vector<vk::SurfaceFormatKHR>
     return formats[0];
 }
 
-vk::PresentModeKHR chooseSurfacePresentMode(const std::vector<vk::PresentModeKHR> modes) {
+vk::PresentModeKHR chooseSurfacePresentMode(const std::vector<vk::PresentModeKHR> modes, bool lowLatency) {
+    if (lowLatency) {
+        for (const auto preferred : {vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate}) {
+            if (std::find(modes.begin(), modes.end(), preferred) != modes.end())
+                return preferred;
+        }
+    }
     return vk::PresentModeKHR::eFifo;
 }
 
-SwapchainDetails createVulkanSwapchainWithGlfw(vk::PhysicalDevice physicalDevice, vk::Device device, vk::SurfaceKHR surface) {
+SwapchainDetails createVulkanSwapchainWithGlfw(vk::PhysicalDevice physicalDevice, vk::Device device, vk::SurfaceKHR surface, bool lowLatencyPresent, vk::SwapchainKHR oldSwapchain) {
     vk::SurfaceCapabilitiesKHR surfaceCapabilities = physicalDevice.getSurfaceCapabilitiesKHR(surface);
     std::vector<vk::SurfaceFormatKHR> surfaceFormats = physicalDevice.getSurfaceFormatsKHR(surface);
     std::vector<vk::PresentModeKHR> surfacePresentModes = physicalDevice.getSurfacePresentModesKHR(surface);
@@ -170,7 +188,10 @@ SwapchainDetails createVulkanSwapchainWithGlfw(vk::PhysicalDevice physicalDevice
     SwapchainDetails swapchain;
 
     vk::SurfaceFormatKHR swapchainFormat = chooseSurfaceFormat(surfaceFormats);
-    vk::PresentModeKHR swapchainPresentMode = chooseSurfacePresentMode(surfacePresentModes);
+    vk::PresentModeKHR swapchainPresentMode = chooseSurfacePresentMode(surfacePresentModes, lowLatencyPresent);
+#ifdef _DEBUG
+    std::clog << "selected present mode: " << vk::to_string(swapchainPresentMode) << std::endl;
+#endif
 
     swapchain.format = swapchainFormat.format;
     swapchain.extent = surfaceCapabilities.currentExtent;
@@ -187,6 +208,7 @@ SwapchainDetails createVulkanSwapchainWithGlfw(vk::PhysicalDevice physicalDevice
     swapchainCreateInfo.imageUsage = vk::ImageUsageFlagBits::eColorAttachment;
     swapchainCreateInfo.imageSharingMode = vk::SharingMode::eExclusive;
     swapchainCreateInfo.clipped = VK_TRUE;
+    swapchainCreateInfo.oldSwapchain = oldSwapchain;
 
     swapchain.swapchain = device.createSwapchainKHRUnique(swapchainCreateInfo);
 
@@ -201,7 +223,7 @@ std::vector<RenderTargetHint> getRenderTargetHintsWithGlfw(vk::PhysicalDevice ph
     return v;
 }
 
-void present(vk::Queue queue, vk::SwapchainKHR swapchain, uint32_t index, std::initializer_list<vk::Semaphore> waitSemaphores) {
+vk::Result present(vk::Queue queue, vk::SwapchainKHR swapchain, uint32_t index, std::initializer_list<vk::Semaphore> waitSemaphores) {
     auto presentSwapchains = {swapchain};
     auto imgIndices = {index};
 
@@ -213,23 +235,32 @@ void present(vk::Queue queue, vk::SwapchainKHR swapchain, uint32_t index, std::i
     presentInfo.waitSemaphoreCount = waitSemaphores.size();
     presentInfo.pWaitSemaphores = waitSemaphores.begin();
 
-    queue.presentKHR(presentInfo);
+    try {
+        return queue.presentKHR(presentInfo);
+    } catch (const vk::OutOfDateKHRError &) {
+        return vk::Result::eErrorOutOfDateKHR;
+    }
 }
 
-VulkanManagerGlfw::VulkanManagerGlfw(GLFWwindow *window) : instance{createVulkanInstanceWithGlfw()},
+VulkanManagerGlfw::VulkanManagerGlfw(GLFWwindow *window, bool lowLatencyPresent, const AssetSettings &assetSettings) : instance{createVulkanInstanceWithGlfw()},
                                                            surface{createVulkanSurfaceWithGlfw(this->instance.get(), window)},
                                                            physicalDevice{chooseSuitablePhysicalDeviceWithGlfw(this->instance.get(), this->surface.get())},
                                                            queueSet{chooseSuitableQueueSet(physicalDevice.getQueueFamilyProperties()).value()},
                                                            device{createVulkanDeviceWithGlfw(this->physicalDevice, queueSet)},
                                                            presentQueue{this->device->getQueue(queueSet.graphicsQueueFamilyIndex, 0)},
-                                                           core{instance.get(), physicalDevice, queueSet, device.get()} {}
+                                                           core{instance.get(), physicalDevice, queueSet, device.get(), assetSettings},
+                                                           lowLatencyPresent{lowLatencyPresent} {}
 
 VulkanManagerGlfw::~VulkanManagerGlfw() {
     presentQueue.waitIdle();
 }
 
 void VulkanManagerGlfw::buildRenderTarget() {
-    swapchain = createVulkanSwapchainWithGlfw(physicalDevice, device.get(), surface.get());
+    // resources of the old swapchain may still be in use
+    device->waitIdle();
+
+    swapchain = createVulkanSwapchainWithGlfw(physicalDevice, device.get(), surface.get(), lowLatencyPresent, swapchain.swapchain.get());
+    swapchainOutdated = false;
     auto hints = getRenderTargetHintsWithGlfw(physicalDevice, device.get(), swapchain);
     core.recreateRenderTarget(hints);
 
@@ -245,30 +276,51 @@ void VulkanManagerGlfw::buildRenderTarget() {
     }
     frameFlightFence.clear();
     frameFlightFence.resize(flightFramesNum);
+    flightFrameIndex = 0;
 }
 
-void VulkanManagerGlfw::render() {
+bool VulkanManagerGlfw::beginFrame() {
     if (frameFlightFence[flightFrameIndex])
         device->waitForFences({frameFlightFence[flightFrameIndex]}, true, UINT64_MAX);
 
-    vk::ResultValue acquireImgResult =
-        device->acquireNextImageKHR(swapchain.swapchain.get(), UINT64_MAX,
-                                    imageAcquiredSemaphores[flightFrameIndex].get());
-    if (acquireImgResult.result != vk::Result::eSuccess)
-        throw std::runtime_error("failed to acquire image");
+    try {
+        vk::ResultValue acquireImgResult =
+            device->acquireNextImageKHR(swapchain.swapchain.get(), UINT64_MAX,
+                                        imageAcquiredSemaphores[flightFrameIndex].get());
+        if (acquireImgResult.result == vk::Result::eSuboptimalKHR)
+            swapchainOutdated = true;
+        else if (acquireImgResult.result != vk::Result::eSuccess)
+            throw std::runtime_error("failed to acquire image");
+
+        acquiredImageIndex = acquireImgResult.value;
+        return true;
+    } catch (const vk::OutOfDateKHRError &) {
+        swapchainOutdated = true;
+        return false;
+    }
+}
+
+PresentTiming VulkanManagerGlfw::render() {
+    PresentTiming timing;
 
     frameFlightFence[flightFrameIndex] =
-        core.render(acquireImgResult.value,
+        core.render(acquiredImageIndex,
                     {imageAcquiredSemaphores[flightFrameIndex].get()},
                     {vk::PipelineStageFlagBits::eColorAttachmentOutput},
                     {imageRenderedSemaphores[flightFrameIndex].get()});
+    timing.submit = FrameClock::now();
 
-    present(presentQueue, swapchain.swapchain.get(), acquireImgResult.value,
-            {imageRenderedSemaphores[flightFrameIndex].get()});
+    auto presentResult = present(presentQueue, swapchain.swapchain.get(), acquiredImageIndex,
+                                 {imageRenderedSemaphores[flightFrameIndex].get()});
+    if (presentResult != vk::Result::eSuccess)
+        swapchainOutdated = true;
+    timing.present = FrameClock::now();
 
     flightFrameIndex++;
     if (flightFrameIndex >= flightFramesNum)
         flightFrameIndex = 0;
+
+    return timing;
 }
 
 #endif
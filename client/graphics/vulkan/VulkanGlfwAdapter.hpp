@@ -1,6 +1,7 @@
 #ifdef USE_DESKTOP_MODE
 
 #include "../IGraphics.hpp"
+#include "../../desktop/FrameTiming.hpp"
 #include "VulkanManagerCore.hpp"
 #include <GLFW/glfw3.h>
 #include <vector>
@@ -17,19 +18,35 @@ class VulkanManagerGlfw : public IGraphics {
     VulkanManagerCore core;
 
     SwapchainDetails swapchain;
+    bool lowLatencyPresent;
+    bool swapchainOutdated = false;
 
     uint32_t flightFramesNum, flightFrameIndex = 0;
+    uint32_t acquiredImageIndex = 0;
     std::vector<vk::UniqueSemaphore> imageAcquiredSemaphores;
     std::vector<vk::UniqueSemaphore> imageRenderedSemaphores;
     std::vector<vk::Fence> frameFlightFence;
 
   public:
-    VulkanManagerGlfw(GLFWwindow *window);
+    VulkanManagerGlfw(GLFWwindow *window, bool lowLatencyPresent = false, const AssetSettings &assetSettings = {});
     ~VulkanManagerGlfw();
 
     void buildRenderTarget();
-
-    void render();
+    bool needsRebuildRenderTarget() const { return swapchainOutdated; }
+
+    // waits for the frame slot and acquires the next image; call before sampling input
+    // returns false if the swapchain has to be rebuilt first
+    bool beginFrame();
+    PresentTiming render();
+
+    // the scene, for what the window doesn't drive itself (remote avatars)
+    VulkanManagerCore &getCore() { return core; }
+    void setViewMatrix(const glm::mat4 &view) { core.setViewMatrix(view); }
+    bool isSceneDirty() const { return core.isSceneDirty(); }
+    const AnimationScheduler &getAnimationScheduler() const { return core.getAnimationScheduler(); }
+    TextureTranscodeStats getTextureStats() const { return core.getTextureStats(); }
+    const TextureResidency &getTextureResidency() const { return core.getTextureResidency(); }
+    const ModelResidency &getModelResidency() const { return core.getModelResidency(); }
 };
 
 #endif
@@ -1,14 +1,35 @@
 #include "VulkanManagerCore.hpp"
+#include "DrawBatcher.hpp"
+#include "RangeAllocator.hpp"
+#include "Skeleton.hpp"
 #include "renderer/SimpleRenderProc.hpp"
 #include <fastgltf/parser.hpp>
+#include <chrono>
+#include <cmath>
+#include <functional>
 #include <future>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <stb_image.h>
 using namespace std::string_literals;
 
 constexpr uint32_t coreflightFramesNum = 2;
+// an avatar takes one object, and three more while drawn as three parts
+constexpr uint32_t maxObjectNum = 4096;
+constexpr uint32_t maxMeshNum = 65536;
+constexpr uint32_t maxJointNum = 65536;
+constexpr uint32_t maxDrawNum = 4096;
+// model files parsed side by side; each also spreads its texture encoding over every core
+constexpr uint32_t modelLoadWorkerNum = 3;
+// spring bone threads besides the render thread, which takes its share too
+constexpr uint32_t springWorkerNum = 2;
+// the same for inverse kinematics
+constexpr uint32_t ikWorkerNum = 2;
+// added to the rank of avatars drawn in full, so one at the budget's boundary doesn't flicker between full and three parts
+constexpr float threePartsMargin = 1.0f;
 
 struct ObjectData {
     glm::mat4 modelMat;
@@ -20,57 +41,335 @@ struct MeshData {
     glm::uint32_t objectIndex;
     glm::uint32_t materialIndex;
     glm::uint32_t textureIndex; // no longer used
-    glm::uint32_t dummy[1];
+    // from gl_VertexIndex to the instance's morph deltas
+    glm::int32_t morphOffset;
 };
 
 constexpr auto idmat = glm::identity<glm::mat4x4>();
 
-std::vector<vk::DrawIndexedIndirectCommand> indirectDraws = {};
 std::vector<MeshData> meshes = {};
 std::vector<ObjectData> objects = {};
 std::vector<glm::mat4> joints = {};
 
-vk::UniqueDescriptorPool createDescPool(vk::Device device) {
+struct ImpostorData {
+    glm::vec4 centerRadius;
+    glm::uint32_t objectIndex;
+    glm::uint32_t textureIndex;
+    glm::uint32_t gridSize;
+    glm::uint32_t dummy[1];
+};
+
+struct AvatarInstance {
+    uint32_t modelIndex;
+    uint32_t objectIndex;
+    // valid while the model is resident
+    uint32_t jointBase;
+    std::vector<uint32_t> meshIndices;
+    // drawn as an impostor quad instead of its meshes
+    bool impostor = false;
+
+    // measured every frame against the first render target
+    float screenPixels = 0.0f;
+    float distance = 0.0f;
+    bool visible = true;
+
+    // latest pose, and the last two palettes evaluated from it
+    PoseBuffer pose;
+    std::vector<glm::mat4> palette, previousPalette;
+    // evaluations left until both palettes reflect the latest pose
+    uint32_t pendingEvaluations = 2;
+    // whether joints[] holds palette as is (rather than a blend)
+    bool showingLatest = false;
+    // pose with the spring bones swung, evaluated instead of pose while it isn't empty
+    PoseBuffer springPose;
+    // layers over pose, with copies of the poses and masks they point at; while they fit the model's skeleton
+    // (layered), their result stands in for pose from there on
+    FKPose layers;
+    std::vector<PoseBuffer> layerPoses;
+    std::vector<std::optional<PoseMask>> layerMasks;
+    bool layered = false;
+    bool layersDirty = false;
+    // clip of the model looped into pose: the first one by default, until a clip is chosen or a pose is set
+    std::optional<uint32_t> clipIndex;
+    bool clipChosen = false;
+    std::optional<ClipCursor> clipCursor;
+    // the clip the cursor reads, to notice when the model's clips move
+    const AnimationClip *cursorClip = nullptr;
+    std::chrono::steady_clock::time_point clipStart = std::chrono::steady_clock::now();
+    // solved into pose while set, instead of the clip
+    std::optional<IKTargets> tracking;
+    bool trackingDirty = false;
+
+    // morph weights by glTF mesh; per primitive, its delta region while any of its weights isn't zero
+    std::map<uint32_t, std::vector<float>> morphWeights;
+    std::vector<uint32_t> morphRegions;
+    bool morphDirty = false;
+
+    // model file being loaded for the avatar, which is drawn as the placeholder meanwhile
+    std::optional<std::filesystem::path> pendingModel;
+    float loadPriority = 0.0f;
+
+    // drawn as head and hands instead of meshes or impostor: always, or while the full avatar budget is exceeded
+    bool threePartsOnly = false;
+    bool threeParts = false;
+    // valid while drawn as three parts; the meshes of the model stay allocated meanwhile
+    uint32_t partObjects[ThreePartsAvatar::PartCount], partMeshes[ThreePartsAvatar::PartCount];
+    // as tracked, once set; the parts follow the pose before that
+    std::optional<ThreePartsAvatar> parts;
+    bool partsDirty = false;
+};
+
+std::vector<Skeleton> skeletons = {};
+// per model, built the first time a tracked avatar shows it; empty if the model can't be driven by IK
+std::map<uint32_t, std::optional<IKRig>> ikRigs = {};
+std::map<uint32_t, AvatarInstance> avatars = {};
+uint32_t nextAvatarId = 0;
+DrawBatcher drawBatcher;
+
+// models by file, and the loads still running with the avatars waiting for each
+struct PendingModel {
+    ModelLoadQueue::Ticket ticket;
+    std::vector<uint32_t> avatarIds;
+};
+std::map<std::filesystem::path, uint32_t> modelsByPath = {};
+std::map<std::filesystem::path, PendingModel> pendingModels = {};
+
+// per model: atlas to bake next, round-robin over its impostor avatars
+std::vector<uint32_t> lastBakedAvatar = {};
+uint32_t nextBakeModel = 0;
+
+// free slots of objects/meshes, and joint ranges; slots past these are never used, so uploads can stop there
+std::vector<uint32_t> freeObjects = {}, freeMeshes = {};
+uint32_t objectsUsed = 0, meshesUsed = 0;
+RangeAllocator jointRanges{maxJointNum};
+
+// bumped on every change of the per-frame scene buffers; each flight frame uploads when it is behind
+uint64_t sceneVersion = 0;
+uint64_t uploadedSceneVersion[coreflightFramesNum] = {};
+std::vector<DrawGroup> uploadedDrawGroups[coreflightFramesNum] = {};
+uint32_t uploadedImpostorCount[coreflightFramesNum] = {};
+
+constexpr uint32_t noMorphRegion = UINT32_MAX;
+
+DrawBatcher::MeshRange meshRangeOf(const ModelManager::MeshPointer &primitive) {
+    return DrawBatcher::MeshRange{int32_t(primitive.vertexBase), primitive.IndexBase, primitive.indexNum};
+}
+
+// the primitive's own variant, morphed while the avatar has deltas for it
+ShaderVariant variantOf(const AvatarInstance &avatar, const ModelManager::ModelInfo &model, uint32_t primitive) {
+    auto variant = model.primitives[primitive].variant;
+    if (avatar.morphRegions[primitive] != noMorphRegion)
+        variant.features |= ShaderFeature::Morph;
+    return variant;
+}
+
+// back to the bind pose; the regions are released once no frame in flight draws with them
+void releaseMorphRegions(AvatarInstance &avatar, const ModelManager::ModelInfo &model, MorphEvaluator &morphEvaluator, uint64_t frame) {
+    for (uint32_t i = 0; i < avatar.morphRegions.size(); i++) {
+        if (avatar.morphRegions[i] == noMorphRegion)
+            continue;
+        morphEvaluator.freeRegion(avatar.morphRegions[i], model.primitives[i].vertexNum, frame);
+        avatar.morphRegions[i] = noMorphRegion;
+        meshes[avatar.meshIndices[i]].morphOffset = 0;
+    }
+}
+
+uint32_t allocateSlot(std::vector<uint32_t> &freeList, uint32_t &used, uint32_t max) {
+    if (!freeList.empty()) {
+        auto slot = freeList.back();
+        freeList.pop_back();
+        return slot;
+    }
+    if (used == max)
+        throw std::runtime_error("out of scene slots");
+    return used++;
+}
+
+uint32_t allocateJoints(uint32_t n) {
+    if (auto base = jointRanges.allocate(n))
+        return *base;
+    throw std::runtime_error("out of joint slots");
+}
+
+// the pose the skeleton is evaluated from, before the spring bones swing
+const PoseBuffer &posedOf(const AvatarInstance &avatar) {
+    return avatar.layered ? avatar.layers.getResult() : avatar.pose;
+}
+
+// separate thresholds so an avatar at the boundary doesn't flicker between meshes and impostor
+bool prefersImpostor(const AvatarInstance &avatar) {
+    return avatar.screenPixels < (avatar.impostor ? ImpostorManager::exitPixels : ImpostorManager::enterPixels);
+}
+
+// gives the avatar the meshes and joints of a model; nothing on the device until the model is resident.
+// The pose is kept if it fits the model's skeleton, and reset to its rest pose otherwise.
+void attachModel(AvatarInstance &avatar, uint32_t modelIndex, const ModelManager &modelManager) {
+    const auto &model = modelManager.getModelInfo(modelIndex);
+    const bool resident = modelManager.isModelResident(modelIndex);
+
+    avatar.modelIndex = modelIndex;
+    avatar.impostor = false;
+    // otherwise joints and meshes are set up by streamModels() once the model is uploaded
+    avatar.jointBase = resident ? allocateJoints(model.nodes.size()) : 0;
+    objects[avatar.objectIndex].jointIndex = avatar.jointBase;
+    if (resident)
+        std::fill_n(joints.begin() + avatar.jointBase, model.nodes.size(), idmat);
+
+    if (avatar.pose.jointCount() != model.nodes.size())
+        avatar.pose = skeletons[modelIndex].getRestPose();
+    avatar.palette.assign(model.nodes.size(), idmat);
+    avatar.previousPalette.assign(model.nodes.size(), idmat);
+    avatar.pendingEvaluations = 2;
+    avatar.showingLatest = false;
+    avatar.springPose.clear();
+    avatar.layersDirty = true;
+    if (!avatar.clipChosen)
+        avatar.clipIndex = model.animations.empty() ? std::nullopt : std::optional<uint32_t>{0};
+    avatar.clipCursor.reset();
+    avatar.trackingDirty = avatar.tracking.has_value();
+    // the weights carry over; deltas are evaluated once the model is resident
+    avatar.morphRegions.assign(model.primitives.size(), noMorphRegion);
+    avatar.morphDirty = true;
+    avatar.partsDirty = true;
+
+    for (const auto &primitive : model.primitives) {
+        auto meshIndex = allocateSlot(freeMeshes, meshesUsed, maxMeshNum);
+        meshes[meshIndex].objectIndex = avatar.objectIndex;
+        meshes[meshIndex].materialIndex = primitive.materialIndex;
+        meshes[meshIndex].morphOffset = 0;
+        if (resident) {
+            meshes[meshIndex].textureIndex = modelManager.getTextureSlot(primitive.textureIndex);
+            if (!avatar.threeParts)
+                drawBatcher.add(meshRangeOf(primitive), primitive.variant, meshIndex);
+        }
+        avatar.meshIndices.push_back(meshIndex);
+    }
+}
+
+void detachModel(AvatarInstance &avatar, const ModelManager &modelManager, MorphEvaluator &morphEvaluator, uint64_t frame) {
+    releaseMorphRegions(avatar, modelManager.getModelInfo(avatar.modelIndex), morphEvaluator, frame);
+    for (const auto meshIndex : avatar.meshIndices) {
+        drawBatcher.remove(meshIndex);
+        freeMeshes.push_back(meshIndex);
+    }
+    avatar.meshIndices.clear();
+    if (modelManager.isModelResident(avatar.modelIndex))
+        jointRanges.free(avatar.jointBase, modelManager.getModelInfo(avatar.modelIndex).nodes.size());
+}
+
+// puts the avatar's head and hands in place of its meshes or impostor
+void showThreeParts(AvatarInstance &avatar, uint32_t partsModel, const ModelManager &modelManager) {
+    for (const auto meshIndex : avatar.meshIndices)
+        drawBatcher.remove(meshIndex);
+    avatar.impostor = false;
+    avatar.springPose.clear();
+
+    const auto &primitive = modelManager.getModelInfo(partsModel).primitives[0];
+    for (uint32_t part = 0; part < ThreePartsAvatar::PartCount; part++) {
+        const auto objectIndex = allocateSlot(freeObjects, objectsUsed, maxObjectNum);
+        const auto meshIndex = allocateSlot(freeMeshes, meshesUsed, maxMeshNum);
+        objects[objectIndex].jointIndex = 0;
+        meshes[meshIndex] = MeshData{objectIndex, primitive.materialIndex, 0, 0};
+        // every part of every avatar shares the range and variant, so all of them go into one instanced draw
+        if (modelManager.isModelResident(partsModel)) {
+            meshes[meshIndex].textureIndex = modelManager.getTextureSlot(primitive.textureIndex);
+            drawBatcher.add(meshRangeOf(primitive), primitive.variant, meshIndex);
+        }
+        avatar.partObjects[part] = objectIndex;
+        avatar.partMeshes[part] = meshIndex;
+    }
+    avatar.threeParts = true;
+    avatar.partsDirty = true;
+}
+
+void releaseThreeParts(AvatarInstance &avatar) {
+    for (uint32_t part = 0; part < ThreePartsAvatar::PartCount; part++) {
+        drawBatcher.remove(avatar.partMeshes[part]);
+        freeMeshes.push_back(avatar.partMeshes[part]);
+        freeObjects.push_back(avatar.partObjects[part]);
+    }
+    avatar.threeParts = false;
+}
+
+// back to the meshes; selectImpostors() takes it on to its impostor from there if it is small
+void hideThreeParts(AvatarInstance &avatar, const ModelManager &modelManager) {
+    releaseThreeParts(avatar);
+    // the palette went stale while the parts were drawn
+    avatar.pendingEvaluations = 2;
+    avatar.showingLatest = false;
+    if (!modelManager.isModelResident(avatar.modelIndex))
+        return;
+    const auto &model = modelManager.getModelInfo(avatar.modelIndex);
+    for (uint32_t i = 0; i < avatar.meshIndices.size(); i++)
+        drawBatcher.add(meshRangeOf(model.primitives[i]), variantOf(avatar, model, i), avatar.meshIndices[i]);
+}
+
+// an unskinned box of one colour, with a single joint
+ModelManager::ModelHostData buildBoxModel(const glm::vec3 &min, const glm::vec3 &max, const glm::u8vec4 &color) {
+    ModelManager::ModelHostData host;
+    for (int axis = 0; axis < 3; axis++) {
+        const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        for (int side = 0; side < 2; side++) {
+            const auto base = static_cast<uint32_t>(host.positions.size());
+            glm::vec3 normal{0.0f};
+            normal[axis] = side ? 1.0f : -1.0f;
+            for (int corner = 0; corner < 4; corner++) {
+                glm::vec3 position;
+                position[axis] = side ? max[axis] : min[axis];
+                position[u] = corner & 1 ? max[u] : min[u];
+                position[v] = corner & 2 ? max[v] : min[v];
+                host.positions.push_back(position);
+                host.normals.push_back(normal);
+                host.texcoords.push_back(glm::vec2(corner & 1, corner >> 1));
+            }
+            // counter-clockwise seen from outside, like glTF
+            constexpr uint32_t quads[2][6] = {{0, 2, 1, 1, 2, 3}, {0, 1, 2, 2, 1, 3}};
+            for (const auto index : quads[side])
+                host.indices.push_back(base + index);
+        }
+    }
+    host.joints.resize(host.positions.size(), glm::u16vec4{0});
+    host.weights.resize(host.positions.size(), glm::vec4{1.0f, 0.0f, 0.0f, 0.0f});
+
+    TextureTranscoder::Texture texture{vk::Format::eR8G8B8A8Srgb, vk::Extent3D{1, 1, 1}};
+    texture.levels.push_back({color.r, color.g, color.b, color.a});
+    host.textures.push_back(std::move(texture));
+
+    host.info.primitives.push_back(ModelManager::MeshPointer{0, 0, static_cast<uint32_t>(host.indices.size()), 0, 0});
+    host.info.nodes.push_back(ModelManager::NodeInfo{idmat, glm::vec3{0.0f}, glm::quat(1.0f, 0.0f, 0.0f, 0.0f)});
+    host.info.boundsCenter = (min + max) * 0.5f;
+    host.info.boundsRadius = glm::length(max - min) * 0.5f;
+    return host;
+}
+
+vk::UniqueDescriptorPool createDescPool(vk::PhysicalDevice physicalDevice, vk::Device device) {
     vk::DescriptorPoolCreateInfo createInfo;
     vk::DescriptorPoolSize poolSizes[4];
     poolSizes[0].descriptorCount = 8;
     poolSizes[0].type = vk::DescriptorType::eUniformBuffer;
     poolSizes[1].descriptorCount = 8;
     poolSizes[1].type = vk::DescriptorType::eUniformBufferDynamic;
-    poolSizes[2].descriptorCount = 256;
-    poolSizes[2].type = vk::DescriptorType::eSampledImage;
-    poolSizes[3].descriptorCount = 8;
-    poolSizes[3].type = vk::DescriptorType::eStorageBuffer;
+    poolSizes[2].descriptorCount = 8;
+    poolSizes[2].type = vk::DescriptorType::eStorageBuffer;
+    poolSizes[3].descriptorCount = ModelManager::getTextureCapacity(physicalDevice);
+    poolSizes[3].type = vk::DescriptorType::eCombinedImageSampler;
 
     createInfo.maxSets = 16;
-    createInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+    // the bindless texture array is written while the set is bound
+    createInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet | vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind;
     createInfo.poolSizeCount = std::size(poolSizes);
     createInfo.pPoolSizes = poolSizes;
     return device.createDescriptorPoolUnique(createInfo);
 }
 
+// Only the camera is a descriptor; the scene buffers are reached through device addresses in push constants.
 vk::UniqueDescriptorSetLayout createDescLayout(vk::Device device) {
-    vk::DescriptorSetLayoutBinding binding[4];
+    vk::DescriptorSetLayoutBinding binding[1];
     // Uniform Buffer
     binding[0].binding = 0;
     binding[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
     binding[0].descriptorCount = 1;
     binding[0].stageFlags = vk::ShaderStageFlagBits::eVertex;
-    // Objects
-    binding[1].binding = 2;
-    binding[1].descriptorType = vk::DescriptorType::eStorageBufferDynamic;
-    binding[1].descriptorCount = 1;
-    binding[1].stageFlags = vk::ShaderStageFlagBits::eVertex;
-    // Joints
-    binding[2].binding = 3;
-    binding[2].descriptorType = vk::DescriptorType::eStorageBufferDynamic;
-    binding[2].descriptorCount = 1;
-    binding[2].stageFlags = vk::ShaderStageFlagBits::eVertex;
-    // Primitives
-    binding[3].binding = 4;
-    binding[3].descriptorType = vk::DescriptorType::eStorageBufferDynamic;
-    binding[3].descriptorCount = 1;
-    binding[3].stageFlags = vk::ShaderStageFlagBits::eVertex;
 
     vk::DescriptorSetLayoutCreateInfo createInfo;
     createInfo.bindingCount = std::size(binding);
@@ -93,6 +392,8 @@ RenderTarget createRenderTargetFromHint(vk::Device device, const RenderTargetHin
 
     rt.extent = hint.extent;
     rt.format = hint.format;
+    rt.finalLayout = hint.finalLayout;
+    rt.images = hint.images;
     rt.imageViews = createImageViewsFromImages(device, hint.images, hint.format);
     return rt;
 }
@@ -118,45 +419,23 @@ vk::UniqueSampler createSampler(vk::Device device) {
     return device.createSamplerUnique(createInfo);
 }
 
-struct JointConfiguration {
-    glm::quat rotation;
-    glm::vec3 translation;
-};
-
-void updateJointMatrix(const ModelManager::ModelInfo &model, const std::vector<JointConfiguration> &jointConfig, uint32_t indexBase) {
-    std::vector<int> indices;
-    std::vector<int> chCount(model.nodes.size(), 0);
-    for (uint32_t i = 0; i < model.nodes.size(); i++) {
-        if (model.nodes[i].parent != -1)
-            chCount[model.nodes[i].parent]++;
-    }
-    for (uint32_t i = 0; i < model.nodes.size(); i++) {
-        if (chCount[i] == 0)
-            indices.push_back(i);
-    }
-    for (uint32_t i = 0; i < model.nodes.size(); i++) {
-        int p = model.nodes[indices[i]].parent;
-        if (p != -1) {
-            chCount[p]--;
-            if (chCount[p] == 0)
-                indices.push_back(p);
-        }
-    }
-    std::reverse(indices.begin(), indices.end());
-    for (const auto i : indices) {
-        joints[indexBase + i] =
-            (model.nodes[i].parent == -1 ? idmat : joints[model.nodes[i].parent]) * glm::translate(idmat, jointConfig[i].translation) * glm::toMat4(jointConfig[i].rotation);
-    }
-    for (uint32_t i = 0; i < model.nodes.size(); i++) {
-        joints[indexBase + i] *= model.nodes[i].inverseBindMatrix;
+bool isSphereInFrustum(const glm::mat4 &viewProj, const glm::vec3 &center, float radius) {
+    const auto m = glm::transpose(viewProj);
+    // left, right, bottom, top, near, far
+    const glm::vec4 planes[] = {m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2]};
+    for (const auto &plane : planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius * glm::length(glm::vec3(plane)))
+            return false;
     }
+    return true;
 }
 
 VulkanManagerCore::VulkanManagerCore(
     vk::Instance instance,
     vk::PhysicalDevice physicalDevice,
     const UsingQueueSet &queueSet,
-    vk::Device device)
+    vk::Device device,
+    const AssetSettings &assetSettings)
     : instance{instance},
       physicalDevice{physicalDevice},
       queueSet{queueSet},
@@ -165,68 +444,713 @@ VulkanManagerCore::VulkanManagerCore(
       renderCmdPool{createCommandPool(device, queueSet.graphicsQueueFamilyIndex)},
       renderCmdBufs{createCommandBuffers(device, renderCmdPool.get(), coreflightFramesNum)},
       renderCmdBufFences{createFences(device, coreflightFramesNum, true)},
-      descPool{createDescPool(device)},
+      descPool{createDescPool(physicalDevice, device)},
       descLayout{createDescLayout(device)},
       descSet{std::move(createDescSets(device, descPool.get(), descLayout.get(), 1)[0])},
       assetManageCmdBuf{createCommandBuffer(device, renderCmdPool.get())},
       assetManageFence{std::move(createFences(device, 1, true)[0])},
-      modelManager{physicalDevice, device, descPool.get(), graphicsQueue, assetManageCmdBuf.get(), assetManageFence.get()},
-      defaultRenderProc{new SimpleRenderProc{physicalDevice, device, descLayout.get(), modelManager.getDescSetLayout()}} {
+      modelManager{physicalDevice, device, descPool.get(), graphicsQueue, queueSet.graphicsQueueFamilyIndex, assetManageCmdBuf.get(), assetManageFence.get(), assetSettings},
+      impostorManager{physicalDevice, device, descPool.get(), descLayout.get(), modelManager.getDescSetLayout(), coreflightFramesNum},
+      morphEvaluator{physicalDevice, device, coreflightFramesNum},
+      springBones{springWorkerNum},
+      ikSolver{ikWorkerNum},
+      loadQueue{[this](const std::filesystem::path &path) { return modelManager.parseGlbFile(path); }, modelLoadWorkerNum},
+      defaultRenderProc{new SimpleRenderProc{physicalDevice, device, descLayout.get(), modelManager.getDescSetLayout(), coreflightFramesNum}},
+      viewMatrix{glm::lookAt(glm::vec3(0.0f, 1.3f, -0.9f), glm::vec3(-0.5f, 0.5f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f))} {
 
-    auto modelInfo = modelManager.loadModelFromGlbFile("AliciaSolid.vrm", graphicsQueue, assetManageCmdBuf.get(), assetManageFence.get());
+    objects.resize(maxObjectNum);
+    meshes.resize(maxMeshNum);
+    joints.resize(maxJointNum, idmat);
 
-    {
-        ObjectData obj;
-        obj.modelMat = glm::translate(idmat, glm::vec3{0.0, -0.5, 0.0});
-        obj.jointIndex = 0;
-        objects.push_back(obj);
-    }
-    for (const auto &primitive : modelInfo.primitives) {
-        vk::DrawIndexedIndirectCommand drawCmd;
-        drawCmd.vertexOffset = primitive.vertexBase;
-        drawCmd.firstIndex = primitive.IndexBase;
-        drawCmd.firstInstance = indirectDraws.size();
-        drawCmd.instanceCount = 1;
-        drawCmd.indexCount = primitive.indexNum;
-        indirectDraws.push_back(drawCmd);
-
-        MeshData mesh;
-        mesh.objectIndex = 0;
-        mesh.materialIndex = primitive.materialIndex;
-        mesh.textureIndex = primitive.textureIndex;
-        meshes.push_back(mesh);
-    }
-    joints.resize(modelInfo.nodes.size(), glm::identity<glm::mat4>());
-
-    // for alignment
-    objects.resize(2048);
-    meshes.resize(65536);
-    joints.resize(65536);
-
-    std::vector<JointConfiguration> jointConfig(modelInfo.nodes.size());
-    for (int i = 0; i < modelInfo.nodes.size(); i++) {
-        jointConfig[i].rotation = modelInfo.nodes[i].rotation;
-        jointConfig[i].translation = modelInfo.nodes[i].translation;
-    }
-    jointConfig[51].rotation = glm::quat(sqrt(0.5f), 0, -sqrt(0.5f), 0);
-    updateJointMatrix(modelInfo, jointConfig, 0);
-
-    drawIndirectBuffer.emplace(physicalDevice, device, sizeof(vk::DrawIndexedIndirectCommand) * indirectDraws.size() * coreflightFramesNum, vk::BufferUsageFlagBits::eIndirectBuffer);
-    meshesBuffer.emplace(physicalDevice, device, sizeof(MeshData) * meshes.size() * coreflightFramesNum, vk::BufferUsageFlagBits::eStorageBuffer);
-    objectsBuffer.emplace(physicalDevice, device, sizeof(ObjectData) * objects.size() * coreflightFramesNum, vk::BufferUsageFlagBits::eStorageBuffer);
-    jointsBuffer.emplace(physicalDevice, device, sizeof(glm::mat4) * joints.size() * coreflightFramesNum, vk::BufferUsageFlagBits::eStorageBuffer);
-
-    for (uint32_t i = 0; i < coreflightFramesNum; i++) {
-        std::copy(indirectDraws.begin(), indirectDraws.end(), static_cast<vk::DrawIndexedIndirectCommand *>(drawIndirectBuffer->get()) + indirectDraws.size() * i);
-        std::copy(meshes.begin(), meshes.end(), static_cast<MeshData *>(meshesBuffer->get()) + meshes.size() * i);
-        std::copy(objects.begin(), objects.end(), static_cast<ObjectData *>(objectsBuffer->get()) + objects.size() * i);
-        std::copy(joints.begin(), joints.end(), static_cast<glm::mat4 *>(jointsBuffer->get()) + joints.size() * i);
-    }
-
-    drawIndirectBuffer.value().flush<1>(device, {{{0, sizeof(vk::DrawIndexedIndirectCommand) * indirectDraws.size() * coreflightFramesNum}}});
-    meshesBuffer.value().flush<1>(device, {{{0, sizeof(MeshData) * meshes.size() * coreflightFramesNum}}});
-    objectsBuffer.value().flush<1>(device, {{{0, sizeof(ObjectData) * objects.size() * coreflightFramesNum}}});
-    jointsBuffer.value().flush<1>(device, {{{0, sizeof(glm::mat4) * joints.size() * coreflightFramesNum}}});
+    constexpr auto sceneBufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress;
+    drawIndirectBuffer.emplace(physicalDevice, device, sizeof(vk::DrawIndexedIndirectCommand) * maxDrawNum * coreflightFramesNum, vk::BufferUsageFlagBits::eIndirectBuffer);
+    instancesBuffer.emplace(physicalDevice, device, sizeof(uint32_t) * maxMeshNum * coreflightFramesNum, sceneBufferUsage);
+    meshesBuffer.emplace(physicalDevice, device, sizeof(MeshData) * meshes.size() * coreflightFramesNum, sceneBufferUsage);
+    objectsBuffer.emplace(physicalDevice, device, sizeof(ObjectData) * objects.size() * coreflightFramesNum, sceneBufferUsage);
+    jointsBuffer.emplace(physicalDevice, device, sizeof(glm::mat4) * joints.size() * coreflightFramesNum, sceneBufferUsage);
+    impostorsBuffer.emplace(physicalDevice, device, sizeof(ImpostorData) * maxObjectNum * coreflightFramesNum, sceneBufferUsage);
+
+    sceneBufferBase.objects = objectsBuffer->getDeviceAddress(device);
+    sceneBufferBase.joints = jointsBuffer->getDeviceAddress(device);
+    sceneBufferBase.meshes = meshesBuffer->getDeviceAddress(device);
+    sceneBufferBase.instances = instancesBuffer->getDeviceAddress(device);
+    sceneBufferBase.impostors = impostorsBuffer->getDeviceAddress(device);
+    sceneBufferBase.morphDeltas = morphEvaluator.getDeltaAddress();
+
+    // a grey box of roughly human size
+    placeholderModel = registerModel(buildBoxModel(glm::vec3{-0.25f, 0.0f, -0.15f}, glm::vec3{0.25f, 1.6f, 0.15f}, glm::u8vec4{160, 160, 160, 255}));
+    partsModel = registerModel(buildBoxModel(glm::vec3{-0.5f}, glm::vec3{0.5f}, glm::u8vec4{224, 190, 160, 255}));
+    requestAvatar("AliciaSolid.vrm", glm::translate(idmat, glm::vec3{0.0, -0.5, 0.0}));
+}
+
+uint32_t VulkanManagerCore::registerModel(ModelManager::ModelHostData host) {
+    const auto modelIndex = modelManager.addModel(std::move(host));
+    impostorManager.addAtlas(modelManager);
+    lastBakedAvatar.push_back(0);
+    skeletons.emplace_back(modelManager.getModelInfo(modelIndex));
+    return modelIndex;
+}
+
+uint32_t VulkanManagerCore::loadModel(const std::filesystem::path &path) {
+    if (auto it = modelsByPath.find(path); it != modelsByPath.end())
+        return it->second;
+    const auto modelIndex = registerModel(modelManager.parseGlbFile(path));
+    modelsByPath.emplace(path, modelIndex);
+    return modelIndex;
+}
+
+uint32_t VulkanManagerCore::addAvatar(uint32_t modelIndex, const glm::mat4 &transform) {
+    if (modelIndex >= modelManager.getModelCount())
+        throw std::out_of_range("no such model");
+
+    AvatarInstance avatar;
+    avatar.objectIndex = allocateSlot(freeObjects, objectsUsed, maxObjectNum);
+    objects[avatar.objectIndex].modelMat = transform;
+    attachModel(avatar, modelIndex, modelManager);
+
+    auto id = nextAvatarId++;
+    avatars.emplace(id, std::move(avatar));
+    springBones.addAvatar(id, modelManager.getModelInfo(modelIndex).springBones, skeletons[modelIndex]);
+    sceneVersion++;
+    sceneDirty = true;
+    return id;
+}
+
+void VulkanManagerCore::removeAvatar(uint32_t avatarId) {
+    auto it = avatars.find(avatarId);
+    if (it == avatars.end())
+        return;
+
+    auto &avatar = it->second;
+    if (avatar.pendingModel) {
+        auto pending = pendingModels.find(*avatar.pendingModel);
+        auto &waiting = pending->second.avatarIds;
+        waiting.erase(std::find(waiting.begin(), waiting.end(), avatarId));
+        if (waiting.empty()) {
+            loadQueue.cancel(pending->second.ticket);
+            pendingModels.erase(pending);
+        }
+    }
+    if (avatar.threeParts)
+        releaseThreeParts(avatar);
+    detachModel(avatar, modelManager, morphEvaluator, frameCount);
+    springBones.removeAvatar(avatarId);
+    freeObjects.push_back(avatar.objectIndex);
+    animationScheduler.remove(avatarId);
+    avatars.erase(it);
+    sceneVersion++;
+    sceneDirty = true;
+}
+
+uint32_t VulkanManagerCore::requestAvatar(const std::filesystem::path &model, const glm::mat4 &transform, float priority) {
+    if (auto it = modelsByPath.find(model); it != modelsByPath.end())
+        return addAvatar(it->second, transform);
+
+    const auto id = addAvatar(placeholderModel, transform);
+    auto &avatar = avatars.at(id);
+    avatar.pendingModel = model;
+    avatar.loadPriority = priority;
+    auto [pending, inserted] = pendingModels.try_emplace(model);
+    if (inserted)
+        pending->second.ticket = loadQueue.push(model, priority);
+    pending->second.avatarIds.push_back(id);
+    return id;
+}
+
+void VulkanManagerCore::setAvatarLoadPriority(uint32_t avatarId, float priority) {
+    avatars.at(avatarId).loadPriority = priority;
+}
+
+uint32_t VulkanManagerCore::addThreePartsAvatar(const glm::mat4 &transform) {
+    // the placeholder gives it bounds of human size to measure
+    const auto id = addAvatar(placeholderModel, transform);
+    auto &avatar = avatars.at(id);
+    avatar.threePartsOnly = true;
+    showThreeParts(avatar, partsModel, modelManager);
+    return id;
+}
+
+void VulkanManagerCore::setAvatarParts(uint32_t avatarId, const ThreePartsAvatar &parts) {
+    auto &avatar = avatars.at(avatarId);
+    avatar.parts = parts;
+    avatar.partsDirty = true;
+    sceneDirty |= avatar.threeParts;
+}
+
+void VulkanManagerCore::setFullAvatarBudget(uint32_t budget) {
+    fullAvatarBudget = budget;
+    sceneDirty = true;
+}
+
+void VulkanManagerCore::setAvatarTransform(uint32_t avatarId, const glm::mat4 &transform) {
+    auto &avatar = avatars.at(avatarId);
+    objects[avatar.objectIndex].modelMat = transform;
+    avatar.partsDirty = true;
+    sceneVersion++;
+    sceneDirty = true;
+}
+
+void VulkanManagerCore::setAvatarPose(uint32_t avatarId, const PoseBuffer &pose) {
+    auto &avatar = avatars.at(avatarId);
+    avatar.pose = pose;
+    avatar.pendingEvaluations = 2;
+    avatar.partsDirty |= !avatar.parts;
+    avatar.layersDirty = true;
+    avatar.clipIndex.reset();
+    avatar.clipChosen = true;
+    sceneDirty = true;
+}
+
+void VulkanManagerCore::playAvatarClip(uint32_t avatarId, std::optional<uint32_t> clip) {
+    auto &avatar = avatars.at(avatarId);
+    avatar.clipIndex = clip;
+    avatar.clipChosen = true;
+    avatar.clipCursor.reset();
+    avatar.clipStart = std::chrono::steady_clock::now();
+    sceneDirty = true;
+}
+
+void VulkanManagerCore::setAvatarTracking(uint32_t avatarId, const std::optional<IKTargets> &targets) {
+    auto &avatar = avatars.at(avatarId);
+    avatar.tracking = targets;
+    avatar.trackingDirty = targets.has_value();
+    if (targets) {
+        avatar.clipIndex.reset();
+        avatar.clipChosen = true;
+    }
+    sceneDirty = true;
+}
+
+void VulkanManagerCore::setAvatarLayers(uint32_t avatarId, const std::vector<FKPose::Layer> &layers) {
+    auto &avatar = avatars.at(avatarId);
+    avatar.layerPoses.clear();
+    avatar.layerMasks.clear();
+    for (const auto &layer : layers) {
+        avatar.layerPoses.push_back(*layer.pose);
+        avatar.layerMasks.push_back(layer.mask ? std::optional<PoseMask>{*layer.mask} : std::nullopt);
+    }
+    // pointers into the copies only once both are complete
+    avatar.layers.clearLayers();
+    for (uint32_t i = 0; i < layers.size(); i++) {
+        auto layer = layers[i];
+        layer.pose = &avatar.layerPoses[i];
+        layer.mask = avatar.layerMasks[i] ? &*avatar.layerMasks[i] : nullptr;
+        avatar.layers.pushLayer(layer);
+    }
+    avatar.layersDirty = true;
+    sceneDirty = true;
+}
+
+void VulkanManagerCore::setAvatarPose(uint32_t avatarId, const std::vector<JointConfiguration> &pose) {
+    setAvatarPose(avatarId, PoseBuffer{pose});
+}
+
+void VulkanManagerCore::setAvatarMorphWeights(uint32_t avatarId, uint32_t mesh, const std::vector<float> &weights) {
+    auto &avatar = avatars.at(avatarId);
+    avatar.morphWeights[mesh] = weights;
+    avatar.morphDirty = true;
+    sceneDirty = true;
+}
+
+void VulkanManagerCore::measureAvatars() {
+    const glm::vec3 cameraPos = glm::vec3(glm::inverse(viewMatrix)[3]);
+    const auto viewProj = projMatrix * viewMatrix;
+    for (auto &[id, avatar] : avatars) {
+        const auto &model = modelManager.getModelInfo(avatar.modelIndex);
+        const glm::vec3 center = glm::vec3(objects[avatar.objectIndex].modelMat * glm::vec4(model.boundsCenter, 1.0f));
+        avatar.distance = glm::distance(cameraPos, center);
+        avatar.screenPixels = 2.0f * model.boundsRadius * projScale / std::max(avatar.distance, 1e-3f);
+        avatar.visible = isSphereInFrustum(viewProj, center, model.boundsRadius);
+    }
+}
+
+void VulkanManagerCore::collectModelLoads() {
+    for (auto &result : loadQueue.takeFinished()) {
+        auto pending = std::find_if(pendingModels.begin(), pendingModels.end(), [&](const auto &entry) { return entry.second.ticket == result.ticket; });
+        const auto path = pending->first;
+        const auto avatarIds = std::move(pending->second.avatarIds);
+        pendingModels.erase(pending);
+
+        if (!result.host) {
+#ifdef _DEBUG
+            std::clog << "failed to load " << path << ": " << result.error << std::endl;
+#endif
+            // left as placeholders
+            for (const auto id : avatarIds)
+                avatars.at(id).pendingModel.reset();
+            continue;
+        }
+        const auto modelIndex = registerModel(std::move(*result.host));
+        modelsByPath.emplace(path, modelIndex);
+        for (const auto id : avatarIds) {
+            auto &avatar = avatars.at(id);
+            detachModel(avatar, modelManager, morphEvaluator, frameCount);
+            attachModel(avatar, modelIndex, modelManager);
+            springBones.removeAvatar(id);
+            springBones.addAvatar(id, modelManager.getModelInfo(modelIndex).springBones, skeletons[modelIndex]);
+            avatar.pendingModel.reset();
+        }
+        sceneVersion++;
+    }
+
+    for (const auto &[path, pending] : pendingModels) {
+        float priority = std::numeric_limits<float>::lowest();
+        for (const auto id : pending.avatarIds) {
+            const auto &avatar = avatars.at(id);
+            priority = std::max(priority, avatar.loadPriority - avatar.distance);
+        }
+        loadQueue.setPriority(pending.ticket, priority);
+    }
+}
+
+void VulkanManagerCore::streamModels() {
+    bool partsShown = false;
+    for (const auto &[id, avatar] : avatars) {
+        modelManager.observeModel(avatar.modelIndex, avatar.distance, avatar.visible && !avatar.threeParts && !prefersImpostor(avatar), frameCount);
+        partsShown |= avatar.threeParts;
+    }
+    if (partsShown)
+        modelManager.observeModel(partsModel, 0.0f, true, frameCount);
+    const auto plan = modelManager.updateModelResidency(frameCount, coreflightFramesNum);
+    if (plan.evict.empty() && plan.load.empty())
+        return;
+
+    auto contains = [](const std::vector<uint32_t> &models, uint32_t model) { return std::find(models.begin(), models.end(), model) != models.end(); };
+    const bool partsMoved = contains(plan.evict, partsModel) || contains(plan.load, partsModel);
+    for (auto &[id, avatar] : avatars) {
+        if (avatar.threeParts && partsMoved) {
+            const auto &primitive = modelManager.getModelInfo(partsModel).primitives[0];
+            for (const auto meshIndex : avatar.partMeshes) {
+                if (modelManager.isModelResident(partsModel)) {
+                    meshes[meshIndex].textureIndex = modelManager.getTextureSlot(primitive.textureIndex);
+                    drawBatcher.add(meshRangeOf(primitive), primitive.variant, meshIndex);
+                } else {
+                    drawBatcher.remove(meshIndex);
+                }
+            }
+        }
+        const auto &model = modelManager.getModelInfo(avatar.modelIndex);
+        if (contains(plan.evict, avatar.modelIndex)) {
+            // the mesh records and pose stay; selectImpostors() puts the last bake of the model in its place
+            if (!avatar.impostor) {
+                for (const auto meshIndex : avatar.meshIndices)
+                    drawBatcher.remove(meshIndex);
+            }
+            jointRanges.free(avatar.jointBase, model.nodes.size());
+            releaseMorphRegions(avatar, model, morphEvaluator, frameCount);
+        } else if (contains(plan.load, avatar.modelIndex)) {
+            avatar.jointBase = allocateJoints(model.nodes.size());
+            objects[avatar.objectIndex].jointIndex = avatar.jointBase;
+            // the last palette until the pose is evaluated again
+            std::copy(avatar.palette.begin(), avatar.palette.end(), joints.begin() + avatar.jointBase);
+            avatar.pendingEvaluations = 2;
+            avatar.showingLatest = true;
+            avatar.morphDirty = true;
+            for (uint32_t i = 0; i < avatar.meshIndices.size(); i++) {
+                meshes[avatar.meshIndices[i]].textureIndex = modelManager.getTextureSlot(model.primitives[i].textureIndex);
+                if (!avatar.impostor && !avatar.threeParts)
+                    drawBatcher.add(meshRangeOf(model.primitives[i]), variantOf(avatar, model, i), avatar.meshIndices[i]);
+            }
+        }
+    }
+    sceneVersion++;
+}
+
+void VulkanManagerCore::selectThreeParts() {
+    std::vector<std::pair<float, uint32_t>> ranked;
+    for (const auto &[id, avatar] : avatars) {
+        if (!avatar.threePartsOnly)
+            ranked.emplace_back(avatar.loadPriority - avatar.distance + (avatar.threeParts ? 0.0f : threePartsMargin), id);
+    }
+    const auto fullNum = std::min<size_t>(fullAvatarBudget, ranked.size());
+    std::nth_element(ranked.begin(), ranked.begin() + fullNum, ranked.end(), std::greater<>());
+
+    bool changed = false;
+    for (size_t i = 0; i < ranked.size(); i++) {
+        auto &avatar = avatars.at(ranked[i].second);
+        const bool threeParts = i >= fullNum;
+        if (threeParts == avatar.threeParts)
+            continue;
+        if (threeParts)
+            showThreeParts(avatar, partsModel, modelManager);
+        else
+            hideThreeParts(avatar, modelManager);
+        changed = true;
+    }
+    if (changed)
+        sceneVersion++;
+}
+
+void VulkanManagerCore::placeParts() {
+    constexpr HumanBone partBones[ThreePartsAvatar::PartCount] = {HumanBone::Head, HumanBone::LeftHand, HumanBone::RightHand};
+    std::vector<glm::mat4> globals;
+    bool changed = false;
+    for (auto &[id, avatar] : avatars) {
+        if (!avatar.threeParts || !avatar.partsDirty)
+            continue;
+        auto parts = avatar.parts.value_or(ThreePartsAvatar{});
+        const auto &humanoid = modelManager.getModelInfo(avatar.modelIndex).humanoid;
+        const auto &skeleton = skeletons[avatar.modelIndex];
+        const auto &pose = posedOf(avatar);
+        if (!avatar.parts && !humanoid.empty() && pose.jointCount() == skeleton.jointCount()) {
+            globals.resize(skeleton.jointCount());
+            skeleton.evaluateGlobals(pose, globals.data());
+            for (uint32_t part = 0; part < ThreePartsAvatar::PartCount; part++) {
+                const auto joint = humanoid[partBones[part]];
+                if (joint < 0)
+                    continue;
+                parts.positions[part] = glm::vec3(globals[joint][3]);
+                // VRM rest poses have every bone unrotated, so the model-space rotation is the turn from rest
+                parts.rotations[part] = glm::quat_cast(glm::mat3(globals[joint]));
+            }
+        }
+        for (uint32_t part = 0; part < ThreePartsAvatar::PartCount; part++)
+            objects[avatar.partObjects[part]].modelMat = objects[avatar.objectIndex].modelMat * parts.partMatrix(ThreePartsAvatar::Part(part));
+        avatar.partsDirty = false;
+        changed = true;
+    }
+    if (changed)
+        sceneVersion++;
+}
+
+void VulkanManagerCore::playClips() {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto &[id, avatar] : avatars) {
+        // placeholders don't move, and impostors and avatars out of sight show nothing of the pose;
+        // they pick the clip up where it has got to once shown
+        if (!avatar.clipIndex || avatar.pendingModel || avatar.impostor || !avatar.visible || (avatar.threeParts && avatar.parts))
+            continue;
+        const auto &animations = modelManager.getModelInfo(avatar.modelIndex).animations;
+        if (*avatar.clipIndex >= animations.size()) {
+            avatar.clipIndex.reset();
+            continue;
+        }
+        const auto &clip = animations[*avatar.clipIndex];
+        if (clip.getDuration() <= 0.0f || clip.getJointCount() > avatar.pose.jointCount())
+            continue;
+        if (!avatar.clipCursor || avatar.cursorClip != &clip) {
+            avatar.clipCursor.emplace(clip);
+            avatar.cursorClip = &clip;
+        }
+
+        avatar.clipCursor->sample(std::fmod(std::chrono::duration<float>(now - avatar.clipStart).count(), clip.getDuration()), avatar.pose);
+        avatar.pendingEvaluations = 2;
+        avatar.partsDirty |= !avatar.parts;
+        avatar.layersDirty = true;
+    }
+}
+
+void VulkanManagerCore::solveTracking() {
+    std::vector<IKSolver::Job> jobs;
+    std::vector<AvatarInstance *> solved;
+    for (auto &[id, avatar] : avatars) {
+        // as for clips; three parts avatars show the targets themselves
+        if (!avatar.trackingDirty || avatar.pendingModel || avatar.impostor || !avatar.visible || avatar.threeParts)
+            continue;
+        auto rig = ikRigs.find(avatar.modelIndex);
+        if (rig == ikRigs.end()) {
+            const auto &model = modelManager.getModelInfo(avatar.modelIndex);
+            const auto &skeleton = skeletons[avatar.modelIndex];
+            std::optional<IKRig> built;
+            try {
+                if (!model.humanoid.empty())
+                    built.emplace(skeleton.getParents(), skeleton.getRestPose(), model.humanoid);
+            } catch (const std::runtime_error &e) {
+#ifdef _DEBUG
+                std::clog << "no IK for model " << avatar.modelIndex << ": " << e.what() << std::endl;
+#endif
+            }
+            rig = ikRigs.emplace(avatar.modelIndex, std::move(built)).first;
+        }
+        avatar.trackingDirty = false;
+        if (!rig->second)
+            continue;
+        jobs.push_back(IKSolver::Job{&*rig->second, *avatar.tracking, &avatar.pose});
+        solved.push_back(&avatar);
+    }
+    if (jobs.empty())
+        return;
+
+    ikSolver.solve(jobs);
+    for (auto avatar : solved) {
+        avatar->pendingEvaluations = 2;
+        avatar->partsDirty |= !avatar->parts;
+        avatar->layersDirty = true;
+    }
+}
+
+void VulkanManagerCore::poseAvatars() {
+    for (auto &[id, avatar] : avatars) {
+        if (!avatar.layersDirty)
+            continue;
+        avatar.layersDirty = false;
+        // layers set for another model are left out until they are set again
+        const bool fits = !avatar.layerPoses.empty() &&
+                          std::all_of(avatar.layerPoses.begin(), avatar.layerPoses.end(), [&](const PoseBuffer &pose) { return pose.jointCount() == avatar.pose.jointCount(); });
+        if (fits)
+            avatar.layers.evaluate(avatar.pose);
+        if (!fits && !avatar.layered)
+            continue;
+        avatar.layered = fits;
+        avatar.pendingEvaluations = 2;
+        avatar.partsDirty |= !avatar.parts;
+    }
+}
+
+void VulkanManagerCore::simulateSprings() {
+    const auto now = std::chrono::steady_clock::now();
+    const float elapsed = std::chrono::duration<float>(now - lastSpringUpdate).count();
+    lastSpringUpdate = now;
+
+    std::vector<SpringBoneSystem::Input> inputs;
+    std::vector<AvatarInstance *> simulated;
+    for (auto &[id, avatar] : avatars) {
+        // impostors show a bake, and evicted models have nothing to swing
+        if (!springBones.hasSprings(id) || avatar.impostor || avatar.threeParts || !modelManager.isModelResident(avatar.modelIndex)) {
+            // its tails would be stale by the time it is drawn in full again
+            springBones.rest(id);
+            avatar.springPose.clear();
+            continue;
+        }
+        // off-screen avatars are put to rest like distant ones
+        const float distance = avatar.visible ? avatar.distance : std::numeric_limits<float>::max();
+        inputs.push_back(SpringBoneSystem::Input{id, &skeletons[avatar.modelIndex], &posedOf(avatar), objects[avatar.objectIndex].modelMat, distance, &avatar.springPose});
+        simulated.push_back(&avatar);
+    }
+    if (inputs.empty())
+        return;
+
+    springBones.update(elapsed, inputs);
+    for (uint32_t i = 0; i < inputs.size(); i++) {
+        if (inputs[i].moved)
+            simulated[i]->pendingEvaluations = 2;
+    }
+}
+
+void VulkanManagerCore::animateAvatars() {
+    bool changed = false;
+    animationPending = false;
+    animationScheduler.beginFrame();
+    for (auto &[id, avatar] : avatars) {
+        // evicted avatars have no joints to write, placeholders don't move, and three parts avatars have no palette;
+        // the pose is picked up once the model is there and drawn
+        if (!modelManager.isModelResident(avatar.modelIndex) || avatar.pendingModel || avatar.threeParts)
+            continue;
+        const auto jointNum = skeletons[avatar.modelIndex].jointCount();
+        const auto action = animationScheduler.schedule(id, avatar.screenPixels, avatar.visible, frameCount);
+
+        bool evaluated = false;
+        if (action == AnimationScheduler::Action::Evaluate && avatar.pendingEvaluations > 0) {
+            std::swap(avatar.palette, avatar.previousPalette);
+            skeletons[avatar.modelIndex].evaluate(avatar.springPose.empty() ? posedOf(avatar) : avatar.springPose, avatar.palette.data());
+            avatar.pendingEvaluations--;
+            evaluated = true;
+        }
+
+        auto display = joints.data() + avatar.jointBase;
+        if (animationScheduler.isSmoothed(id) && (evaluated || avatar.pendingEvaluations > 0)) {
+            interpolatePalette(avatar.previousPalette.data(), avatar.palette.data(), animationScheduler.interpolationFactor(id, frameCount), jointNum, display);
+            avatar.showingLatest = false;
+            changed = true;
+        } else if (!animationScheduler.isSmoothed(id) && (evaluated || !avatar.showingLatest)) {
+            std::copy(avatar.palette.begin(), avatar.palette.end(), display);
+            avatar.showingLatest = true;
+            changed = true;
+        }
+        animationPending |= avatar.pendingEvaluations > 0;
+    }
+    animationScheduler.endFrame();
+    if (changed)
+        sceneVersion++;
+}
+
+void VulkanManagerCore::selectImpostors() {
+    bool changed = false;
+    for (auto &[id, avatar] : avatars) {
+        if (avatar.threeParts)
+            continue;
+        const auto &model = modelManager.getModelInfo(avatar.modelIndex);
+        const bool resident = modelManager.isModelResident(avatar.modelIndex);
+        // an evicted model has no meshes to draw: its last bake stands in, or nothing until it is back
+        const bool impostor = resident ? prefersImpostor(avatar) : impostorManager.isBaked(avatar.modelIndex);
+        if (impostor == avatar.impostor)
+            continue;
+
+        avatar.impostor = impostor;
+        for (uint32_t i = 0; i < avatar.meshIndices.size() && resident; i++) {
+            if (impostor)
+                drawBatcher.remove(avatar.meshIndices[i]);
+            else
+                drawBatcher.add(meshRangeOf(model.primitives[i]), variantOf(avatar, model, i), avatar.meshIndices[i]);
+        }
+        changed = true;
+    }
+    if (changed)
+        sceneVersion++;
+}
+
+void VulkanManagerCore::evaluateMorphs() {
+    bool changed = false;
+    morphPending = false;
+    for (auto &[id, avatar] : avatars) {
+        // three parts avatars pick up their weights once drawn in full again
+        if (!avatar.morphDirty || avatar.threeParts || !modelManager.isModelResident(avatar.modelIndex))
+            continue;
+        const auto &model = modelManager.getModelInfo(avatar.modelIndex);
+        // a full delta buffer is retried with the next change of weights, full tables on the next frame
+        bool done = true, deferred = false;
+        for (uint32_t i = 0; i < model.primitives.size(); i++) {
+            const auto &primitive = model.primitives[i];
+            if (primitive.morphTargetNum == 0)
+                continue;
+
+            std::vector<MorphEvaluator::Target> targets;
+            if (auto weights = avatar.morphWeights.find(primitive.mesh); weights != avatar.morphWeights.end()) {
+                for (uint32_t t = 0; t < primitive.morphTargetNum && t < weights->second.size(); t++) {
+                    const auto &target = model.morphTargets[primitive.firstMorphTarget + t];
+                    if (weights->second[t] != 0.0f && target.entryNum > 0)
+                        targets.push_back(MorphEvaluator::Target{model.morphEntryBase + target.firstEntry, target.entryNum, weights->second[t]});
+                }
+            }
+
+            // the variant only changes when the primitive starts or stops being morphed
+            auto &region = avatar.morphRegions[i];
+            const bool wasMorphed = region != noMorphRegion;
+            if (targets.empty() && wasMorphed) {
+                morphEvaluator.freeRegion(region, primitive.vertexNum, frameCount);
+                region = noMorphRegion;
+                meshes[avatar.meshIndices[i]].morphOffset = 0;
+            } else if (!targets.empty() && !wasMorphed) {
+                const auto allocated = morphEvaluator.allocateRegion(primitive.vertexNum, frameCount);
+                if (!allocated) {
+                    done = false;
+                    continue;
+                }
+                region = *allocated;
+                meshes[avatar.meshIndices[i]].morphOffset = int32_t(region) - int32_t(primitive.vertexBase);
+            }
+            if (wasMorphed != (region != noMorphRegion)) {
+                if (!avatar.impostor) {
+                    drawBatcher.remove(avatar.meshIndices[i]);
+                    drawBatcher.add(meshRangeOf(primitive), variantOf(avatar, model, i), avatar.meshIndices[i]);
+                }
+                changed = true;
+            }
+
+            if (!targets.empty() && !morphEvaluator.evaluate(region, model.morphEntryBase + primitive.firstTouched, primitive.touchedNum, targets)) {
+                done = false;
+                deferred = true;
+            }
+        }
+        avatar.morphDirty = !done;
+        morphPending |= deferred;
+    }
+    if (changed)
+        sceneVersion++;
+}
+
+void VulkanManagerCore::streamTextures() {
+    bool partsShown = false;
+    for (const auto &[id, avatar] : avatars) {
+        partsShown |= avatar.threeParts;
+        if (!avatar.visible || avatar.threeParts || !modelManager.isModelResident(avatar.modelIndex))
+            continue;
+        // impostors only need what their atlas cells are baked at
+        const float pixels = avatar.impostor ? float(ImpostorManager::cellSize) : avatar.screenPixels;
+        for (const auto &primitive : modelManager.getModelInfo(avatar.modelIndex).primitives)
+            modelManager.requestTexture(primitive.textureIndex, pixels, frameCount);
+    }
+    // a single texel
+    const auto partsTexture = modelManager.getModelInfo(partsModel).primitives[0].textureIndex;
+    if (partsShown)
+        modelManager.requestTexture(partsTexture, 1.0f, frameCount);
+    if (!modelManager.updateTextureResidency(frameCount, coreflightFramesNum))
+        return;
+
+    for (const auto &[id, avatar] : avatars) {
+        if (!modelManager.isModelResident(avatar.modelIndex))
+            continue;
+        const auto &model = modelManager.getModelInfo(avatar.modelIndex);
+        for (uint32_t i = 0; i < avatar.meshIndices.size(); i++)
+            meshes[avatar.meshIndices[i]].textureIndex = modelManager.getTextureSlot(model.primitives[i].textureIndex);
+    }
+    for (const auto &[id, avatar] : avatars) {
+        for (uint32_t part = 0; part < ThreePartsAvatar::PartCount && avatar.threeParts; part++)
+            meshes[avatar.partMeshes[part]].textureIndex = modelManager.getTextureSlot(partsTexture);
+    }
+    sceneVersion++;
+}
+
+void VulkanManagerCore::bakeImpostor(const RenderDetails &rd) {
+    auto isImpostorOf = [](uint32_t modelIndex) {
+        return [modelIndex](const auto &entry) { return entry.second.impostor && entry.second.modelIndex == modelIndex; };
+    };
+    const auto modelCount = modelManager.getModelCount();
+    for (uint32_t n = 0; n < modelCount; n++) {
+        const uint32_t modelIndex = (nextBakeModel + n) % modelCount;
+        // an evicted model keeps its last bake
+        if (!modelManager.isModelResident(modelIndex) || !impostorManager.needsBake(modelIndex, frameCount))
+            continue;
+
+        // the next impostor avatar of the model after the one baked last time
+        auto it = std::find_if(avatars.upper_bound(lastBakedAvatar[modelIndex]), avatars.end(), isImpostorOf(modelIndex));
+        if (it == avatars.end())
+            it = std::find_if(avatars.begin(), avatars.end(), isImpostorOf(modelIndex));
+        if (it == avatars.end())
+            continue;
+
+        // morphed like its meshes, not in the bind shape
+        const auto &model = modelManager.getModelInfo(modelIndex);
+        std::vector<ShaderVariant> variants;
+        for (uint32_t i = 0; i < model.primitives.size(); i++)
+            variants.push_back(variantOf(it->second, model, i));
+        impostorManager.bake(rd, modelIndex, model, it->second.meshIndices, variants, objects[it->second.objectIndex].modelMat, frameCount);
+        lastBakedAvatar[modelIndex] = it->first;
+        nextBakeModel = modelIndex + 1;
+        return;
+    }
+}
+
+void VulkanManagerCore::uploadScene() {
+    if (uploadedSceneVersion[flightIndex] == sceneVersion)
+        return;
+
+    drawBatcher.rebuild();
+    const auto &draws = drawBatcher.getDraws();
+    const auto &instances = drawBatcher.getInstanceTable();
+    if (draws.size() > maxDrawNum)
+        throw std::runtime_error("too many draws");
+
+    std::copy(draws.begin(), draws.end(), static_cast<vk::DrawIndexedIndirectCommand *>(drawIndirectBuffer->get()) + maxDrawNum * flightIndex);
+    std::copy(instances.begin(), instances.end(), static_cast<uint32_t *>(instancesBuffer->get()) + maxMeshNum * flightIndex);
+    std::copy_n(meshes.begin(), meshesUsed, static_cast<MeshData *>(meshesBuffer->get()) + meshes.size() * flightIndex);
+    std::copy_n(objects.begin(), objectsUsed, static_cast<ObjectData *>(objectsBuffer->get()) + objects.size() * flightIndex);
+    std::copy_n(joints.begin(), jointRanges.getHighWater(), static_cast<glm::mat4 *>(jointsBuffer->get()) + joints.size() * flightIndex);
+
+    std::vector<ImpostorData> impostors;
+    for (const auto &[id, avatar] : avatars) {
+        if (!avatar.impostor)
+            continue;
+        const auto &model = modelManager.getModelInfo(avatar.modelIndex);
+        ImpostorData impostor;
+        impostor.centerRadius = glm::vec4(model.boundsCenter, model.boundsRadius);
+        impostor.objectIndex = avatar.objectIndex;
+        impostor.textureIndex = impostorManager.getTextureIndex(avatar.modelIndex);
+        impostor.gridSize = ImpostorManager::gridSize;
+        impostors.push_back(impostor);
+    }
+    std::copy(impostors.begin(), impostors.end(), static_cast<ImpostorData *>(impostorsBuffer->get()) + maxObjectNum * flightIndex);
+
+    drawIndirectBuffer.value().flush<1>(device, {{{sizeof(vk::DrawIndexedIndirectCommand) * maxDrawNum * flightIndex, sizeof(vk::DrawIndexedIndirectCommand) * maxDrawNum}}});
+    instancesBuffer.value().flush<1>(device, {{{sizeof(uint32_t) * maxMeshNum * flightIndex, sizeof(uint32_t) * maxMeshNum}}});
+    meshesBuffer.value().flush<1>(device, {{{sizeof(MeshData) * meshes.size() * flightIndex, sizeof(MeshData) * meshes.size()}}});
+    objectsBuffer.value().flush<1>(device, {{{sizeof(ObjectData) * objects.size() * flightIndex, sizeof(ObjectData) * objects.size()}}});
+    jointsBuffer.value().flush<1>(device, {{{sizeof(glm::mat4) * joints.size() * flightIndex, sizeof(glm::mat4) * joints.size()}}});
+    impostorsBuffer.value().flush<1>(device, {{{sizeof(ImpostorData) * maxObjectNum * flightIndex, sizeof(ImpostorData) * maxObjectNum}}});
+
+    uploadedDrawGroups[flightIndex] = drawBatcher.getGroups();
+    uploadedImpostorCount[flightIndex] = impostors.size();
+    uploadedSceneVersion[flightIndex] = sceneVersion;
 }
 
 VulkanManagerCore::~VulkanManagerCore() {
@@ -234,6 +1158,7 @@ VulkanManagerCore::~VulkanManagerCore() {
 }
 
 void VulkanManagerCore::recreateRenderTarget(std::vector<RenderTargetHint> hints) {
+    sceneDirty = true;
     rprtd.clear();
     renderTargets.clear();
     std::transform(hints.begin(), hints.end(), std::back_inserter(renderTargets),
@@ -249,64 +1174,34 @@ void VulkanManagerCore::recreateRenderTarget(std::vector<RenderTargetHint> hints
     uniformBuffer.emplace(physicalDevice, device, sizeof(SceneData) * renderTargets.size() * coreflightFramesNum, vk::BufferUsageFlagBits::eUniformBuffer);
     SceneData *dat = static_cast<SceneData *>(uniformBuffer->get());
 
-    const auto &textures = modelManager.getTextureImageViews();
-
     {
         vk::DescriptorBufferInfo descUniformBufInfo[1];
         descUniformBufInfo[0].buffer = uniformBuffer->getBuffer();
         descUniformBufInfo[0].offset = 0;
         descUniformBufInfo[0].range = sizeof(SceneData);
 
-        vk::DescriptorBufferInfo descObjectBufInfo[1];
-        descObjectBufInfo[0].buffer = objectsBuffer->getBuffer();
-        descObjectBufInfo[0].offset = 0;
-        descObjectBufInfo[0].range = sizeof(ObjectData) * objects.size();
-
-        vk::DescriptorBufferInfo descJointBufInfo[1];
-        descJointBufInfo[0].buffer = jointsBuffer->getBuffer();
-        descJointBufInfo[0].offset = 0;
-        descJointBufInfo[0].range = sizeof(glm::mat4) * joints.size();
-
-        vk::DescriptorBufferInfo descMeshBufInfo[1];
-        descMeshBufInfo[0].buffer = meshesBuffer->getBuffer();
-        descMeshBufInfo[0].offset = 0;
-        descMeshBufInfo[0].range = sizeof(MeshData) * meshes.size();
-
-        vk::WriteDescriptorSet writeDescSet[4];
+        vk::WriteDescriptorSet writeDescSet[1];
         writeDescSet[0].dstSet = descSet.get();
         writeDescSet[0].dstBinding = 0;
         writeDescSet[0].dstArrayElement = 0;
         writeDescSet[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
         writeDescSet[0].descriptorCount = std::size(descUniformBufInfo);
         writeDescSet[0].pBufferInfo = descUniformBufInfo;
-        writeDescSet[1].dstSet = descSet.get();
-        writeDescSet[1].dstBinding = 2;
-        writeDescSet[1].dstArrayElement = 0;
-        writeDescSet[1].descriptorType = vk::DescriptorType::eStorageBufferDynamic;
-        writeDescSet[1].descriptorCount = std::size(descObjectBufInfo);
-        writeDescSet[1].pBufferInfo = descObjectBufInfo;
-        writeDescSet[2].dstSet = descSet.get();
-        writeDescSet[2].dstBinding = 3;
-        writeDescSet[2].dstArrayElement = 0;
-        writeDescSet[2].descriptorType = vk::DescriptorType::eStorageBufferDynamic;
-        writeDescSet[2].descriptorCount = std::size(descJointBufInfo);
-        writeDescSet[2].pBufferInfo = descJointBufInfo;
-        writeDescSet[3].dstSet = descSet.get();
-        writeDescSet[3].dstBinding = 4;
-        writeDescSet[3].dstArrayElement = 0;
-        writeDescSet[3].descriptorType = vk::DescriptorType::eStorageBufferDynamic;
-        writeDescSet[3].descriptorCount = std::size(descMeshBufInfo);
-        writeDescSet[3].pBufferInfo = descMeshBufInfo;
 
         device.updateDescriptorSets(writeDescSet, {});
     }
 
     for (uint32_t j = 0; j < renderTargets.size(); j++) {
         for (uint32_t i = 0; i < coreflightFramesNum; i++) {
-            dat[j * coreflightFramesNum + i].view = glm::lookAt(glm::vec3(0.0f, 1.3f, -0.9f), glm::vec3(-0.5f, 0.5f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
-            dat[j * coreflightFramesNum + i].proj = glm::perspective(glm::radians(45.0f), float(renderTargets[0].extent.width) / float(renderTargets[0].extent.height), 0.1f, 10.0f);
+            dat[j * coreflightFramesNum + i].view = viewMatrix;
+            dat[j * coreflightFramesNum + i].proj = glm::perspective(glm::radians(45.0f), float(renderTargets[j].extent.width) / float(renderTargets[j].extent.height), 0.1f, 10.0f);
         }
     }
+    // impostor selection uses the first target's pixels per unit at distance 1
+    if (!renderTargets.empty()) {
+        projMatrix = dat[0].proj;
+        projScale = projMatrix[1][1] * renderTargets[0].extent.height * 0.5f;
+    }
 }
 
 vk::Fence VulkanManagerCore::render(uint32_t imageIndex,
@@ -320,27 +1215,55 @@ vk::Fence VulkanManagerCore::render(uint32_t imageIndex,
     device.waitForFences({currentFence}, true, UINT64_MAX);
     device.resetFences({currentFence});
 
+    {
+        SceneData *dat = static_cast<SceneData *>(uniformBuffer->get());
+        for (uint32_t targetIndex = 0; targetIndex < renderTargets.size(); targetIndex++)
+            dat[targetIndex * coreflightFramesNum + flightIndex].view = viewMatrix;
+        uniformBuffer.value().flush<1>(device, {{{0, VK_WHOLE_SIZE}}});
+    }
+    measureAvatars();
+    collectModelLoads();
+    selectThreeParts();
+    streamModels();
+    selectImpostors();
+    playClips();
+    solveTracking();
+    poseAvatars();
+    simulateSprings();
+    animateAvatars();
+    placeParts();
+    evaluateMorphs();
+    streamTextures();
+    uploadScene();
+
     {
         CommandRec cmd{currentCmdBuf};
 
-        for (uint32_t targetIndex = 0; targetIndex < renderTargets.size(); targetIndex++) {
-            RenderDetails rd;
-            rd.cmdBuf = currentCmdBuf;
-            modelManager.prepareRender(rd);
-            rd.descSet = currentDescSet;
-            rd.dynamicOfs = {
-                uint32_t(sizeof(SceneData) * (targetIndex * coreflightFramesNum + flightIndex)),
-                uint32_t(sizeof(ObjectData) * objects.size() * flightIndex),
-                uint32_t(sizeof(glm::mat4) * joints.size() * flightIndex),
-                uint32_t(sizeof(MeshData) * meshes.size() * flightIndex),
-            };
-            rd.imageIndex = imageIndex;
-
-            rd.modelsCount = indirectDraws.size();
-            rd.drawBuf = drawIndirectBuffer.value().getBuffer();
-            rd.drawBufOffset = 0;
-            rd.drawBufStride = sizeof(vk::DrawIndexedIndirectCommand);
+        RenderDetails rd;
+        rd.cmdBuf = currentCmdBuf;
+        modelManager.prepareRender(rd);
+        rd.descSet = currentDescSet;
+        rd.cameraOffset = 0;
+        rd.sceneBuffers.objects = sceneBufferBase.objects + sizeof(ObjectData) * objects.size() * flightIndex;
+        rd.sceneBuffers.joints = sceneBufferBase.joints + sizeof(glm::mat4) * joints.size() * flightIndex;
+        rd.sceneBuffers.meshes = sceneBufferBase.meshes + sizeof(MeshData) * meshes.size() * flightIndex;
+        rd.sceneBuffers.instances = sceneBufferBase.instances + sizeof(uint32_t) * maxMeshNum * flightIndex;
+        rd.sceneBuffers.impostors = sceneBufferBase.impostors + sizeof(ImpostorData) * maxObjectNum * flightIndex;
+        rd.sceneBuffers.morphDeltas = sceneBufferBase.morphDeltas;
+        rd.imageIndex = imageIndex;
+        rd.flightIndex = flightIndex;
 
+        rd.drawGroups = &uploadedDrawGroups[flightIndex];
+        rd.impostorCount = uploadedImpostorCount[flightIndex];
+        rd.drawBuf = drawIndirectBuffer.value().getBuffer();
+        rd.drawBufOffset = sizeof(vk::DrawIndexedIndirectCommand) * maxDrawNum * flightIndex;
+        rd.drawBufStride = sizeof(vk::DrawIndexedIndirectCommand);
+
+        morphEvaluator.record(currentCmdBuf, flightIndex, modelManager.getMorphEntryAddress());
+        bakeImpostor(rd);
+
+        for (uint32_t targetIndex = 0; targetIndex < renderTargets.size(); targetIndex++) {
+            rd.cameraOffset = uint32_t(sizeof(SceneData) * (targetIndex * coreflightFramesNum + flightIndex));
             defaultRenderProc->render(rd, renderTargets[targetIndex], rprtd[targetIndex]);
         }
     }
@@ -359,8 +1282,11 @@ vk::Fence VulkanManagerCore::render(uint32_t imageIndex,
     submitInfo.pSignalSemaphores = signalSemaphores.begin();
 
     graphicsQueue.submit({submitInfo}, currentFence);
+    // keep on-demand rendering going until every scheduled evaluation, model load and upload has landed
+    sceneDirty = animationPending || morphPending || loadQueue.isBusy() || modelManager.isModelStreamingPending() || modelManager.isTextureStreamingPending();
 
     flightIndex = (flightIndex + 1) % coreflightFramesNum;
+    frameCount++;
 
     return currentFence;
 }
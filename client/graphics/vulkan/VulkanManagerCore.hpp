@@ -1,11 +1,21 @@
 #ifndef VULKAN_MANAGER_CORE_HPP
 #define VULKAN_MANAGER_CORE_HPP
 
+#include "../../avator/ThreePartsAvator.hpp"
+#include "../../avator/pose/FKPose.hpp"
+#include "../../avator/pose/IKPose.hpp"
+#include "AnimationScheduler.hpp"
 #include "Render.hpp"
 #include "Helper.hpp"
 #include "Buffer.hpp"
 #include "Image.hpp"
+#include "ImpostorManager.hpp"
+#include "ModelLoadQueue.hpp"
 #include "ModelManager.hpp"
+#include "MorphEvaluator.hpp"
+#include "Skeleton.hpp"
+#include "SpringBones.hpp"
+#include <chrono>
 #include <vulkan/vulkan.hpp>
 
 class VulkanManagerCore {
@@ -28,25 +38,141 @@ class VulkanManagerCore {
 
     std::optional<CommunicationBuffer> uniformBuffer;
     std::optional<CommunicationBuffer> drawIndirectBuffer;
+    std::optional<CommunicationBuffer> instancesBuffer;
     std::optional<CommunicationBuffer> meshesBuffer;
     std::optional<CommunicationBuffer> objectsBuffer;
     std::optional<CommunicationBuffer> jointsBuffer;
+    std::optional<CommunicationBuffer> impostorsBuffer;
+    // addresses of the scene buffers above; each flight frame adds its region's offset
+    SceneBufferAddresses sceneBufferBase;
 
     ModelManager modelManager;
+    ImpostorManager impostorManager;
+    MorphEvaluator morphEvaluator;
+    SpringBoneSystem springBones;
+    IKSolver ikSolver;
+    // after modelManager, so running parses finish before it goes
+    ModelLoadQueue loadQueue;
+    // drawn for avatars whose model is still loading
+    uint32_t placeholderModel;
+    // the unit cube the head and hands of three parts avatars are scaled from
+    uint32_t partsModel;
+    // avatars drawn in full at most; the rest of the crowd is drawn as three parts
+    uint32_t fullAvatarBudget = 32;
 
     std::unique_ptr<IRenderProc> defaultRenderProc;
     std::vector<RenderTarget> renderTargets;
     std::vector<RenderProcRenderTargetDependant> rprtd;
 
+    glm::mat4 viewMatrix;
+    bool sceneDirty = true;
+    // projection of the first render target, and the pixels one unit covers at distance one on it
+    glm::mat4 projMatrix{1.0f};
+    float projScale = 0.0f;
+    uint64_t frameCount = 0;
+
+    AnimationScheduler animationScheduler;
+    bool animationPending = false;
+    // avatars whose weights changed but didn't fit this frame's evaluation
+    bool morphPending = false;
+    std::chrono::steady_clock::time_point lastSpringUpdate = std::chrono::steady_clock::now();
+
+    // adds a model with its skeleton and impostor atlas, without uploading it
+    uint32_t registerModel(ModelManager::ModelHostData host);
+
+    // on-screen size, distance and frustum visibility of every avatar
+    void measureAvatars();
+    // swaps placeholders for the models that finished loading, and reorders the loads still queued
+    void collectModelLoads();
+    // keeps the models avatars need on the device, and moves avatars of evicted or reloaded models on or off their meshes
+    void streamModels();
+    // switches avatars between meshes and impostors by their on-screen size
+    void selectImpostors();
+    // shows the avatars past the full avatar budget as three parts, and the ones back within it in full
+    void selectThreeParts();
+    // moves the parts of three parts avatars whose transform, tracked parts or pose changed
+    void placeParts();
+    // samples the clips avatars loop into their poses
+    void playClips();
+    // solves the poses of shown avatars whose tracked head and hands moved
+    void solveTracking();
+    // evaluates the layer stacks of avatars whose pose or layers changed
+    void poseAvatars();
+    // advances the spring bones of resident avatars by the time since the last frame, re-evaluating those that swung
+    void simulateSprings();
+    // evaluates, blends or keeps each avatar's joint palette as scheduled for this frame
+    void animateAvatars();
+    // queues the morph evaluations of avatars whose weights changed, moving their primitives on or off the Morph variant
+    void evaluateMorphs();
+    // requests texture levels by on-screen size and points meshes at the slots of re-uploaded textures
+    void streamTextures();
+    // re-bakes at most one impostor atlas that is due
+    void bakeImpostor(const RenderDetails &rd);
+
+    // writes draws, instances and per-object data into the current flight frame's region if they changed
+    void uploadScene();
+
   public:
     VulkanManagerCore(
         vk::Instance instance,
         vk::PhysicalDevice physicalDevice,
         const UsingQueueSet &queueSet,
-        vk::Device device);
+        vk::Device device,
+        const AssetSettings &assetSettings = {});
     ~VulkanManagerCore();
 
     void recreateRenderTarget(std::vector<RenderTargetHint> hints);
+    void setViewMatrix(const glm::mat4 &view) {
+        sceneDirty |= view != viewMatrix;
+        viewMatrix = view;
+    }
+    // parses a glb model on the calling thread and registers it; it is uploaded once an avatar needs it, and may be evicted again
+    uint32_t loadModel(const std::filesystem::path &path);
+    // avatars sharing a model are drawn with one instanced draw per primitive
+    uint32_t addAvatar(uint32_t modelIndex, const glm::mat4 &transform);
+    // adds an avatar right away, shown as a placeholder until its model is loaded in the background.
+    // Loads go highest priority first, after subtracting the avatar's distance to the camera every frame:
+    // a priority of 10 (someone speaking, say) puts an avatar ahead of anyone within 10 units.
+    // Avatars requesting a file already loaded, or being loaded, share it.
+    uint32_t requestAvatar(const std::filesystem::path &model, const glm::mat4 &transform, float priority = 0.0f);
+    void setAvatarLoadPriority(uint32_t avatarId, float priority);
+    // an avatar that is only ever drawn as its head and hands
+    uint32_t addThreePartsAvatar(const glm::mat4 &transform);
+    // the tracked head and hands, used whenever the avatar is drawn as three parts; until set, they follow its pose
+    void setAvatarParts(uint32_t avatarId, const ThreePartsAvatar &parts);
+    // per room: beyond this many avatars, those with the lowest load priority (after subtracting their distance,
+    // as for model loads) are drawn as three parts, with every part of every such avatar in one instanced draw
+    void setFullAvatarBudget(uint32_t budget);
+    // cancels the load of its model if no other avatar waits for it
+    void removeAvatar(uint32_t avatarId);
+    void setAvatarTransform(uint32_t avatarId, const glm::mat4 &transform);
+    // the skeleton is re-evaluated from this pose at the avatar's animation LOD rate.
+    // While the model loads the pose is kept, and used once it arrives if the joint counts match.
+    void setAvatarPose(uint32_t avatarId, const PoseBuffer &pose);
+    // converted to a PoseBuffer; an FKPose result goes to the overload above as is
+    void setAvatarPose(uint32_t avatarId, const std::vector<JointConfiguration> &pose);
+    // head and hands to reach with inverse kinematics whenever the avatar is drawn in full, in place of its pose and clip;
+    // nullopt hands the avatar back to them. Models without the humanoid bones IK needs keep their pose.
+    void setAvatarTracking(uint32_t avatarId, const std::optional<IKTargets> &targets);
+    // layers applied over the pose, as FKPose does, every time it changes; the poses and masks are copied.
+    // Layers whose joint counts don't match the avatar's skeleton leave the pose as is; an empty list removes them.
+    void setAvatarLayers(uint32_t avatarId, const std::vector<FKPose::Layer> &layers);
+    // weights of the morph targets of a glTF mesh of the avatar's model, as indexed in the file (VRM expressions bind to these).
+    // Missing weights are zero; kept while the model loads.
+    void setAvatarMorphWeights(uint32_t avatarId, uint32_t mesh, const std::vector<float> &weights);
+    // loops a clip of the avatar's model (its index in getModelAnimations()) into its pose from the start, or stops with nullopt.
+    // Avatars loop their model's first clip until this is called or their pose is set.
+    void playAvatarClip(uint32_t avatarId, std::optional<uint32_t> clip);
+    // compressed clips of a loaded model, to be played into a pose with a ClipCursor
+    const std::vector<AnimationClip> &getModelAnimations(uint32_t modelIndex) const { return modelManager.getModelInfo(modelIndex).animations; }
+    const AnimationScheduler &getAnimationScheduler() const { return animationScheduler; }
+    const IKSolveStats &getIKStats() const { return ikSolver.getStats(); }
+    TextureTranscodeStats getTextureStats() const { return modelManager.getTextureStats(); }
+    const TextureResidency &getTextureResidency() const { return modelManager.getTextureResidency(); }
+    const ModelResidency &getModelResidency() const { return modelManager.getModelResidency(); }
+
+    // true if anything has changed since the last render()
+    bool isSceneDirty() const { return sceneDirty; }
 
     vk::Fence render(uint32_t imageIndex,
                      std::initializer_list<vk::Semaphore> waitSemaphores,
@@ -12,7 +12,7 @@ vk::Instance createVulkanInstanceWithOpenxr(xr::Instance xrInstance, xr::SystemI
     appInfo.apiVersion = 1;
     appInfo.pEngineName = "";
     appInfo.engineVersion = 1;
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_2;
 
     vk::InstanceCreateInfo createInfo{};
     createInfo.pApplicationInfo = &appInfo;
@@ -61,11 +61,17 @@ vk::Device createDeviceWithOpenxr(xr::Instance xrInstance, xr::SystemId xrSystem
     std::vector<const char *> layers;
 
     auto devFeats = physicalDevice.getFeatures2();
+    vk::PhysicalDeviceBufferDeviceAddressFeatures featbda;
+    featbda.bufferDeviceAddress = true;
+    featbda.pNext = &devFeats;
     vk::PhysicalDeviceDescriptorIndexingFeatures feati;
     feati.shaderSampledImageArrayNonUniformIndexing = true;
     feati.runtimeDescriptorArray = true;
     feati.descriptorBindingVariableDescriptorCount = true;
-    feati.pNext = &devFeats;
+    feati.descriptorBindingPartiallyBound = true;
+    feati.descriptorBindingSampledImageUpdateAfterBind = true;
+    feati.descriptorBindingUpdateUnusedWhilePending = true;
+    feati.pNext = &featbda;
 
     vk::DeviceCreateInfo createInfo{};
     createInfo.pNext = &feati;
@@ -128,6 +134,8 @@ std::vector<RenderTargetHint> getRenderTargetHintsWithOpenxr(const std::vector<O
                        hint.format = vk::Format(swapchain.format);
                        hint.extent = vk::Extent2D(swapchain.extent.width, swapchain.extent.height);
                        hint.images = getImagesFromXrSwapchain(swapchain.swapchain);
+                       // the runtime expects swapchain images back in the attachment layout
+                       hint.finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
                        return hint;
                    });
     return v;
@@ -1,128 +1,68 @@
 #include "SimpleRenderProc.hpp"
+#include <algorithm>
 #include <glm/glm.hpp>
-
-vk::UniqueRenderPass createRenderPass(vk::Device device, vk::Format renderTargetFormat) {
-    vk::AttachmentDescription attachments[2];
-    attachments[0].format = renderTargetFormat;
-    attachments[0].samples = vk::SampleCountFlagBits::e1;
-    attachments[0].loadOp = vk::AttachmentLoadOp::eClear;
-    attachments[0].storeOp = vk::AttachmentStoreOp::eStore;
-    attachments[0].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-    attachments[0].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-    attachments[0].initialLayout = vk::ImageLayout::eUndefined;
-    attachments[0].finalLayout = vk::ImageLayout::ePresentSrcKHR;
-    attachments[1].format = vk::Format::eD32Sfloat;
-    attachments[1].samples = vk::SampleCountFlagBits::e1;
-    attachments[1].loadOp = vk::AttachmentLoadOp::eClear;
-    attachments[1].storeOp = vk::AttachmentStoreOp::eDontCare;
-    attachments[1].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-    attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-    attachments[1].initialLayout = vk::ImageLayout::eUndefined;
-    attachments[1].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-
-    vk::AttachmentReference subpass0_attachmentRefs[1];
-    subpass0_attachmentRefs[0].attachment = 0;
-    subpass0_attachmentRefs[0].layout = vk::ImageLayout::eColorAttachmentOptimal;
-
-    vk::AttachmentReference subpass0_depthAttachmentRef;
-    subpass0_depthAttachmentRef.attachment = 1;
-    subpass0_depthAttachmentRef.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-
-    vk::SubpassDescription subpasses[1];
-    subpasses[0].pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
-    subpasses[0].colorAttachmentCount = 1;
-    subpasses[0].pColorAttachments = subpass0_attachmentRefs;
-    subpasses[0].pDepthStencilAttachment = &subpass0_depthAttachmentRef;
-
-    vk::SubpassDependency dependency[1];
-    dependency[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency[0].dstSubpass = 0;
-    dependency[0].srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
-    dependency[0].dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
-    dependency[0].srcAccessMask = {};
-    dependency[0].dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-
-    vk::RenderPassCreateInfo renderpassCreateInfo;
-    renderpassCreateInfo.attachmentCount = std::size(attachments);
-    renderpassCreateInfo.pAttachments = attachments;
-    renderpassCreateInfo.subpassCount = std::size(subpasses);
-    renderpassCreateInfo.pSubpasses = subpasses;
-    renderpassCreateInfo.dependencyCount = std::size(dependency);
-    renderpassCreateInfo.pDependencies = dependency;
-
-    return device.createRenderPassUnique(renderpassCreateInfo);
-}
+#include <iterator>
 
 vk::UniquePipelineLayout createPipelineLayout(vk::Device device, std::initializer_list<vk::DescriptorSetLayout> descLayouts) {
+    vk::PushConstantRange pushConstantRange{vk::ShaderStageFlagBits::eVertex, 0, sizeof(SceneBufferAddresses)};
     vk::PipelineLayoutCreateInfo layoutCreateInfo;
     layoutCreateInfo.setLayoutCount = descLayouts.size();
     layoutCreateInfo.pSetLayouts = descLayouts.begin();
+    layoutCreateInfo.pushConstantRangeCount = 1;
+    layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
     return device.createPipelineLayoutUnique(layoutCreateInfo);
 }
 
-vk::UniquePipeline SimpleRenderProc::createPipeline(vk::Device device, vk::Extent2D extent, vk::RenderPass renderpass, vk::PipelineLayout pipelineLayout) {
+vk::UniquePipeline createScenePipeline(vk::Device device, vk::ShaderModule vertShader, vk::ShaderModule fragShader, std::optional<vk::Extent2D> extent,
+                                       vk::RenderPass renderpass, vk::PipelineLayout pipelineLayout, std::optional<ShaderVariant> variant) {
     vk::Viewport viewports[1];
-    viewports[0].x = 0.0;
-    viewports[0].y = 0.0;
-    viewports[0].minDepth = 0.0;
-    viewports[0].maxDepth = 1.0;
-    viewports[0].width = extent.width;
-    viewports[0].height = extent.height;
-
     vk::Rect2D scissors[1];
-    scissors[0].offset = vk::Offset2D{0, 0};
-    scissors[0].extent = extent;
-
     vk::PipelineViewportStateCreateInfo viewportState;
     viewportState.viewportCount = 1;
-    viewportState.pViewports = viewports;
     viewportState.scissorCount = 1;
-    viewportState.pScissors = scissors;
-
-    vk::VertexInputBindingDescription vertBindings[5];
-    vk::VertexInputAttributeDescription vertAttrs[5];
-
-    vertBindings[0].binding = 0;
-    vertBindings[0].inputRate = vk::VertexInputRate::eVertex;
-    vertBindings[0].stride = sizeof(glm::vec3);
-    vertAttrs[0].binding = 0;
-    vertAttrs[0].location = 0;
-    vertAttrs[0].offset = 0;
-    vertAttrs[0].format = vk::Format::eR32G32B32Sfloat;
-    vertBindings[1].binding = 1;
-    vertBindings[1].inputRate = vk::VertexInputRate::eVertex;
-    vertBindings[1].stride = sizeof(glm::vec3);
-    vertAttrs[1].binding = 1;
-    vertAttrs[1].location = 1;
-    vertAttrs[1].offset = 0;
-    vertAttrs[1].format = vk::Format::eR32G32B32Sfloat;
-    vertBindings[2].binding = 2;
-    vertBindings[2].inputRate = vk::VertexInputRate::eVertex;
-    vertBindings[2].stride = sizeof(glm::vec2);
-    vertAttrs[2].binding = 2;
-    vertAttrs[2].location = 2;
-    vertAttrs[2].offset = 0;
-    vertAttrs[2].format = vk::Format::eR32G32Sfloat;
-    vertBindings[3].binding = 3;
-    vertBindings[3].inputRate = vk::VertexInputRate::eVertex;
-    vertBindings[3].stride = sizeof(glm::i16vec4);
-    vertAttrs[3].binding = 3;
-    vertAttrs[3].location = 3;
-    vertAttrs[3].offset = 0;
-    vertAttrs[3].format = vk::Format::eR16G16B16A16Uint;
-    vertBindings[4].binding = 4;
-    vertBindings[4].inputRate = vk::VertexInputRate::eVertex;
-    vertBindings[4].stride = sizeof(glm::vec4);
-    vertAttrs[4].binding = 4;
-    vertAttrs[4].location = 4;
-    vertAttrs[4].offset = 0;
-    vertAttrs[4].format = vk::Format::eR32G32B32A32Sfloat;
+    if (extent) {
+        viewports[0].x = 0.0;
+        viewports[0].y = 0.0;
+        viewports[0].minDepth = 0.0;
+        viewports[0].maxDepth = 1.0;
+        viewports[0].width = extent->width;
+        viewports[0].height = extent->height;
+
+        scissors[0].offset = vk::Offset2D{0, 0};
+        scissors[0].extent = *extent;
+
+        viewportState.pViewports = viewports;
+        viewportState.pScissors = scissors;
+    }
+
+    vk::DynamicState dynamicStates[] = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+    vk::PipelineDynamicStateCreateInfo dynamicState;
+    dynamicState.dynamicStateCount = extent ? 0 : std::size(dynamicStates);
+    dynamicState.pDynamicStates = dynamicStates;
+
+    // binding and location numbers are fixed per stream so every variant shares the vertex buffer bindings
+    std::vector<vk::VertexInputBindingDescription> vertBindings;
+    std::vector<vk::VertexInputAttributeDescription> vertAttrs;
+    auto addStream = [&](uint32_t binding, uint32_t stride, vk::Format format) {
+        vertBindings.push_back(vk::VertexInputBindingDescription{binding, stride, vk::VertexInputRate::eVertex});
+        vertAttrs.push_back(vk::VertexInputAttributeDescription{binding, binding, format, 0});
+    };
+    if (variant) {
+        addStream(0, sizeof(glm::vec3), vk::Format::eR32G32B32Sfloat);
+        if (!(variant->features & ShaderFeature::Compact))
+            addStream(1, sizeof(glm::vec3), vk::Format::eR32G32B32Sfloat);
+        addStream(2, sizeof(glm::vec2), vk::Format::eR32G32Sfloat);
+        if (variant->features & ShaderFeature::Skinned) {
+            addStream(3, sizeof(glm::i16vec4), vk::Format::eR16G16B16A16Uint);
+            addStream(4, sizeof(glm::vec4), vk::Format::eR32G32B32A32Sfloat);
+        }
+    }
 
     vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
-    vertexInputInfo.vertexBindingDescriptionCount = std::size(vertBindings);
-    vertexInputInfo.pVertexBindingDescriptions = vertBindings;
-    vertexInputInfo.vertexAttributeDescriptionCount = std::size(vertAttrs);
-    vertexInputInfo.pVertexAttributeDescriptions = vertAttrs;
+    vertexInputInfo.vertexBindingDescriptionCount = vertBindings.size();
+    vertexInputInfo.pVertexBindingDescriptions = vertBindings.data();
+    vertexInputInfo.vertexAttributeDescriptionCount = vertAttrs.size();
+    vertexInputInfo.pVertexAttributeDescriptions = vertAttrs.data();
 
     vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
     inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
@@ -133,7 +73,7 @@ vk::UniquePipeline SimpleRenderProc::createPipeline(vk::Device device, vk::Exten
     rasterizer.rasterizerDiscardEnable = false;
     rasterizer.polygonMode = vk::PolygonMode::eFill;
     rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = vk::CullModeFlagBits::eBack;
+    rasterizer.cullMode = variant ? vk::CullModeFlagBits::eBack : vk::CullModeFlagBits::eNone;
     rasterizer.frontFace = vk::FrontFace::eClockwise;
     rasterizer.depthBiasEnable = false;
 
@@ -167,12 +107,22 @@ vk::UniquePipeline SimpleRenderProc::createPipeline(vk::Device device, vk::Exten
 
     vk::PipelineShaderStageCreateInfo shaderStage[2];
     shaderStage[0].stage = vk::ShaderStageFlagBits::eVertex;
-    shaderStage[0].module = shaders[0].get();
+    shaderStage[0].module = vertShader;
     shaderStage[0].pName = "main";
     shaderStage[1].stage = vk::ShaderStageFlagBits::eFragment;
-    shaderStage[1].module = shaders[1].get();
+    shaderStage[1].module = fragShader;
     shaderStage[1].pName = "main";
 
+    vk::SpecializationMapEntry alphaCutoffEntry{0, 0, sizeof(float)};
+    vk::SpecializationInfo fragSpecialization;
+    if (variant && (variant->features & ShaderFeature::AlphaTest)) {
+        fragSpecialization.mapEntryCount = 1;
+        fragSpecialization.pMapEntries = &alphaCutoffEntry;
+        fragSpecialization.dataSize = sizeof(float);
+        fragSpecialization.pData = &variant->alphaCutoff;
+        shaderStage[1].pSpecializationInfo = &fragSpecialization;
+    }
+
     vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
     pipelineCreateInfo.pViewportState = &viewportState;
     pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
@@ -181,6 +131,7 @@ vk::UniquePipeline SimpleRenderProc::createPipeline(vk::Device device, vk::Exten
     pipelineCreateInfo.pMultisampleState = &multisample;
     pipelineCreateInfo.pColorBlendState = &blend;
     pipelineCreateInfo.pDepthStencilState = &depthStencil;
+    pipelineCreateInfo.pDynamicState = &dynamicState;
     pipelineCreateInfo.layout = pipelineLayout;
     pipelineCreateInfo.renderPass = renderpass;
     pipelineCreateInfo.subpass = 0;
@@ -190,59 +141,65 @@ vk::UniquePipeline SimpleRenderProc::createPipeline(vk::Device device, vk::Exten
     return device.createGraphicsPipelineUnique(nullptr, pipelineCreateInfo).value;
 }
 
-SimpleRenderProc::SimpleRenderProc(vk::PhysicalDevice _physDevice, vk::Device _device, vk::DescriptorSetLayout descLayout, vk::DescriptorSetLayout assetDescLayout)
-    : physDevice(_physDevice), device(_device) {
+SimpleRenderProc::SimpleRenderProc(vk::PhysicalDevice _physDevice, vk::Device _device, vk::DescriptorSetLayout descLayout, vk::DescriptorSetLayout assetDescLayout, uint32_t flightFramesNum)
+    : physDevice(_physDevice), device(_device), flightFramesNum(flightFramesNum) {
     pipelinelayout = createPipelineLayout(device, {descLayout, assetDescLayout});
 
-    auto featVertShader = std::async(std::launch::async, [this]() { return createShaderModuleFromFile(device, "shader.vert.spv"); });
-    auto featFragShader = std::async(std::launch::async, [this]() { return createShaderModuleFromFile(device, "shader.frag.spv"); });
-    shaders.push_back(featVertShader.get());
-    shaders.push_back(featFragShader.get());
+    auto featImpostorVertShader = std::async(std::launch::async, [this]() { return createShaderModuleFromFile(device, "impostor.vert.spv"); });
+    auto featImpostorFragShader = std::async(std::launch::async, [this]() { return createShaderModuleFromFile(device, "impostor.frag.spv"); });
+    shaders.push_back(featImpostorVertShader.get());
+    shaders.push_back(featImpostorFragShader.get());
 }
 
 RenderProcRenderTargetDependant SimpleRenderProc::prepareRenderTargetDependant(const RenderTarget &rt) {
     RenderProcRenderTargetDependant d;
+    d.graph = std::make_unique<RenderGraph>(physDevice, device, flightFramesNum);
 
-    for (uint32_t i = 0; i < rt.imageViews.size(); i++) {
-        d.depthImages.emplace_back(physDevice, device, vk::Extent3D{rt.extent.width, rt.extent.height, 1}, 1,
-                                   vk::Format::eD32Sfloat, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal);
-        d.depthImageViews.emplace_back(createImageViewFromImage(device, d.depthImages.back().getImage(), vk::Format::eD32Sfloat, 1, vk::ImageAspectFlagBits::eDepth));
-    }
+    std::vector<vk::ImageView> views;
+    std::transform(rt.imageViews.begin(), rt.imageViews.end(), std::back_inserter(views), [](const vk::UniqueImageView &v) { return v.get(); });
 
-    d.renderpass = createRenderPass(device, rt.format);
-    d.pipeline = createPipeline(device, rt.extent, d.renderpass.get(), pipelinelayout.get());
-    d.frameBufs = createFrameBufsFromImageView(device, d.renderpass.get(), rt.extent, {rt.imageViews, d.depthImageViews});
+    auto backbuffer = d.graph->importImages("backbuffer", rt.images, views, rt.format, rt.extent, rt.finalLayout);
+    auto depth = d.graph->createTransientImage("depth", vk::Format::eD32Sfloat, rt.extent, vk::ImageAspectFlagBits::eDepth);
+
+    // the pipelines need the pass's render pass, so they are filled in after compile()
+    auto pipelines = std::make_shared<std::pair<ScenePipelineCache *, vk::Pipeline>>();
+    auto scenePass = d.graph->addGraphicsPass("scene", [this, pipelines](const RenderGraphPassContext &ctx) { recordScene(ctx, *pipelines->first, pipelines->second); });
+    d.graph->writeColor(scenePass, backbuffer, vk::ClearColorValue{std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f}});
+    d.graph->writeDepth(scenePass, depth, 1.0f);
+    d.graph->compile();
+
+    d.scenePipelines = std::make_unique<ScenePipelineCache>(device, pipelinelayout.get(), d.graph->getRenderPass(scenePass), rt.extent);
+    d.impostorPipeline = createScenePipeline(device, shaders[0].get(), shaders[1].get(), rt.extent, d.graph->getRenderPass(scenePass), pipelinelayout.get(), std::nullopt);
+    *pipelines = {d.scenePipelines.get(), d.impostorPipeline.get()};
     return d;
 }
 
-void SimpleRenderProc::render(const RenderDetails &rd, const RenderTarget &rt, const RenderProcRenderTargetDependant &rprtd) {
-    const auto cmdBuf = rd.cmdBuf;
-
-    vk::ClearValue clearVal[2];
-    clearVal[0].color.float32[0] = 0.0f;
-    clearVal[0].color.float32[1] = 0.0f;
-    clearVal[0].color.float32[2] = 0.0f;
-    clearVal[0].color.float32[3] = 1.0f;
-    clearVal[1].depthStencil.depth = 1.0f;
-    clearVal[1].depthStencil.stencil = 0.0f;
-
-    vk::RenderPassBeginInfo rpBeginInfo;
-    rpBeginInfo.renderPass = rprtd.renderpass.get();
-    rpBeginInfo.framebuffer = rprtd.frameBufs[rd.imageIndex].get();
-    rpBeginInfo.renderArea = vk::Rect2D{{0, 0}, rt.extent};
-    rpBeginInfo.clearValueCount = std::size(clearVal);
-    rpBeginInfo.pClearValues = clearVal;
-
-    cmdBuf.beginRenderPass(rpBeginInfo, vk::SubpassContents::eInline);
+void SimpleRenderProc::recordScene(const RenderGraphPassContext &ctx, ScenePipelineCache &scenePipelines, vk::Pipeline impostorPipeline) {
+    const auto &rd = ctx.rd;
+    const auto cmdBuf = ctx.cmdBuf;
+
     cmdBuf.bindVertexBuffers(0,
                              {rd.positionVertBuf, rd.normalVertBuf, rd.texcoordVertBuf[0], rd.jointsVertBuf[0], rd.weightsVertBuf[0]},
                              {0, 0, 0, 0, 0});
     cmdBuf.bindIndexBuffer(rd.indexBuf, 0, vk::IndexType::eUint32);
-    cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelinelayout.get(), 0, {rd.descSet, rd.assetDescSet}, rd.dynamicOfs);
-    cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, rprtd.pipeline.get());
+    cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelinelayout.get(), 0, {rd.descSet, rd.assetDescSet}, {rd.cameraOffset});
+    cmdBuf.pushConstants(pipelinelayout.get(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(SceneBufferAddresses), &rd.sceneBuffers);
+
+    // draws are grouped by variant, so each group is one pipeline bind and one indirect call
+    for (const auto &group : *rd.drawGroups) {
+        cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, scenePipelines.get(group.variant));
+        cmdBuf.drawIndexedIndirect(rd.drawBuf, rd.drawBufOffset + group.firstDraw * rd.drawBufStride, group.drawCount, rd.drawBufStride);
+    }
 
-    cmdBuf.drawIndexedIndirect(rd.drawBuf, rd.drawBufOffset, rd.modelsCount, rd.drawBufStride);
-    cmdBuf.endRenderPass();
+    // one camera-facing quad per distant avatar
+    if (rd.impostorCount > 0) {
+        cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, impostorPipeline);
+        cmdBuf.draw(6, rd.impostorCount, 0, 0);
+    }
+}
+
+void SimpleRenderProc::render(const RenderDetails &rd, const RenderTarget &rt, const RenderProcRenderTargetDependant &rprtd) {
+    rprtd.graph->execute(rd.cmdBuf, rd, rd.imageIndex, rd.flightIndex);
 }
 
 SimpleRenderProc::~SimpleRenderProc() {}
@@ -3,17 +3,25 @@
 
 #include "../Render.hpp"
 #include "../Helper.hpp"
+#include "../ScenePipelineCache.hpp"
 #include <future>
 
+vk::UniquePipelineLayout createPipelineLayout(vk::Device device, std::initializer_list<vk::DescriptorSetLayout> descLayouts);
+// variant: the mesh vertex streams and specialization of that permutation; without it vertices come from gl_VertexIndex alone.
+// Without an extent, viewport and scissor are dynamic.
+vk::UniquePipeline createScenePipeline(vk::Device device, vk::ShaderModule vertShader, vk::ShaderModule fragShader, std::optional<vk::Extent2D> extent,
+                                       vk::RenderPass renderpass, vk::PipelineLayout pipelineLayout, std::optional<ShaderVariant> variant);
+
 class SimpleRenderProc : public IRenderProc {
     vk::PhysicalDevice physDevice;
     vk::Device device;
+    uint32_t flightFramesNum;
     vk::UniquePipelineLayout pipelinelayout;
     std::vector<vk::UniqueShaderModule> shaders;
 
-    vk::UniquePipeline createPipeline(vk::Device device, vk::Extent2D extent, vk::RenderPass renderpass, vk::PipelineLayout pipelineLayout);
+    void recordScene(const RenderGraphPassContext &ctx, ScenePipelineCache &scenePipelines, vk::Pipeline impostorPipeline);
   public:
-    SimpleRenderProc(vk::PhysicalDevice _physDevice, vk::Device _device, vk::DescriptorSetLayout descLayout, vk::DescriptorSetLayout assetDescLayout);
+    SimpleRenderProc(vk::PhysicalDevice _physDevice, vk::Device _device, vk::DescriptorSetLayout descLayout, vk::DescriptorSetLayout assetDescLayout, uint32_t flightFramesNum);
     RenderProcRenderTargetDependant prepareRenderTargetDependant(const RenderTarget &rt) override;
     void render(const RenderDetails &rd, const RenderTarget &rt, const RenderProcRenderTargetDependant &rprtd) override;
     ~SimpleRenderProc();
@@ -4,13 +4,17 @@
 #include "communicate/Communicate.hpp"
 
 int main() {
-    std::thread commThread{[](){
-        Communicate comm;
+    Communicate comm;
+    Gui gui;
+    // wired up before the network thread starts, as neither end changes afterwards
+    comm.getChannel().wakeRender = [&gui]() { gui.requestRedraw(); };
+    gui.setRoomChannel(comm.getChannel());
+    std::thread commThread{[&comm](){
         comm.run();
     }};
-    Gui gui;
     gui.mainloop();
 
+    comm.stop();
     commThread.join();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,74 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_buffer_reference : require
+
+layout(set = 0, binding = 0) uniform SceneData {
+    mat4 view;
+    mat4 proj;
+} camera;
+
+layout(location = 2) out vec2 outTexcoord;
+layout(location = 4) flat out uint outTextureIndex;
+
+struct ObjectData{
+    mat4 model;
+    uint jointIndex;
+    uint dummy[3];
+};
+
+struct ImpostorData{
+    vec4 centerRadius; // bounding sphere in model space
+    uint objectIndex;
+    uint textureIndex;
+    uint gridSize;
+    uint dummy[1];
+};
+
+layout(buffer_reference, std430) readonly buffer ObjectBuffer{
+    ObjectData objects[];
+};
+
+layout(buffer_reference, std430) readonly buffer ImpostorBuffer{
+    ImpostorData impostors[];
+};
+
+// SceneBufferAddresses in Render.hpp; joints, meshes and instances aren't read here
+layout(push_constant) uniform SceneBuffers{
+    ObjectBuffer objectBuffer;
+    uvec2 jointBuffer;
+    uvec2 meshBuffer;
+    uvec2 instanceBuffer;
+    ImpostorBuffer impostorBuffer;
+} scene;
+
+const vec2 corners[6] = vec2[](
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+// must match octahedralDecode() used when baking
+vec2 octahedralEncode(vec3 dir) {
+    vec2 p = dir.xy / (abs(dir.x) + abs(dir.y) + abs(dir.z));
+    if (dir.z < 0.0)
+        p = (1.0 - abs(p.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+    return p * 0.5 + 0.5;
+}
+
+void main() {
+    ImpostorData impostor = scene.impostorBuffer.impostors[gl_InstanceIndex];
+    mat4 model = scene.objectBuffer.objects[impostor.objectIndex].model;
+    vec3 center = (model * vec4(impostor.centerRadius.xyz, 1.0)).xyz;
+    float radius = impostor.centerRadius.w;
+
+    // the atlas cell is chosen by the direction towards the camera in model space
+    vec3 cameraPos = -transpose(mat3(camera.view)) * camera.view[3].xyz;
+    vec3 dir = normalize(transpose(mat3(model)) * (cameraPos - center));
+    float grid = float(impostor.gridSize);
+    vec2 cell = clamp(floor(octahedralEncode(dir) * grid), vec2(0.0), vec2(grid - 1.0));
+
+    vec2 corner = corners[gl_VertexIndex];
+    vec4 viewPos = camera.view * vec4(center, 1.0) + vec4(corner * radius, 0.0, 0.0);
+    gl_Position = camera.proj * viewPos;
+
+    outTexcoord = (cell + corner * 0.5 + 0.5) / grid;
+    outTextureIndex = impostor.textureIndex;
+}
@@ -2,6 +2,11 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_EXT_nonuniform_qualifier : enable
 
+// ALPHA_TEST: discard texels below alphaCutoff, which is specialized per material
+#ifdef ALPHA_TEST
+layout(constant_id = 0) const float alphaCutoff = 0.5;
+#endif
+
 layout(set = 1, binding = 3) uniform sampler2D texSampler[];
 
 layout(location = 2) in vec2 inTexcoord;
@@ -10,5 +15,9 @@ layout(location = 4) flat in uint inTexIndex;
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(texSampler[inTexIndex], inTexcoord);
+    outColor = texture(texSampler[nonuniformEXT(inTexIndex)], inTexcoord);
+#ifdef ALPHA_TEST
+    if (outColor.a < alphaCutoff)
+        discard;
+#endif
 }
\ No newline at end of file
@@ -1,5 +1,11 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_buffer_reference : require
+
+// Permutations (compiled by CMake, see ShaderVariant.hpp):
+//   SKINNED  joints/weights streams and the joint palette; static props go without
+//   MORPH    per-instance position deltas, written by morph.comp
+//   COMPACT  no normal stream
 
 layout(set = 0, binding = 0) uniform SceneData {
     mat4 view;
@@ -7,11 +13,18 @@ layout(set = 0, binding = 0) uniform SceneData {
 } camera;
 
 layout(location = 0) in vec3 inPos;
+#ifndef COMPACT
 layout(location = 1) in vec3 inNorm;
+#endif
 layout(location = 2) in vec2 inTexcoord;
+#ifdef SKINNED
 layout(location = 3) in uvec4 inJoints;
 layout(location = 4) in vec4 inWeight;
+#endif
 
+#ifndef COMPACT
+layout(location = 1) out vec3 outNormal;
+#endif
 layout(location = 2) out vec2 outTexcoord;
 layout(location = 3) flat out uint outMaterialIndex;
 layout(location = 4) flat out uint outTextureIndex;
@@ -26,34 +39,68 @@ struct MeshData{
     uint objectIndex;
     uint materialIndex;
     uint textureIndex;
-    uint dummy[1];
+    // gl_VertexIndex + morphOffset -> the instance's delta, with MORPH
+    int morphOffset;
 };
 
-layout(set = 0, binding = 2) readonly buffer ObjectBuffer{
+layout(buffer_reference, std430) readonly buffer ObjectBuffer{
 	ObjectData objects[];
-} objectBuffer;
+};
 
-layout(set = 0, binding = 3) readonly buffer JointBuffer{
+layout(buffer_reference, std430) readonly buffer JointBuffer{
 	mat4 joints[];
-} jointBuffer;
+};
 
-layout(set = 0, binding = 4) readonly buffer MeshBuffer{
+layout(buffer_reference, std430) readonly buffer MeshBuffer{
 	MeshData meshes[];
-} meshBuffer;
+};
+
+// gl_InstanceIndex -> mesh record; instances of one batched draw are contiguous
+layout(buffer_reference, std430) readonly buffer InstanceBuffer{
+	uint meshIndices[];
+};
+
+// vec3 per vertex, tightly packed
+layout(buffer_reference, std430) readonly buffer MorphDeltaBuffer{
+	float deltas[];
+};
+
+// SceneBufferAddresses in Render.hpp
+layout(push_constant) uniform SceneBuffers{
+    ObjectBuffer objectBuffer;
+    JointBuffer jointBuffer;
+    MeshBuffer meshBuffer;
+    InstanceBuffer instanceBuffer;
+    uvec2 impostorBuffer;
+    MorphDeltaBuffer morphDeltaBuffer;
+} scene;
 
 void main() {
-    uint objectIndex = meshBuffer.meshes[gl_InstanceIndex].objectIndex;
-    uint jointIndex = objectBuffer.objects[objectIndex].jointIndex;
+    uint meshIndex = scene.instanceBuffer.meshIndices[gl_InstanceIndex];
+    uint objectIndex = scene.meshBuffer.meshes[meshIndex].objectIndex;
+    vec3 pos = inPos;
+#ifdef MORPH
+    uint delta = uint(gl_VertexIndex + scene.meshBuffer.meshes[meshIndex].morphOffset) * 3;
+    pos += vec3(scene.morphDeltaBuffer.deltas[delta], scene.morphDeltaBuffer.deltas[delta + 1], scene.morphDeltaBuffer.deltas[delta + 2]);
+#endif
+    mat4 modelMat = scene.objectBuffer.objects[objectIndex].model;
+#ifdef SKINNED
+    uint jointIndex = scene.objectBuffer.objects[objectIndex].jointIndex;
     mat4 skinMat = 
-        inWeight.x * jointBuffer.joints[jointIndex + inJoints.x] +
-        inWeight.y * jointBuffer.joints[jointIndex + inJoints.y] +
-        inWeight.z * jointBuffer.joints[jointIndex + inJoints.z] +
-        inWeight.w * jointBuffer.joints[jointIndex + inJoints.w];
+        inWeight.x * scene.jointBuffer.joints[jointIndex + inJoints.x] +
+        inWeight.y * scene.jointBuffer.joints[jointIndex + inJoints.y] +
+        inWeight.z * scene.jointBuffer.joints[jointIndex + inJoints.z] +
+        inWeight.w * scene.jointBuffer.joints[jointIndex + inJoints.w];
+    modelMat = modelMat * skinMat;
+#endif
 
-    vec4 worldPos = objectBuffer.objects[objectIndex].model * skinMat * vec4(inPos, 1.0);
+    vec4 worldPos = modelMat * vec4(pos, 1.0);
     gl_Position = camera.proj * camera.view * worldPos;
+#ifndef COMPACT
+    outNormal = normalize(mat3(modelMat) * inNorm);
+#endif
 
     outTexcoord = inTexcoord;
-    outMaterialIndex = meshBuffer.meshes[gl_InstanceIndex].materialIndex;
-    outTextureIndex = meshBuffer.meshes[gl_InstanceIndex].textureIndex;
+    outMaterialIndex = scene.meshBuffer.meshes[meshIndex].materialIndex;
+    outTextureIndex = scene.meshBuffer.meshes[meshIndex].textureIndex;
 }
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Packs values of any width up to 32 bits, least significant bit first.
+class BitWriter {
+    std::vector<uint8_t> &out;
+    uint64_t pending = 0;
+    uint32_t pendingBits = 0;
+
+  public:
+    // appends to out
+    explicit BitWriter(std::vector<uint8_t> &out) : out{out} {}
+
+    void write(uint32_t value, uint32_t bits) {
+        pending |= uint64_t(value & (bits == 32 ? ~0u : (1u << bits) - 1)) << pendingBits;
+        pendingBits += bits;
+        while (pendingBits >= 8) {
+            out.push_back(uint8_t(pending));
+            pending >>= 8;
+            pendingBits -= 8;
+        }
+    }
+    void writeBool(bool value) { write(value ? 1 : 0, 1); }
+    // pads the last byte with zeros
+    void flush() {
+        if (pendingBits > 0)
+            out.push_back(uint8_t(pending));
+        pending = 0;
+        pendingBits = 0;
+    }
+};
+
+// Reads what a BitWriter wrote. Reading past the end gives zeros and marks the reader overrun, so a truncated
+// packet is found once at the end rather than checked on every field.
+class BitReader {
+    const uint8_t *data;
+    size_t size;
+    size_t position = 0;
+    uint64_t pending = 0;
+    uint32_t pendingBits = 0;
+    bool overrun = false;
+
+  public:
+    BitReader(const uint8_t *data, size_t size) : data{data}, size{size} {}
+
+    uint32_t read(uint32_t bits) {
+        while (pendingBits < bits) {
+            if (position == size) {
+                overrun = true;
+                return 0;
+            }
+            pending |= uint64_t(data[position++]) << pendingBits;
+            pendingBits += 8;
+        }
+        const auto value = uint32_t(pending & (bits == 32 ? ~0u : (1u << bits) - 1));
+        pending >>= bits;
+        pendingBits -= bits;
+        return value;
+    }
+    bool readBool() { return read(1) != 0; }
+    bool isOverrun() const { return overrun; }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct PacketPoolStats {
+    // heap allocations made for buffers, and buffers handed out
+    uint64_t slabAllocations = 0, acquired = 0;
+    uint32_t inUse = 0, peakInUse = 0;
+};
+
+// Fixed-size packet buffers carved out of slabs and recycled through a free list.
+// A slab is only added when more buffers are in flight than ever before, so a steady packet rate settles into
+// acquiring and releasing with no allocation at all.
+class PacketPool {
+  public:
+    // the largest UDP datagram fits
+    static constexpr size_t bufferSize = 65536;
+    static constexpr size_t buffersPerSlab = 8;
+
+  private:
+    std::vector<std::unique_ptr<uint8_t[]>> slabs;
+    std::vector<uint8_t *> freeBuffers;
+    PacketPoolStats stats;
+
+  public:
+    uint8_t *acquire() {
+        if (freeBuffers.empty()) {
+            slabs.push_back(std::make_unique<uint8_t[]>(bufferSize * buffersPerSlab));
+            stats.slabAllocations++;
+            // room for every buffer there is, so releasing never grows the list
+            freeBuffers.reserve(slabs.size() * buffersPerSlab);
+            for (size_t i = 0; i < buffersPerSlab; i++)
+                freeBuffers.push_back(slabs.back().get() + i * bufferSize);
+        }
+        auto buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+        stats.acquired++;
+        stats.inUse++;
+        if (stats.inUse > stats.peakInUse)
+            stats.peakInUse = stats.inUse;
+        return buffer;
+    }
+    // a buffer from acquire(), once nothing refers to it any more
+    void release(uint8_t *buffer) {
+        freeBuffers.push_back(buffer);
+        stats.inUse--;
+    }
+
+    const PacketPoolStats &getStats() const { return stats; }
+};
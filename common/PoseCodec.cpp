@@ -0,0 +1,308 @@
+#include "PoseCodec.hpp"
+#include "BitStream.hpp"
+#include "Protocol.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace {
+
+// deltas this small take the short form: a few bits instead of the whole value
+constexpr uint32_t idDeltaBits = 4;
+constexpr uint32_t positionDeltaBits = 8;
+constexpr uint32_t rotationDeltaBits = 6;
+// bits of the baseline's age in ticks
+constexpr uint32_t baselineAgeBits = 5;
+static_assert(PoseEncoder::historySize <= 1u << baselineAgeBits, "the age of any baseline in the history must fit");
+
+// the components besides the largest of a unit quaternion lie within +-1/sqrt(2)
+constexpr float smallestRange = 0.70710678f;
+constexpr uint32_t rotationMax = (1u << QuantizedPose::rotationBits) - 1;
+
+int32_t quantizePosition(float value, uint32_t bits) {
+    const auto limit = (1l << (bits - 1)) - 1;
+    return static_cast<int32_t>(std::clamp(std::lround(value * QuantizedPose::positionScale), -limit, limit));
+}
+
+QuantizedPose::Rotation quantizeRotation(const glm::quat &rotation) {
+    auto q = glm::normalize(rotation);
+    const float values[4] = {q.x, q.y, q.z, q.w};
+    uint8_t largest = 0;
+    for (uint8_t c = 1; c < 4; c++) {
+        if (std::abs(values[c]) > std::abs(values[largest]))
+            largest = c;
+    }
+    // q and -q are the same rotation; the dropped component is kept positive
+    const float sign = values[largest] < 0.0f ? -1.0f : 1.0f;
+    QuantizedPose::Rotation result{largest, {}};
+    for (int c = 0, i = 0; c < 4; c++) {
+        if (c == largest)
+            continue;
+        const float normalized = (std::clamp(values[c] * sign, -smallestRange, smallestRange) + smallestRange) / (2.0f * smallestRange);
+        result.components[i++] = static_cast<uint16_t>(std::lround(normalized * rotationMax));
+    }
+    return result;
+}
+
+glm::quat dequantizeRotation(const QuantizedPose::Rotation &rotation) {
+    float values[4];
+    float sumSq = 0.0f;
+    for (int c = 0, i = 0; c < 4; c++) {
+        if (c == rotation.largest)
+            continue;
+        values[c] = float(rotation.components[i++]) / rotationMax * (2.0f * smallestRange) - smallestRange;
+        sumSq += values[c] * values[c];
+    }
+    values[rotation.largest] = std::sqrt(std::max(1.0f - sumSq, 0.0f));
+    return glm::quat(values[3], values[0], values[1], values[2]);
+}
+
+bool operator==(const QuantizedPose::Rotation &a, const QuantizedPose::Rotation &b) {
+    return a.largest == b.largest && std::equal(std::begin(a.components), std::end(a.components), std::begin(b.components));
+}
+
+// everything but the id
+bool samePose(const QuantizedPose &a, const QuantizedPose &b) {
+    if (!std::equal(std::begin(a.position), std::end(a.position), std::begin(b.position)) || !(a.rotation == b.rotation))
+        return false;
+    for (uint32_t part = 0; part < AvatarPose::PartCount; part++) {
+        if (!std::equal(std::begin(a.partPositions[part]), std::end(a.partPositions[part]), std::begin(b.partPositions[part])) ||
+            !(a.partRotations[part] == b.partRotations[part]))
+            return false;
+    }
+    return true;
+}
+
+uint32_t zigzag(int32_t value) { return (uint32_t(value) << 1) ^ uint32_t(value >> 31); }
+int32_t unzigzag(uint32_t value) { return int32_t(value >> 1) ^ -int32_t(value & 1); }
+int32_t signExtend(uint32_t value, uint32_t bits) { return int32_t(value << (32 - bits)) >> (32 - bits); }
+
+// 0: as the baseline. 10 and a zigzag delta of smallBits, or 11 and the value itself in fullBits
+void writeField(BitWriter &writer, int32_t value, int32_t baseline, uint32_t smallBits, uint32_t fullBits) {
+    if (value == baseline) {
+        writer.writeBool(false);
+        return;
+    }
+    writer.writeBool(true);
+    const auto delta = zigzag(value - baseline);
+    if (delta < 1u << smallBits) {
+        writer.writeBool(false);
+        writer.write(delta, smallBits);
+    } else {
+        writer.writeBool(true);
+        writer.write(uint32_t(value), fullBits);
+    }
+}
+
+int32_t readField(BitReader &reader, int32_t baseline, uint32_t smallBits, uint32_t fullBits, bool isSigned) {
+    if (!reader.readBool())
+        return baseline;
+    if (!reader.readBool())
+        return baseline + unzigzag(reader.read(smallBits));
+    const auto value = reader.read(fullBits);
+    return isSigned ? signExtend(value, fullBits) : int32_t(value);
+}
+
+// components are deltas while the dropped one stays the same, which it does unless the rotation turns a lot
+void writeRotation(BitWriter &writer, const QuantizedPose::Rotation &rotation, const QuantizedPose::Rotation &baseline) {
+    const bool sameLargest = rotation.largest == baseline.largest;
+    writer.writeBool(!sameLargest);
+    if (!sameLargest)
+        writer.write(rotation.largest, 2);
+    for (int c = 0; c < 3; c++) {
+        if (sameLargest)
+            writeField(writer, rotation.components[c], baseline.components[c], rotationDeltaBits, QuantizedPose::rotationBits);
+        else
+            writer.write(rotation.components[c], QuantizedPose::rotationBits);
+    }
+}
+
+QuantizedPose::Rotation readRotation(BitReader &reader, const QuantizedPose::Rotation &baseline) {
+    QuantizedPose::Rotation rotation;
+    const bool sameLargest = !reader.readBool();
+    rotation.largest = sameLargest ? baseline.largest : uint8_t(reader.read(2));
+    for (int c = 0; c < 3; c++) {
+        rotation.components[c] = uint16_t(sameLargest ? readField(reader, baseline.components[c], rotationDeltaBits, QuantizedPose::rotationBits, false)
+                                                      : reader.read(QuantizedPose::rotationBits));
+    }
+    return rotation;
+}
+
+void writePose(BitWriter &writer, const QuantizedPose &pose, const QuantizedPose &baseline) {
+    const bool changed = !samePose(pose, baseline);
+    writer.writeBool(changed);
+    if (!changed)
+        return;
+    for (int c = 0; c < 3; c++)
+        writeField(writer, pose.position[c], baseline.position[c], positionDeltaBits, QuantizedPose::positionBits);
+    writeRotation(writer, pose.rotation, baseline.rotation);
+    for (uint32_t part = 0; part < AvatarPose::PartCount; part++) {
+        for (int c = 0; c < 3; c++)
+            writeField(writer, pose.partPositions[part][c], baseline.partPositions[part][c], positionDeltaBits, QuantizedPose::partPositionBits);
+        writeRotation(writer, pose.partRotations[part], baseline.partRotations[part]);
+    }
+}
+
+QuantizedPose readPose(BitReader &reader, const QuantizedPose &baseline) {
+    auto pose = baseline;
+    if (!reader.readBool())
+        return pose;
+    for (int c = 0; c < 3; c++)
+        pose.position[c] = readField(reader, baseline.position[c], positionDeltaBits, QuantizedPose::positionBits, true);
+    pose.rotation = readRotation(reader, baseline.rotation);
+    for (uint32_t part = 0; part < AvatarPose::PartCount; part++) {
+        for (int c = 0; c < 3; c++)
+            pose.partPositions[part][c] = readField(reader, baseline.partPositions[part][c], positionDeltaBits, QuantizedPose::partPositionBits, true);
+        pose.partRotations[part] = readRotation(reader, baseline.partRotations[part]);
+    }
+    return pose;
+}
+
+// walks the baseline's avatars along with the snapshot's, both in ascending id order
+class BaselineCursor {
+    const std::vector<QuantizedPose> *avatars;
+    size_t next = 0;
+    QuantizedPose rest;
+
+  public:
+    explicit BaselineCursor(const std::vector<QuantizedPose> *avatars) : avatars{avatars} {}
+
+    const QuantizedPose &find(uint16_t avatarId) {
+        if (!avatars)
+            return rest;
+        while (next < avatars->size() && (*avatars)[next].avatarId < avatarId)
+            next++;
+        return next < avatars->size() && (*avatars)[next].avatarId == avatarId ? (*avatars)[next] : rest;
+    }
+};
+
+} // namespace
+
+QuantizedPose::QuantizedPose() : QuantizedPose(AvatarPose{}) {}
+
+QuantizedPose::QuantizedPose(const AvatarPose &pose) : avatarId{pose.avatarId} {
+    for (int c = 0; c < 3; c++)
+        position[c] = quantizePosition(pose.position[c], positionBits);
+    rotation = quantizeRotation(pose.rotation);
+    for (uint32_t part = 0; part < AvatarPose::PartCount; part++) {
+        for (int c = 0; c < 3; c++)
+            partPositions[part][c] = quantizePosition(pose.partPositions[part][c], partPositionBits);
+        partRotations[part] = quantizeRotation(pose.partRotations[part]);
+    }
+}
+
+AvatarPose QuantizedPose::decode() const {
+    AvatarPose pose;
+    pose.avatarId = avatarId;
+    pose.position = glm::vec3(position[0], position[1], position[2]) / positionScale;
+    pose.rotation = dequantizeRotation(rotation);
+    for (uint32_t part = 0; part < AvatarPose::PartCount; part++) {
+        pose.partPositions[part] = glm::vec3(partPositions[part][0], partPositions[part][1], partPositions[part][2]) / positionScale;
+        pose.partRotations[part] = dequantizeRotation(partRotations[part]);
+    }
+    return pose;
+}
+
+uint16_t PoseEncoder::encode(const std::vector<AvatarPose> &avatars, std::vector<uint8_t> &out) {
+    Sent sent{nextTick++, {}};
+    sent.avatars.reserve(avatars.size());
+    for (const auto &avatar : avatars)
+        sent.avatars.emplace_back(avatar);
+
+    const Sent *baseline = nullptr;
+    if (ackedTick) {
+        const auto &entry = history[*ackedTick % historySize];
+        if (uint16_t(sent.tick - *ackedTick) < historySize && entry && entry->tick == *ackedTick)
+            baseline = &*entry;
+    }
+
+    out.clear();
+    BitWriter writer{out};
+    writer.write(uint32_t(MessageType::PoseSync), 8);
+    writer.write(sent.tick, 16);
+    writer.writeBool(baseline != nullptr);
+    if (baseline)
+        writer.write(uint16_t(sent.tick - baseline->tick), baselineAgeBits);
+    writer.write(uint32_t(sent.avatars.size()), 16);
+    BaselineCursor cursor{baseline ? &baseline->avatars : nullptr};
+    int32_t previousId = -1;
+    for (const auto &pose : sent.avatars) {
+        // ids mostly follow one another, so they are coded against the one after the last
+        writeField(writer, pose.avatarId, previousId + 1, idDeltaBits, 16);
+        previousId = pose.avatarId;
+        writePose(writer, pose, cursor.find(pose.avatarId));
+    }
+    writer.flush();
+
+    stats.packets++;
+    stats.fullPackets += baseline ? 0 : 1;
+    stats.avatars += sent.avatars.size();
+    stats.bytes += out.size();
+    const auto tick = sent.tick;
+    history[tick % historySize] = std::move(sent);
+    return tick;
+}
+
+void PoseEncoder::acknowledge(uint16_t tick) {
+    const auto &entry = history[tick % historySize];
+    if (!entry || entry->tick != tick)
+        return;
+    if (ackedTick && int16_t(tick - *ackedTick) <= 0)
+        return;
+    ackedTick = tick;
+}
+
+std::optional<PoseSnapshot> PoseDecoder::decode(const uint8_t *data, size_t size) {
+    BitReader reader{data, size};
+    if (reader.read(8) != uint32_t(MessageType::PoseSync))
+        return std::nullopt;
+    Received received{uint16_t(reader.read(16)), {}};
+    const Received *baseline = nullptr;
+    if (reader.readBool()) {
+        const uint16_t baselineTick = received.tick - reader.read(baselineAgeBits);
+        const auto &entry = history[baselineTick % PoseEncoder::historySize];
+        if (!entry || entry->tick != baselineTick)
+            return std::nullopt;
+        baseline = &*entry;
+    }
+
+    const auto count = reader.read(16);
+    received.avatars.reserve(std::min<size_t>(count, size));
+    BaselineCursor cursor{baseline ? &baseline->avatars : nullptr};
+    int32_t previousId = -1;
+    for (uint32_t i = 0; i < count && !reader.isOverrun(); i++) {
+        const auto avatarId = uint16_t(readField(reader, previousId + 1, idDeltaBits, 16, false));
+        previousId = avatarId;
+        auto pose = readPose(reader, cursor.find(avatarId));
+        pose.avatarId = avatarId;
+        received.avatars.push_back(pose);
+    }
+    if (reader.isOverrun())
+        return std::nullopt;
+
+    PoseSnapshot snapshot;
+    snapshot.tick = received.tick;
+    snapshot.avatars.reserve(received.avatars.size());
+    for (const auto &pose : received.avatars)
+        snapshot.avatars.push_back(pose.decode());
+
+    stats.packets++;
+    stats.fullPackets += baseline ? 0 : 1;
+    stats.avatars += received.avatars.size();
+    stats.bytes += size;
+    // a tick so late that its slot holds a newer one is decoded, but not kept as a baseline
+    auto &slot = history[received.tick % PoseEncoder::historySize];
+    if (!slot || int16_t(received.tick - slot->tick) > 0)
+        slot = std::move(received);
+    return snapshot;
+}
+
+std::array<uint8_t, 3> encodePoseAck(uint16_t tick) {
+    return {uint8_t(MessageType::PoseAck), uint8_t(tick), uint8_t(tick >> 8)};
+}
+
+std::optional<uint16_t> decodePoseAck(const uint8_t *data, size_t size) {
+    if (size < 3 || data[0] != uint8_t(MessageType::PoseAck))
+        return std::nullopt;
+    return uint16_t(data[1] | data[2] << 8);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <optional>
+#include <vector>
+
+// What replicates of an avatar: where it stands in the room, and its tracked head and hands relative to that.
+struct AvatarPose {
+    enum Part { Head, LeftHand, RightHand, PartCount };
+
+    uint16_t avatarId;
+    // room space
+    glm::vec3 position{0.0f};
+    glm::quat rotation{1.0f, 0.0f, 0.0f, 0.0f};
+    // the avatar's model space, as ThreePartsAvatar and IKTargets take them
+    glm::vec3 partPositions[PartCount]{glm::vec3{0.0f}, glm::vec3{0.0f}, glm::vec3{0.0f}};
+    glm::quat partRotations[PartCount]{glm::quat{1.0f, 0.0f, 0.0f, 0.0f}, glm::quat{1.0f, 0.0f, 0.0f, 0.0f}, glm::quat{1.0f, 0.0f, 0.0f, 0.0f}};
+};
+
+struct PoseSnapshot {
+    uint16_t tick = 0;
+    // ascending avatar ids
+    std::vector<AvatarPose> avatars;
+};
+
+// An AvatarPose as it goes on the wire. Positions are fixed point, 1/positionScale of a meter: the room position
+// over +-512 m, parts over +-8 m. Rotations are smallest-three, the index of the dropped component and three more.
+struct QuantizedPose {
+    static constexpr float positionScale = 1024.0f;
+    static constexpr uint32_t positionBits = 20, partPositionBits = 14;
+    static constexpr uint32_t rotationBits = 10;
+
+    struct Rotation {
+        uint8_t largest;
+        uint16_t components[3];
+    };
+
+    uint16_t avatarId;
+    int32_t position[3];
+    Rotation rotation;
+    int32_t partPositions[AvatarPose::PartCount][3];
+    Rotation partRotations[AvatarPose::PartCount];
+
+    // at rest, at the room origin: what an avatar missing from the baseline is coded against
+    QuantizedPose();
+    explicit QuantizedPose(const AvatarPose &pose);
+    AvatarPose decode() const;
+};
+
+struct PoseCodecStats {
+    uint64_t packets = 0, fullPackets = 0;
+    uint64_t avatars = 0, bytes = 0;
+
+    // per avatar per tick, over every packet so far
+    double bytesPerAvatar() const { return avatars ? double(bytes) / double(avatars) : 0.0; }
+};
+
+// Encodes the snapshots of one stream, to one receiver. Each tick is bit-packed as deltas against the newest tick the
+// receiver acknowledged, or in full while there is none within the history. Unchanged avatars cost a bit, small
+// changes a few bits per component.
+class PoseEncoder {
+  public:
+    static constexpr uint16_t historySize = 32;
+
+  private:
+    struct Sent {
+        uint16_t tick;
+        std::vector<QuantizedPose> avatars;
+    };
+
+    uint16_t nextTick = 0;
+    std::array<std::optional<Sent>, historySize> history;
+    std::optional<uint16_t> ackedTick;
+    PoseCodecStats stats;
+
+  public:
+    // writes a PoseSync message of the next tick into out, replacing its contents; avatars must be in ascending id order
+    uint16_t encode(const std::vector<AvatarPose> &avatars, std::vector<uint8_t> &out);
+    // the receiver has tick; older acknowledgements, and ones for ticks out of the history, are ignored
+    void acknowledge(uint16_t tick);
+
+    const PoseCodecStats &getStats() const { return stats; }
+};
+
+// Decodes the snapshots of one stream, keeping the ticks it can be sent deltas against.
+class PoseDecoder {
+    struct Received {
+        uint16_t tick;
+        std::vector<QuantizedPose> avatars;
+    };
+
+    std::array<std::optional<Received>, PoseEncoder::historySize> history;
+    PoseCodecStats stats;
+
+  public:
+    // empty if the message is truncated or its baseline is gone; otherwise the snapshot, which should be acknowledged.
+    // Late ticks decode too: the snapshot carries its tick for interpolation to order it
+    std::optional<PoseSnapshot> decode(const uint8_t *data, size_t size);
+
+    const PoseCodecStats &getStats() const { return stats; }
+};
+
+// a PoseAck message for tick
+std::array<uint8_t, 3> encodePoseAck(uint16_t tick);
+std::optional<uint16_t> decodePoseAck(const uint8_t *data, size_t size);
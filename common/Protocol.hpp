@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+// the first byte of every datagram between client and server
+enum class MessageType : uint8_t {
+    // PoseEncoder output: avatar poses of one tick
+    PoseSync = 1,
+    // the newest PoseSync tick received, as a little-endian uint16 after the type
+    PoseAck = 2,
+};
+
+constexpr unsigned int defaultServerPort = 7600;
+// PoseSync ticks per second; a tick's send time is its number over this
+constexpr float poseSyncRate = 20.0f;
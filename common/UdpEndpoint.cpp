@@ -0,0 +1,126 @@
+#include "UdpEndpoint.hpp"
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+UdpEndpoint::UdpEndpoint(uv_loop_t *loop, ReceiveFn onReceive) : onReceive{std::move(onReceive)} {
+    if (const auto error = uv_udp_init(loop, &handle))
+        throw std::runtime_error(std::string("failed to create a UDP socket: ") + uv_strerror(error));
+    handle.data = this;
+}
+
+void UdpEndpoint::bind(const std::string &ip, unsigned int port) {
+    const auto address = parseAddress(ip, port);
+    if (const auto error = uv_udp_bind(&handle, reinterpret_cast<const sockaddr *>(&address), 0))
+        throw std::runtime_error("failed to bind " + ip + ":" + std::to_string(port) + ": " + uv_strerror(error));
+}
+
+void UdpEndpoint::start() {
+    if (const auto error = uv_udp_recv_start(&handle, allocate, received))
+        throw std::runtime_error(std::string("failed to receive on a UDP socket: ") + uv_strerror(error));
+}
+
+void UdpEndpoint::allocate(uv_handle_t *handle, size_t, uv_buf_t *buf) {
+    auto self = static_cast<UdpEndpoint *>(handle->data);
+    *buf = uv_buf_init(reinterpret_cast<char *>(self->pool.acquire()), PacketPool::bufferSize);
+}
+
+void UdpEndpoint::received(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const sockaddr *from, unsigned) {
+    auto self = static_cast<UdpEndpoint *>(handle->data);
+    // nothing read and no address: the socket is drained for now
+    if (nread > 0 && from) {
+        self->stats.received++;
+        self->onReceive(reinterpret_cast<const uint8_t *>(buf->base), size_t(nread), from);
+    }
+#ifdef _DEBUG
+    else if (nread < 0)
+        std::clog << "udp: " << uv_strerror(int(nread)) << std::endl;
+#endif
+    self->pool.release(reinterpret_cast<uint8_t *>(buf->base));
+}
+
+bool UdpEndpoint::send(const uint8_t *data, size_t size, const sockaddr *to) {
+    if (closed || size > PacketPool::bufferSize) {
+        stats.failed++;
+        return false;
+    }
+    // libuv refuses this while earlier sends are queued, which keeps the order
+    auto buf = uv_buf_init(const_cast<char *>(reinterpret_cast<const char *>(data)), static_cast<unsigned int>(size));
+    const auto result = uv_udp_try_send(&handle, &buf, 1, to);
+    if (result >= 0) {
+        stats.sent++;
+        return true;
+    }
+    if (result != UV_EAGAIN) {
+#ifdef _DEBUG
+        std::clog << "udp: " << uv_strerror(result) << std::endl;
+#endif
+        stats.failed++;
+        return false;
+    }
+
+    if (freeSends.empty()) {
+        sends.push_back(std::make_unique<PendingSend>());
+        stats.requestAllocations++;
+        freeSends.reserve(sends.size());
+        freeSends.push_back(sends.back().get());
+    }
+    auto pending = freeSends.back();
+    freeSends.pop_back();
+    pending->buffer = pool.acquire();
+    std::memcpy(pending->buffer, data, size);
+    pending->request.data = pending;
+    buf = uv_buf_init(reinterpret_cast<char *>(pending->buffer), static_cast<unsigned int>(size));
+    if (const auto error = uv_udp_send(&pending->request, &handle, &buf, 1, to, sent)) {
+#ifdef _DEBUG
+        std::clog << "udp: " << uv_strerror(error) << std::endl;
+#endif
+        pool.release(pending->buffer);
+        freeSends.push_back(pending);
+        stats.failed++;
+        return false;
+    }
+    stats.queued++;
+    return true;
+}
+
+void UdpEndpoint::sent(uv_udp_send_t *request, int status) {
+    auto pending = static_cast<PendingSend *>(request->data);
+    auto self = static_cast<UdpEndpoint *>(request->handle->data);
+    if (status < 0)
+        self->stats.failed++;
+    else
+        self->stats.sent++;
+    self->pool.release(pending->buffer);
+    self->freeSends.push_back(pending);
+}
+
+void UdpEndpoint::close() {
+    if (closed)
+        return;
+    closed = true;
+    // queued sends complete (as canceled) before the handle is closed
+    uv_close(reinterpret_cast<uv_handle_t *>(&handle), nullptr);
+}
+
+sockaddr_storage parseAddress(const std::string &ip, unsigned int port) {
+    sockaddr_storage address{};
+    if (uv_ip4_addr(ip.c_str(), int(port), reinterpret_cast<sockaddr_in *>(&address)) != 0 &&
+        uv_ip6_addr(ip.c_str(), int(port), reinterpret_cast<sockaddr_in6 *>(&address)) != 0)
+        throw std::runtime_error("not an IP address: " + ip);
+    return address;
+}
+
+bool sameAddress(const sockaddr *a, const sockaddr *b) {
+    if (a->sa_family != b->sa_family)
+        return false;
+    if (a->sa_family == AF_INET) {
+        const auto &a4 = *reinterpret_cast<const sockaddr_in *>(a), &b4 = *reinterpret_cast<const sockaddr_in *>(b);
+        return a4.sin_port == b4.sin_port && a4.sin_addr.s_addr == b4.sin_addr.s_addr;
+    }
+    if (a->sa_family == AF_INET6) {
+        const auto &a6 = *reinterpret_cast<const sockaddr_in6 *>(a), &b6 = *reinterpret_cast<const sockaddr_in6 *>(b);
+        return a6.sin6_port == b6.sin6_port && std::memcmp(&a6.sin6_addr, &b6.sin6_addr, sizeof(a6.sin6_addr)) == 0;
+    }
+    return false;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "PacketPool.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+#include <uv.h>
+#include <vector>
+
+struct UdpStats {
+    uint64_t received = 0, sent = 0;
+    // sends the socket couldn't take at once, so copied into a pooled buffer and queued; sends that failed
+    uint64_t queued = 0, failed = 0;
+    // heap allocations for queued send requests; together with the pool's slabs, none once traffic is steady
+    uint64_t requestAllocations = 0;
+};
+
+// A UDP socket on a libuv loop that doesn't allocate per datagram, as uvw's udp_handle does.
+// Datagrams are received into pooled buffers and handed over in place. Sends go out straight from the caller's
+// bytes when the socket takes them at once, and are otherwise copied into a pooled buffer released on completion.
+// Everything but construction happens on the loop's thread.
+class UdpEndpoint {
+  public:
+    // data is only valid during the call
+    using ReceiveFn = std::function<void(const uint8_t *data, size_t size, const sockaddr *from)>;
+
+  private:
+    struct PendingSend {
+        uv_udp_send_t request;
+        uint8_t *buffer;
+    };
+
+    uv_udp_t handle;
+    ReceiveFn onReceive;
+    PacketPool pool;
+    std::vector<std::unique_ptr<PendingSend>> sends;
+    std::vector<PendingSend *> freeSends;
+    UdpStats stats;
+    bool closed = false;
+
+    static void allocate(uv_handle_t *handle, size_t suggestedSize, uv_buf_t *buf);
+    static void received(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const sockaddr *from, unsigned flags);
+    static void sent(uv_udp_send_t *request, int status);
+
+  public:
+    UdpEndpoint(uv_loop_t *loop, ReceiveFn onReceive);
+    // the handle lives in here: close() it and let the loop run before destroying
+    UdpEndpoint(const UdpEndpoint &) = delete;
+    UdpEndpoint &operator=(const UdpEndpoint &) = delete;
+
+    // throws if the address doesn't parse or can't be bound
+    void bind(const std::string &ip, unsigned int port);
+    void start();
+    // false if the datagram was dropped
+    bool send(const uint8_t *data, size_t size, const sockaddr *to);
+    void close();
+
+    const UdpStats &getStats() const { return stats; }
+    const PacketPoolStats &getPoolStats() const { return pool.getStats(); }
+};
+
+// an IPv4 or IPv6 address; throws if it is neither
+sockaddr_storage parseAddress(const std::string &ip, unsigned int port);
+// same family, address and port
+bool sameAddress(const sockaddr *a, const sockaddr *b);
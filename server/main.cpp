@@ -1,8 +1,25 @@
+#include "room/Manager.hpp"
+#include <iostream>
 #include <uvw.hpp>
 
 int main() {
     auto defaultLoop = uvw::loop::get_default();
-    
+    Manager room{*defaultLoop};
+
+#ifdef _DEBUG
+    // allocations should stop growing once traffic is steady, and a tick grow with peers times neighbours
+    auto report = defaultLoop->resource<uvw::timer_handle>();
+    report->on<uvw::timer_event>([&room](const uvw::timer_event &, uvw::timer_handle &) {
+        const auto &roomStats = room.getStats();
+        const auto &socket = room.getReceive().getSocket();
+        std::clog << "peers: " << roomStats.peers << " (" << room.getReceive().getRejected() << " turned away), last tick: " << roomStats.candidates << " in range, " << roomStats.avatarsSent
+                  << " avatars sent in " << roomStats.tickSeconds * 1000.0f << " ms; datagrams received: " << socket.getStats().received
+                  << ", sent: " << socket.getStats().sent << " (" << socket.getStats().queued << " queued), allocations: "
+                  << socket.getPoolStats().slabAllocations << " slabs, " << socket.getStats().requestAllocations << " send requests" << std::endl;
+    });
+    report->start(uvw::timer_handle::time{10000}, uvw::timer_handle::time{10000});
+#endif
+
     defaultLoop->run();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,10 @@
+#include "Cast.hpp"
+
+void Cast::send(Peer &recipient, const PeerAddress &address, const std::vector<AvatarPose> &avatars) {
+    recipient.downlink.encode(avatars, packet);
+    if (!socket.send(packet.data(), packet.size(), address.get()))
+        return;
+    stats.packets++;
+    stats.bytes += packet.size();
+    stats.avatars += avatars.size();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Receive.hpp"
+#include <vector>
+
+struct CastStats {
+    uint64_t packets = 0, bytes = 0, avatars = 0;
+};
+
+// Sends the room to its peers, one snapshot per recipient, each delta-encoded by the recipient's own downlink.
+class Cast {
+    UdpEndpoint &socket;
+    // serialized into and sent from, one recipient after another
+    std::vector<uint8_t> packet;
+    CastStats stats;
+
+  public:
+    explicit Cast(UdpEndpoint &socket) : socket{socket} {}
+
+    // avatars in ascending id order
+    void send(Peer &recipient, const PeerAddress &address, const std::vector<AvatarPose> &avatars);
+
+    const CastStats &getStats() const { return stats; }
+};
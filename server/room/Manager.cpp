@@ -0,0 +1,69 @@
+#include "Manager.hpp"
+#include <algorithm>
+
+Manager::Manager(uvw::loop &loop, unsigned int port)
+    : receive{loop.raw(), port}, cast{receive.getSocket()}, timer{loop.resource<uvw::timer_handle>()} {
+    timer->on<uvw::timer_event>([this](const uvw::timer_event &, uvw::timer_handle &) { update(); });
+    const uvw::timer_handle::time interval{uint64_t(1000.0f / poseSyncRate)};
+    timer->start(interval, interval);
+}
+
+void Manager::close() {
+    timer->close();
+    receive.close();
+}
+
+void Manager::update() {
+    const auto start = std::chrono::steady_clock::now();
+    tick++;
+
+    // the silent have left; everyone else is where they last said
+    auto &peers = receive.getPeers();
+    senders.clear();
+    for (auto it = peers.begin(); it != peers.end();) {
+        auto &peer = it->second;
+        if (start - peer.lastHeard > peerTimeout) {
+            grid.remove(peer.avatarId);
+            it = receive.removePeer(it);
+            continue;
+        }
+        if (peer.pose) {
+            grid.update(peer.avatarId, peer.pose->position);
+            senders.emplace(peer.avatarId, &peer);
+        }
+        ++it;
+    }
+
+    uint64_t candidates = 0, avatarsSent = 0;
+    for (auto &[address, recipient] : peers) {
+        // until it has said where it is, nothing is near it
+        if (!recipient.pose)
+            continue;
+        interest.clear();
+        grid.query(recipient.pose->position, farRange, [&](uint16_t id, float distanceSquared) {
+            candidates++;
+            if (id == recipient.avatarId)
+                return;
+            const auto &pose = *senders.at(id)->pose;
+            if (distanceSquared <= nearRange * nearRange || (tick + id) % farRateDivisor == 0) {
+                interest.push_back(pose);
+                return;
+            }
+            // off its turn: as this recipient last had it
+            const auto sent = std::lower_bound(recipient.sent.begin(), recipient.sent.end(), id,
+                                               [](const AvatarPose &entry, uint16_t key) { return entry.avatarId < key; });
+            interest.push_back(sent != recipient.sent.end() && sent->avatarId == id ? *sent : pose);
+        });
+        std::sort(interest.begin(), interest.end(), [](const AvatarPose &a, const AvatarPose &b) { return a.avatarId < b.avatarId; });
+        cast.send(recipient, address, interest);
+        avatarsSent += interest.size();
+        // the previous list becomes the next recipient's scratch space
+        std::swap(recipient.sent, interest);
+    }
+
+    stats.ticks++;
+    stats.peers = uint32_t(peers.size());
+    stats.candidates = candidates;
+    stats.avatarsSent = avatarsSent;
+    stats.tickSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
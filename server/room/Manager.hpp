@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Cast.hpp"
+#include "Receive.hpp"
+#include "SpatialGrid.hpp"
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <uvw.hpp>
+
+struct RoomStats {
+    uint64_t ticks = 0;
+    // of the latest tick: peers, grid entries the queries visited within range, avatars sent, and its duration
+    uint32_t peers = 0;
+    uint64_t candidates = 0, avatarsSent = 0;
+    float tickSeconds = 0.0f;
+};
+
+// A room: everyone's newest pose, sent on at poseSyncRate to whoever is near enough to care.
+// Interest comes from a spatial grid over the avatars, so a tick costs about the number of peers times the
+// neighbours each has, not the square of the room's size. Within nearRange an avatar is sent at full rate; within
+// farRange only every farRateDivisor-th tick (staggered by id), and repeated unchanged in between, which costs the
+// delta coding a bit or so and keeps it in the recipient's snapshots; beyond farRange it isn't sent at all.
+class Manager {
+  public:
+    // meters
+    static constexpr float nearRange = 8.0f, farRange = 32.0f;
+    static constexpr uint32_t farRateDivisor = 4;
+    // a peer silent this long has left
+    static constexpr std::chrono::seconds peerTimeout{10};
+
+  private:
+    Receive receive;
+    Cast cast;
+    SpatialGrid grid{nearRange};
+    std::shared_ptr<uvw::timer_handle> timer;
+    uint64_t tick = 0;
+    // reused every tick: peers with a pose by avatar id, and one recipient's avatars
+    std::unordered_map<uint16_t, const Peer *> senders;
+    std::vector<AvatarPose> interest;
+    RoomStats stats;
+
+    void update();
+
+  public:
+    explicit Manager(uvw::loop &loop, unsigned int port = defaultServerPort);
+
+    void close();
+
+    const Receive &getReceive() const { return receive; }
+    const RoomStats &getStats() const { return stats; }
+    const CastStats &getCastStats() const { return cast.getStats(); }
+};
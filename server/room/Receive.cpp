@@ -0,0 +1,76 @@
+#include "Receive.hpp"
+#include <cstring>
+
+PeerAddress::PeerAddress(const sockaddr *address) {
+    std::memcpy(bytes.data(), address, address->sa_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in));
+}
+
+Receive::Receive(uv_loop_t *loop, unsigned int port)
+    : socket{loop, [this](const uint8_t *data, size_t size, const sockaddr *from) { receive(data, size, from); }} {
+    // dual-stack where the system allows it
+    socket.bind("::", port);
+    socket.start();
+}
+
+void Receive::receive(const uint8_t *data, size_t size, const sockaddr *from) {
+    if (size == 0)
+        return;
+    // a lookup on the stack; only a new client allocates
+    const PeerAddress address{from};
+    auto it = peers.find(address);
+
+    switch (MessageType(data[0])) {
+    case MessageType::PoseSync:
+        if (it != peers.end()) {
+            if (auto snapshot = it->second.uplink.decode(data, size))
+                acceptPose(it->second, *snapshot, from);
+            break;
+        }
+        {
+            // decoded before there is a peer for it; the decoder then carries on as the peer's, baseline and all
+            PoseDecoder uplink;
+            auto snapshot = uplink.decode(data, size);
+            if (!snapshot)
+                break;
+            if (peers.size() >= maxPeers) {
+                rejected++;
+                break;
+            }
+            auto &peer = peers.emplace(address, Peer{}).first->second;
+            if (!freeAvatarIds.empty()) {
+                peer.avatarId = freeAvatarIds.front();
+                freeAvatarIds.pop_front();
+            } else {
+                peer.avatarId = nextAvatarId++;
+            }
+            peer.uplink = std::move(uplink);
+            acceptPose(peer, *snapshot, from);
+        }
+        break;
+    case MessageType::PoseAck:
+        if (it == peers.end())
+            break;
+        if (auto tick = decodePoseAck(data, size)) {
+            it->second.lastHeard = std::chrono::steady_clock::now();
+            it->second.downlink.acknowledge(*tick);
+        }
+        break;
+    }
+}
+
+void Receive::acceptPose(Peer &peer, const PoseSnapshot &snapshot, const sockaddr *from) {
+    peer.lastHeard = std::chrono::steady_clock::now();
+    const auto ack = encodePoseAck(snapshot.tick);
+    socket.send(ack.data(), ack.size(), from);
+    // a client sends its own avatar; the id is the server's to give
+    if (!snapshot.avatars.empty() && (!peer.pose || int16_t(snapshot.tick - peer.poseTick) > 0)) {
+        peer.pose = snapshot.avatars.front();
+        peer.pose->avatarId = peer.avatarId;
+        peer.poseTick = snapshot.tick;
+    }
+}
+
+Receive::Peers::iterator Receive::removePeer(Peers::iterator peer) {
+    freeAvatarIds.push_back(peer->second.avatarId);
+    return peers.erase(peer);
+}
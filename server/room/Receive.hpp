@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../../common/PoseCodec.hpp"
+#include "../../common/Protocol.hpp"
+#include "../../common/UdpEndpoint.hpp"
+#include <array>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <optional>
+
+// a client's address, comparable whichever family it is
+struct PeerAddress {
+    std::array<uint8_t, sizeof(sockaddr_in6)> bytes{};
+
+    explicit PeerAddress(const sockaddr *address);
+    const sockaddr *get() const { return reinterpret_cast<const sockaddr *>(bytes.data()); }
+    bool operator<(const PeerAddress &other) const { return bytes < other.bytes; }
+};
+
+// a client, known by the address its datagrams come from
+struct Peer {
+    uint16_t avatarId = 0;
+    std::chrono::steady_clock::time_point lastHeard;
+    PoseDecoder uplink;
+    // the newest pose it sent, under its avatarId
+    std::optional<AvatarPose> pose;
+    uint16_t poseTick = 0;
+    // the room as this peer sees it, encoded against what it acknowledged; what it was sent last, by id
+    PoseEncoder downlink;
+    std::vector<AvatarPose> sent;
+};
+
+// The room's socket: takes every client's datagrams in place from pooled buffers, keeps a Peer per address,
+// acknowledges the poses it sends and hands its acknowledgements to its downlink.
+// An address becomes a peer with its first pose that decodes, while the room has space; anything else from
+// an unknown address is dropped without a trace.
+class Receive {
+  public:
+    using Peers = std::map<PeerAddress, Peer>;
+    // well within the avatar ids there are, so they never run out
+    static constexpr size_t maxPeers = 4096;
+
+  private:
+    UdpEndpoint socket;
+    Peers peers;
+    // ids of peers that left, oldest first, so clients have long stopped showing an id by the time it comes back
+    std::deque<uint16_t> freeAvatarIds;
+    uint16_t nextAvatarId = 0;
+    // poses turned away because the room was full
+    uint64_t rejected = 0;
+
+    void receive(const uint8_t *data, size_t size, const sockaddr *from);
+    void acceptPose(Peer &peer, const PoseSnapshot &snapshot, const sockaddr *from);
+
+  public:
+    Receive(uv_loop_t *loop, unsigned int port = defaultServerPort);
+
+    // the room's Manager drops those gone silent, through removePeer()
+    Peers &getPeers() { return peers; }
+    const Peers &getPeers() const { return peers; }
+    // frees its avatar id; returns the peer after it
+    Peers::iterator removePeer(Peers::iterator peer);
+    uint64_t getRejected() const { return rejected; }
+    // to send to the peers through
+    UdpEndpoint &getSocket() { return socket; }
+    const UdpEndpoint &getSocket() const { return socket; }
+    void close() { socket.close(); }
+};
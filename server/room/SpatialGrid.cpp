@@ -0,0 +1,38 @@
+#include "SpatialGrid.hpp"
+
+void SpatialGrid::unlink(const Entry &entry) {
+    auto cell = cells.find(entry.cell);
+    auto &ids = cell->second;
+    // the last one takes the slot
+    ids[entry.slot] = ids.back();
+    entries.at(ids.back()).slot = entry.slot;
+    ids.pop_back();
+    if (ids.empty())
+        cells.erase(cell);
+}
+
+void SpatialGrid::update(uint16_t id, const glm::vec3 &position) {
+    const auto cell = cellKey(cellCoordinate(position.x), cellCoordinate(position.z));
+    auto it = entries.find(id);
+    if (it != entries.end()) {
+        it->second.position = position;
+        if (it->second.cell == cell)
+            return;
+        unlink(it->second);
+    } else {
+        it = entries.emplace(id, Entry{}).first;
+        it->second.position = position;
+    }
+    auto &ids = cells[cell];
+    it->second.cell = cell;
+    it->second.slot = uint32_t(ids.size());
+    ids.push_back(id);
+}
+
+void SpatialGrid::remove(uint16_t id) {
+    auto it = entries.find(id);
+    if (it == entries.end())
+        return;
+    unlink(it->second);
+    entries.erase(it);
+}
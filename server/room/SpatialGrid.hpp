@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+// A uniform grid over the floor (x and z), hashed so only occupied cells take memory. An avatar only moves between
+// cells when an update takes it across a border; a query visits just the cells overlapping its circle.
+class SpatialGrid {
+    struct Entry {
+        uint64_t cell;
+        // index in the cell's list
+        uint32_t slot;
+        glm::vec3 position;
+    };
+
+    float cellSize;
+    std::unordered_map<uint64_t, std::vector<uint16_t>> cells;
+    std::unordered_map<uint16_t, Entry> entries;
+
+    static uint64_t cellKey(int32_t x, int32_t z) { return uint64_t(uint32_t(x)) << 32 | uint32_t(z); }
+    int32_t cellCoordinate(float value) const { return int32_t(std::floor(value / cellSize)); }
+    void unlink(const Entry &entry);
+
+  public:
+    explicit SpatialGrid(float cellSize) : cellSize{cellSize} {}
+
+    void update(uint16_t id, const glm::vec3 &position);
+    void remove(uint16_t id);
+    size_t size() const { return entries.size(); }
+
+    // calls fn(id, squared distance) for everyone within radius of center, in no particular order
+    template <typename Fn>
+    void query(const glm::vec3 &center, float radius, Fn &&fn) const {
+        const float radiusSquared = radius * radius;
+        const auto minX = cellCoordinate(center.x - radius), maxX = cellCoordinate(center.x + radius);
+        const auto minZ = cellCoordinate(center.z - radius), maxZ = cellCoordinate(center.z + radius);
+        for (auto x = minX; x <= maxX; x++)
+            for (auto z = minZ; z <= maxZ; z++) {
+                const auto cell = cells.find(cellKey(x, z));
+                if (cell == cells.end())
+                    continue;
+                for (const auto id : cell->second) {
+                    const auto offset = entries.at(id).position - center;
+                    const float distanceSquared = glm::dot(offset, offset);
+                    if (distanceSquared <= radiusSquared)
+                        fn(id, distanceSquared);
+                }
+            }
+    }
+};
@@ -0,0 +1,72 @@
+#include "../client/communicate/RemoteRoster.hpp"
+#include "../client/communicate/SnapshotBuffer.hpp"
+#include "../common/Protocol.hpp"
+#include <iostream>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+AvatarPose poseOf(uint16_t avatarId) {
+    AvatarPose pose;
+    pose.avatarId = avatarId;
+    pose.position = glm::vec3{float(avatarId), 0.0f, 0.0f};
+    return pose;
+}
+
+// the last peer leaves: the server goes on sending snapshots with nobody in them, and the roster has to drain
+void peersLeave() {
+    const auto interval = std::chrono::duration_cast<SnapshotBuffer::Clock::duration>(std::chrono::duration<double>(1.0 / poseSyncRate));
+    const auto start = SnapshotBuffer::Clock::now();
+    SnapshotBuffer buffer;
+    RemoteRoster roster;
+    RemoteRoster::Changes changes;
+    std::vector<AvatarPose> poses;
+
+    buffer.push(PoseSnapshot{0, {poseOf(1), poseOf(2)}}, start);
+    buffer.sample(start, poses);
+    roster.update(poses, changes);
+    check(roster.size() == 2 && changes.joined.size() == 2, "both peers shown from the first snapshot");
+
+    for (uint16_t tick = 1; tick < 8; tick++)
+        buffer.push(PoseSnapshot{tick, {}}, start + interval * tick);
+    buffer.sample(start + interval * 8, poses);
+    check(poses.empty(), "nobody in the sample once playback passes the empty snapshots");
+    roster.update(poses, changes);
+    check(roster.size() == 0, "roster drained by an empty sample");
+    check(changes.left.size() == 2 && changes.left[0] == 1 && changes.left[1] == 2, "both peers reported as left");
+
+    roster.update(poses, changes);
+    check(changes.left.empty() && changes.joined.empty(), "nothing more to do on the next empty sample");
+}
+
+void peersMove() {
+    RemoteRoster roster;
+    RemoteRoster::Changes changes;
+    roster.update({poseOf(1), poseOf(3)}, changes);
+
+    auto moved = poseOf(3);
+    moved.position.y = 1.0f;
+    roster.update({poseOf(2), moved}, changes);
+    check(changes.left.size() == 1 && changes.left[0] == 1, "a peer missing from the sample leaves");
+    check(changes.joined.size() == 1 && changes.joined[0].avatarId == 2, "a new peer joins");
+    check(changes.moved.size() == 1 && changes.moved[0].avatarId == 3, "only the peer that moved is reported moved");
+    check(roster.size() == 2 && roster.contains(2) && roster.contains(3), "roster follows the sample");
+}
+
+} // namespace
+
+int main() {
+    peersLeave();
+    peersMove();
+    if (failures == 0)
+        std::cout << "RemoteRosterTest: ok" << std::endl;
+    return failures == 0 ? 0 : 1;
+}